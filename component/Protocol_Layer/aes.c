@@ -37,6 +37,7 @@ NOTE:   String length must be evenly divisible by 16byte (str_len % 16 == 0)
 /*****************************************************************************/
 #include <string.h> // CBC mode, for memset
 #include "aes.h"
+#include "protocol_layer_simd.h" // word-wide XOR
 
 /*****************************************************************************/
 /* Defines:                                                                  */
@@ -491,11 +492,8 @@ void AES_ECB_decrypt(const struct AES_ctx* ctx, uint8_t* buf)
 
 static void XorWithIv(uint8_t* buf, const uint8_t* Iv)
 {
-  uint8_t i;
-  for (i = 0; i < AES_BLOCKLEN; ++i) // The block in AES is always 128bit no matter the key size
-  {
-    buf[i] ^= Iv[i];
-  }
+  // The block in AES is always 128bit no matter the key size
+  PL_Xor16(buf, Iv);
 }
 
 void AES_CBC_encrypt_buffer(struct AES_ctx *ctx, uint8_t* buf, size_t length)
@@ -13,15 +13,28 @@ file.
 #include "fsl_crc.h"  // library of CRC from SDK
 #include "app.h"        // library of Ethernet from SDK
 #include "protocol_layer_cfg.h"  // Include the configuration header
+#include "protocol_layer_backend.h"
+#include "protocol_layer_ivpool.h"
+#include "protocol_layer_session.h"
+#include "protocol_layer_simd.h"
+#include "protocol_layer_frag.h"
+#include "protocol_layer_agg.h"
+#include "protocol_layer_reliable.h"
+#include "protocol_layer_credit.h"
+#include "protocol_layer_lz.h"
+#include "protocol_layer_peer.h"
+#include "protocol_layer_replay.h"
+#include "protocol_layer_fec.h"
+#include "protocol_layer_rpc.h"
+#include "protocol_layer_rxq.h"
+#include "protocol_layer_txq.h"
+#include "protocol_layer_coalesce.h"
+#include "protocol_layer_napi.h"
+#include "protocol_layer_filter.h"
 
 /*******************************************************************************
  * Definitions
  ******************************************************************************/
-#define ENET_RXBD_NUM          (4)
-#define ENET_TXBD_NUM          (4)
-#define ENET_RXBUFF_SIZE       (ENET_FRAME_MAX_FRAMELEN)
-#define ENET_TXBUFF_SIZE       (ENET_FRAME_MAX_FRAMELEN)
-#define ENET_DATA_LENGTH       (1000)
 #define ENET_TRANSMIT_DATA_NUM (20)
 
 #define CRC32_DATA_SIZE        (4)
@@ -36,27 +49,97 @@ file.
 
 #define SWAP16(value) (((value >> 8) & 0x00FF) | ((value << 8) & 0xFF00))
 
+/* Longest frame body after the protocol header: a padded chunk behind every
+   header extension, and the trailer */
+#define PL_FRAME_BODY_MAX      (PROTOCOL_LAYER_FRAG_CHUNK + AES_BLOCKLEN + PL_EXT_IV_SIZE + PL_EXT_FRAG_SIZE + \
+                                PL_EXT_SEQ_SIZE + PL_EXT_ACK_SIZE + PL_EXT_CREDIT_SIZE + PL_EXT_REPLAY_SIZE + \
+                                PL_EXT_FEC_SIZE + PL_TRAILER_SIZE)
+/* 802.1Q tag after the source address of the frames sent */
+#if PROTOCOL_LAYER_VLAN
+#define VLAN_TX_SIZE           (PL_VLAN_TAG_SIZE)
+#else
+#define VLAN_TX_SIZE           (0U)
+#endif
+/* Room ahead of a frame to send for the IPv4 and UDP headers */
+#if PROTOCOL_LAYER_UDP
+#define UDP_ROOM_SIZE          (PL_UDP_HEADER_SIZE)
+#else
+#define UDP_ROOM_SIZE          (0U)
+#endif
+#if ((PL_FRAME_BODY_MAX + UDP_ROOM_SIZE) > ENET_DATA_LENGTH)
+#error "PROTOCOL_LAYER_FRAG_CHUNK does not fit in one frame"
+#endif
+/* Bytes the MAC adds before a received frame and drops before a sent one,
+   so the protocol header after the 14-byte Ethernet header is word aligned */
+#if PROTOCOL_LAYER_SHIFT16
+#define FRAME_SHIFT            (2U)
+#else
+#define FRAME_SHIFT            (0U)
+#endif
+/* A parity frame carries a whole frame of the group behind its own header */
+#define PL_PARITY_FRAME_SIZE   (DATA_BUFFER_INDEX + VLAN_TX_SIZE + PL_HEADER_SIZE + PL_EXT_REPLAY_SIZE + \
+                                PL_EXT_FEC_SIZE + PL_FEC_LENGTH_SIZE + PL_HEADER_SIZE + PL_FRAME_BODY_MAX + \
+                                PL_TRAILER_SIZE)
+#if PROTOCOL_LAYER_FEC && ((FRAME_SHIFT + UDP_ROOM_SIZE + PL_PARITY_FRAME_SIZE) > ENET_TXBUFF_SIZE)
+#error "A parity frame does not fit in one frame"
+#endif
+#if (PROTOCOL_LAYER_AGG_FRAME_SIZE > PROTOCOL_LAYER_FRAG_CHUNK)
+#error "PROTOCOL_LAYER_AGG_FRAME_SIZE must not exceed PROTOCOL_LAYER_FRAG_CHUNK"
+#endif
+#if PROTOCOL_LAYER_RELIABLE && (PL_FRAG_MAX_COUNT > PROTOCOL_LAYER_RELIABLE_WINDOW)
+#error "A fragmented message must fit in PROTOCOL_LAYER_RELIABLE_WINDOW"
+#endif
+#if PROTOCOL_LAYER_TXQ && (PROTOCOL_LAYER_TXQ_BUFFER < ENET_TXBUFF_SIZE)
+#error "PROTOCOL_LAYER_TXQ_BUFFER must hold the longest frame"
+#endif
+/* The receive path waits for the receive interrupt */
+#define RX_INTERRUPTS          (PROTOCOL_LAYER_IRQ_COALESCE || PROTOCOL_LAYER_NAPI)
+#if PROTOCOL_LAYER_IRQ_COALESCE && !(defined(FSL_FEATURE_ENET_HAS_INTERRUPT_COALESCE) && FSL_FEATURE_ENET_HAS_INTERRUPT_COALESCE)
+#error "PROTOCOL_LAYER_IRQ_COALESCE needs a MAC with interrupt coalescing"
+#endif
+#if PROTOCOL_LAYER_RXQ && (PL_RXQ_FRAME_MAX < ENET_RXBUFF_SIZE)
+#error "PROTOCOL_LAYER_RXQ_BULK_BUFFER must hold the longest frame"
+#endif
+
 /*******************************************************************************
  * Data Types
  ******************************************************************************/
 typedef struct
 {
+#if PROTOCOL_LAYER_UDP
+    uint8_t UdpRoom[UDP_ROOM_SIZE]; // taken by the Ethernet header in UDP
+#endif
+#if PROTOCOL_LAYER_SHIFT16
+    uint8_t Shift16[FRAME_SHIFT];   // dropped by the MAC
+#endif
     uint8_t MACdst[MAC_DATA_SIZE];
     uint8_t MACsrc[MAC_DATA_SIZE];
+#if PROTOCOL_LAYER_VLAN
+    uint8_t VlanTag[VLAN_TX_SIZE];
+#endif
     uint16_t DataLength;
+    uint8_t Mode;
+    uint8_t HeaderLength;
+    uint16_t Flags;
     uint8_t DataBuffer[ENET_DATA_LENGTH];
 } tstEthMsg;
 
 /*******************************************************************************
- * Variables
+ * Prototypes
  ******************************************************************************/
-AT_NONCACHEABLE_SECTION_ALIGN(enet_rx_bd_struct_t g_rxBuffDescrip[ENET_RXBD_NUM], ENET_BUFF_ALIGNMENT);
-AT_NONCACHEABLE_SECTION_ALIGN(enet_tx_bd_struct_t g_txBuffDescrip[ENET_TXBD_NUM], ENET_BUFF_ALIGNMENT);
-SDK_ALIGN(uint8_t g_rxDataBuff[ENET_RXBD_NUM][SDK_SIZEALIGN(ENET_RXBUFF_SIZE, APP_ENET_BUFF_ALIGNMENT)],
-          APP_ENET_BUFF_ALIGNMENT);
-SDK_ALIGN(uint8_t g_txDataBuff[ENET_TXBD_NUM][SDK_SIZEALIGN(ENET_TXBUFF_SIZE, APP_ENET_BUFF_ALIGNMENT)],
-          APP_ENET_BUFF_ALIGNMENT);
+static void SendFrame(pl_peer_t* peer, const uint8_t* message, size_t length, const pl_frag_t* frag, uint16_t flags,
+                      uint32_t seq);
+#if PROTOCOL_LAYER_RELIABLE
+static bool Retransmit(pl_peer_t* peer, const uint8_t* message, size_t length, const pl_frag_t* frag, uint16_t flags,
+                       uint32_t seq);
+#endif
+#if PROTOCOL_LAYER_NAPI && PROTOCOL_LAYER_RXQ
+static bool RxRead(void);
+#endif
 
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
 enet_handle_t g_handle;
 phy_handle_t phyHandle;
 static CRC_Type *CRC_base = CRC_ENGINE;
@@ -64,6 +147,80 @@ static CRC_Type *CRC_base = CRC_ENGINE;
 static uint8_t key[16] = AES_KEY;
 static uint8_t iv[16] = AES_IV;
 
+static uint8_t s_mode = PROTOCOL_LAYER_DEFAULT_MODE;
+static bool s_aggregate = (PROTOCOL_LAYER_AGGREGATION != 0U);
+static pl_peer_t* s_aggPeer;                    // destination of the queued small messages
+static uint8_t s_aggClass = kPL_TxClass_Bulk;   // traffic class of the queued small messages
+static uint8_t s_aggSource[MAC_DATA_SIZE];      // sender of the aggregated frame being split
+static uint16_t s_rxFlags;                      // PL_FLAG_RPC of the message just received
+static const uint8_t s_defaultPeer[MAC_DATA_SIZE] = DEST_MAC_ADDRESS;
+static uint8_t s_txClass = kPL_TxClass_Bulk;    // traffic class of the frames being sent
+static uint8_t s_aggPcp;                        // 802.1Q priority of the queued small messages
+static uint8_t s_txPcp;                         // 802.1Q priority of the frames being sent
+
+/* 802.1Q priority of a traffic class, the one the receive class queues of
+   the peer sort it by */
+static const uint8_t s_classPcp[kPL_TxClass_Num] = {
+    PROTOCOL_LAYER_RXQ_PCP_CONTROL,
+    PROTOCOL_LAYER_RXQ_PCP_TELEMETRY,
+    0U,
+};
+
+/* Size of every header extension, indexed by flag bit. */
+static const uint8_t s_extSize[] = {
+    PL_EXT_IV_SIZE,
+    0,              // PL_FLAG_EPOCH
+    PL_EXT_FRAG_SIZE,
+    0,              // PL_FLAG_AGG
+    PL_EXT_SEQ_SIZE,
+    PL_EXT_ACK_SIZE,
+    PL_EXT_CREDIT_SIZE,
+    0,              // PL_FLAG_LZ
+    PL_EXT_REPLAY_SIZE,
+    PL_EXT_FEC_SIZE,
+    0,              // PL_FLAG_SYN
+    0,              // PL_FLAG_RPC
+};
+
+#if PROTOCOL_LAYER_CREDIT
+/* Fragments of a message still waiting for credits, sent from the idle path */
+static uint8_t s_backlog[PROTOCOL_LAYER_MAX_MESSAGE];
+static size_t s_backlogLength = 0;
+static pl_frag_t s_backlogFrag;
+static pl_peer_t* s_backlogPeer;
+static uint8_t s_backlogClass;
+static uint8_t s_backlogPcp;
+static uint16_t s_backlogFlags;
+#endif
+
+#if PROTOCOL_LAYER_COMPRESSION
+/* Compressed payload of the frame being sent */
+static uint8_t s_lzBuffer[PROTOCOL_LAYER_FRAG_CHUNK];
+#endif
+
+#if PROTOCOL_LAYER_FEC
+/* Parity frame being sent after UDP_ROOM_SIZE + FRAME_SHIFT bytes, with a
+   spare block for the in-place CMAC padding */
+SDK_ALIGN(static uint8_t s_parityFrame[UDP_ROOM_SIZE + FRAME_SHIFT + PL_PARITY_FRAME_SIZE + AES_BLOCKLEN], 4);
+static pl_peer_t* s_fecPeer;                    // destination of the open parity group
+#endif
+
+#if PROTOCOL_LAYER_VIEW
+/* Messages decoded at once for a view: fragmented, compressed, aggregated */
+static uint8_t s_viewBuffer[PROTOCOL_LAYER_MAX_MESSAGE];
+static uint8_t* s_viewFrame;                    // received frame a view is on, freed on release
+#if PROTOCOL_LAYER_RXQ
+static bool s_viewSlot;                         // the view is on the head of the receive queues
+#endif
+static uint32_t s_viewHandle;                   // handle of the view out, 0 if none
+static uint32_t s_viewCount;
+#endif
+
+#if RX_INTERRUPTS && !PROTOCOL_LAYER_NAPI
+/* Set by the receive interrupt, cleared when the receive ring is found empty */
+static volatile bool s_rxSignal = true;
+#endif
+
 uint8_t g_frame[ENET_DATA_LENGTH + 14]; 
 uint8_t g_macAddr[6] = SRC_MAC_ADDRESS;
 
@@ -111,6 +268,165 @@ static void ProtocolLayer_initPHY(void)
     } while (!(link && autonego));
 }
 
+#if RX_INTERRUPTS
+/*! @brief ENET callback, in interrupt context: a frame, or a batch of frames
+ *         with coalescing, is in the receive ring. With PROTOCOL_LAYER_NAPI
+ *         the receive interrupt stays masked until the ring is empty. */
+static void EnetCallback(ENET_Type* base, enet_handle_t* handle,
+#if FSL_FEATURE_ENET_QUEUE > 1
+                         uint32_t ringId,
+#endif
+                         enet_event_t event, enet_frame_info_t* frameInfo, void* userData)
+{
+    (void)handle;
+#if FSL_FEATURE_ENET_QUEUE > 1
+    (void)ringId;
+#endif
+    (void)frameInfo;
+    (void)userData;
+    (void)base;
+    if (event == kENET_RxEvent)
+    {
+#if PROTOCOL_LAYER_IRQ_COALESCE
+        ProtocolLayer_coalesceOnIrq();
+#endif
+#if PROTOCOL_LAYER_NAPI
+        ProtocolLayer_napiOnIrq();
+#else
+        s_rxSignal = true;
+#endif
+    }
+}
+#endif
+
+#if PROTOCOL_LAYER_IRQ_COALESCE
+/*! @brief Program the receive interrupt coalescing of the MAC. */
+static void SetCoalescing(const pl_coalesce_setting_t* setting)
+{
+    // The thresholds are only changed with coalescing off
+    EXAMPLE_ENET->RXIC[0] = 0U;
+    if (setting->frames != 0U)
+    {
+        // The timer counts in units of 64 cycles of the ENET clock
+        uint32_t ticks = (uint32_t)(((uint64_t)setting->timeUs * EXAMPLE_CLOCK_FREQ) / (64U * 1000000U));
+
+        ticks = (ticks == 0U) ? 1U : ((ticks > 0xFFFFU) ? 0xFFFFU : ticks);
+        EXAMPLE_ENET->RXIC[0] = ENET_RXIC_ICFT(setting->frames) | ENET_RXIC_ICTT(ticks) | ENET_RXIC_ICCS_MASK |
+                                ENET_RXIC_ICEN_MASK;
+    }
+}
+#endif
+
+#if RX_INTERRUPTS
+#if PROTOCOL_LAYER_NAPI
+/*! @brief Ring and interrupt operations of the receive scheduler. */
+static bool RxPending(void)
+{
+    uint32_t length = 0;
+
+    // A frame in error has a length of 0 too, only the status tells it apart
+    return ENET_GetRxFrameSize(&g_handle, &length, 0) != kStatus_ENET_RxFrameEmpty;
+}
+
+static void RxMask(void)
+{
+    ENET_DisableInterrupts(EXAMPLE_ENET, kENET_RxFrameInterrupt);
+}
+
+static void RxUnmask(void)
+{
+    ENET_EnableInterrupts(EXAMPLE_ENET, kENET_RxFrameInterrupt);
+}
+
+static void RxClearStatus(void)
+{
+    ENET_ClearInterruptStatus(EXAMPLE_ENET, kENET_RxFrameInterrupt);
+}
+
+/* Without the receive class queues the receive path reads the ring itself,
+   so there is no read operation */
+static const pl_napi_ops_t s_napiOps = {
+    RxPending,
+#if PROTOCOL_LAYER_RXQ
+    RxRead,
+#else
+    NULL,
+#endif
+    RxMask,
+    RxUnmask,
+    RxClearStatus,
+};
+#endif
+
+/*! @brief True if the receive ring may hold a frame: the receive interrupt
+ *         fired since the ring was last found empty. Also adapts the
+ *         coalescing to the frame rate. */
+static bool RxSignalled(void)
+{
+#if PROTOCOL_LAYER_IRQ_COALESCE
+    pl_coalesce_setting_t setting;
+
+    if (ProtocolLayer_coalesceService(&setting))
+    {
+        SetCoalescing(&setting);
+    }
+#endif
+#if PROTOCOL_LAYER_NAPI
+    // Polling until the ring is empty, with an idle turn after every budget
+    return ProtocolLayer_napiPoll();
+#else
+    if (!s_rxSignal)
+    {
+        return false;
+    }
+    // Cleared before the ring is read: a frame arriving meanwhile signals again
+    s_rxSignal = false;
+    return true;
+#endif
+}
+
+// With NAPI and the receive class queues, ProtocolLayer_napiPass() reads the ring
+#if !PROTOCOL_LAYER_NAPI || !PROTOCOL_LAYER_RXQ
+/*! @brief A frame was taken from the receive ring.
+ *  @return false once the poll budget is used up. */
+static bool RxTaken(void)
+{
+#if PROTOCOL_LAYER_IRQ_COALESCE
+    ProtocolLayer_coalesceOnFrame();
+#endif
+#if PROTOCOL_LAYER_NAPI
+    return ProtocolLayer_napiOnFrame();
+#else
+    // More may follow it without a new interrupt
+    s_rxSignal = true;
+    return true;
+#endif
+}
+
+/*! @brief The receive ring was found empty. */
+static void RxEmpty(void)
+{
+#if PROTOCOL_LAYER_NAPI
+    ProtocolLayer_napiOnEmpty();
+#endif
+}
+#endif
+#else
+static bool RxSignalled(void)
+{
+    return true;
+}
+
+static bool RxTaken(void)
+{
+    return true;
+}
+
+static void RxEmpty(void)
+{
+}
+#endif
+
 /*! @brief Apply padding to the data. */
 static void ApplyPadding(uint8_t* data, size_t length, uint8_t* paddedData, size_t* paddedLength)
 {
@@ -121,27 +437,17 @@ static void ApplyPadding(uint8_t* data, size_t length, uint8_t* paddedData, size
     memset(paddedData + length, padSize, padSize);
 }
 
-/*! @brief Remove padding from the data. */
+/*! @brief Remove padding from the data, checked in constant time. */
 static void RemovePadding(uint8_t* data, size_t length, size_t* dataLength)
 {
-    uint8_t padValue = data[length - 1];
-    if (padValue > AES_BLOCKLEN)
+    uint8_t padValue = PL_CheckPadding(&data[length - AES_BLOCKLEN]);
+    if (padValue == 0U)
     {
         PRINTF("Incorrect padding.\r\n");
         *dataLength = 0;
         return;
     }
 
-    for (size_t i = 0; i < padValue; i++)
-    {
-        if (data[length - 1 - i] != padValue)
-        {
-            PRINTF("Incorrect padding.\r\n");
-            *dataLength = 0;
-            return;
-        }
-    }
-
     *dataLength = length - padValue;
 }
 
@@ -160,19 +466,120 @@ void ProtocolLayer_initCRC32(void)
     CRC_Init(CRC_base, &config);
 }
 
-/*! @brief Check the CRC32 of the received message. */
-static bool CheckCRC(const uint8_t* buffer, uint16_t length, CRC_Type* crcBase)
+/*! @brief Offset of a header extension from the start of the protocol header.
+ *         Extensions are stored in flag bit order, only when their flag is set.
+ *         With PL_FLAG_LAST it returns the size of the whole header. */
+static uint16_t HeaderExtOffset(uint16_t flags, uint16_t flag)
+{
+    uint16_t offset = PL_HEADER_SIZE;
+
+    for (uint8_t bit = 0; (bit < sizeof(s_extSize)) && ((1U << bit) < flag); bit++)
+    {
+        if ((flags & (1U << bit)) != 0U)
+        {
+            offset += s_extSize[bit];
+        }
+    }
+    return offset;
+}
+
+/*! @brief Check the CRC32 or truncated CMAC trailer of the received header and payload. */
+static bool CheckIntegrity(pl_session_t* session, uint8_t* buffer, uint16_t length, uint8_t mode)
+{
+    // Read before the CMAC, which pads the buffer in place over the trailer
+    uint32_t receivedTag = PL_Load32(&buffer[length]);
+
+    if (mode == PL_MODE_CMAC)
+    {
+        uint8_t mac[AES_BLOCKLEN];
+
+        ProtocolLayer_cmacStart(session, buffer, length);
+        bool finished = ProtocolLayer_cmacFinish(mac);
+        // Put the trailer back, FEC XORs the frame as received
+        PL_Store32(&buffer[length], receivedTag);
+        return finished && PL_Equal(mac, (const uint8_t*)&receivedTag, PL_TRAILER_SIZE);
+    }
+
+    return (ProtocolLayer_crc32(buffer, length) == receivedTag);
+}
+
+/*! @brief Check the replay counter of an authenticated frame; with
+ *         PROTOCOL_LAYER_ANTI_REPLAY a frame without one is refused.
+ *  @return false if the frame is a replay and must be dropped. */
+static bool CheckReplay(pl_session_t* session, const uint8_t* header, uint16_t flags)
+{
+#if PROTOCOL_LAYER_ANTI_REPLAY
+    return ((flags & PL_FLAG_REPLAY) != 0U) &&
+           ProtocolLayer_replayCheck(&session->replay, &header[HeaderExtOffset(flags, PL_FLAG_REPLAY)]);
+#else
+    (void)session;
+    (void)header;
+    (void)flags;
+    return true;
+#endif
+}
+
+/*! @brief Pass an authenticated frame to FEC before it is decrypted:
+ *         data frames are XORed into their group, parity frames rebuild a
+ *         lost one. length covers the header and payload, not the trailer.
+ *  @return false if the frame is not to be delivered: a parity frame, or a
+ *          frame that was already rebuilt. */
+static bool ReceiveParity(pl_peer_t* peer, const uint8_t* data, uint16_t length, uint16_t flags, bool rebuilt)
+{
+#if PROTOCOL_LAYER_FEC
+    const uint8_t* header = &data[PL_HEADER_INDEX];
+    const uint8_t* ext = &header[HeaderExtOffset(flags, PL_FLAG_FEC)];
+
+    if (((flags & PL_FLAG_FEC) == 0U) || rebuilt)
+    {
+        return true;
+    }
+    if (ProtocolLayer_fecIsParity(ext))
+    {
+        uint8_t hdrLength = header[1];
+        ProtocolLayer_fecOnParity(peer->index, data, ext, &header[hdrLength], length - hdrLength);
+        return false;
+    }
+    return ProtocolLayer_fecOnData(peer->index, data, ext, header, length + PL_TRAILER_SIZE);
+#else
+    (void)peer;
+    (void)data;
+    (void)length;
+    (void)flags;
+    (void)rebuilt;
+    return true;
+#endif
+}
+
+/*! @brief Next non-empty message of the last aggregated frame; an empty
+ *         message has nothing to hand over and is skipped.
+ *  @return its length, 0 when none is left. */
+static size_t AggNext(uint8_t* msgBuffer)
 {
-    uint32_t receivedCRC = 0;
-    uint32_t calculatedCRC = 0;
+    size_t length = 0;
 
-    memcpy(&receivedCRC, &buffer[length], CRC32_DATA_SIZE);
+    while ((length == 0U) && ProtocolLayer_aggNext(msgBuffer, &length))
+    {
+    }
+    return length;
+}
 
-    ProtocolLayer_initCRC32();
-    CRC_WriteData(crcBase, buffer, length);
-    calculatedCRC = CRC_Get32bitResult(crcBase);
+/*! @brief Store a fragment in the reassembly table; taken is cleared if
+ *         it was not stored, e.g. for lack of a free slot.
+ *  @return length of the message decrypted into msgBuffer once it is
+ *          complete. */
+static size_t ReceiveFragment(pl_peer_t* peer, uint8_t epoch, const uint8_t* ext, const uint8_t* payload,
+                              size_t length, const uint8_t* iv, uint8_t* msgBuffer, bool* taken)
+{
+    pl_frag_t frag;
 
-    return (receivedCRC == calculatedCRC);
+    ProtocolLayer_fragRead(ext, &frag);
+    *taken = ProtocolLayer_reasmAdd(peer->index, &frag, payload, length, iv, epoch);
+    if (!*taken)
+    {
+        return 0;
+    }
+    return ProtocolLayer_reasmDeliver(peer->index, frag.msgId, &peer->keys, msgBuffer);
 }
 
 /*******************************************************************************
@@ -186,19 +593,10 @@ void ProtocolLayer_init(void)
     phy_duplex_t duplex;
     uint8_t g_macAddr[MAC_DATA_SIZE] = SRC_MAC_ADDRESS;
 
-    enet_buffer_config_t buffConfig[] = {{
-        ENET_RXBD_NUM,
-        ENET_TXBD_NUM,
-        SDK_SIZEALIGN(ENET_RXBUFF_SIZE, APP_ENET_BUFF_ALIGNMENT),
-        SDK_SIZEALIGN(ENET_TXBUFF_SIZE, APP_ENET_BUFF_ALIGNMENT),
-        &g_rxBuffDescrip[0],
-        &g_txBuffDescrip[0],
-        &g_rxDataBuff[0][0],
-        &g_txDataBuff[0][0],
-        true,
-        true,
-        NULL,
-    }};
+    enet_buffer_config_t buffConfig[1];
+
+    // Ring depths and buffer memory from ProtocolLayer_ringConfigure()
+    ProtocolLayer_ringSetup(&buffConfig[0]);
 
     ENET_GetDefaultConfig(&config);
 
@@ -211,6 +609,27 @@ void ProtocolLayer_init(void)
     config.miiDuplex = (enet_mii_duplex_t)duplex;
 
     config.macSpecialConfig = kENET_ControlRxBroadCastRejectEnable;
+#if PROTOCOL_LAYER_VLAN
+    // Tagged frames are 4 bytes longer
+    config.macSpecialConfig |= kENET_ControlVLANTagEnable;
+#endif
+#if PROTOCOL_LAYER_SHIFT16
+    // Two bytes ahead of every frame align the protocol header and the payload
+    config.rxAccelerConfig = kENET_RxAccelisShift16Enabled;
+    config.txAccelerConfig = kENET_TxAccelIsShift16Enabled;
+#endif
+#if RX_INTERRUPTS
+    // Receive interrupts only signal the receive path
+    config.interrupt = kENET_RxFrameInterrupt;
+    config.callback = EnetCallback;
+#endif
+#if PROTOCOL_LAYER_IRQ_COALESCE
+    // One interrupt per frame until the frame rate calls for coalescing
+    ProtocolLayer_coalesceInit((uint8_t)(ProtocolLayer_ringRxDepth() - 1U));
+#endif
+#if PROTOCOL_LAYER_NAPI
+    ProtocolLayer_napiInit(&s_napiOps);
+#endif
 
     ENET_Init(EXAMPLE_ENET, &g_handle, &config, &buffConfig[0], &g_macAddr[0], EXAMPLE_CLOCK_FREQ);
     ENET_ActiveRead(EXAMPLE_ENET);
@@ -224,107 +643,1430 @@ void ProtocolLayer_init(void)
     crcConfig.complementOut = true;
     crcConfig.seed          = 0xFFFFFFFFU;
     CRC_Init(CRC_base, &crcConfig);
+
+    // Select the fastest AES/CRC backend per payload size
+    ProtocolLayer_initBackends();
+    ProtocolLayer_peerInit();
+    (void)ProtocolLayer_peerAdd(s_defaultPeer, aes_key, aes_mac_key);
+    ProtocolLayer_reasmInit();
+#if PROTOCOL_LAYER_FEC
+    ProtocolLayer_fecInit();
+#endif
+    ProtocolLayer_rpcInit();
+#if PROTOCOL_LAYER_RXQ
+    ProtocolLayer_rxqInit();
+#endif
+#if PROTOCOL_LAYER_TXQ
+    ProtocolLayer_txqInit();
+#endif
+#if PROTOCOL_LAYER_FILTER
+    ProtocolLayer_filterInit();
+#endif
+#if PROTOCOL_LAYER_UDP
+    static const uint8_t ip[4] = PROTOCOL_LAYER_IP_ADDRESS;
+    ProtocolLayer_udpInit(ip, PROTOCOL_LAYER_UDP_PORT);
+#endif
+#if PROTOCOL_LAYER_RELIABLE
+    ProtocolLayer_relInit(Retransmit);
+#endif
+#if PROTOCOL_LAYER_CALIBRATE_ON_INIT
+    ProtocolLayer_calibrate();
+    ProtocolLayer_printCalibration();
+#endif
+
+#if PROTOCOL_LAYER_USE_IV_POOL
+    ProtocolLayer_ivPoolInit();
+#endif
+}
+
+/*! @brief Select the integrity mode (PL_MODE_CRC32 or PL_MODE_CMAC) for send and receive. */
+void ProtocolLayer_setMode(uint8_t mode)
+{
+    s_mode = mode;
+}
+
+#if PROTOCOL_LAYER_TXQ
+/*! @brief Hand queued frames to the MAC while it has free descriptors, the
+ *         most urgent class first and bulk frames as the shaper allows. */
+static void PumpTx(void)
+{
+    const uint8_t* frame;
+    uint32_t length;
+
+    while ((frame = ProtocolLayer_txqNext(&length)) != NULL)
+    {
+        if (ENET_SendFrame(EXAMPLE_ENET, &g_handle, (uint8_t*)frame, length, 0, false, NULL) ==
+            kStatus_ENET_TxFrameBusy)
+        {
+            ProtocolLayer_ringOnTxFull();
+            break;
+        }
+        ProtocolLayer_txqSent();
+    }
+}
+#endif
+
+#if PROTOCOL_LAYER_UDP
+/*! @brief Carry a frame to a peer with a UDP route in UDP/IPv4. The Ethernet
+ *         header moves into the UDP_ROOM_SIZE bytes the caller leaves ahead
+ *         of the frame, the IPv4 and UDP headers of the route fill the gap
+ *         it leaves before the protocol header, and the length field becomes
+ *         the EtherType. Frames to peers without a route stay 802.3.
+ *  @return start of the frame to send, with length updated. */
+static uint8_t* Encapsulate(uint8_t* frame, uint32_t* length)
+{
+    uint32_t headerLength = FRAME_SHIFT + VLAN_TX_SIZE + DATA_BUFFER_INDEX;
+    uint8_t* moved = frame - UDP_ROOM_SIZE;
+    uint16_t payload = (uint16_t)((frame[headerLength - 2U] << 8) | frame[headerLength - 1U]);
+
+    memcpy(moved, frame, headerLength);
+    if (!ProtocolLayer_udpEncap(&moved[FRAME_SHIFT], &moved[headerLength], payload))
+    {
+        return frame;
+    }
+    moved[headerLength - 2U] = (uint8_t)(PL_ETHERTYPE_IPV4 >> 8);
+    moved[headerLength - 1U] = (uint8_t)(PL_ETHERTYPE_IPV4 & 0xFFU);
+    *length += UDP_ROOM_SIZE;
+    return moved;
+}
+#endif
+
+/*! @brief Send a built frame, through the queue of the current traffic class
+ *         with PROTOCOL_LAYER_TXQ. A full queue is drained first: the
+ *         sender of a shaped class waits for its rate. With
+ *         PROTOCOL_LAYER_UDP there are UDP_ROOM_SIZE free bytes ahead of
+ *         frame. */
+static void EmitFrame(uint8_t* frame, uint32_t length)
+{
+#if PROTOCOL_LAYER_UDP
+    frame = Encapsulate(frame, &length);
+#endif
+#if PROTOCOL_LAYER_TXQ
+    while (!ProtocolLayer_txqPush(s_txClass, frame, length))
+    {
+        PumpTx();
+    }
+    PumpTx();
+#else
+    if (ENET_SendFrame(EXAMPLE_ENET, &g_handle, frame, length, 0, false, NULL) == kStatus_ENET_TxFrameBusy)
+    {
+        ProtocolLayer_ringOnTxFull();
+    }
+#endif
+}
+
+#if PROTOCOL_LAYER_VLAN
+/*! @brief Write the 802.1Q tag of the frames being sent: the priority of the
+ *         message, drop eligible clear, the configured VLAN ID. */
+static void WriteVlanTag(uint8_t* tag)
+{
+    tag[0] = (uint8_t)(PL_VLAN_TPID >> 8);
+    tag[1] = (uint8_t)(PL_VLAN_TPID & 0xFFU);
+    tag[2] = (uint8_t)(((s_txPcp & 0x07U) << 5) | ((PROTOCOL_LAYER_VLAN_ID >> 8) & 0x0FU));
+    tag[3] = (uint8_t)(PROTOCOL_LAYER_VLAN_ID & 0xFFU);
+}
+#endif
+
+#if PROTOCOL_LAYER_FEC
+/*! @brief Close the open parity group and send its parity frame. The parity
+ *         is already the XOR of ciphertexts, it is sent as is under the
+ *         integrity trailer of the peer's current keys. */
+static void SendParity(void)
+{
+    static const uint8_t srcMac[MAC_DATA_SIZE] = SRC_MAC_ADDRESS;
+    pl_peer_t* peer = s_fecPeer;
+    uint8_t epoch = ProtocolLayer_txEpoch(&peer->keys);
+    pl_session_t* session = ProtocolLayer_session(&peer->keys, epoch);
+    uint8_t* frame = &s_parityFrame[UDP_ROOM_SIZE + FRAME_SHIFT];
+    uint8_t* fields = &frame[VLAN_TX_SIZE];     // length field and protocol header, behind the tag
+    uint8_t* header = &fields[PL_HEADER_INDEX];
+    uint16_t flags = PL_FLAG_FEC | ((epoch != 0U) ? PL_FLAG_EPOCH : 0U);
+    size_t hdrLength = PL_HEADER_SIZE;
+    uint8_t mac[AES_BLOCKLEN];
+    bool link = false;
+
+    if (ProtocolLayer_fecQueued() == 0U)
+    {
+        return;
+    }
+#if PROTOCOL_LAYER_ANTI_REPLAY
+    // Parity frames are checked for replay like data frames, before FEC
+    ProtocolLayer_replayWrite(&header[hdrLength], session->txCounter++);
+    hdrLength += PL_EXT_REPLAY_SIZE;
+    flags |= PL_FLAG_REPLAY;
+#endif
+    size_t length = ProtocolLayer_fecParity(&header[hdrLength], &header[hdrLength + PL_EXT_FEC_SIZE]);
+    hdrLength += PL_EXT_FEC_SIZE;
+    length += hdrLength;
+
+    memcpy(&frame[0], peer->mac, MAC_DATA_SIZE);
+    memcpy(&frame[MAC_DATA_SIZE], srcMac, MAC_DATA_SIZE);
+#if PROTOCOL_LAYER_VLAN
+    WriteVlanTag(&frame[DATA_LENGTH_INDEX]);
+#endif
+    fields[DATA_LENGTH_INDEX] = (uint8_t)((length + PL_TRAILER_SIZE) >> 8);
+    fields[DATA_LENGTH_INDEX + 1] = (uint8_t)((length + PL_TRAILER_SIZE) & 0xFFU);
+    header[0] = s_mode;
+    header[1] = (uint8_t)hdrLength;
+    header[2] = (uint8_t)(flags & 0xFFU);
+    header[3] = (uint8_t)(flags >> 8);
+
+    if (s_mode == PL_MODE_CMAC)
+    {
+        ProtocolLayer_cmacStart(session, header, length);
+        PHY_GetLinkStatus(&phyHandle, &link);
+        ProtocolLayer_cmacFinish(mac);
+        memcpy(&header[length], mac, PL_TRAILER_SIZE);
+    }
+    else
+    {
+        uint32_t u32CRC = ProtocolLayer_crc32(header, length);
+        memcpy(&header[length], (uint8_t*)&u32CRC, CRC32_DATA_SIZE);
+        PHY_GetLinkStatus(&phyHandle, &link);
+    }
+
+    if (link)
+    {
+        EmitFrame(&s_parityFrame[UDP_ROOM_SIZE],
+                  FRAME_SHIFT + VLAN_TX_SIZE + DATA_BUFFER_INDEX + length + PL_TRAILER_SIZE);
+    }
 }
+#endif
 
-/*! @brief Send an encrypted message with CRC32 over Ethernet. */
-void ProtocolLayer_send(const uint8_t* message, size_t length)
+/*! @brief Encrypt and send one frame. With frag set the fragment extension
+ *         is added, and only the last fragment of a message is padded.
+ *         flags adds flags without an extension, such as PL_FLAG_AGG. seq is
+ *         the reliable sequence number or PL_REL_NO_SEQ. */
+static void SendFrame(pl_peer_t* peer, const uint8_t* message, size_t length, const pl_frag_t* frag, uint16_t flags,
+                      uint32_t seq)
 {
-    struct AES_ctx ctx;
     uint32_t u32CRC = 0;
+    uint8_t mac[AES_BLOCKLEN];
     size_t u16MsgLength = 0;
+    size_t u16ExtLength = 0;
+    uint16_t u16Flags = flags;
+    const uint8_t* iv = aes_iv;
     bool link = false;
 
-    tstEthMsg stMsgInfo = {
-        .MACdst = DEST_MAC_ADDRESS,
+    // Read the epoch once, a rekey switching it mid-frame must not mix keys
+    uint8_t epoch = ProtocolLayer_txEpoch(&peer->keys);
+    pl_session_t* session = ProtocolLayer_session(&peer->keys, epoch);
+
+    SDK_ALIGN(tstEthMsg stMsgInfo, 4) = {
         .MACsrc = SRC_MAC_ADDRESS,
+        .Mode = s_mode,
     };
+    memcpy(stMsgInfo.MACdst, peer->mac, MAC_DATA_SIZE);
+#if PROTOCOL_LAYER_VLAN
+    WriteVlanTag(stMsgInfo.VlanTag);
+#endif
+    peer->stats.txFrames++;
+    peer->stats.txBytes += length;
 
-    // Apply padding and encrypt the data
-    ApplyPadding((uint8_t*)message, length, stMsgInfo.DataBuffer, &u16MsgLength);
-    AES_init_ctx_iv(&ctx, aes_key, aes_iv);
-    AES_CBC_encrypt_buffer(&ctx, stMsgInfo.DataBuffer, u16MsgLength);
+#if PROTOCOL_LAYER_COMPRESSION
+    // Fragments keep their fixed size; anything else is compressed if that
+    // saves at least one AES block once padded
+    if ((frag == NULL) && (length >= AES_BLOCKLEN) && (length <= sizeof(s_lzBuffer)))
+    {
+        size_t packed = ProtocolLayer_lzCompress(message, length, s_lzBuffer,
+                                                 ((length / AES_BLOCKLEN) * AES_BLOCKLEN) - 1U);
+        if (packed != 0U)
+        {
+            message = s_lzBuffer;
+            length = packed;
+            u16Flags |= PL_FLAG_LZ;
+        }
+    }
+#endif
+#if PROTOCOL_LAYER_USE_IV_POOL
+    // Fresh IV from the pool, sent in clear as the first header extension
+    ProtocolLayer_ivPoolTake(&stMsgInfo.DataBuffer[u16ExtLength]);
+    iv = &stMsgInfo.DataBuffer[u16ExtLength];
+    u16ExtLength += PL_EXT_IV_SIZE;
+    u16Flags |= PL_FLAG_IV;
+#endif
+    if (epoch != 0U)
+    {
+        u16Flags |= PL_FLAG_EPOCH;
+    }
+    if (frag != NULL)
+    {
+        ProtocolLayer_fragWrite(&stMsgInfo.DataBuffer[u16ExtLength], frag);
+        u16ExtLength += PL_EXT_FRAG_SIZE;
+        u16Flags |= PL_FLAG_FRAG;
+    }
+#if PROTOCOL_LAYER_RELIABLE
+    if (seq != PL_REL_NO_SEQ)
+    {
+        ProtocolLayer_relWriteSeq(&stMsgInfo.DataBuffer[u16ExtLength], (uint16_t)seq);
+        u16ExtLength += PL_EXT_SEQ_SIZE;
+        u16Flags |= PL_FLAG_SEQ;
+        if (ProtocolLayer_relIsSyn(&peer->rel, (uint16_t)seq))
+        {
+            u16Flags |= PL_FLAG_SYN;
+        }
+    }
+    // Every frame acknowledges what has been received so far, except to a
+    // group, whose members do not share one receive window, and before the
+    // first sequenced frame from the peer
+    if (!PL_MAC_IS_GROUP(peer->mac) && ProtocolLayer_relAckReady(&peer->rel))
+    {
+        ProtocolLayer_relWriteAck(&peer->rel, &stMsgInfo.DataBuffer[u16ExtLength]);
+        u16ExtLength += PL_EXT_ACK_SIZE;
+        u16Flags |= PL_FLAG_ACK;
+    }
+#else
+    (void)seq;
+#endif
+#if PROTOCOL_LAYER_CREDIT
+    // Only frames with a payload use a credit, pure ACKs and updates are free
+    if (!PL_MAC_IS_GROUP(peer->mac))
+    {
+        ProtocolLayer_creditWrite(&peer->credit, &stMsgInfo.DataBuffer[u16ExtLength],
+                                  (length != 0U) || (seq != PL_REL_NO_SEQ));
+        u16ExtLength += PL_EXT_CREDIT_SIZE;
+        u16Flags |= PL_FLAG_CREDIT;
+    }
+#endif
+#if PROTOCOL_LAYER_ANTI_REPLAY
+    // Every transmission, retransmissions and pure ACKs included, gets the
+    // next counter of the session
+    ProtocolLayer_replayWrite(&stMsgInfo.DataBuffer[u16ExtLength], session->txCounter++);
+    u16ExtLength += PL_EXT_REPLAY_SIZE;
+    u16Flags |= PL_FLAG_REPLAY;
+#endif
+#if PROTOCOL_LAYER_FEC
+    // A parity group has a single destination
+    if ((s_fecPeer != peer) && (ProtocolLayer_fecQueued() != 0U))
+    {
+        SendParity();
+    }
+    s_fecPeer = peer;
+    ProtocolLayer_fecWrite(&stMsgInfo.DataBuffer[u16ExtLength]);
+    u16ExtLength += PL_EXT_FEC_SIZE;
+    u16Flags |= PL_FLAG_FEC;
+#endif
 
-    // Calculate CRC32
-    ProtocolLayer_initCRC32();
-    CRC_WriteData(CRC_base, stMsgInfo.DataBuffer, u16MsgLength);
-    u32CRC = CRC_Get32bitResult(CRC_base);
+    stMsgInfo.HeaderLength = (uint8_t)(PL_HEADER_SIZE + u16ExtLength);
+    stMsgInfo.Flags = u16Flags;
 
-    // Append CRC32 to the DataBuffer
-    memcpy(&stMsgInfo.DataBuffer[u16MsgLength], (uint8_t*)&u32CRC, CRC32_DATA_SIZE);
+    // Apply padding and encrypt the data
+    uint8_t* payload = &stMsgInfo.DataBuffer[u16ExtLength];
+    if ((frag != NULL) && ((frag->index + 1U) < frag->count))
+    {
+        // Whole chunk, a multiple of the block size: no padding
+        PL_Copy(payload, message, length);
+        u16MsgLength = length;
+    }
+    else
+    {
+        ApplyPadding((uint8_t*)message, length, payload, &u16MsgLength);
+    }
+    ProtocolLayer_encryptCBC(session, payload, u16MsgLength, iv);
 
-    // Set the length of the data
-    stMsgInfo.DataLength = SWAP16(u16MsgLength + CRC32_DATA_SIZE);
+    // Header, payload and trailer, the length does not count the MAC addresses
+    size_t u16TrailerOffset = u16ExtLength + u16MsgLength;
+    size_t u16CoveredLength = PL_HEADER_SIZE + u16TrailerOffset;
+    stMsgInfo.DataLength = SWAP16((uint16_t)(u16CoveredLength + PL_TRAILER_SIZE));
 
-    // Ensure the payload is at least 48 bytes and at most 1488 bytes
-    size_t totalLength = HEADER_MSG_SIZE + u16MsgLength + CRC32_DATA_SIZE;
+    // Ensure the frame is at least 48 bytes; PL_FRAME_BODY_MAX keeps it
+    // within ENET_DATA_LENGTH, the 1500-byte Ethernet payload
+    size_t totalLength = DATA_BUFFER_INDEX + u16CoveredLength + PL_TRAILER_SIZE;
     if (totalLength < 48)
     {
-        memset(stMsgInfo.DataBuffer + u16MsgLength + CRC32_DATA_SIZE, 0, 48 - totalLength);
+        memset(stMsgInfo.DataBuffer + u16TrailerOffset + PL_TRAILER_SIZE, 0, 48 - totalLength);
         totalLength = 48;
     }
-    else if (totalLength > 1488)
+
+    // The integrity check covers the protocol header and the encrypted payload
+    uint8_t* covered = &stMsgInfo.MACdst[VLAN_TX_SIZE + PL_HEADER_INDEX];
+    if (s_mode == PL_MODE_CMAC)
+    {
+        // The CMAC runs on ELS while the link is checked and the previous frame is still in DMA
+        ProtocolLayer_cmacStart(session, covered, u16CoveredLength);
+        PHY_GetLinkStatus(&phyHandle, &link);
+        ProtocolLayer_cmacFinish(mac);
+        memcpy(&stMsgInfo.DataBuffer[u16TrailerOffset], mac, PL_TRAILER_SIZE);
+    }
+    else
     {
-        totalLength = 1488;
+        u32CRC = ProtocolLayer_crc32(covered, u16CoveredLength);
+        memcpy(&stMsgInfo.DataBuffer[u16TrailerOffset], (uint8_t*)&u32CRC, CRC32_DATA_SIZE);
+        PHY_GetLinkStatus(&phyHandle, &link);
     }
 
     // Send the frame over Ethernet
-    PHY_GetLinkStatus(&phyHandle, &link);
     if (link)
     {
-        ENET_SendFrame(EXAMPLE_ENET, &g_handle, (uint8_t*)&stMsgInfo, totalLength, 0, false, NULL);
+        EmitFrame(&((uint8_t*)&stMsgInfo)[UDP_ROOM_SIZE], FRAME_SHIFT + VLAN_TX_SIZE + totalLength);
+    }
+
+#if PROTOCOL_LAYER_FEC
+    // The parity covers the frame as sent, from the protocol header to the trailer
+    ProtocolLayer_fecAdd(covered, u16CoveredLength + PL_TRAILER_SIZE);
+    if (ProtocolLayer_fecDue())
+    {
+        SendParity();
     }
+#endif
 }
 
-/*! @brief Receive a message from Ethernet, verify the CRC32, and decrypt it. */
-uint16_t ProtocolLayer_receive(uint8_t* msgBuffer)
+/*! @brief True if that many frames fit in the reliable send window and the
+ *         peer has granted a credit. A fragmented message only needs one
+ *         credit to start, the fragments beyond the credits wait in the
+ *         backlog. */
+static bool WindowOpen(pl_peer_t* peer, uint32_t frames)
 {
-    enet_data_error_stats_t eErrStatic;
-    uint32_t length = 0;
-    status_t status;
-    uint16_t msgLength = 0;
-    size_t unpadLength = 0;
-    bool CRC_check = false;
-    struct AES_ctx ctx;
+    bool open = true;
 
-    status = ENET_GetRxFrameSize(&g_handle, &length, 0);
-    if (length != 0)
+    // Frames to a group are sent once and never held back
+    if (PL_MAC_IS_GROUP(peer->mac))
     {
-        uint8_t *data = (uint8_t *)malloc(length);
-        status = ENET_ReadFrame(EXAMPLE_ENET, &g_handle, data, length, 0, NULL);
-        if (status == kStatus_Success)
-        {
-            memcpy((uint8_t*)&msgLength, &data[DATA_LENGTH_INDEX], sizeof(msgLength));
-            msgLength = SWAP16(msgLength) - CRC32_DATA_SIZE;
+        return true;
+    }
 
-            CRC_check = CheckCRC(&data[DATA_BUFFER_INDEX], (uint16_t)msgLength, CRC_base);
-            if (CRC_check == true)
+#if PROTOCOL_LAYER_RELIABLE
+    open = (ProtocolLayer_relWindowSpace(&peer->rel) >= frames);
+#endif
+#if PROTOCOL_LAYER_CREDIT
+    open = open && (s_backlogLength == 0U) && ProtocolLayer_creditAvailable(&peer->credit, 1U);
+#endif
+    (void)peer;
+    (void)frames;
+    return open;
+}
+
+#if PROTOCOL_LAYER_RELIABLE
+/*! @brief Send a retransmission or a pure ACK for the reliable layer; a
+ *         retransmission waits for a credit like any other frame. */
+static bool Retransmit(pl_peer_t* peer, const uint8_t* message, size_t length, const pl_frag_t* frag, uint16_t flags,
+                       uint32_t seq)
+{
+#if PROTOCOL_LAYER_CREDIT
+    if ((seq != PL_REL_NO_SEQ) && !ProtocolLayer_creditAvailable(&peer->credit, 1U))
+    {
+        return false;
+    }
+#endif
+    SendFrame(peer, message, length, frag, flags, seq);
+    return true;
+}
+#endif
+
+/*! @brief Send a new frame, kept for retransmission in reliable mode.
+ *         Check WindowOpen() first. */
+static void Transmit(pl_peer_t* peer, const uint8_t* message, size_t length, const pl_frag_t* frag, uint16_t flags)
+{
+    uint32_t seq = PL_REL_NO_SEQ;
+
+#if PROTOCOL_LAYER_RELIABLE
+    if (!PL_MAC_IS_GROUP(peer->mac))
+    {
+        seq = ProtocolLayer_relQueue(&peer->rel, message, length, frag, flags);
+    }
+#endif
+    SendFrame(peer, message, length, frag, flags, seq);
+}
+
+/*! @brief Send the fragments of a message from frag->index on, as far as the
+ *         peer's credits go, each with the flags of the message.
+ *  @return true once the last fragment is sent. */
+static bool SendFragments(pl_peer_t* peer, const uint8_t* message, size_t length, pl_frag_t* frag,
+                          uint16_t flags)
+{
+    for (; frag->index < frag->count; frag->index++)
+    {
+        size_t offset = (size_t)frag->index * PROTOCOL_LAYER_FRAG_CHUNK;
+        size_t chunk = ((length - offset) < PROTOCOL_LAYER_FRAG_CHUNK) ? (length - offset) : PROTOCOL_LAYER_FRAG_CHUNK;
+
+#if PROTOCOL_LAYER_CREDIT
+        if (!ProtocolLayer_creditAvailable(&peer->credit, 1U))
+        {
+            return false;
+        }
+#endif
+        Transmit(peer, &message[offset], chunk, frag, flags);
+    }
+    return true;
+}
+
+/*! @brief Send the queued small messages as one frame.
+ *  @return false if the reliable send window is full; the messages stay queued. */
+bool ProtocolLayer_flush(void)
+{
+    const uint8_t* data;
+
+    if (ProtocolLayer_aggQueued() == 0U)
+    {
+        return true;
+    }
+    if (!WindowOpen(s_aggPeer, 1U))
+    {
+        return false;
+    }
+
+    size_t length = ProtocolLayer_aggTake(&data);
+    s_txClass = s_aggClass;
+    s_txPcp = s_aggPcp;
+    Transmit(s_aggPeer, data, length, NULL, PL_FLAG_AGG);
+    return true;
+}
+
+/*! @brief Turn small-message aggregation on or off; queued messages are sent
+ *         when it is turned off. */
+void ProtocolLayer_setAggregation(bool enable)
+{
+    if (!enable)
+    {
+        (void)ProtocolLayer_flush();
+    }
+    s_aggregate = enable;
+}
+
+/*! @brief Send a message, see ProtocolLayer_sendToPriority(). flags is added
+ *         to every frame of the message, which is never aggregated, so that
+ *         the receiver gets it with the message. */
+static bool SendMessage(const uint8_t* mac, const uint8_t* message, size_t length, uint8_t cls, uint8_t pcp,
+                        uint16_t flags)
+{
+    static uint16_t s_txMsgId = 0;
+    pl_peer_t* peer = ProtocolLayer_peerFind(mac);
+
+    if (peer == NULL)
+    {
+        PRINTF("Destino desconocido.\r\n");
+        return false;
+    }
+
+    // The aggregation frame has a single destination, traffic class and priority
+    if (((s_aggPeer != peer) || (s_aggClass != cls) || (s_aggPcp != pcp)) && !ProtocolLayer_flush())
+    {
+        return false;
+    }
+
+    if (s_aggregate)
+    {
+        s_aggPeer = peer;
+        s_aggClass = cls;
+        s_aggPcp = pcp;
+        if ((flags == 0U) && (length != 0U) && (length <= PL_AGG_MAX_MESSAGE))
+        {
+            if (!ProtocolLayer_aggAppend(message, length))
+            {
+                if (!ProtocolLayer_flush())
+                {
+                    return false;
+                }
+                (void)ProtocolLayer_aggAppend(message, length);
+            }
+            if (ProtocolLayer_aggDue())
+            {
+                (void)ProtocolLayer_flush();
+            }
+            return true;
+        }
+        // Keep the order: queued messages go out before this one
+        if (!ProtocolLayer_flush())
+        {
+            return false;
+        }
+    }
+
+    if (length > PROTOCOL_LAYER_MAX_MESSAGE)
+    {
+        PRINTF("Mensaje demasiado largo.\r\n");
+        return false;
+    }
+
+    s_txClass = cls;
+    s_txPcp = pcp;
+    pl_frag_t frag = {
+        .msgId = s_txMsgId,
+        .count = (uint8_t)((length + PROTOCOL_LAYER_FRAG_CHUNK - 1U) / PROTOCOL_LAYER_FRAG_CHUNK),
+    };
+    if (!WindowOpen(peer, (frag.count > 1U) ? frag.count : 1U))
+    {
+        return false;
+    }
+    if (frag.count <= 1U)
+    {
+        Transmit(peer, message, length, NULL, flags);
+        return true;
+    }
+
+    s_txMsgId++;
+    if (!SendFragments(peer, message, length, &frag, flags))
+    {
+#if PROTOCOL_LAYER_CREDIT
+        // Out of credits: the rest goes out from the idle path
+        memcpy(s_backlog, message, length);
+        s_backlogLength = length;
+        s_backlogFrag = frag;
+        s_backlogPeer = peer;
+        s_backlogClass = s_txClass;
+        s_backlogPcp = s_txPcp;
+        s_backlogFlags = flags;
+#endif
+    }
+    return true;
+}
+
+/*! @brief Send an encrypted message with CRC32 or CMAC over Ethernet to a
+ *         peer of the peer table, with its keys. Messages longer than
+ *         PROTOCOL_LAYER_FRAG_CHUNK are split over several frames.
+ *         With aggregation on, short messages are queued and sent together
+ *         when the frame is full or PROTOCOL_LAYER_AGG_DEADLINE_US expires.
+ *         cls is the traffic class (pl_tx_class_t) of its frames with
+ *         PROTOCOL_LAYER_TXQ, ignored otherwise. pcp is the 802.1Q priority
+ *         of its frames with PROTOCOL_LAYER_VLAN, ignored otherwise.
+ *  @return false if the message was not accepted: unknown peer, too long, or
+ *          the reliable send window is full (call ProtocolLayer_receive()
+ *          and retry). */
+bool ProtocolLayer_sendToPriority(const uint8_t* mac, const uint8_t* message, size_t length, uint8_t cls,
+                                  uint8_t pcp)
+{
+    return SendMessage(mac, message, length, cls, pcp, 0U);
+}
+
+/*! @brief Send a message in a traffic class, with the 802.1Q priority of the
+ *         class; see ProtocolLayer_sendToPriority(). */
+bool ProtocolLayer_sendToClass(const uint8_t* mac, const uint8_t* message, size_t length, uint8_t cls)
+{
+    return ProtocolLayer_sendToPriority(mac, message, length, cls,
+                                        (cls < kPL_TxClass_Num) ? s_classPcp[cls] : 0U);
+}
+
+/*! @brief Send a message as bulk traffic, see ProtocolLayer_sendToClass(). */
+bool ProtocolLayer_sendTo(const uint8_t* mac, const uint8_t* message, size_t length)
+{
+    return ProtocolLayer_sendToClass(mac, message, length, kPL_TxClass_Bulk);
+}
+
+/*! @brief Send a message as bulk traffic with header flags that tell the
+ *         receiver what it is; only PL_FLAG_RPC is taken, and such a message
+ *         is never aggregated. See ProtocolLayer_sendTo(). */
+bool ProtocolLayer_sendToFlags(const uint8_t* mac, const uint8_t* message, size_t length, uint16_t flags)
+{
+    return SendMessage(mac, message, length, kPL_TxClass_Bulk, s_classPcp[kPL_TxClass_Bulk], flags & PL_FLAG_RPC);
+}
+
+/*! @brief Join a multicast group: frames sent to the group address pass the
+ *         MAC's hash filter and are decrypted with the group keys, anything
+ *         else sent to a group address is dropped by the MAC. Send to the
+ *         group with ProtocolLayer_sendTo(); one frame reaches every member.
+ *  @return false if the address is not a group address, the group is
+ *          already joined or the peer table is full. */
+bool ProtocolLayer_joinGroup(const uint8_t* group, const uint8_t* key, const uint8_t* macKey)
+{
+    uint8_t address[MAC_DATA_SIZE];
+
+    if (!PL_MAC_IS_GROUP(group) || (ProtocolLayer_peerAdd(group, key, macKey) == NULL))
+    {
+        return false;
+    }
+    memcpy(address, group, MAC_DATA_SIZE);
+    ENET_AddMulticastGroup(EXAMPLE_ENET, address);
+    return true;
+}
+
+/*! @brief Leave a multicast group. The hash filter bit is cleared once no
+ *         other joined group shares it.
+ *  @return false if the group was not joined. */
+bool ProtocolLayer_leaveGroup(const uint8_t* group)
+{
+    uint8_t address[MAC_DATA_SIZE];
+
+    if (!PL_MAC_IS_GROUP(group) || !ProtocolLayer_peerRemove(group))
+    {
+        return false;
+    }
+    memcpy(address, group, MAC_DATA_SIZE);
+    ENET_LeaveMulticastGroup(EXAMPLE_ENET, address);
+    return true;
+}
+
+/*! @brief Nothing received: use the idle time for key expansion,
+ *         reassembly timeouts, credits and the IV pool. */
+static void ServiceIdle(void)
+{
+#if PROTOCOL_LAYER_CREDIT
+    s_txClass = s_backlogClass;
+    s_txPcp = s_backlogPcp;
+    if ((s_backlogLength != 0U) &&
+        SendFragments(s_backlogPeer, s_backlog, s_backlogLength, &s_backlogFrag, s_backlogFlags))
+    {
+        s_backlogLength = 0;
+    }
+#endif
+    // Parity, ACKs, credit updates and retransmissions are control traffic
+    s_txClass = kPL_TxClass_Control;
+    s_txPcp = s_classPcp[kPL_TxClass_Control];
+#if PROTOCOL_LAYER_FEC
+    if (ProtocolLayer_fecDue())
+    {
+        SendParity();
+    }
+#endif
+    for (uint8_t i = 0; i < PROTOCOL_LAYER_MAX_PEERS; i++)
+    {
+        pl_peer_t* peer = ProtocolLayer_peerAt(i);
+        if (peer == NULL)
+        {
+            continue;
+        }
+        ProtocolLayer_sessionService(&peer->keys);
+        if (PL_MAC_IS_GROUP(peer->mac))
+        {
+            continue;
+        }
+#if PROTOCOL_LAYER_RELIABLE
+        ProtocolLayer_relService(&peer->rel, peer);
+#endif
+#if PROTOCOL_LAYER_CREDIT
+        if (ProtocolLayer_creditService(&peer->credit))
+        {
+            SendFrame(peer, (const uint8_t*)"", 0, NULL, 0U, PL_REL_NO_SEQ);
+        }
+#endif
+    }
+    ProtocolLayer_reasmService();
+#if PROTOCOL_LAYER_USE_IV_POOL
+    ProtocolLayer_ivPoolService();
+#endif
+}
+
+/*! @brief Checks of the length field and the protocol header that need no
+ *         key: the mode in use, a header holding the extensions of its flags
+ *         and a payload of whole blocks inside the frame. data starts at the
+ *         destination address, the addresses are not read. */
+static bool HeaderValid(const uint8_t* data, uint32_t length)
+{
+    uint8_t hdrLength = data[PL_HDRLEN_INDEX];
+    uint16_t flags = (uint16_t)(data[PL_FLAGS_INDEX] | (data[PL_FLAGS_INDEX + 1] << 8));
+    uint16_t msgLength = (uint16_t)((data[DATA_LENGTH_INDEX] << 8) | data[DATA_LENGTH_INDEX + 1]);
+
+    return (data[PL_MODE_INDEX] == s_mode) && (hdrLength >= HeaderExtOffset(flags, PL_FLAG_LAST)) &&
+           (msgLength <= (length - DATA_BUFFER_INDEX)) &&
+           (msgLength >= (hdrLength + AES_BLOCKLEN + PL_TRAILER_SIZE)) &&
+           (((msgLength - hdrLength - PL_TRAILER_SIZE) % AES_BLOCKLEN) == 0);
+}
+
+/*! @brief Next frame of the receive ring, read where the MAC wrote it: a
+ *         receive buffer holds a whole frame, so its header is in the first
+ *         descriptor. The buffers are not cached. The pointer is valid until
+ *         the frame is read or dropped.
+ *  @return NULL if the ring holds no complete frame. */
+const uint8_t* ProtocolLayer_rxPeek(uint32_t* length)
+{
+    enet_rx_bd_ring_t* ring = &g_handle.rxBdRing[0];
+    volatile enet_rx_bd_struct_t* descriptor = ring->rxBdBase + ring->rxGenIdx;
+    uintptr_t address;
+
+    if ((ENET_GetRxFrameSize(&g_handle, length, 0) != kStatus_Success) || (*length <= FRAME_SHIFT))
+    {
+        return NULL;
+    }
+#if defined(FSL_FEATURE_MEMORY_HAS_ADDRESS_OFFSET) && FSL_FEATURE_MEMORY_HAS_ADDRESS_OFFSET
+    address = MEMORY_ConvertMemoryMapAddress(descriptor->buffer, kMEMORY_DMA2Local);
+#else
+    address = descriptor->buffer;
+#endif
+    *length -= FRAME_SHIFT;
+    return (const uint8_t*)address + FRAME_SHIFT;
+}
+
+#if PROTOCOL_LAYER_FILTER || !PROTOCOL_LAYER_RXQ
+/*! @brief Whether a received frame of length bytes carries an 802.1Q tag. */
+static bool VlanTagged(const uint8_t* frame, uint32_t length)
+{
+    return (length > (PL_HEADER_INDEX + PL_HEADER_SIZE + PL_VLAN_TAG_SIZE)) &&
+           (frame[DATA_LENGTH_INDEX] == (PL_VLAN_TPID >> 8)) && (frame[DATA_LENGTH_INDEX + 1] == (PL_VLAN_TPID & 0xFFU));
+}
+#endif
+
+#if PROTOCOL_LAYER_UDP
+/*! @brief Whether a received frame, untagged, carries IPv4. */
+static bool IsIpv4(const uint8_t* frame)
+{
+    return (frame[DATA_LENGTH_INDEX] == (PL_ETHERTYPE_IPV4 >> 8)) &&
+           (frame[DATA_LENGTH_INDEX + 1] == (PL_ETHERTYPE_IPV4 & 0xFFU));
+}
+
+/*! @brief Turn a received UDP frame of length bytes back into the frame it
+ *         carries: the IPv4 and UDP headers are dropped, the peer of the
+ *         source route becomes the source address, a group the destination,
+ *         and the length field is the UDP payload length. Other frames are
+ *         left as they are.
+ *  @return start of the frame, with length updated; NULL if the frame is
+ *          IPv4 and not for the layer. */
+static uint8_t* Decapsulate(uint8_t* frame, uint32_t* length)
+{
+    const uint8_t* src = NULL;
+    const uint8_t* dst = NULL;
+    uint8_t* moved = &frame[PL_UDP_HEADER_SIZE];
+    size_t payload;
+
+    if (!IsIpv4(frame))
+    {
+        return frame;
+    }
+    payload = ProtocolLayer_udpReceive(&frame[DATA_BUFFER_INDEX], *length - DATA_BUFFER_INDEX, &src, &dst);
+    if (payload <= PL_HEADER_SIZE)
+    {
+        return NULL;
+    }
+
+    memcpy(moved, (dst != NULL) ? dst : frame, MAC_DATA_SIZE);
+    memcpy(&moved[MAC_DATA_SIZE], src, MAC_DATA_SIZE);
+    moved[DATA_LENGTH_INDEX] = (uint8_t)(payload >> 8);
+    moved[DATA_LENGTH_INDEX + 1] = (uint8_t)(payload & 0xFFU);
+    *length = (uint32_t)(DATA_BUFFER_INDEX + payload);
+    return moved;
+}
+#endif
+
+#if PROTOCOL_LAYER_FILTER
+/*! @brief Verdict on the next frame of the receive ring before it is copied:
+ *         the rule table, then for a frame no rule decides the checks of
+ *         ReceiveFrame() that need no key, and a known sender. */
+static uint8_t Screen(void)
+{
+    uint32_t length = 0;
+    uint32_t tag = 0;
+    const uint8_t* frame = ProtocolLayer_rxPeek(&length);
+
+    if ((frame == NULL) || (length <= (PL_HEADER_INDEX + PL_HEADER_SIZE)))
+    {
+        return kPL_Filter_Pass;
+    }
+    // An 802.1Q tag is removed after the copy, the fields are behind it
+    if (VlanTagged(frame, length))
+    {
+        tag = PL_VLAN_TAG_SIZE;
+    }
+    const uint8_t* fields = &frame[tag];
+#if PROTOCOL_LAYER_UDP
+    // A UDP frame is screened on a copy of the frame header it stands for
+    uint8_t local[PL_HEADER_INDEX + PL_HEADER_SIZE];
+    if (IsIpv4(fields))
+    {
+        const uint8_t* src = NULL;
+        const uint8_t* dst = NULL;
+        size_t payload =
+            ProtocolLayer_udpCheck(&fields[DATA_BUFFER_INDEX], length - tag - DATA_BUFFER_INDEX, &src, &dst);
+
+        if (payload <= PL_HEADER_SIZE)
+        {
+            ProtocolLayer_filterOnReject();
+            return kPL_Filter_Drop;
+        }
+        memcpy(local, (dst != NULL) ? dst : frame, MAC_DATA_SIZE);
+        memcpy(&local[MAC_DATA_SIZE], src, MAC_DATA_SIZE);
+        local[DATA_LENGTH_INDEX] = (uint8_t)(payload >> 8);
+        local[DATA_LENGTH_INDEX + 1] = (uint8_t)(payload & 0xFFU);
+        memcpy(&local[PL_HEADER_INDEX], &fields[DATA_BUFFER_INDEX + PL_UDP_HEADER_SIZE], PL_HEADER_SIZE);
+        frame = local;
+        fields = local;
+        length = (uint32_t)(DATA_BUFFER_INDEX + payload);
+        tag = 0;
+    }
+#endif
+    uint8_t action = ProtocolLayer_filterCheck(
+        &frame[MAC_DATA_SIZE], (uint16_t)((fields[DATA_LENGTH_INDEX] << 8) | fields[DATA_LENGTH_INDEX + 1]),
+        fields[PL_MODE_INDEX]);
+
+    if ((action == kPL_Filter_Pass) &&
+        (!HeaderValid(fields, length - tag) ||
+         (ProtocolLayer_peerFind(PL_MAC_IS_GROUP(frame) ? &frame[0] : &frame[MAC_DATA_SIZE]) == NULL)))
+    {
+        ProtocolLayer_filterOnReject();
+        action = kPL_Filter_Drop;
+    }
+    return action;
+}
+#else
+static uint8_t Screen(void)
+{
+    return kPL_Filter_Pass;
+}
+#endif
+
+#if PROTOCOL_LAYER_RXQ
+/*! @brief Take the next frame of the receive ring to its class queue; a
+ *         frame in error, too long or screened out is dropped.
+ *  @return false if the ring is empty. */
+static bool TakeFrame(void)
+{
+    enet_data_error_stats_t eErrStatic;
+    uint32_t length = 0;
+    uint8_t action = kPL_Filter_Pass;
+    status_t status = ENET_GetRxFrameSize(&g_handle, &length, 0);
+
+    if (status == kStatus_ENET_RxFrameError)
+    {
+        ENET_GetRxErrBeforeReadFrame(&g_handle, &eErrStatic, 0);
+        ENET_ReadFrame(EXAMPLE_ENET, &g_handle, NULL, 0, 0, NULL);
+    }
+    else if (length == 0U)
+    {
+        return false;
+    }
+    else if ((length > (FRAME_SHIFT + PL_RXQ_FRAME_MAX)) || ((action = Screen()) == kPL_Filter_Drop))
+    {
+        ENET_ReadFrame(EXAMPLE_ENET, &g_handle, NULL, 0, 0, NULL);
+    }
+    else if ((ENET_ReadFrame(EXAMPLE_ENET, &g_handle, ProtocolLayer_rxqLanding(), length, 0, NULL) ==
+              kStatus_Success) &&
+             (length > (FRAME_SHIFT + PL_HEADER_INDEX + PL_HEADER_SIZE)))
+    {
+        (void)ProtocolLayer_rxqPush(length, (action >= kPL_Filter_Control)
+                                                ? (uint8_t)(action - kPL_Filter_Control)
+                                                : (uint8_t)kPL_RxClass_Num);
+    }
+    return true;
+}
+
+#if PROTOCOL_LAYER_NAPI
+/*! @brief Read operation of the receive scheduler. */
+static bool RxRead(void)
+{
+    if (!TakeFrame())
+    {
+        return false;
+    }
+#if PROTOCOL_LAYER_IRQ_COALESCE
+    ProtocolLayer_coalesceOnFrame();
+#endif
+    return true;
+}
+#endif
+
+/*! @brief Move every frame of the receive ring to its class queue, so the
+ *         ring never holds a control frame behind bulk frames. */
+static void DrainRing(void)
+{
+#if PROTOCOL_LAYER_NAPI
+    // One pass of the scheduler, which unmasks the interrupt once the ring is empty
+    ProtocolLayer_ringOnDrain(ProtocolLayer_napiPass(ProtocolLayer_ringRxDepth()));
+#else
+    uint32_t frames = 0;
+
+    while (frames < ProtocolLayer_ringRxDepth())
+    {
+        if (!TakeFrame())
+        {
+            RxEmpty();
+            break;
+        }
+        frames++;
+        (void)RxTaken();
+    }
+    ProtocolLayer_ringOnDrain(frames);
+#endif
+}
+#endif
+
+/*! @brief Check, decrypt and deliver one received frame of length bytes;
+ *         rebuilt is set for a frame recovered from a parity frame. With a
+ *         view a whole message is not decrypted but opened in the view,
+ *         which then needs the frame until it is released.
+ *  @return length of the message copied to msgBuffer, 0 if there is none;
+ *          for a message left encrypted, its ciphertext length. */
+static size_t ReceiveFrame(uint8_t* data, uint32_t length, bool rebuilt, uint8_t* msgBuffer, uint8_t* mac,
+                           pl_view_t* view)
+{
+    uint16_t msgLength = 0;
+    size_t unpadLength = 0;
+    bool CRC_check = false;
+#if !PROTOCOL_LAYER_VIEW
+    (void)view;
+#endif
+
+    uint8_t mode = data[PL_MODE_INDEX];
+    uint8_t hdrLength = data[PL_HDRLEN_INDEX];
+    uint16_t flags = (uint16_t)(data[PL_FLAGS_INDEX] | (data[PL_FLAGS_INDEX + 1] << 8));
+    // Constant time lookup of the sender, or of the group the frame
+    // was sent to; its keys decrypt the frame. Group frames that only
+    // passed the MAC's hash filter by collision end here.
+    bool group = PL_MAC_IS_GROUP(&data[0]);
+    pl_peer_t* peer = ProtocolLayer_peerFind(group ? &data[0] : &data[MAC_DATA_SIZE]);
+    pl_session_t* session = NULL;
+
+    if (peer != NULL)
+    {
+        session = ProtocolLayer_session(&peer->keys, ((flags & PL_FLAG_EPOCH) != 0U) ? 1U : 0U);
+    }
+
+    memcpy((uint8_t*)&msgLength, &data[DATA_LENGTH_INDEX], sizeof(msgLength));
+    msgLength = SWAP16(msgLength);
+
+    if (!HeaderValid(data, length))
+    {
+        PRINTF("Trama invalida.\r\n");
+    }
+    else if (peer == NULL)
+    {
+        PRINTF("Remitente desconocido.\r\n");
+    }
+    else if (session == NULL)
+    {
+        PRINTF("Clave caducada.\r\n");
+        peer->stats.rejected++;
+    }
+    else
+    {
+        msgLength -= PL_TRAILER_SIZE;
+        CRC_check = CheckIntegrity(session, &data[PL_HEADER_INDEX], msgLength, mode);
+        // The replay check comes first: a replayed data or parity frame must
+        // not reach its FEC group, where it would evict or refill a slot
+        if (CRC_check && !CheckReplay(session, &data[PL_HEADER_INDEX], flags))
+        {
+            PRINTF("Trama repetida.\r\n");
+            peer->stats.rejected++;
+        }
+        else if (CRC_check && !ReceiveParity(peer, data, msgLength, flags, rebuilt))
+        {
+            // Parity only feeds its group, a late copy of a rebuilt frame is dropped
+        }
+        else if (CRC_check == true)
+        {
+            uint8_t* header = &data[PL_HEADER_INDEX];
+            uint8_t* payload = &header[hdrLength];
+            const uint8_t* iv = aes_iv;
+            msgLength -= hdrLength;
+            peer->stats.rxFrames++;
+            peer->stats.rxBytes += msgLength;
+
+            if ((flags & PL_FLAG_IV) != 0U)
+            {
+                iv = &header[HeaderExtOffset(flags, PL_FLAG_IV)];
+            }
+            bool fresh = true;
+            bool taken = true;
+#if PROTOCOL_LAYER_CREDIT
+            if (((flags & PL_FLAG_CREDIT) != 0U) && !group)
+            {
+                ProtocolLayer_creditOnFrame(&peer->credit, &header[HeaderExtOffset(flags, PL_FLAG_CREDIT)]);
+            }
+#endif
+#if PROTOCOL_LAYER_RELIABLE
+            if (((flags & PL_FLAG_ACK) != 0U) && !group)
+            {
+                ProtocolLayer_relOnAck(&peer->rel, &header[HeaderExtOffset(flags, PL_FLAG_ACK)]);
+            }
+            if (((flags & PL_FLAG_SEQ) != 0U) && !group)
+            {
+                // A retransmission of a frame already delivered is only ACKed again
+                fresh = ProtocolLayer_relOnData(&peer->rel, &header[HeaderExtOffset(flags, PL_FLAG_SEQ)],
+                                                (flags & PL_FLAG_SYN) != 0U);
+            }
+#endif
+            if (fresh && ((flags & PL_FLAG_FRAG) != 0U))
+            {
+                unpadLength = ReceiveFragment(peer, ((flags & PL_FLAG_EPOCH) != 0U) ? 1U : 0U,
+                                              &header[HeaderExtOffset(flags, PL_FLAG_FRAG)], payload, msgLength,
+                                              iv, msgBuffer, &taken);
+            }
+#if PROTOCOL_LAYER_VIEW
+            else if (fresh && (view != NULL) && ((flags & (PL_FLAG_LZ | PL_FLAG_AGG)) == 0U))
+            {
+                // A single block may be only padding, as in a pure ACK
+                ProtocolLayer_viewOpen(view, session, payload, msgLength, iv);
+                unpadLength = (view->encrypted && (msgLength > AES_BLOCKLEN)) ? msgLength
+                                                                               : ProtocolLayer_viewLength(view);
+            }
+#endif
+            else if (fresh)
             {
-                AES_init_ctx_iv(&ctx, aes_key, aes_iv);
-                AES_CBC_decrypt_buffer(&ctx, &data[DATA_BUFFER_INDEX], msgLength);
+                ProtocolLayer_decryptCBC(session, payload, msgLength, iv);
 
-                RemovePadding(&data[DATA_BUFFER_INDEX], msgLength, &unpadLength);
-                if (unpadLength > 0)
+                RemovePadding(payload, msgLength, &unpadLength);
+                if ((unpadLength > 0) && ((flags & PL_FLAG_LZ) != 0U))
                 {
-                    memcpy(msgBuffer, &data[DATA_BUFFER_INDEX], unpadLength);
+                    // Only whole frames are compressed, never more than a chunk
+                    unpadLength = ProtocolLayer_lzDecompress(payload, unpadLength, msgBuffer,
+                                                             PROTOCOL_LAYER_FRAG_CHUNK);
+                    payload = msgBuffer;
                 }
+                if ((unpadLength > 0) && ((flags & PL_FLAG_AGG) != 0U))
+                {
+                    // Split the frame, the first message is returned now
+                    ProtocolLayer_aggLoad(payload, unpadLength);
+                    memcpy(s_aggSource, &data[MAC_DATA_SIZE], MAC_DATA_SIZE);
+                    unpadLength = AggNext(msgBuffer);
+                }
+                else if ((unpadLength > 0) && (payload != msgBuffer))
+                {
+                    PL_Copy(msgBuffer, payload, unpadLength);
+                }
+            }
+#if PROTOCOL_LAYER_RELIABLE
+            // Only a frame taken is recorded and so acknowledged; a fragment
+            // the reassembly had no room for comes again
+            if (fresh && taken && ((flags & PL_FLAG_SEQ) != 0U) && !group)
+            {
+                ProtocolLayer_relAccept(&peer->rel, &header[HeaderExtOffset(flags, PL_FLAG_SEQ)],
+                                        (flags & PL_FLAG_SYN) != 0U);
             }
-            else
+#endif
+            if (unpadLength > 0)
+            {
+                s_rxFlags = flags & PL_FLAG_RPC;
+            }
+            if ((unpadLength > 0) && (mac != NULL))
             {
-                PRINTF("CRC incorrecto.\r\n");
+                memcpy(mac, &data[MAC_DATA_SIZE], MAC_DATA_SIZE);
             }
         }
+        else
+        {
+            PRINTF((mode == PL_MODE_CMAC) ? "CMAC incorrecto.\r\n" : "CRC incorrecto.\r\n");
+            peer->stats.rejected++;
+        }
+    }
+
+    return unpadLength;
+}
+
+/*! @brief Send an encrypted message to the default peer (DEST_MAC_ADDRESS),
+ *         see ProtocolLayer_sendTo(). */
+bool ProtocolLayer_send(const uint8_t* message, size_t length)
+{
+    return ProtocolLayer_sendTo(s_defaultPeer, message, length);
+}
+
+/*! @brief Whether the message just received is a view left encrypted in
+ *         its frame, which is then kept until the view is released. */
+static bool ViewHolds(const pl_view_t* view, size_t length)
+{
+#if PROTOCOL_LAYER_VIEW
+    return (view != NULL) && view->encrypted && (length != 0U);
+#else
+    (void)view;
+    (void)length;
+    return false;
+#endif
+}
+
+#if PROTOCOL_LAYER_FEC || !PROTOCOL_LAYER_RXQ
+/*! @brief Free a received frame, or keep it for the view opened on it. */
+static void FreeFrame(uint8_t* data, const pl_view_t* view, size_t length)
+{
+    if (ViewHolds(view, length))
+    {
+#if PROTOCOL_LAYER_VIEW
+        s_viewFrame = data;
+#endif
+        return;
+    }
+    free(data);
+}
+#endif
+
+#if PROTOCOL_LAYER_VIEW && PROTOCOL_LAYER_RXQ
+/*! @brief Keep the link going while the view out holds the head of the
+ *         receive queues: no message is taken, but the ring still drains
+ *         into the class queues, so the MAC does not run out of receive
+ *         descriptors, and ACKs, retransmissions and parity still go out.
+ *         A queue that fills up meanwhile drops frames of its class. */
+static void ServiceHeld(void)
+{
+    if (RxSignalled())
+    {
+        DrainRing();
+    }
+#if PROTOCOL_LAYER_TXQ
+    PumpTx();
+#endif
+    ServiceIdle();
+}
+#endif
+
+/*! @brief Take one message, for ProtocolLayer_receiveFrom() or, with a view,
+ *         ProtocolLayer_receiveView(). */
+static size_t Receive(uint8_t* msgBuffer, uint8_t* mac, pl_view_t* view)
+{
+#if !PROTOCOL_LAYER_RXQ
+    enet_data_error_stats_t eErrStatic;
+    status_t status;
+#endif
+    uint32_t length = 0;
+    size_t unpadLength = 0;
+
+    s_rxFlags = 0;
 
-        free(data);
+    // Checked on every call: under steady receive traffic the idle path
+    // may not run for a long time
+    if (ProtocolLayer_aggDue())
+    {
+        (void)ProtocolLayer_flush();
+    }
+
+#if PROTOCOL_LAYER_VIEW && PROTOCOL_LAYER_RXQ
+    // The frame of the view out is the head of the receive queues
+    if (s_viewSlot)
+    {
+        ServiceHeld();
+        return 0;
+    }
+#endif
+
+#if PROTOCOL_LAYER_TXQ
+    // Frames held back by the shaper or a full transmit ring
+    PumpTx();
+#endif
+
+    // Messages left from the last aggregated frame come first
+    unpadLength = AggNext(msgBuffer);
+    if (unpadLength != 0U)
+    {
+        if (mac != NULL)
+        {
+            memcpy(mac, s_aggSource, MAC_DATA_SIZE);
+        }
+        return unpadLength;
+    }
+
+#if PROTOCOL_LAYER_FEC
+    // Then a frame rebuilt from a parity frame
+    length = ProtocolLayer_fecPending();
+    if (length != 0U)
+    {
+        // Rebuilt at the offset of a received frame, so it is aligned alike
+        uint8_t* data = (uint8_t*)malloc(FRAME_SHIFT + length + AES_BLOCKLEN);
+        ProtocolLayer_fecRebuild(&data[FRAME_SHIFT]);
+        unpadLength = ReceiveFrame(&data[FRAME_SHIFT], length, true, msgBuffer, mac, view);
+        FreeFrame(data, view, unpadLength);
+        return unpadLength;
+    }
+#endif
+
+#if PROTOCOL_LAYER_RXQ
+    // Empty the receive ring into the class queues, then take the most urgent frame
+    if (RxSignalled())
+    {
+        DrainRing();
+    }
+    uint8_t* data = ProtocolLayer_rxqNext(&length);
+    if (data != NULL)
+    {
+        uint8_t* frame = data;
+#if PROTOCOL_LAYER_UDP
+        frame = Decapsulate(frame, &length);
+#endif
+        unpadLength = (frame != NULL) ? ReceiveFrame(frame, length, false, msgBuffer, mac, view) : 0U;
+        if (ViewHolds(view, unpadLength))
+        {
+#if PROTOCOL_LAYER_VIEW
+            s_viewSlot = true;
+#endif
+        }
+        else
+        {
+            ProtocolLayer_rxqRelease();
+        }
+    }
+    else
+    {
+        ServiceIdle();
+    }
+#else
+    status = kStatus_ENET_RxFrameEmpty;
+    if (RxSignalled())
+    {
+        status = ENET_GetRxFrameSize(&g_handle, &length, 0);
+        if (status == kStatus_ENET_RxFrameEmpty)
+        {
+            RxEmpty();
+        }
+    }
+    if ((length != 0) && (Screen() == kPL_Filter_Drop))
+    {
+        // Dropped in its receive buffer, before any copy
+        ENET_ReadFrame(EXAMPLE_ENET, &g_handle, NULL, 0, 0, NULL);
+        (void)RxTaken();
+    }
+    else if (length != 0)
+    {
+        // Spare block at the end for the in-place CMAC padding
+        uint8_t *data = (uint8_t *)malloc(length + AES_BLOCKLEN);
+        (void)RxTaken();
+        status = ENET_ReadFrame(EXAMPLE_ENET, &g_handle, data, length, 0, NULL);
+        if ((status == kStatus_Success) && (length > (FRAME_SHIFT + PL_HEADER_INDEX + PL_HEADER_SIZE)))
+        {
+            uint8_t* frame = &data[FRAME_SHIFT];
+            length -= FRAME_SHIFT;
+            if (VlanTagged(frame, length))
+            {
+                // Drop the tag: the addresses move up over it
+                memmove(&frame[PL_VLAN_TAG_SIZE], frame, 2U * MAC_DATA_SIZE);
+                frame += PL_VLAN_TAG_SIZE;
+                length -= PL_VLAN_TAG_SIZE;
+            }
+#if PROTOCOL_LAYER_UDP
+            frame = Decapsulate(frame, &length);
+#endif
+            unpadLength = (frame != NULL) ? ReceiveFrame(frame, length, false, msgBuffer, mac, view) : 0U;
+        }
+
+        FreeFrame(data, view, unpadLength);
     }
     else if (status == kStatus_ENET_RxFrameError)
     {
         ENET_GetRxErrBeforeReadFrame(&g_handle, &eErrStatic, 0);
         ENET_ReadFrame(EXAMPLE_ENET, &g_handle, NULL, 0, 0, NULL);
+        (void)RxTaken();
     }
+    else
+    {
+        ServiceIdle();
+    }
+#endif
 
     return unpadLength;
 }
 
+/*! @brief Receive a message from Ethernet, verify the CRC32 or CMAC, and decrypt it
+ *         with the keys of the peer that sent it; frames from MAC addresses
+ *         not in the peer table are dropped. msgBuffer must hold
+ *         PROTOCOL_LAYER_MAX_MESSAGE bytes; a fragmented message is returned
+ *         once its last missing fragment arrives. mac, if not NULL, gets the
+ *         sender of the message. */
+uint16_t ProtocolLayer_receiveFrom(uint8_t* msgBuffer, uint8_t* mac)
+{
+    return (uint16_t)Receive(msgBuffer, mac, NULL);
+}
+
+#if PROTOCOL_LAYER_VIEW
+/*! @brief Receive a message as a view on its frame. The frame is checked as
+ *         by ProtocolLayer_receiveFrom() but the payload is left encrypted in
+ *         the receive buffer; ProtocolLayer_viewRead() decrypts the bytes
+ *         asked for. Fragmented, compressed and aggregated messages are
+ *         decoded at once, into a buffer of the layer. There is one view at
+ *         a time, given back with ProtocolLayer_viewRelease(); with
+ *         PROTOCOL_LAYER_RXQ no message is received before that, but the
+ *         frames that arrive are still queued, up to the depth of their
+ *         class queue.
+ *  @return false if no message arrived or the last view is still out. */
+bool ProtocolLayer_receiveView(pl_view_t* view)
+{
+    size_t length;
+
+    if (s_viewHandle != 0U)
+    {
+#if PROTOCOL_LAYER_RXQ
+        if (s_viewSlot)
+        {
+            ServiceHeld();
+        }
+#endif
+        return false;
+    }
+    view->encrypted = false;
+    length = Receive(s_viewBuffer, view->mac, view);
+    if (length == 0U)
+    {
+        return false;
+    }
+    if (!view->encrypted)
+    {
+        ProtocolLayer_viewOpenPlain(view, s_viewBuffer, length);
+    }
+
+    s_viewCount = (s_viewCount == UINT32_MAX) ? 1U : (s_viewCount + 1U);
+    s_viewHandle = s_viewCount;
+    view->handle = s_viewHandle;
+    return true;
+}
+
+/*! @brief Give back the frame of a view; the view is empty afterwards. */
+void ProtocolLayer_viewRelease(pl_view_t* view)
+{
+    if ((view->handle == 0U) || (view->handle != s_viewHandle))
+    {
+        return;
+    }
+    if (s_viewFrame != NULL)
+    {
+        free(s_viewFrame);
+        s_viewFrame = NULL;
+    }
+#if PROTOCOL_LAYER_RXQ
+    if (s_viewSlot)
+    {
+        ProtocolLayer_rxqRelease();
+        s_viewSlot = false;
+    }
+#endif
+    s_viewHandle = 0;
+    view->handle = 0;
+    view->data = NULL;
+    view->size = 0;
+    view->length = 0;
+    view->encrypted = false;
+}
+#endif
+
+/*! @brief Flags of the frame of the message just received that tell what it
+ *         is: PL_FLAG_RPC for an RPC request or response. */
+uint16_t ProtocolLayer_rxFlags(void)
+{
+    return s_rxFlags;
+}
+
+/*! @brief Receive a message from any peer, see ProtocolLayer_receiveFrom(). */
+uint16_t ProtocolLayer_receive(uint8_t* msgBuffer)
+{
+    return ProtocolLayer_receiveFrom(msgBuffer, NULL);
+}
+
+/*! @brief Burst absorption test of the receive ring, with a loopback plug on
+ *         the port and before any traffic. Bursts of full-size frames to the
+ *         board itself, up to twice the receive ring, are sent back to back
+ *         while nothing is read; then the ring is emptied and the frames that
+ *         made it are counted against the MAC's overflow counter. */
+void ProtocolLayer_ringBenchmark(void)
+{
+    static const uint8_t srcMac[MAC_DATA_SIZE] = SRC_MAC_ADDRESS;
+    // Longest frame without the FCS, after the FRAME_SHIFT bytes the MAC drops
+    SDK_ALIGN(static uint8_t frame[FRAME_SHIFT + ENET_FRAME_MAX_FRAMELEN - 4U], 4);
+    uint8_t* ethernet = &frame[FRAME_SHIFT];
+    uint32_t depth = ProtocolLayer_ringRxDepth();
+    pl_ring_stats_t before;
+    pl_ring_stats_t after;
+    uint32_t length = 0;
+
+    memcpy(&ethernet[0], srcMac, MAC_DATA_SIZE);
+    memcpy(&ethernet[MAC_DATA_SIZE], srcMac, MAC_DATA_SIZE);
+    ethernet[DATA_LENGTH_INDEX] = (uint8_t)((sizeof(frame) - FRAME_SHIFT - DATA_BUFFER_INDEX) >> 8);
+    ethernet[DATA_LENGTH_INDEX + 1] = (uint8_t)((sizeof(frame) - FRAME_SHIFT - DATA_BUFFER_INDEX) & 0xFFU);
+
+    PRINTF("Ring burst test, %u receive descriptors\r\n", (unsigned)depth);
+    for (uint32_t burst = 1; burst <= 2U * depth; burst = (burst < depth) ? (burst * 2U) : (burst + depth))
+    {
+        uint32_t received = 0;
+
+        ProtocolLayer_ringGetStats(EXAMPLE_ENET, &before);
+        for (uint32_t i = 0; i < burst; i++)
+        {
+            while (ENET_SendFrame(EXAMPLE_ENET, &g_handle, frame, sizeof(frame), 0, false, NULL) ==
+                   kStatus_ENET_TxFrameBusy)
+            {
+            }
+        }
+        // A full-size frame takes 123 us at 100 Mbit/s
+        SDK_DelayAtLeastUs(130U * burst + 1000U, SDK_DEVICE_MAXIMUM_CPU_CLOCK_FREQUENCY);
+        while (ENET_GetRxFrameSize(&g_handle, &length, 0) != kStatus_ENET_RxFrameEmpty)
+        {
+            ENET_ReadFrame(EXAMPLE_ENET, &g_handle, NULL, 0, 0, NULL);
+            received++;
+        }
+        ProtocolLayer_ringGetStats(EXAMPLE_ENET, &after);
+        PRINTF("  burst %3u: %3u received, %3u overflowed\r\n", (unsigned)burst, (unsigned)received,
+               (unsigned)(after.rxOverflow - before.rxOverflow));
+    }
+}
+
 #if (defined(EXAMPLE_PHY_LINK_INTR_SUPPORT) && (EXAMPLE_PHY_LINK_INTR_SUPPORT))
 void PHY_LinkStatusChange(void)
 {
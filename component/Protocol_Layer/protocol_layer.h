@@ -13,6 +13,10 @@ necessary to use the library.
 #include "fsl_enet.h"
 #include "fsl_phy.h"
 #include "protocol_layer_cfg.h"
+#include "protocol_layer_txq.h"
+#include "protocol_layer_ring.h"
+#include "protocol_layer_view.h"
+#include "protocol_layer_udp.h"
 
 #include "aes.h"        // libray from https://github.com/kokke/tiny-AES-c
 #include "fsl_crc.h"  // library of CRC from SDK
@@ -22,11 +26,17 @@ necessary to use the library.
  * Definitions
  ******************************************************************************/
 
-#define ENET_RXBD_NUM          (4)
-#define ENET_TXBD_NUM          (4)
+/* Longest frame with its FCS, and with the 802.1Q tag of PROTOCOL_LAYER_VLAN */
+#if PROTOCOL_LAYER_VLAN
+#define ENET_RXBUFF_SIZE       (ENET_FRAME_MAX_FRAMELEN + ENET_FRAME_VLAN_TAGLEN)
+#define ENET_TXBUFF_SIZE       (ENET_FRAME_MAX_FRAMELEN + ENET_FRAME_VLAN_TAGLEN)
+#else
 #define ENET_RXBUFF_SIZE       (ENET_FRAME_MAX_FRAMELEN)
 #define ENET_TXBUFF_SIZE       (ENET_FRAME_MAX_FRAMELEN)
-#define ENET_DATA_LENGTH       (1000)
+#endif
+/* 1500-byte Ethernet payload after the protocol header: header extensions,
+   up to 1488 bytes of encrypted data and the trailer */
+#define ENET_DATA_LENGTH       (1496)
 #define ENET_TRANSMIT_DATA_NUM (20)
 #ifndef APP_ENET_BUFF_ALIGNMENT
 #define APP_ENET_BUFF_ALIGNMENT ENET_BUFF_ALIGNMENT
@@ -68,6 +78,39 @@ necessary to use the library.
 #define DATA_LENGTH_INDEX      (12)
 #define DATA_BUFFER_INDEX      (14)
 
+/* Protocol header, sent in clear right after the length field and covered by
+ * the integrity trailer:
+ *   byte 0    mode (PL_MODE_*)
+ *   byte 1    header length in bytes, the payload starts after it
+ *   byte 2-3  flags, little endian */
+#define PL_HEADER_INDEX        (DATA_BUFFER_INDEX)
+#define PL_HEADER_SIZE         (4)
+#define PL_MODE_INDEX          (PL_HEADER_INDEX)
+#define PL_HDRLEN_INDEX        (PL_HEADER_INDEX + 1)
+#define PL_FLAGS_INDEX         (PL_HEADER_INDEX + 2)
+#define PL_TRAILER_SIZE        (4)
+
+#define PL_MODE_CRC32          (0x00U)   // CRC32 trailer
+#define PL_MODE_CMAC           (0x01U)   // AES-CMAC tag truncated to PL_TRAILER_SIZE
+
+/* Header extensions follow the base header in flag bit order, each one only
+ * present when its flag is set. */
+#define PL_FLAG_IV             (0x0001U) // per-frame IV, otherwise aes_iv is used
+#define PL_FLAG_EPOCH          (0x0002U) // key epoch 1, no extension
+#define PL_FLAG_FRAG           (0x0004U) // fragment of a longer message
+#define PL_FLAG_AGG            (0x0008U) // length-prefixed small messages, no extension
+#define PL_FLAG_SEQ            (0x0010U) // sequence number, reliable delivery
+#define PL_FLAG_ACK            (0x0020U) // cumulative and selective ACK
+#define PL_FLAG_CREDIT         (0x0040U) // frame count and credit limit, flow control
+#define PL_FLAG_LZ             (0x0080U) // LZ4 compressed payload, no extension
+#define PL_FLAG_REPLAY         (0x0100U) // session frame counter, anti-replay
+#define PL_FLAG_FEC            (0x0200U) // parity group, or parity frame if count is set
+#define PL_FLAG_SYN            (0x0400U) // first sequence number after a reset, no extension
+#define PL_FLAG_RPC            (0x0800U) // RPC request or response, no extension
+#define PL_FLAG_LAST           (0x1000U) // first unused flag bit
+
+#define PL_EXT_IV_SIZE         (16)
+
 // Function to swap the endianess of a 16-bit value
 static inline uint16_t SWAP16(uint16_t x) {
     return (x >> 8) | (x << 8);
@@ -106,8 +149,24 @@ extern bool tempLink;
 
 
 void ProtocolLayer_init(void);
-void ProtocolLayer_send(const uint8_t* message, size_t length);
+bool ProtocolLayer_send(const uint8_t* message, size_t length);
+bool ProtocolLayer_sendTo(const uint8_t* mac, const uint8_t* message, size_t length);
+bool ProtocolLayer_sendToClass(const uint8_t* mac, const uint8_t* message, size_t length, uint8_t cls);
+bool ProtocolLayer_sendToPriority(const uint8_t* mac, const uint8_t* message, size_t length, uint8_t cls,
+                                  uint8_t pcp);
+bool ProtocolLayer_sendToFlags(const uint8_t* mac, const uint8_t* message, size_t length, uint16_t flags);
 uint16_t ProtocolLayer_receive(uint8_t* msgBuffer);
+uint16_t ProtocolLayer_receiveFrom(uint8_t* msgBuffer, uint8_t* mac);
+uint16_t ProtocolLayer_rxFlags(void);
+bool ProtocolLayer_receiveView(pl_view_t* view);
+void ProtocolLayer_viewRelease(pl_view_t* view);
+void ProtocolLayer_ringBenchmark(void);
+const uint8_t* ProtocolLayer_rxPeek(uint32_t* length);
+bool ProtocolLayer_joinGroup(const uint8_t* group, const uint8_t* key, const uint8_t* macKey);
+bool ProtocolLayer_leaveGroup(const uint8_t* group);
+void ProtocolLayer_setMode(uint8_t mode);
+void ProtocolLayer_setAggregation(bool enable);
+bool ProtocolLayer_flush(void);
 void ProtocolLayer_initCRC32(void);
 void ProtocolLayer_printFrame(const uint8_t* frame, uint32_t frameLength);
 void ENET_BuildBroadCastFrame(void);
@@ -0,0 +1,140 @@
+/*
+This file contains the aggregation buffers. The transmit side collects
+length-prefixed messages until ProtocolLayer_aggTake() hands the packed
+block to the send path, which encrypts it as a single frame. The receive
+side keeps the decrypted block of the last aggregated frame and returns
+one message per ProtocolLayer_aggNext() call.
+*/
+
+#include <string.h>
+#include "protocol_layer_agg.h"
+#include "protocol_layer_backend.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#if (PL_AGG_MAX_MESSAGE > (PROTOCOL_LAYER_AGG_FRAME_SIZE - PL_AGG_PREFIX_MAX))
+#error "PROTOCOL_LAYER_AGG_MAX_MESSAGE must leave room for its length prefix in the frame"
+#endif
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static uint8_t s_txBuffer[PROTOCOL_LAYER_AGG_FRAME_SIZE];
+static size_t s_txLength = 0;
+static uint32_t s_txStart;      // timer ticks of the first queued message
+
+static uint8_t s_rxBuffer[PROTOCOL_LAYER_AGG_FRAME_SIZE];
+static size_t s_rxLength = 0;
+static size_t s_rxOffset = 0;
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Queue a message in the frame being built.
+ *  @return false if it does not fit; flush and append it again. */
+bool ProtocolLayer_aggAppend(const uint8_t* message, size_t length)
+{
+    size_t prefix = (length > PL_AGG_PREFIX_SHORT_MAX) ? 2U : 1U;
+
+    if ((length > PL_AGG_MAX_MESSAGE) || ((s_txLength + prefix + length) > sizeof(s_txBuffer)))
+    {
+        return false;
+    }
+
+    if (s_txLength == 0U)
+    {
+        s_txStart = ProtocolLayer_timerTicks();
+    }
+    if (prefix == 1U)
+    {
+        s_txBuffer[s_txLength++] = (uint8_t)length;
+    }
+    else
+    {
+        s_txBuffer[s_txLength++] = (uint8_t)(0x80U | (length >> 8));
+        s_txBuffer[s_txLength++] = (uint8_t)(length & 0xFFU);
+    }
+    memcpy(&s_txBuffer[s_txLength], message, length);
+    s_txLength += length;
+    return true;
+}
+
+/*! @brief True when queued messages have waited PROTOCOL_LAYER_AGG_DEADLINE_US. */
+bool ProtocolLayer_aggDue(void)
+{
+    uint32_t deadlineTicks = (ProtocolLayer_timerHz() / 1000000U) * PROTOCOL_LAYER_AGG_DEADLINE_US;
+
+    return (s_txLength != 0U) && ((ProtocolLayer_timerTicks() - s_txStart) >= deadlineTicks);
+}
+
+/*! @brief Bytes queued in the frame being built. */
+size_t ProtocolLayer_aggQueued(void)
+{
+    return s_txLength;
+}
+
+/*! @brief Hand the packed messages to the send path and start a new frame.
+ *  @return bytes packed, 0 if nothing is queued. The data stays valid until
+ *          the next ProtocolLayer_aggAppend(). */
+size_t ProtocolLayer_aggTake(const uint8_t** data)
+{
+    size_t length = s_txLength;
+
+    *data = s_txBuffer;
+    s_txLength = 0;
+    return length;
+}
+
+/*! @brief Keep the decrypted block of an aggregated frame for splitting. */
+void ProtocolLayer_aggLoad(const uint8_t* data, size_t length)
+{
+    if (length > sizeof(s_rxBuffer))
+    {
+        length = 0;
+    }
+    memcpy(s_rxBuffer, data, length);
+    s_rxLength = length;
+    s_rxOffset = 0;
+}
+
+/*! @brief True while messages of the last aggregated frame are left. */
+bool ProtocolLayer_aggPending(void)
+{
+    return (s_rxOffset < s_rxLength);
+}
+
+/*! @brief Copy the next message of the last aggregated frame.
+ *  @param length set to its length, which may be 0.
+ *  @return false when none is left or the block is malformed. */
+bool ProtocolLayer_aggNext(uint8_t* msgBuffer, size_t* length)
+{
+    size_t next;
+
+    if (s_rxOffset >= s_rxLength)
+    {
+        return false;
+    }
+
+    next = s_rxBuffer[s_rxOffset++];
+    if ((next & 0x80U) != 0U)
+    {
+        if (s_rxOffset >= s_rxLength)
+        {
+            s_rxLength = 0;
+            return false;
+        }
+        next = ((next & 0x7FU) << 8) | s_rxBuffer[s_rxOffset++];
+    }
+    if (next > (s_rxLength - s_rxOffset))
+    {
+        // Truncated message: drop the rest of the frame
+        s_rxLength = 0;
+        return false;
+    }
+
+    memcpy(msgBuffer, &s_rxBuffer[s_rxOffset], next);
+    s_rxOffset += next;
+    *length = next;
+    return true;
+}
@@ -0,0 +1,38 @@
+/*
+This file declares small-message aggregation. Short messages are packed
+into one frame, each behind a 1 or 2 byte length prefix, and the frame is
+sent when it is full or when PROTOCOL_LAYER_AGG_DEADLINE_US has passed
+since the first message was queued. The receive side splits the frame back
+into the original messages.
+*/
+
+#ifndef _PROTOCOL_LAYER_AGG_H_
+#define _PROTOCOL_LAYER_AGG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* Length prefix: 0lllllll for 0..127, 1hhhhhhh llllllll for 128..32767 */
+#define PL_AGG_PREFIX_SHORT_MAX (0x7FU)
+#define PL_AGG_PREFIX_MAX      (2U)
+/* Longest message that is aggregated, longer ones are sent on their own */
+#define PL_AGG_MAX_MESSAGE     (PROTOCOL_LAYER_AGG_MAX_MESSAGE)
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+bool ProtocolLayer_aggAppend(const uint8_t* message, size_t length);
+bool ProtocolLayer_aggDue(void);
+size_t ProtocolLayer_aggQueued(void);
+size_t ProtocolLayer_aggTake(const uint8_t** data);
+
+void ProtocolLayer_aggLoad(const uint8_t* data, size_t length);
+bool ProtocolLayer_aggPending(void);
+bool ProtocolLayer_aggNext(uint8_t* msgBuffer, size_t* length);
+
+#endif // _PROTOCOL_LAYER_AGG_H_
@@ -0,0 +1,600 @@
+/*
+This file contains the crypto and CRC backends of the protocol layer and
+the calibration pass that selects the fastest one for every payload size
+class. It does not depend on the Ethernet driver so it can also be built
+for the host (define PROTOCOL_LAYER_HOST_BUILD), where the CRC engine and
+ELS are left out and the host monotonic clock is used as timer.
+*/
+
+#ifdef PROTOCOL_LAYER_HOST_BUILD
+#define _POSIX_C_SOURCE 199309L // clock_gettime() also with -std=c99
+#endif
+
+#include <string.h>
+#include "protocol_layer_backend.h"
+#include "protocol_layer_simd.h"
+#include "aes.h"        // libray from https://github.com/kokke/tiny-AES-c
+
+#ifdef PROTOCOL_LAYER_HOST_BUILD
+#include <stdio.h>
+#include <time.h>
+#define PRINTF printf
+#else
+#include "fsl_debug_console.h"
+#include "fsl_device_registers.h"
+#include "fsl_crc.h"    // library of CRC from SDK
+#include "app.h"        // library of Ethernet from SDK
+#endif
+
+#if PROTOCOL_LAYER_USE_ELS
+#include "mcuxClEls.h"
+#endif
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define CRC32_POLY_REFLECTED   (0xEDB88320U)
+#define CALIB_MAX_SAMPLE       (1488U)
+#define CALIB_SEED             (0x2545F491U)
+/* Keeps a timed call between its timer reads: memory is read after the
+ * first and written, like value, before the second. Without it an inlined
+ * backend can be moved out of the timed region. */
+#define CALIB_FENCE(value)     __asm__ volatile("" : : "r"(value) : "memory")
+
+typedef void (*pl_aes_fn_t)(pl_session_t* session, uint8_t* buf, size_t length, const uint8_t* iv, bool decrypt);
+typedef uint32_t (*pl_crc_fn_t)(const uint8_t* data, size_t length);
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+static void AesTinyAes(pl_session_t* session, uint8_t* buf, size_t length, const uint8_t* iv, bool decrypt);
+#if PROTOCOL_LAYER_USE_ELS
+static void AesEls(pl_session_t* session, uint8_t* buf, size_t length, const uint8_t* iv, bool decrypt);
+static bool AesElsTo(pl_session_t* session, const uint8_t* in, uint8_t* out, size_t length, const uint8_t* iv,
+                     bool decrypt);
+#endif
+#ifndef PROTOCOL_LAYER_HOST_BUILD
+static uint32_t CrcHw(const uint8_t* data, size_t length);
+#endif
+static uint32_t CrcSw(const uint8_t* data, size_t length);
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static const pl_aes_fn_t s_aesBackends[kPL_AesBackend_Num] = {
+    AesTinyAes,
+#if PROTOCOL_LAYER_USE_ELS
+    AesEls,
+#endif
+};
+
+static const char* const s_aesNames[kPL_AesBackend_Num] = {
+    "tiny-AES",
+#if PROTOCOL_LAYER_USE_ELS
+    "ELS",
+#endif
+};
+
+static const pl_crc_fn_t s_crcBackends[kPL_CrcBackend_Num] = {
+#ifndef PROTOCOL_LAYER_HOST_BUILD
+    CrcHw,
+#endif
+    CrcSw,
+};
+
+static const char* const s_crcNames[kPL_CrcBackend_Num] = {
+#ifndef PROTOCOL_LAYER_HOST_BUILD
+    "CRC engine",
+#endif
+    "software",
+};
+
+static const uint16_t s_classLimits[PL_SIZE_CLASS_NUM] = PL_SIZE_CLASS_LIMITS;
+static const uint16_t s_classSamples[PL_SIZE_CLASS_NUM] = PL_SIZE_CLASS_SAMPLES;
+
+static pl_calibration_t s_calib;
+static uint32_t s_crcTable[256];
+
+static uint8_t s_cmacState[AES_BLOCKLEN];
+static bool s_cmacPending = false;
+#if PROTOCOL_LAYER_USE_ELS
+static bool s_cmacOnEls = false;
+static volatile bool s_elsOwned = false;
+#endif
+
+static uint8_t s_calibIn[CALIB_MAX_SAMPLE];
+static uint8_t s_calibRef[CALIB_MAX_SAMPLE];
+static uint8_t s_calibOut[CALIB_MAX_SAMPLE];
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+/*! @brief Map a payload length to its size class. */
+static uint8_t SizeClass(size_t length)
+{
+    uint8_t sizeClass = 0;
+
+    while ((sizeClass < (PL_SIZE_CLASS_NUM - 1)) && (length > s_classLimits[sizeClass]))
+    {
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+/*! @brief AES-128-CBC with tiny-AES, with the key schedule of the session slot. */
+static void AesTinyAes(pl_session_t* session, uint8_t* buf, size_t length, const uint8_t* iv, bool decrypt)
+{
+    AES_ctx_set_iv(&session->aesCtx, iv);
+    if (decrypt)
+    {
+        AES_CBC_decrypt_buffer(&session->aesCtx, buf, length);
+    }
+    else
+    {
+        AES_CBC_encrypt_buffer(&session->aesCtx, buf, length);
+    }
+}
+
+#if PROTOCOL_LAYER_USE_ELS
+/*! @brief AES-128-CBC on the ELS engine with the key taken from CPU memory. */
+static void AesEls(pl_session_t* session, uint8_t* buf, size_t length, const uint8_t* iv, bool decrypt)
+{
+    // ELS busy with a background job (IV pool refill): do not wait for it
+    if (!AesElsTo(session, buf, buf, length, iv, decrypt))
+    {
+        AesTinyAes(session, buf, length, iv, decrypt);
+    }
+}
+
+/*! @brief AES-128-CBC on the ELS engine from in to out, which may be the
+ *         same buffer.
+ *  @return false if the engine is busy and nothing was done. */
+static bool AesElsTo(pl_session_t* session, const uint8_t* in, uint8_t* out, size_t length, const uint8_t* iv,
+                     bool decrypt)
+{
+    mcuxClEls_CipherOption_t options = {0};
+    uint8_t state[AES_BLOCKLEN];
+
+    if (!ProtocolLayer_elsAcquire())
+    {
+        return false;
+    }
+
+    memcpy(state, iv, AES_BLOCKLEN);
+    options.bits.dcrpt  = decrypt ? MCUXCLELS_CIPHER_DECRYPT : MCUXCLELS_CIPHER_ENCRYPT;
+    options.bits.cphmde = MCUXCLELS_CIPHERPARAM_ALGORITHM_AES_CBC;
+    options.bits.extkey = MCUXCLELS_CIPHER_EXTERNAL_KEY;
+
+    MCUX_CSSL_FP_FUNCTION_CALL_BEGIN(result, token,
+        mcuxClEls_Cipher_Async(options, 0U, session->aesKey, PL_KEY_SIZE, in, length, state, out));
+    if ((MCUX_CSSL_FP_FUNCTION_CALLED(mcuxClEls_Cipher_Async) != token) || (MCUXCLELS_STATUS_OK_WAIT != result))
+    {
+        PRINTF("ELS cipher request failed.\r\n");
+    }
+    MCUX_CSSL_FP_FUNCTION_CALL_END();
+
+    MCUX_CSSL_FP_FUNCTION_CALL_BEGIN(result, token, mcuxClEls_WaitForOperation(MCUXCLELS_ERROR_FLAGS_CLEAR));
+    if ((MCUX_CSSL_FP_FUNCTION_CALLED(mcuxClEls_WaitForOperation) != token) || (MCUXCLELS_STATUS_OK != result))
+    {
+        PRINTF("ELS cipher operation failed.\r\n");
+    }
+    MCUX_CSSL_FP_FUNCTION_CALL_END();
+    ProtocolLayer_elsRelease();
+    return true;
+}
+#endif
+
+#ifndef PROTOCOL_LAYER_HOST_BUILD
+/*! @brief CRC32 on the CRC engine. CRC_WriteData() feeds bytes until the
+ *         data is word aligned, from the first byte with PROTOCOL_LAYER_SHIFT16. */
+static uint32_t CrcHw(const uint8_t* data, size_t length)
+{
+    CRC_WriteSeed(CRC_ENGINE, 0xFFFFFFFFU);
+    CRC_WriteData(CRC_ENGINE, data, length);
+    return CRC_Get32bitResult(CRC_ENGINE);
+}
+#endif
+
+/*! @brief CRC32 (IEEE 802.3, same result as zlib.crc32) with a byte table. */
+static uint32_t CrcSw(const uint8_t* data, size_t length)
+{
+    uint32_t crc = 0xFFFFFFFFU;
+
+#if PROTOCOL_LAYER_SHIFT16
+    // Aligned frame buffers: one word load for four table steps
+    if (PL_ALIGNED4(data))
+    {
+        const uint32_t* words = (const uint32_t*)(const void*)data;
+
+        for (; length >= 4U; length -= 4U)
+        {
+            crc ^= *words++;
+            crc = s_crcTable[crc & 0xFFU] ^ (crc >> 8);
+            crc = s_crcTable[crc & 0xFFU] ^ (crc >> 8);
+            crc = s_crcTable[crc & 0xFFU] ^ (crc >> 8);
+            crc = s_crcTable[crc & 0xFFU] ^ (crc >> 8);
+        }
+        data = (const uint8_t*)words;
+    }
+#endif
+    for (size_t i = 0; i < length; i++)
+    {
+        crc = s_crcTable[(crc ^ data[i]) & 0xFFU] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/*! @brief AES-CMAC (NIST SP 800-38B) with tiny-AES, used when ELS is not built in. */
+static void CmacSw(const pl_session_t* session, const uint8_t* data, size_t length, uint8_t* mac)
+{
+    size_t blocks = (length + AES_BLOCKLEN - 1) / AES_BLOCKLEN;
+    bool complete = (length != 0U) && ((length % AES_BLOCKLEN) == 0U);
+
+    memset(mac, 0, AES_BLOCKLEN);
+    blocks = (blocks == 0U) ? 1U : blocks;
+
+    for (size_t b = 0; b < (blocks - 1); b++)
+    {
+        PL_Xor16(mac, &data[b * AES_BLOCKLEN]);
+        AES_ECB_encrypt(&session->macCtx, mac);
+    }
+
+    size_t last = (blocks - 1) * AES_BLOCKLEN;
+    for (uint8_t i = 0; i < AES_BLOCKLEN; i++)
+    {
+        uint8_t m;
+        if (complete)
+        {
+            m = data[last + i] ^ session->cmacK1[i];
+        }
+        else
+        {
+            m = ((last + i) < length) ? data[last + i] : (((last + i) == length) ? 0x80U : 0x00U);
+            m ^= session->cmacK2[i];
+        }
+        mac[i] ^= m;
+    }
+    AES_ECB_encrypt(&session->macCtx, mac);
+}
+
+/*! @brief Fill the calibration input with a fixed pseudo random pattern. */
+static void FillPattern(uint8_t* buf, size_t length)
+{
+    uint32_t x = CALIB_SEED;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        buf[i] = (uint8_t)x;
+    }
+}
+
+/*! @brief Pick the fastest backend, preferring the default (index 0) unless
+ *         the candidate is faster by more than 1/8 so noise cannot flip it. */
+static uint8_t SelectFastest(const uint32_t* ticks, size_t stride, uint8_t count)
+{
+    uint8_t best = 0;
+    uint32_t bestTicks = ticks[0];
+
+    for (uint8_t i = 1; i < count; i++)
+    {
+        uint32_t t = ticks[i * stride];
+        if ((t < bestTicks) && ((bestTicks - t) > (ticks[0] >> 3)))
+        {
+            best = i;
+            bestTicks = t;
+        }
+    }
+    return best;
+}
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Free running tick counter used for calibration and statistics. */
+uint32_t ProtocolLayer_timerTicks(void)
+{
+#ifdef PROTOCOL_LAYER_HOST_BUILD
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+#else
+    return DWT->CYCCNT;
+#endif
+}
+
+/*! @brief Rate of ProtocolLayer_timerTicks() in Hz. */
+uint32_t ProtocolLayer_timerHz(void)
+{
+#ifdef PROTOCOL_LAYER_HOST_BUILD
+    return 1000000000U;
+#else
+    return SystemCoreClock;
+#endif
+}
+
+/*! @brief Prepare the backends and the default dispatch table. */
+void ProtocolLayer_initBackends(void)
+{
+    for (uint32_t i = 0; i < 256U; i++)
+    {
+        uint32_t c = i;
+        for (uint8_t k = 0; k < 8U; k++)
+        {
+            c = (c & 1U) ? (CRC32_POLY_REFLECTED ^ (c >> 1)) : (c >> 1);
+        }
+        s_crcTable[i] = c;
+    }
+
+#ifndef PROTOCOL_LAYER_HOST_BUILD
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+#if PROTOCOL_LAYER_USE_ELS
+    MCUX_CSSL_FP_FUNCTION_CALL_BEGIN(result, token, mcuxClEls_Enable_Async());
+    if ((MCUX_CSSL_FP_FUNCTION_CALLED(mcuxClEls_Enable_Async) == token) && (MCUXCLELS_STATUS_OK_WAIT == result))
+    {
+        (void)mcuxClEls_WaitForOperation(MCUXCLELS_ERROR_FLAGS_CLEAR);
+    }
+    MCUX_CSSL_FP_FUNCTION_CALL_END();
+#endif
+
+    memset(&s_calib, 0, sizeof(s_calib));
+}
+
+/*! @brief Time every backend on the representative sizes and rebuild the
+ *         dispatch table. Run it again after switching between
+ *         BOARD_BootClockRUN and BOARD_BootClockLPR. */
+void ProtocolLayer_calibrate(void)
+{
+    static const uint8_t zeroIv[AES_BLOCKLEN] = {0};
+    // Own key slot, the timings do not depend on which keys are used
+    static pl_session_t s_calibSession;
+    pl_session_t* session = &s_calibSession;
+    uint32_t refCrc = 0;
+
+    ProtocolLayer_sessionLoad(session, aes_key, aes_mac_key);
+
+    FillPattern(s_calibIn, sizeof(s_calibIn));
+
+#ifndef PROTOCOL_LAYER_HOST_BUILD
+    SystemCoreClockUpdate();
+#endif
+    s_calib.coreHz = ProtocolLayer_timerHz();
+    s_calib.timerHz = ProtocolLayer_timerHz();
+
+    for (uint8_t sizeClass = 0; sizeClass < PL_SIZE_CLASS_NUM; sizeClass++)
+    {
+        size_t sample = s_classSamples[sizeClass];
+
+        // A single AES backend has nothing to be chosen against
+        for (uint8_t b = 0; (kPL_AesBackend_Num > 1) && (b < kPL_AesBackend_Num); b++)
+        {
+            uint32_t best = UINT32_MAX;
+            for (uint8_t round = 0; round < PROTOCOL_LAYER_CALIB_ROUNDS; round++)
+            {
+                memcpy(s_calibOut, s_calibIn, sample);
+                uint32_t start = ProtocolLayer_timerTicks();
+                CALIB_FENCE(start);
+                s_aesBackends[b](session, s_calibOut, sample, zeroIv, false);
+                CALIB_FENCE(s_calibOut);
+                uint32_t elapsed = ProtocolLayer_timerTicks() - start;
+                best = (elapsed < best) ? elapsed : best;
+            }
+            if (b == 0U)
+            {
+                memcpy(s_calibRef, s_calibOut, sample);
+            }
+            else if (memcmp(s_calibRef, s_calibOut, sample) != 0)
+            {
+                // A backend that disagrees with the reference is never selected
+                best = UINT32_MAX;
+            }
+            s_calib.aesTicks[b][sizeClass] = best;
+        }
+
+        for (uint8_t b = 0; b < kPL_CrcBackend_Num; b++)
+        {
+            uint32_t best = UINT32_MAX;
+            uint32_t crc = 0;
+            for (uint8_t round = 0; round < PROTOCOL_LAYER_CALIB_ROUNDS; round++)
+            {
+                uint32_t start = ProtocolLayer_timerTicks();
+                CALIB_FENCE(start);
+                crc = s_crcBackends[b](s_calibIn, sample);
+                CALIB_FENCE(crc);
+                uint32_t elapsed = ProtocolLayer_timerTicks() - start;
+                best = (elapsed < best) ? elapsed : best;
+            }
+            if (b == 0U)
+            {
+                refCrc = crc;
+            }
+            else if (crc != refCrc)
+            {
+                best = UINT32_MAX;
+            }
+            s_calib.crcTicks[b][sizeClass] = best;
+        }
+
+        s_calib.aesSelect[sizeClass] = SelectFastest(&s_calib.aesTicks[0][sizeClass], PL_SIZE_CLASS_NUM,
+                                                     kPL_AesBackend_Num);
+        s_calib.crcSelect[sizeClass] = SelectFastest(&s_calib.crcTicks[0][sizeClass], PL_SIZE_CLASS_NUM,
+                                                     kPL_CrcBackend_Num);
+    }
+
+    s_calib.valid = true;
+}
+
+/*! @brief Results of the last calibration pass, for logging. */
+const pl_calibration_t* ProtocolLayer_getCalibration(void)
+{
+    return &s_calib;
+}
+
+const char* ProtocolLayer_aesBackendName(uint8_t backend)
+{
+    return (backend < kPL_AesBackend_Num) ? s_aesNames[backend] : "?";
+}
+
+const char* ProtocolLayer_crcBackendName(uint8_t backend)
+{
+    return (backend < kPL_CrcBackend_Num) ? s_crcNames[backend] : "?";
+}
+
+/*! @brief Print the calibration table on the debug console. */
+void ProtocolLayer_printCalibration(void)
+{
+    if (!s_calib.valid)
+    {
+        PRINTF("Backends not calibrated.\r\n");
+        return;
+    }
+
+    PRINTF("Backend calibration @ %u Hz core, %u Hz timer\r\n", (unsigned)s_calib.coreHz, (unsigned)s_calib.timerHz);
+    for (uint8_t sizeClass = 0; sizeClass < PL_SIZE_CLASS_NUM; sizeClass++)
+    {
+        PRINTF("  <= %4u bytes: AES %s, CRC %s\r\n", (unsigned)s_classLimits[sizeClass],
+               s_aesNames[s_calib.aesSelect[sizeClass]], s_crcNames[s_calib.crcSelect[sizeClass]]);
+        for (uint8_t b = 0; (kPL_AesBackend_Num > 1) && (b < kPL_AesBackend_Num); b++)
+        {
+            PRINTF("      AES %-10s %10u ticks\r\n", s_aesNames[b], (unsigned)s_calib.aesTicks[b][sizeClass]);
+        }
+        for (uint8_t b = 0; b < kPL_CrcBackend_Num; b++)
+        {
+            PRINTF("      CRC %-10s %10u ticks\r\n", s_crcNames[b], (unsigned)s_calib.crcTicks[b][sizeClass]);
+        }
+    }
+}
+
+/*! @brief CRC32 of the data with the backend selected for its size. */
+uint32_t ProtocolLayer_crc32(const uint8_t* data, size_t length)
+{
+    return s_crcBackends[s_calib.crcSelect[SizeClass(length)]](data, length);
+}
+
+/*! @brief AES-128-CBC encrypt in place with the backend selected for the size. */
+void ProtocolLayer_encryptCBC(pl_session_t* session, uint8_t* buf, size_t length, const uint8_t* iv)
+{
+    s_aesBackends[s_calib.aesSelect[SizeClass(length)]](session, buf, length, iv, false);
+}
+
+/*! @brief AES-128-CBC decrypt in place with the backend selected for the size. */
+void ProtocolLayer_decryptCBC(pl_session_t* session, uint8_t* buf, size_t length, const uint8_t* iv)
+{
+    s_aesBackends[s_calib.aesSelect[SizeClass(length)]](session, buf, length, iv, true);
+}
+
+/*! @brief AES-128-CBC decrypt from src into dst, which must not overlap;
+ *         the ciphertext is left as it is. Each block is chained from the
+ *         ciphertext block before it in src, so it costs one pass like the
+ *         in-place decrypt instead of a copy and a decrypt. */
+void ProtocolLayer_decryptCBCTo(pl_session_t* session, const uint8_t* src, uint8_t* dst, size_t length,
+                                const uint8_t* iv)
+{
+#if PROTOCOL_LAYER_USE_ELS
+    if ((s_calib.aesSelect[SizeClass(length)] == kPL_AesBackend_Els) &&
+        AesElsTo(session, src, dst, length, iv, true))
+    {
+        return;
+    }
+#endif
+    for (size_t i = 0; i < length; i += AES_BLOCKLEN)
+    {
+        memcpy(&dst[i], &src[i], AES_BLOCKLEN);
+        AES_ECB_decrypt(&session->aesCtx, &dst[i]);
+        PL_Xor16(&dst[i], (i == 0U) ? iv : &src[i - AES_BLOCKLEN]);
+    }
+}
+
+/*! @brief Start an AES-CMAC over the data with the MAC key of the session slot.
+ *
+ * With ELS the MAC runs on the engine while the caller keeps working (link
+ * check, descriptor handling, the previous frame's DMA), and the input is
+ * padded in place, so the buffer needs AES_BLOCKLEN writable bytes after
+ * length. Without ELS the MAC is computed in software right away. */
+void ProtocolLayer_cmacStart(pl_session_t* session, uint8_t* data, size_t length)
+{
+#if PROTOCOL_LAYER_USE_ELS
+    mcuxClEls_CmacOption_t options = {0};
+    size_t rem = length % AES_BLOCKLEN;
+
+    s_cmacOnEls = ProtocolLayer_elsAcquire();
+    if (s_cmacOnEls)
+    {
+        if ((rem != 0U) || (length == 0U))
+        {
+            data[length] = 0x80U;
+            memset(&data[length + 1U], 0, AES_BLOCKLEN - rem - 1U);
+        }
+        options.bits.initialize = MCUXCLELS_CMAC_INITIALIZE_ENABLE;
+        options.bits.finalize   = MCUXCLELS_CMAC_FINALIZE_ENABLE;
+        options.bits.extkey     = MCUXCLELS_CMAC_EXTERNAL_KEY_ENABLE;
+
+        MCUX_CSSL_FP_FUNCTION_CALL_BEGIN(result, token,
+            mcuxClEls_Cmac_Async(options, 0U, session->macKey, PL_KEY_SIZE, data, length, s_cmacState));
+        if ((MCUX_CSSL_FP_FUNCTION_CALLED(mcuxClEls_Cmac_Async) != token) || (MCUXCLELS_STATUS_OK_WAIT != result))
+        {
+            PRINTF("ELS CMAC request failed.\r\n");
+        }
+        MCUX_CSSL_FP_FUNCTION_CALL_END();
+    }
+    else
+    {
+        // ELS busy with a background job: compute in software instead of waiting
+        CmacSw(session, data, length, s_cmacState);
+    }
+#else
+    CmacSw(session, data, length, s_cmacState);
+#endif
+    s_cmacPending = true;
+}
+
+/*! @brief Wait for the MAC started by ProtocolLayer_cmacStart() and copy it out. */
+bool ProtocolLayer_cmacFinish(uint8_t* mac)
+{
+    bool ok = s_cmacPending;
+
+#if PROTOCOL_LAYER_USE_ELS
+    if (ok && s_cmacOnEls)
+    {
+        MCUX_CSSL_FP_FUNCTION_CALL_BEGIN(result, token, mcuxClEls_WaitForOperation(MCUXCLELS_ERROR_FLAGS_CLEAR));
+        if ((MCUX_CSSL_FP_FUNCTION_CALLED(mcuxClEls_WaitForOperation) != token) || (MCUXCLELS_STATUS_OK != result))
+        {
+            PRINTF("ELS CMAC operation failed.\r\n");
+            ok = false;
+        }
+        MCUX_CSSL_FP_FUNCTION_CALL_END();
+        s_cmacOnEls = false;
+        ProtocolLayer_elsRelease();
+    }
+#endif
+
+    memcpy(mac, s_cmacState, AES_BLOCKLEN);
+    s_cmacPending = false;
+    return ok;
+}
+
+#if PROTOCOL_LAYER_USE_ELS
+/*! @brief Claim the ELS engine. ELS users never wait for each other: when
+ *         this fails the caller uses its software path or retries later.
+ *         Only to be called from thread context, not from interrupts. */
+bool ProtocolLayer_elsAcquire(void)
+{
+    if (s_elsOwned)
+    {
+        return false;
+    }
+    s_elsOwned = true;
+    return true;
+}
+
+/*! @brief Give the ELS engine back after the operation has completed. */
+void ProtocolLayer_elsRelease(void)
+{
+    s_elsOwned = false;
+}
+#endif
@@ -0,0 +1,87 @@
+/*
+This file declares the crypto and CRC backends used by the protocol
+layer, the dispatch table that picks one backend per payload size class,
+and the boot-time calibration that fills that table.
+*/
+
+#ifndef _PROTOCOL_LAYER_BACKEND_H_
+#define _PROTOCOL_LAYER_BACKEND_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+#include "protocol_layer_session.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+
+/* Payload size classes used by the dispatch table. A payload of n bytes
+ * belongs to the first class whose limit is >= n. */
+#define PL_SIZE_CLASS_NUM      (3)
+#define PL_SIZE_CLASS_LIMITS   {64U, 256U, 1488U}
+/* Representative payload size timed for every class (multiple of 16). */
+#define PL_SIZE_CLASS_SAMPLES  {48U, 256U, 1488U}
+
+typedef enum
+{
+    kPL_AesBackend_TinyAes = 0,     /* tiny-AES-c, software */
+#if PROTOCOL_LAYER_USE_ELS
+    kPL_AesBackend_Els,             /* ELS AES engine, mcuxClEls_Cipher_Async */
+#endif
+    kPL_AesBackend_Num
+} pl_aes_backend_t;
+
+typedef enum
+{
+#ifndef PROTOCOL_LAYER_HOST_BUILD
+    kPL_CrcBackend_Hw = 0,          /* CRC engine, fsl_crc */
+#endif
+    kPL_CrcBackend_Sw,              /* table driven software CRC32 */
+    kPL_CrcBackend_Num
+} pl_crc_backend_t;
+
+/* Result of the last calibration pass. Times are in ticks of timerHz and are
+ * the fastest of PROTOCOL_LAYER_CALIB_ROUNDS runs, so one interrupt during a
+ * run does not change the selection. */
+typedef struct
+{
+    uint32_t coreHz;                /* core clock when the pass ran */
+    uint32_t timerHz;               /* tick rate of the timer used */
+    bool     valid;                 /* false until a pass has completed */
+    uint32_t aesTicks[kPL_AesBackend_Num][PL_SIZE_CLASS_NUM]; /* not timed with a single AES backend */
+    uint32_t crcTicks[kPL_CrcBackend_Num][PL_SIZE_CLASS_NUM];
+    uint8_t  aesSelect[PL_SIZE_CLASS_NUM];
+    uint8_t  crcSelect[PL_SIZE_CLASS_NUM];
+} pl_calibration_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+
+void ProtocolLayer_initBackends(void);
+void ProtocolLayer_calibrate(void);
+const pl_calibration_t* ProtocolLayer_getCalibration(void);
+void ProtocolLayer_printCalibration(void);
+const char* ProtocolLayer_aesBackendName(uint8_t backend);
+const char* ProtocolLayer_crcBackendName(uint8_t backend);
+
+uint32_t ProtocolLayer_crc32(const uint8_t* data, size_t length);
+void ProtocolLayer_encryptCBC(pl_session_t* session, uint8_t* buf, size_t length, const uint8_t* iv);
+void ProtocolLayer_decryptCBC(pl_session_t* session, uint8_t* buf, size_t length, const uint8_t* iv);
+void ProtocolLayer_decryptCBCTo(pl_session_t* session, const uint8_t* src, uint8_t* dst, size_t length,
+                                const uint8_t* iv);
+
+void ProtocolLayer_cmacStart(pl_session_t* session, uint8_t* data, size_t length);
+bool ProtocolLayer_cmacFinish(uint8_t* mac);
+
+#if PROTOCOL_LAYER_USE_ELS
+bool ProtocolLayer_elsAcquire(void);
+void ProtocolLayer_elsRelease(void);
+#endif
+
+uint32_t ProtocolLayer_timerTicks(void);
+uint32_t ProtocolLayer_timerHz(void);
+
+#endif // _PROTOCOL_LAYER_BACKEND_H_
@@ -10,9 +10,368 @@ Este archivo contiene las configuraciones de la biblioteca, como la clave de enc
 
 static const uint8_t aes_key[16] = "My16byteKey00000";
 static const uint8_t aes_iv[16] = "My16byteKey00000";
+static const uint8_t aes_mac_key[16] = "My16byteMacKey00";
 
 #define DEST_MAC_ADDRESS {0x00, 0x2b, 0x67, 0x36, 0x70, 0x0F}
 #define SRC_MAC_ADDRESS {0x54, 0x27, 0x8d, 0x24, 0x2a, 0xf2}
 
+/* Integrity mode used by ProtocolLayer_send(): 0 = CRC32 trailer,
+ * 1 = AES-CMAC tag truncated to 4 bytes (see PL_MODE_* in protocol_layer.h). */
+#ifndef PROTOCOL_LAYER_DEFAULT_MODE
+#define PROTOCOL_LAYER_DEFAULT_MODE (0U)
+#endif
+
+/* Time every crypto/CRC backend in ProtocolLayer_init() and build the
+ * per-size dispatch table. When disabled the defaults (tiny-AES and the CRC
+ * engine) are used until ProtocolLayer_calibrate() is called. */
+#ifndef PROTOCOL_LAYER_CALIBRATE_ON_INIT
+#define PROTOCOL_LAYER_CALIBRATE_ON_INIT (1U)
+#endif
+#ifndef PROTOCOL_LAYER_CALIB_ROUNDS
+#define PROTOCOL_LAYER_CALIB_ROUNDS (4U)
+#endif
+
+/* Per-frame IVs taken from a pool that is refilled in the background and
+ * sent in clear in the protocol header. When disabled aes_iv is used for
+ * every frame. Depth must be a power of two.
+ * On by default: frames carry the IV extension (flag 0x0001), a different
+ * wire format than the fixed-IV frames of the original protocol, which a
+ * peer that does not read the header extensions cannot decrypt. */
+#ifndef PROTOCOL_LAYER_USE_IV_POOL
+#define PROTOCOL_LAYER_USE_IV_POOL (1U)
+#endif
+#ifndef PROTOCOL_LAYER_IV_POOL_DEPTH
+#define PROTOCOL_LAYER_IV_POOL_DEPTH (32U)
+#endif
+#ifndef PROTOCOL_LAYER_IV_POOL_BATCH
+#define PROTOCOL_LAYER_IV_POOL_BATCH (8U)
+#endif
+
+/* After a rekey (ProtocolLayer_rekey()) frames of the previous epoch are
+ * still accepted for this long, so frames in flight are not lost. */
+#ifndef PROTOCOL_LAYER_REKEY_GRACE_MS
+#define PROTOCOL_LAYER_REKEY_GRACE_MS (500U)
+#endif
+
+/* Messages longer than PROTOCOL_LAYER_FRAG_CHUNK bytes are sent as
+ * fragments of that size (a multiple of 16 that fits in one frame with
+ * every header extension, at most 1424).
+ * Received fragments are reassembled in PROTOCOL_LAYER_REASM_SLOTS buffers of
+ * PROTOCOL_LAYER_MAX_MESSAGE bytes; a message not complete after
+ * PROTOCOL_LAYER_REASM_TIMEOUT_MS is dropped. */
+#ifndef PROTOCOL_LAYER_FRAG_CHUNK
+#define PROTOCOL_LAYER_FRAG_CHUNK (896U)
+#endif
+#ifndef PROTOCOL_LAYER_MAX_MESSAGE
+#define PROTOCOL_LAYER_MAX_MESSAGE (4096U)
+#endif
+#ifndef PROTOCOL_LAYER_REASM_SLOTS
+#define PROTOCOL_LAYER_REASM_SLOTS (2U)
+#endif
+#ifndef PROTOCOL_LAYER_REASM_TIMEOUT_MS
+#define PROTOCOL_LAYER_REASM_TIMEOUT_MS (200U)
+#endif
+
+/* Small-message aggregation (ProtocolLayer_setAggregation()): messages of
+ * 1 to PROTOCOL_LAYER_AGG_MAX_MESSAGE bytes are packed into one frame of up
+ * to PROTOCOL_LAYER_AGG_FRAME_SIZE bytes, sent when full or
+ * PROTOCOL_LAYER_AGG_DEADLINE_US after the first one. The cap keeps at
+ * least four messages, with their 2-byte prefixes, in a frame; longer ones
+ * gain little from sharing a frame and are sent on their own at once. */
+#ifndef PROTOCOL_LAYER_AGGREGATION
+#define PROTOCOL_LAYER_AGGREGATION (0U)
+#endif
+#ifndef PROTOCOL_LAYER_AGG_FRAME_SIZE
+#define PROTOCOL_LAYER_AGG_FRAME_SIZE (PROTOCOL_LAYER_FRAG_CHUNK)
+#endif
+#ifndef PROTOCOL_LAYER_AGG_MAX_MESSAGE
+#define PROTOCOL_LAYER_AGG_MAX_MESSAGE ((PROTOCOL_LAYER_AGG_FRAME_SIZE / 4U) - 2U)
+#endif
+#ifndef PROTOCOL_LAYER_AGG_DEADLINE_US
+#define PROTOCOL_LAYER_AGG_DEADLINE_US (1000U)
+#endif
+
+/* Reliable delivery: sequence numbers, a send window of
+ * PROTOCOL_LAYER_RELIABLE_WINDOW frames (power of two, at most 32), ACKs in
+ * every frame and RTT based retransmission. Both peers must enable it. */
+#ifndef PROTOCOL_LAYER_RELIABLE
+#define PROTOCOL_LAYER_RELIABLE (0U)
+#endif
+#ifndef PROTOCOL_LAYER_RELIABLE_WINDOW
+#define PROTOCOL_LAYER_RELIABLE_WINDOW (8U)
+#endif
+#ifndef PROTOCOL_LAYER_RELIABLE_RTO_INIT_MS
+#define PROTOCOL_LAYER_RELIABLE_RTO_INIT_MS (200U)
+#endif
+#ifndef PROTOCOL_LAYER_RELIABLE_RTO_MIN_MS
+#define PROTOCOL_LAYER_RELIABLE_RTO_MIN_MS (2U)
+#endif
+#ifndef PROTOCOL_LAYER_RELIABLE_RTO_MAX_MS
+#define PROTOCOL_LAYER_RELIABLE_RTO_MAX_MS (2000U)
+#endif
+#ifndef PROTOCOL_LAYER_RELIABLE_ACK_DELAY_US
+#define PROTOCOL_LAYER_RELIABLE_ACK_DELAY_US (500U)
+#endif
+
+/* Credit-based flow control: every frame tells the peer how many more
+ * frames it may send, PROTOCOL_LAYER_CREDIT_WINDOW beyond the last one
+ * processed, so it never overruns the receive descriptors. The window must
+ * be below the receive ring depth, one descriptor is kept for frames
+ * without a payload. A stalled sender asks for a new grant every
+ * PROTOCOL_LAYER_CREDIT_PROBE_MS. Both peers must enable it. */
+#ifndef PROTOCOL_LAYER_CREDIT
+#define PROTOCOL_LAYER_CREDIT (0U)
+#endif
+#ifndef PROTOCOL_LAYER_CREDIT_WINDOW
+#define PROTOCOL_LAYER_CREDIT_WINDOW (3U)
+#endif
+#ifndef PROTOCOL_LAYER_CREDIT_PROBE_MS
+#define PROTOCOL_LAYER_CREDIT_PROBE_MS (50U)
+#endif
+
+/* LZ4 block compression of frame payloads before encryption, skipped for
+ * fragments and when it would not save an AES block. The compressor uses a
+ * hash table of 2^PROTOCOL_LAYER_LZ_HASH_BITS 16-bit entries. Compressed
+ * frames are always accepted on receive. */
+#ifndef PROTOCOL_LAYER_COMPRESSION
+#define PROTOCOL_LAYER_COMPRESSION (0U)
+#endif
+#ifndef PROTOCOL_LAYER_LZ_HASH_BITS
+#define PROTOCOL_LAYER_LZ_HASH_BITS (10U)
+#endif
+
+/* Anti-replay: every frame carries a 32-bit counter of its session and the
+ * receiver drops frames already seen or older than a 64-frame window.
+ * Frames without a counter are refused when enabled. */
+#ifndef PROTOCOL_LAYER_ANTI_REPLAY
+#define PROTOCOL_LAYER_ANTI_REPLAY (0U)
+#endif
+
+/* Forward error correction: a parity frame after every
+ * PROTOCOL_LAYER_FEC_GROUP frames (2 to 16), or PROTOCOL_LAYER_FEC_DEADLINE_US
+ * after the first frame of a group that is not full. The receiver rebuilds
+ * one lost frame per group and tracks PROTOCOL_LAYER_FEC_SLOTS groups. */
+#ifndef PROTOCOL_LAYER_FEC
+#define PROTOCOL_LAYER_FEC (0U)
+#endif
+#ifndef PROTOCOL_LAYER_FEC_GROUP
+#define PROTOCOL_LAYER_FEC_GROUP (4U)
+#endif
+#ifndef PROTOCOL_LAYER_FEC_DEADLINE_US
+#define PROTOCOL_LAYER_FEC_DEADLINE_US (2000U)
+#endif
+#ifndef PROTOCOL_LAYER_FEC_SLOTS
+#define PROTOCOL_LAYER_FEC_SLOTS (2U)
+#endif
+
+/* Request/response layer: up to PROTOCOL_LAYER_RPC_SLOTS requests in flight.
+ * With PROTOCOL_LAYER_RPC the test sends its messages as pipelined requests
+ * that expire after PROTOCOL_LAYER_RPC_TIMEOUT_MS. */
+#ifndef PROTOCOL_LAYER_RPC
+#define PROTOCOL_LAYER_RPC (0U)
+#endif
+#ifndef PROTOCOL_LAYER_RPC_SLOTS
+#define PROTOCOL_LAYER_RPC_SLOTS (32U)
+#endif
+#ifndef PROTOCOL_LAYER_RPC_TIMEOUT_MS
+#define PROTOCOL_LAYER_RPC_TIMEOUT_MS (1000U)
+#endif
+
+/* Receive class queues: the frames of the receive ring are moved to a
+ * control, telemetry or bulk queue, by 802.1Q priority (control from
+ * PROTOCOL_LAYER_RXQ_PCP_CONTROL, telemetry from
+ * PROTOCOL_LAYER_RXQ_PCP_TELEMETRY) or, untagged, by length, and served in
+ * that order. Each class has its own depth and buffer size. */
+#ifndef PROTOCOL_LAYER_RXQ
+#define PROTOCOL_LAYER_RXQ (0U)
+#endif
+#ifndef PROTOCOL_LAYER_RXQ_CONTROL_DEPTH
+#define PROTOCOL_LAYER_RXQ_CONTROL_DEPTH (4U)
+#endif
+#ifndef PROTOCOL_LAYER_RXQ_CONTROL_BUFFER
+#define PROTOCOL_LAYER_RXQ_CONTROL_BUFFER (256U)
+#endif
+#ifndef PROTOCOL_LAYER_RXQ_TELEMETRY_DEPTH
+#define PROTOCOL_LAYER_RXQ_TELEMETRY_DEPTH (4U)
+#endif
+#ifndef PROTOCOL_LAYER_RXQ_TELEMETRY_BUFFER
+#define PROTOCOL_LAYER_RXQ_TELEMETRY_BUFFER (512U)
+#endif
+#ifndef PROTOCOL_LAYER_RXQ_BULK_DEPTH
+#define PROTOCOL_LAYER_RXQ_BULK_DEPTH (8U)
+#endif
+#ifndef PROTOCOL_LAYER_RXQ_BULK_BUFFER
+#define PROTOCOL_LAYER_RXQ_BULK_BUFFER (1536U)
+#endif
+#ifndef PROTOCOL_LAYER_RXQ_PCP_CONTROL
+#define PROTOCOL_LAYER_RXQ_PCP_CONTROL (5U)
+#endif
+#ifndef PROTOCOL_LAYER_RXQ_PCP_TELEMETRY
+#define PROTOCOL_LAYER_RXQ_PCP_TELEMETRY (3U)
+#endif
+
+/* Transmit class queues: frames wait in a control, telemetry or bulk queue
+ * of PROTOCOL_LAYER_TXQ_*_DEPTH frames of up to PROTOCOL_LAYER_TXQ_BUFFER
+ * bytes. Control and telemetry go first, bulk is shaped to
+ * PROTOCOL_LAYER_TXQ_BULK_KBPS with bursts of up to
+ * PROTOCOL_LAYER_TXQ_BULK_BURST bytes. */
+#ifndef PROTOCOL_LAYER_TXQ
+#define PROTOCOL_LAYER_TXQ (0U)
+#endif
+#ifndef PROTOCOL_LAYER_TXQ_CONTROL_DEPTH
+#define PROTOCOL_LAYER_TXQ_CONTROL_DEPTH (4U)
+#endif
+#ifndef PROTOCOL_LAYER_TXQ_TELEMETRY_DEPTH
+#define PROTOCOL_LAYER_TXQ_TELEMETRY_DEPTH (4U)
+#endif
+#ifndef PROTOCOL_LAYER_TXQ_BULK_DEPTH
+#define PROTOCOL_LAYER_TXQ_BULK_DEPTH (8U)
+#endif
+#ifndef PROTOCOL_LAYER_TXQ_BUFFER
+#define PROTOCOL_LAYER_TXQ_BUFFER (1536U)
+#endif
+#ifndef PROTOCOL_LAYER_TXQ_BULK_KBPS
+#define PROTOCOL_LAYER_TXQ_BULK_KBPS (50000U)
+#endif
+#ifndef PROTOCOL_LAYER_TXQ_BULK_BURST
+#define PROTOCOL_LAYER_TXQ_BULK_BURST (3000U)
+#endif
+
+/* Receive interrupt moderation: the receive path reads the ring once the
+ * receive interrupt signals a frame. Below PROTOCOL_LAYER_COALESCE_OFF_FPS
+ * every frame interrupts; from PROTOCOL_LAYER_COALESCE_ON_FPS the interrupt
+ * waits for a batch sized from the rate or PROTOCOL_LAYER_COALESCE_US. The
+ * rate is measured every PROTOCOL_LAYER_COALESCE_PERIOD_MS. */
+#ifndef PROTOCOL_LAYER_IRQ_COALESCE
+#define PROTOCOL_LAYER_IRQ_COALESCE (0U)
+#endif
+#ifndef PROTOCOL_LAYER_COALESCE_US
+#define PROTOCOL_LAYER_COALESCE_US (200U)
+#endif
+#ifndef PROTOCOL_LAYER_COALESCE_ON_FPS
+#define PROTOCOL_LAYER_COALESCE_ON_FPS (5000U)
+#endif
+#ifndef PROTOCOL_LAYER_COALESCE_OFF_FPS
+#define PROTOCOL_LAYER_COALESCE_OFF_FPS (2500U)
+#endif
+#ifndef PROTOCOL_LAYER_COALESCE_PERIOD_MS
+#define PROTOCOL_LAYER_COALESCE_PERIOD_MS (100U)
+#endif
+
+/* Hybrid interrupt/poll receive: the first receive interrupt masks itself
+ * and the ring is polled, PROTOCOL_LAYER_NAPI_BUDGET frames per pass with
+ * the idle work in between, until it is empty. Combines with
+ * PROTOCOL_LAYER_IRQ_COALESCE. */
+#ifndef PROTOCOL_LAYER_NAPI
+#define PROTOCOL_LAYER_NAPI (0U)
+#endif
+#ifndef PROTOCOL_LAYER_NAPI_BUDGET
+#define PROTOCOL_LAYER_NAPI_BUDGET (4U)
+#endif
+
+/* Frame alignment: with PROTOCOL_LAYER_SHIFT16 the MAC receives every frame
+ * two bytes into its buffer and drops two leading bytes from every frame
+ * sent (RACC/TACC SHIFT16), so the protocol header after the 14-byte
+ * Ethernet header, and the buffers behind it, are word aligned. The CRC,
+ * XOR and copy kernels then take their aligned paths. */
+#ifndef PROTOCOL_LAYER_SHIFT16
+#define PROTOCOL_LAYER_SHIFT16 (0U)
+#endif
+
+/* Descriptor rings: ProtocolLayer_ringConfigure(), before
+ * ProtocolLayer_init(), sets the receive and transmit ring depths, up to
+ * PROTOCOL_LAYER_RING_MAX. SRAM has frame buffers for
+ * PROTOCOL_LAYER_RING_SRAM_RX/TX descriptors, the default depths. With
+ * PROTOCOL_LAYER_RING_PSRAM the buffers of deeper rings can be placed in
+ * the PSRAM from PROTOCOL_LAYER_RING_PSRAM_BASE on, which
+ * ProtocolLayer_init() brings up with BOARD_InitPsRam(); the PSRAM below
+ * the end of the ring buffers is made non-cacheable. */
+#ifndef PROTOCOL_LAYER_RING_MAX
+#define PROTOCOL_LAYER_RING_MAX (64U)
+#endif
+#ifndef PROTOCOL_LAYER_RING_SRAM_RX
+#define PROTOCOL_LAYER_RING_SRAM_RX (4U)
+#endif
+#ifndef PROTOCOL_LAYER_RING_SRAM_TX
+#define PROTOCOL_LAYER_RING_SRAM_TX (4U)
+#endif
+#ifndef PROTOCOL_LAYER_RING_PSRAM
+#define PROTOCOL_LAYER_RING_PSRAM (0U)
+#endif
+#ifndef PROTOCOL_LAYER_RING_PSRAM_BASE
+#define PROTOCOL_LAYER_RING_PSRAM_BASE (0x28000000U)
+#endif
+
+/* Early receive filter: every frame is screened in its receive buffer,
+ * before it is copied, by up to PROTOCOL_LAYER_FILTER_RULES rules on the
+ * source MAC, length field and mode byte (ProtocolLayer_filterAdd()), then
+ * by the header checks that need no key and the peer table. Rejected
+ * frames only cost the peek; a rule can also steer a frame to a
+ * PROTOCOL_LAYER_RXQ class. */
+#ifndef PROTOCOL_LAYER_FILTER
+#define PROTOCOL_LAYER_FILTER (0U)
+#endif
+#ifndef PROTOCOL_LAYER_FILTER_RULES
+#define PROTOCOL_LAYER_FILTER_RULES (8U)
+#endif
+
+/* Receive views: ProtocolLayer_receiveView() hands over a message still
+ * encrypted in its receive buffer, after the integrity, replay and
+ * sequence checks, and ProtocolLayer_viewRead() decrypts only the blocks
+ * of the range read. Takes a PROTOCOL_LAYER_MAX_MESSAGE buffer for the
+ * messages that have to be decoded at once. */
+#ifndef PROTOCOL_LAYER_VIEW
+#define PROTOCOL_LAYER_VIEW (0U)
+#endif
+
+/* 802.1Q tagging of sent frames, VLAN ID PROTOCOL_LAYER_VLAN_ID (0 for
+ * priority tags only) and a priority (PCP) per message: the one given to
+ * ProtocolLayer_sendToPriority(), else the PROTOCOL_LAYER_RXQ_PCP_* of the
+ * traffic class, bulk at 0. The MAC accepts frames of 1522 bytes. Tags of
+ * received frames are always removed. */
+#ifndef PROTOCOL_LAYER_VLAN
+#define PROTOCOL_LAYER_VLAN (0U)
+#endif
+#ifndef PROTOCOL_LAYER_VLAN_ID
+#define PROTOCOL_LAYER_VLAN_ID (0U)
+#endif
+
+/* UDP/IPv4 encapsulation: frames to a peer with a static route
+ * (ProtocolLayer_udpAddRoute(), after ProtocolLayer_init()) are sent in
+ * UDP from PROTOCOL_LAYER_IP_ADDRESS:PROTOCOL_LAYER_UDP_PORT, and UDP
+ * frames to that port are received from any routed peer. Peers without a
+ * route stay on 802.3 frames. There is no ARP: the peers need a static
+ * entry for the board. The 28 header bytes come off the frame, a
+ * PROTOCOL_LAYER_FRAG_CHUNK of at most 1392. */
+#ifndef PROTOCOL_LAYER_UDP
+#define PROTOCOL_LAYER_UDP (0U)
+#endif
+#ifndef PROTOCOL_LAYER_IP_ADDRESS
+#define PROTOCOL_LAYER_IP_ADDRESS {192U, 168U, 0U, 102U}
+#endif
+#ifndef PROTOCOL_LAYER_UDP_PORT
+#define PROTOCOL_LAYER_UDP_PORT (47800U)
+#endif
+#ifndef PROTOCOL_LAYER_IP_TTL
+#define PROTOCOL_LAYER_IP_TTL (64U)
+#endif
+
+/* Peer table: up to PROTOCOL_LAYER_MAX_PEERS peers, each with its own keys
+ * and state, found by MAC address in a hash table of
+ * PROTOCOL_LAYER_PEER_TABLE_SIZE entries (a power of two, at least twice
+ * the number of peers). */
+#ifndef PROTOCOL_LAYER_MAX_PEERS
+#define PROTOCOL_LAYER_MAX_PEERS (4U)
+#endif
+#ifndef PROTOCOL_LAYER_PEER_TABLE_SIZE
+#define PROTOCOL_LAYER_PEER_TABLE_SIZE (8U)
+#endif
+
+/* ELS based backends. Needs the mcuxClEls cipher/CMAC/RNG sources of the
+ * SDK els_pkc component, only the common part is in this project. */
+#ifndef PROTOCOL_LAYER_USE_ELS
+#define PROTOCOL_LAYER_USE_ELS (0U)
+#endif
+
 #endif // _PROTOCOL_LAYER_CFG_H_
 
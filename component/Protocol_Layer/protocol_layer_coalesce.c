@@ -0,0 +1,129 @@
+/*
+This file contains the interrupt moderation policy. The receive interrupt
+and the receive path count interrupts and frames; every
+PROTOCOL_LAYER_COALESCE_PERIOD_MS the idle path turns them into a frame
+rate and picks the setting for the next period. Coalescing starts at
+PROTOCOL_LAYER_COALESCE_ON_FPS and stops below
+PROTOCOL_LAYER_COALESCE_OFF_FPS, so a rate close to one threshold does not
+switch the setting every period.
+
+The batch is the number of frames expected within
+PROTOCOL_LAYER_COALESCE_US, at least 2 and at most maxFrames, which must
+leave the receive ring room for the frames that arrive before the
+interrupt is served. The timer threshold bounds the delay of a frame when
+the traffic stops in the middle of a batch.
+*/
+
+#include <string.h>
+#include "protocol_layer_coalesce.h"
+#include "protocol_layer_backend.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#if (PROTOCOL_LAYER_COALESCE_OFF_FPS > PROTOCOL_LAYER_COALESCE_ON_FPS)
+#error "PROTOCOL_LAYER_COALESCE_OFF_FPS must not exceed PROTOCOL_LAYER_COALESCE_ON_FPS"
+#endif
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static volatile uint32_t s_interrupts;          // written by the receive interrupt
+static uint32_t s_frames;
+static uint32_t s_periodStart;
+static uint32_t s_periodFrames;                 // counts at the start of the period
+static uint32_t s_periodInterrupts;
+static uint8_t s_maxFrames;
+static pl_coalesce_stats_t s_stats;
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Start with an interrupt per frame. maxFrames is the largest batch
+ *         the receive ring can hold. */
+void ProtocolLayer_coalesceInit(uint8_t maxFrames)
+{
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_interrupts = 0;
+    s_frames = 0;
+    s_periodFrames = 0;
+    s_periodInterrupts = 0;
+    s_periodStart = ProtocolLayer_timerTicks();
+    s_maxFrames = maxFrames;
+}
+
+/*! @brief Count a receive interrupt, from the interrupt handler. */
+void ProtocolLayer_coalesceOnIrq(void)
+{
+    s_interrupts++;
+}
+
+/*! @brief Count a frame taken from the receive ring. */
+void ProtocolLayer_coalesceOnFrame(void)
+{
+    s_frames++;
+}
+
+/*! @brief Call it from the receive path; at the end of every period the
+ *         rate is measured and the setting for the next period chosen.
+ *  @return true if the MAC has to be set to the new setting. */
+bool ProtocolLayer_coalesceService(pl_coalesce_setting_t* setting)
+{
+    uint32_t now = ProtocolLayer_timerTicks();
+    uint32_t elapsed = now - s_periodStart;
+    uint32_t periodTicks = (ProtocolLayer_timerHz() / 1000U) * PROTOCOL_LAYER_COALESCE_PERIOD_MS;
+    pl_coalesce_setting_t next = {0U, 0U};
+
+    if (elapsed < periodTicks)
+    {
+        return false;
+    }
+
+    uint32_t interrupts = s_interrupts;
+    uint32_t frames = s_frames - s_periodFrames;
+    uint32_t rate = (uint32_t)(((uint64_t)frames * ProtocolLayer_timerHz()) / elapsed);
+
+    s_stats.irqPerKFrame = (frames != 0U) ? (uint32_t)(((uint64_t)(interrupts - s_periodInterrupts) * 1000U) / frames)
+                                          : 0U;
+    s_stats.rateFps = rate;
+    s_periodStart = now;
+    s_periodFrames = s_frames;
+    s_periodInterrupts = interrupts;
+
+    if ((s_maxFrames >= 2U) &&
+        ((rate >= PROTOCOL_LAYER_COALESCE_ON_FPS) ||
+         ((s_stats.setting.frames != 0U) && (rate >= PROTOCOL_LAYER_COALESCE_OFF_FPS))))
+    {
+        uint32_t batch = (uint32_t)(((uint64_t)rate * PROTOCOL_LAYER_COALESCE_US) / 1000000U);
+
+        batch = (batch < 2U) ? 2U : batch;
+        next.frames = (uint8_t)((batch > s_maxFrames) ? s_maxFrames : batch);
+        next.timeUs = PROTOCOL_LAYER_COALESCE_US;
+    }
+
+    if ((next.frames == s_stats.setting.frames) && (next.timeUs == s_stats.setting.timeUs))
+    {
+        return false;
+    }
+    s_stats.setting = next;
+    *setting = next;
+    return true;
+}
+
+/*! @brief Interrupt and frame counters, for logging. The added latency is
+ *         worked out from the last rate: the first frame of a batch waits
+ *         for the rest of it, or for the timer. */
+void ProtocolLayer_coalesceGetStats(pl_coalesce_stats_t* stats)
+{
+    *stats = s_stats;
+    stats->frames = s_frames;
+    stats->interrupts = s_interrupts;
+    stats->latencyUs = 0U;
+    if (s_stats.setting.frames != 0U)
+    {
+        uint32_t fill = (s_stats.rateFps != 0U)
+                            ? (uint32_t)(((uint64_t)(s_stats.setting.frames - 1U) * 1000000U) / s_stats.rateFps)
+                            : s_stats.setting.timeUs;
+        stats->latencyUs = (fill < s_stats.setting.timeUs) ? fill : s_stats.setting.timeUs;
+    }
+}
@@ -0,0 +1,46 @@
+/*
+This file declares adaptive receive interrupt moderation. At a low frame
+rate every received frame raises an interrupt; once the measured rate
+passes PROTOCOL_LAYER_COALESCE_ON_FPS the MAC is set to interrupt after a
+batch of frames or after PROTOCOL_LAYER_COALESCE_US, with the batch sized
+from the rate so it normally fills within that time.
+*/
+
+#ifndef _PROTOCOL_LAYER_COALESCE_H_
+#define _PROTOCOL_LAYER_COALESCE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* Receive interrupt setting; frames 0 for an interrupt per frame */
+typedef struct
+{
+    uint8_t frames;                 /* ICFT, frame count threshold */
+    uint32_t timeUs;                /* ICTT, timer threshold */
+} pl_coalesce_setting_t;
+
+typedef struct
+{
+    uint32_t frames;                /* frames received */
+    uint32_t interrupts;            /* receive interrupts taken */
+    uint32_t irqPerKFrame;          /* interrupts per 1000 frames, last period */
+    uint32_t rateFps;               /* frames per second, last period */
+    uint32_t latencyUs;             /* longest delay the current setting adds to a frame */
+    pl_coalesce_setting_t setting;  /* current setting */
+} pl_coalesce_stats_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+void ProtocolLayer_coalesceInit(uint8_t maxFrames);
+void ProtocolLayer_coalesceOnIrq(void);
+void ProtocolLayer_coalesceOnFrame(void);
+bool ProtocolLayer_coalesceService(pl_coalesce_setting_t* setting);
+void ProtocolLayer_coalesceGetStats(pl_coalesce_stats_t* stats);
+
+#endif // _PROTOCOL_LAYER_COALESCE_H_
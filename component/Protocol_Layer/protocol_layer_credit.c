@@ -0,0 +1,146 @@
+/*
+This file contains the credit counters. Frames are counted rather than
+credits handed out one by one: the sender numbers the frames that carry a
+payload and the receiver grants a limit, the last count it has processed
+plus PROTOCOL_LAYER_CREDIT_WINDOW. A lost frame or a lost grant is
+corrected by the next one, so the two sides never drift apart.
+
+Frames without a payload (pure ACKs and credit updates) are not counted;
+the window leaves one receive descriptor free for them. A receiver that
+has processed half a window without sending anything sends a credit-only
+frame. A sender out of credits sets the probe bit in its frames, at most
+every PROTOCOL_LAYER_CREDIT_PROBE_MS, in case a grant was lost.
+*/
+
+#include <string.h>
+#include "protocol_layer_credit.h"
+#include "protocol_layer_backend.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#if ((PROTOCOL_LAYER_CREDIT_WINDOW == 0U) || (PROTOCOL_LAYER_CREDIT_WINDOW >= (PL_CREDIT_MASK / 2U)))
+#error "PROTOCOL_LAYER_CREDIT_WINDOW out of range"
+#endif
+
+/* Difference of two 15-bit frame counts */
+#define COUNT_DIFF(a, b)       ((int16_t)(uint16_t)(((a) - (b)) << 1) / 2)
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+/*! @brief Frames the peer accepts before the next grant. */
+static int16_t Available(const pl_credit_t* credit)
+{
+    return COUNT_DIFF(credit->txLimit, credit->txCount);
+}
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Reset the counters; both sides start with one window of credits. */
+void ProtocolLayer_creditInit(pl_credit_t* credit)
+{
+    memset(credit, 0, sizeof(*credit));
+    credit->txLimit = PROTOCOL_LAYER_CREDIT_WINDOW;
+    credit->advertised = PROTOCOL_LAYER_CREDIT_WINDOW;
+}
+
+/*! @brief Call it from the idle loop.
+ *  @return true when a credit-only frame has to be sent: the peer asked for
+ *          one, half a window was freed since the last grant, or this side
+ *          is stalled and due to probe. */
+bool ProtocolLayer_creditService(pl_credit_t* credit)
+{
+    uint16_t limit = (uint16_t)((credit->rxCount + PROTOCOL_LAYER_CREDIT_WINDOW) & PL_CREDIT_MASK);
+    uint32_t probeTicks = (ProtocolLayer_timerHz() / 1000U) * PROTOCOL_LAYER_CREDIT_PROBE_MS;
+
+    if (credit->updateNow ||
+        (COUNT_DIFF(limit, credit->advertised) >= (int16_t)((PROTOCOL_LAYER_CREDIT_WINDOW + 1U) / 2U)) ||
+        (credit->stalled && ((ProtocolLayer_timerTicks() - credit->probeTick) >= probeTicks)))
+    {
+        credit->stats.updates++;
+        return true;
+    }
+    return false;
+}
+
+/*! @brief True if the peer accepts that many more frames. When it does not,
+ *         the sender is stalled and starts probing for a lost grant. */
+bool ProtocolLayer_creditAvailable(pl_credit_t* credit, uint32_t frames)
+{
+    if (Available(credit) >= (int16_t)frames)
+    {
+        return true;
+    }
+    if (!credit->stalled)
+    {
+        credit->stalled = true;
+        credit->probeTick = ProtocolLayer_timerTicks();
+        credit->stats.stalls++;
+    }
+    return false;
+}
+
+/*! @brief Serialize the credit extension of a frame being sent.
+ *  @param charge true for a frame with a payload, which uses one credit. */
+void ProtocolLayer_creditWrite(pl_credit_t* credit, uint8_t* ext, bool charge)
+{
+    uint16_t count;
+
+    if (charge)
+    {
+        credit->txCount = (uint16_t)((credit->txCount + 1U) & PL_CREDIT_MASK);
+    }
+    count = credit->txCount;
+    if (credit->stalled)
+    {
+        count |= PL_CREDIT_PROBE;
+        credit->probeTick = ProtocolLayer_timerTicks();
+    }
+    credit->advertised = (uint16_t)((credit->rxCount + PROTOCOL_LAYER_CREDIT_WINDOW) & PL_CREDIT_MASK);
+    credit->updateNow = false;
+
+    ext[0] = (uint8_t)(count & 0xFFU);
+    ext[1] = (uint8_t)(count >> 8);
+    ext[2] = (uint8_t)(credit->advertised & 0xFFU);
+    ext[3] = (uint8_t)(credit->advertised >> 8);
+}
+
+/*! @brief Process the credit extension of a received frame, once the frame
+ *         is out of the receive ring. */
+void ProtocolLayer_creditOnFrame(pl_credit_t* credit, const uint8_t* ext)
+{
+    uint16_t count = (uint16_t)(ext[0] | (ext[1] << 8));
+    uint16_t limit = (uint16_t)((ext[2] | (ext[3] << 8)) & PL_CREDIT_MASK);
+
+    if ((count & PL_CREDIT_PROBE) != 0U)
+    {
+        credit->updateNow = true;
+        credit->stats.probes++;
+    }
+    count &= PL_CREDIT_MASK;
+
+    // Counts only move forward, an older frame changes nothing
+    if (COUNT_DIFF(count, credit->rxCount) > 0)
+    {
+        credit->rxCount = count;
+    }
+    if (COUNT_DIFF(limit, credit->txLimit) > 0)
+    {
+        credit->txLimit = limit;
+    }
+    if (credit->stalled && (Available(credit) > 0))
+    {
+        credit->stalled = false;
+    }
+}
+
+/*! @brief Credit counters of a peer, for logging. */
+void ProtocolLayer_creditGetStats(const pl_credit_t* credit, pl_credit_stats_t* stats)
+{
+    int16_t available = Available(credit);
+
+    *stats = credit->stats;
+    stats->available = (available > 0) ? (uint32_t)available : 0U;
+}
@@ -0,0 +1,62 @@
+/*
+This file declares credit-based flow control. Each side tells the other,
+in every frame, how many frames it may still send before the receive
+descriptors run out, and the sender stops when its credits are used up
+instead of overrunning the peer's receive ring.
+*/
+
+#ifndef _PROTOCOL_LAYER_CREDIT_H_
+#define _PROTOCOL_LAYER_CREDIT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* Credit extension, 2 x 2 bytes little endian:
+ *   count  frames with a payload sent so far, this one included (15 bits);
+ *          bit 15 set when the sender is out of credits and asks for an update
+ *   limit  count up to which the sender of this frame accepts frames */
+#define PL_EXT_CREDIT_SIZE     (4)
+#define PL_CREDIT_PROBE        (0x8000U)
+#define PL_CREDIT_MASK         (0x7FFFU)
+
+typedef struct
+{
+    uint32_t available;     /* frames the peer accepts right now */
+    uint32_t stalls;        /* sends refused for lack of credits */
+    uint32_t updates;       /* credit-only frames sent */
+    uint32_t probes;        /* credit updates requested by the peer */
+} pl_credit_stats_t;
+
+/* Credit counters of one peer */
+typedef struct
+{
+    /* Send side */
+    uint16_t txCount;               /* frames with a payload sent */
+    uint16_t txLimit;               /* granted by the peer */
+    bool stalled;
+    uint32_t probeTick;
+
+    /* Receive side */
+    uint16_t rxCount;               /* newest count of the peer processed */
+    uint16_t advertised;            /* last limit sent to the peer */
+    bool updateNow;                 /* the peer asked for an update */
+
+    pl_credit_stats_t stats;
+} pl_credit_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+void ProtocolLayer_creditInit(pl_credit_t* credit);
+bool ProtocolLayer_creditService(pl_credit_t* credit);
+bool ProtocolLayer_creditAvailable(pl_credit_t* credit, uint32_t frames);
+void ProtocolLayer_creditWrite(pl_credit_t* credit, uint8_t* ext, bool charge);
+void ProtocolLayer_creditOnFrame(pl_credit_t* credit, const uint8_t* ext);
+void ProtocolLayer_creditGetStats(const pl_credit_t* credit, pl_credit_stats_t* stats);
+
+#endif // _PROTOCOL_LAYER_CREDIT_H_
@@ -0,0 +1,344 @@
+/*
+This file contains the XOR parity groups. The send side XORs every frame
+into one accumulator as it goes out, 16 bytes at a time, and hands the
+accumulator to the send path as the parity frame. The receive side keeps
+PROTOCOL_LAYER_FEC_SLOTS groups: each received frame of a group is XORed
+into its slot, and once the parity frame and all but one data frame have
+arrived the slot holds the missing frame. The rebuilt frame goes through
+the normal receive path, so its own trailer still verifies it.
+
+Parity covers whole frames rather than the ciphertext alone: the rebuilt
+frame then has its header and extensions back, and nothing has to be
+trusted before its integrity check.
+*/
+
+#include <string.h>
+#include "protocol_layer_fec.h"
+#include "protocol_layer_backend.h"
+#include "protocol_layer_simd.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#if ((PROTOCOL_LAYER_FEC_GROUP < 2U) || (PROTOCOL_LAYER_FEC_GROUP > PL_FEC_GROUP_MAX))
+#error "PROTOCOL_LAYER_FEC_GROUP out of range"
+#endif
+
+#define FEC_ACC_SIZE           (PL_FEC_LENGTH_SIZE + PL_FEC_SEGMENT_MAX)
+#define FEC_MAC_SIZE           (12U)    /* destination and source MAC */
+#define FEC_NO_SLOT            (0xFFU)
+
+/* Receive state of one group */
+typedef struct
+{
+    bool used;
+    bool done;                      /* complete or rebuilt, late frames are dropped */
+    uint8_t peer;
+    uint8_t count;                  /* data frames, 0 until the parity frame arrives */
+    uint16_t group;
+    uint16_t received;              /* bit n: data frame n */
+    uint32_t age;
+    uint8_t mac[FEC_MAC_SIZE];
+    size_t length;                  /* accumulator bytes in use */
+    uint8_t acc[FEC_ACC_SIZE];
+} fec_slot_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+/* Send side */
+static uint16_t s_txGroup;
+static uint8_t s_txIndex;
+static uint32_t s_txStart;
+static size_t s_txLength;
+static uint8_t s_txAcc[FEC_ACC_SIZE];
+
+/* Receive side */
+static fec_slot_t s_slots[PROTOCOL_LAYER_FEC_SLOTS];
+static uint32_t s_age;
+static uint8_t s_ready = FEC_NO_SLOT;
+
+static pl_fec_stats_t s_stats;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+/*! @brief dst ^= src, with the word-wide XOR for the whole blocks. */
+static void XorInto(uint8_t* dst, const uint8_t* src, size_t length)
+{
+    size_t i = 0;
+
+    for (; (i + PL_BLOCK_SIZE) <= length; i += PL_BLOCK_SIZE)
+    {
+        PL_Xor16(&dst[i], &src[i]);
+    }
+    for (; i < length; i++)
+    {
+        dst[i] ^= src[i];
+    }
+}
+
+/*! @brief XOR one frame, its length first, into an accumulator. */
+static void Accumulate(uint8_t* acc, size_t* used, const uint8_t* segment, size_t length)
+{
+    acc[0] ^= (uint8_t)(length & 0xFFU);
+    acc[1] ^= (uint8_t)(length >> 8);
+    XorInto(&acc[PL_FEC_LENGTH_SIZE], segment, length);
+    if ((PL_FEC_LENGTH_SIZE + length) > *used)
+    {
+        *used = PL_FEC_LENGTH_SIZE + length;
+    }
+}
+
+/*! @brief Number of bits set. */
+static uint8_t CountBits(uint16_t bits)
+{
+    uint8_t count = 0;
+
+    for (; bits != 0U; bits &= (uint16_t)(bits - 1U))
+    {
+        count++;
+    }
+    return count;
+}
+
+/*! @brief Slot of a group, a new one (the oldest is reused) if the group is
+ *         not known yet. */
+static fec_slot_t* FindSlot(uint8_t peer, const uint8_t* frame, uint16_t group)
+{
+    fec_slot_t* slot = &s_slots[0];
+
+    for (uint8_t i = 0; i < PROTOCOL_LAYER_FEC_SLOTS; i++)
+    {
+        fec_slot_t* candidate = &s_slots[i];
+
+        if (candidate->used && (candidate->peer == peer) && (candidate->group == group))
+        {
+            return candidate;
+        }
+        if (!candidate->used ? slot->used : (slot->used && (candidate->age < slot->age)))
+        {
+            slot = candidate;
+        }
+    }
+
+    if (slot->used && !slot->done && (slot->count != 0U) && ((CountBits(slot->received) + 1U) < slot->count))
+    {
+        s_stats.unrecoverable++;
+    }
+    memset(slot, 0, sizeof(*slot));
+    slot->used = true;
+    slot->peer = peer;
+    slot->group = group;
+    slot->age = s_age++;
+    memcpy(slot->mac, frame, FEC_MAC_SIZE);
+    return slot;
+}
+
+/*! @brief Close a group once its parity frame is in: free it when nothing
+ *         is missing, mark the missing frame ready when only one is. */
+static void CheckSlot(fec_slot_t* slot)
+{
+    uint8_t present = CountBits(slot->received);
+    size_t length = (size_t)slot->acc[0] | ((size_t)slot->acc[1] << 8);
+
+    if ((slot->count == 0U) || slot->done)
+    {
+        return;
+    }
+    if (present >= slot->count)
+    {
+        slot->done = true;
+        return;
+    }
+    if ((present + 1U) < slot->count)
+    {
+        return;
+    }
+
+    // The accumulator now holds the missing frame; a length that cannot be
+    // right means the group mixed frames that do not belong together
+    slot->done = true;
+    if ((length == 0U) || ((PL_FEC_LENGTH_SIZE + length) > slot->length))
+    {
+        s_stats.unrecoverable++;
+        return;
+    }
+    for (uint8_t index = 0; index < slot->count; index++)
+    {
+        if ((slot->received & (1U << index)) == 0U)
+        {
+            slot->received |= (uint16_t)(1U << index);
+            break;
+        }
+    }
+    s_ready = (uint8_t)(slot - s_slots);
+}
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Reset both sides. */
+void ProtocolLayer_fecInit(void)
+{
+    s_txGroup = 0;
+    s_txIndex = 0;
+    s_txLength = 0;
+    memset(s_txAcc, 0, sizeof(s_txAcc));
+    memset(s_slots, 0, sizeof(s_slots));
+    s_ready = FEC_NO_SLOT;
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+/*! @brief Serialize the FEC extension of the next data frame. */
+void ProtocolLayer_fecWrite(uint8_t* ext)
+{
+    ext[0] = (uint8_t)(s_txGroup & 0xFFU);
+    ext[1] = (uint8_t)(s_txGroup >> 8);
+    ext[2] = s_txIndex;
+    ext[3] = 0;
+}
+
+/*! @brief Add a frame just sent, from its protocol header to its trailer. */
+void ProtocolLayer_fecAdd(const uint8_t* segment, size_t length)
+{
+    if (s_txIndex == 0U)
+    {
+        s_txStart = ProtocolLayer_timerTicks();
+    }
+    Accumulate(s_txAcc, &s_txLength, segment, length);
+    s_txIndex++;
+}
+
+/*! @brief Data frames in the open group. */
+size_t ProtocolLayer_fecQueued(void)
+{
+    return s_txIndex;
+}
+
+/*! @brief True when the open group is full or its deadline has passed. */
+bool ProtocolLayer_fecDue(void)
+{
+    uint32_t deadlineTicks = (ProtocolLayer_timerHz() / 1000000U) * PROTOCOL_LAYER_FEC_DEADLINE_US;
+
+    return (s_txIndex >= PROTOCOL_LAYER_FEC_GROUP) ||
+           ((s_txIndex != 0U) && ((ProtocolLayer_timerTicks() - s_txStart) >= deadlineTicks));
+}
+
+/*! @brief Close the open group: write the extension and the payload of its
+ *         parity frame and start the next group.
+ *  @return parity payload length, 0 if the group is empty. */
+size_t ProtocolLayer_fecParity(uint8_t* ext, uint8_t* parity)
+{
+    size_t length = s_txLength;
+
+    if (s_txIndex == 0U)
+    {
+        return 0;
+    }
+    ext[0] = (uint8_t)(s_txGroup & 0xFFU);
+    ext[1] = (uint8_t)(s_txGroup >> 8);
+    ext[2] = s_txIndex;
+    ext[3] = s_txIndex;
+    memcpy(parity, s_txAcc, length);
+
+    memset(s_txAcc, 0, length);
+    s_txLength = 0;
+    s_txIndex = 0;
+    s_txGroup++;
+    s_stats.paritySent++;
+    return length;
+}
+
+/*! @brief True if the extension is the one of a parity frame. */
+bool ProtocolLayer_fecIsParity(const uint8_t* ext)
+{
+    return ext[3] != 0U;
+}
+
+/*! @brief Record an authenticated data frame before it is decrypted. With
+ *         PROTOCOL_LAYER_ANTI_REPLAY the frame has passed its replay check,
+ *         so a copy never gets here to reopen or refill a group.
+ *  @param frame the received frame, for its MAC addresses
+ *  @return false if the frame was already rebuilt and must be dropped. */
+bool ProtocolLayer_fecOnData(uint8_t peer, const uint8_t* frame, const uint8_t* ext, const uint8_t* segment,
+                             size_t length)
+{
+    uint16_t group = (uint16_t)(ext[0] | (ext[1] << 8));
+    uint8_t index = ext[2];
+
+    if ((index >= PL_FEC_GROUP_MAX) || (length > PL_FEC_SEGMENT_MAX))
+    {
+        return true;
+    }
+
+    fec_slot_t* slot = FindSlot(peer, frame, group);
+    if ((slot->received & (1U << index)) != 0U)
+    {
+        return !slot->done;
+    }
+    slot->received |= (uint16_t)(1U << index);
+    Accumulate(slot->acc, &slot->length, segment, length);
+    CheckSlot(slot);
+    return true;
+}
+
+/*! @brief Record an authenticated parity frame. */
+void ProtocolLayer_fecOnParity(uint8_t peer, const uint8_t* frame, const uint8_t* ext, const uint8_t* parity,
+                               size_t length)
+{
+    uint16_t group = (uint16_t)(ext[0] | (ext[1] << 8));
+    uint8_t count = ext[3];
+
+    if ((count > PL_FEC_GROUP_MAX) || (length > FEC_ACC_SIZE))
+    {
+        return;
+    }
+
+    fec_slot_t* slot = FindSlot(peer, frame, group);
+    if (slot->count != 0U)
+    {
+        return;
+    }
+    s_stats.parityReceived++;
+    slot->count = count;
+    XorInto(slot->acc, parity, length);
+    if (length > slot->length)
+    {
+        slot->length = length;
+    }
+    CheckSlot(slot);
+}
+
+/*! @brief Length of the Ethernet frame waiting to be rebuilt, 0 if none. */
+size_t ProtocolLayer_fecPending(void)
+{
+    if (s_ready == FEC_NO_SLOT)
+    {
+        return 0;
+    }
+    const fec_slot_t* slot = &s_slots[s_ready];
+    return FEC_MAC_SIZE + PL_FEC_LENGTH_SIZE + ((size_t)slot->acc[0] | ((size_t)slot->acc[1] << 8));
+}
+
+/*! @brief Copy the rebuilt frame, MAC addresses and length field included,
+ *         into a buffer of ProtocolLayer_fecPending() bytes. */
+void ProtocolLayer_fecRebuild(uint8_t* frame)
+{
+    const fec_slot_t* slot = &s_slots[s_ready];
+    size_t length = (size_t)slot->acc[0] | ((size_t)slot->acc[1] << 8);
+
+    memcpy(frame, slot->mac, FEC_MAC_SIZE);
+    // Length field in network order
+    frame[FEC_MAC_SIZE] = (uint8_t)(length >> 8);
+    frame[FEC_MAC_SIZE + 1U] = (uint8_t)(length & 0xFFU);
+    memcpy(&frame[FEC_MAC_SIZE + PL_FEC_LENGTH_SIZE], &slot->acc[PL_FEC_LENGTH_SIZE], length);
+    s_ready = FEC_NO_SLOT;
+    s_stats.rebuilt++;
+}
+
+/*! @brief FEC counters, for logging. */
+void ProtocolLayer_fecGetStats(pl_fec_stats_t* stats)
+{
+    *stats = s_stats;
+}
@@ -0,0 +1,61 @@
+/*
+This file declares forward error correction with XOR parity. After every
+PROTOCOL_LAYER_FEC_GROUP frames sent to a peer, or when the group deadline
+expires, a parity frame carries the XOR of the frames of the group, so the
+receiver rebuilds one lost frame per group without waiting a round trip for
+a retransmission.
+*/
+
+#ifndef _PROTOCOL_LAYER_FEC_H_
+#define _PROTOCOL_LAYER_FEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* FEC extension, 4 bytes:
+ *   group  group number, 2 bytes little endian
+ *   index  position of the frame in the group
+ *   count  0 in a data frame; in the parity frame, the number of data
+ *          frames it covers
+ * The payload of a parity frame is not encrypted: it is the XOR of the
+ * lengths (2 bytes little endian) and of the protected bytes (header,
+ * ciphertext and trailer) of the frames of the group. */
+#define PL_EXT_FEC_SIZE        (4)
+#define PL_FEC_LENGTH_SIZE     (2)
+#define PL_FEC_SEGMENT_MAX     (1500U)  /* Ethernet payload */
+#define PL_FEC_GROUP_MAX       (16U)
+
+typedef struct
+{
+    uint32_t paritySent;    /* parity frames sent */
+    uint32_t parityReceived;/* parity frames received */
+    uint32_t rebuilt;       /* lost frames rebuilt from a parity frame */
+    uint32_t unrecoverable; /* groups dropped with more than one frame lost */
+} pl_fec_stats_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+void ProtocolLayer_fecInit(void);
+
+void ProtocolLayer_fecWrite(uint8_t* ext);
+void ProtocolLayer_fecAdd(const uint8_t* segment, size_t length);
+size_t ProtocolLayer_fecQueued(void);
+bool ProtocolLayer_fecDue(void);
+size_t ProtocolLayer_fecParity(uint8_t* ext, uint8_t* parity);
+
+bool ProtocolLayer_fecIsParity(const uint8_t* ext);
+bool ProtocolLayer_fecOnData(uint8_t peer, const uint8_t* frame, const uint8_t* ext, const uint8_t* segment,
+                             size_t length);
+void ProtocolLayer_fecOnParity(uint8_t peer, const uint8_t* frame, const uint8_t* ext, const uint8_t* parity,
+                               size_t length);
+size_t ProtocolLayer_fecPending(void);
+void ProtocolLayer_fecRebuild(uint8_t* frame);
+void ProtocolLayer_fecGetStats(pl_fec_stats_t* stats);
+
+#endif // _PROTOCOL_LAYER_FEC_H_
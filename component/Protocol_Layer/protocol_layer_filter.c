@@ -0,0 +1,109 @@
+/*
+This file contains the early receive filter. Rules are kept in the order
+they were added and the first one whose fields all match decides; a frame
+no rule matches passes on to the header and sender checks of the receive
+path, which report their drops here so one set of counters covers every
+frame rejected before its copy.
+*/
+
+#include <string.h>
+#include "protocol_layer_filter.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#if (PROTOCOL_LAYER_FILTER_RULES == 0U) || (PROTOCOL_LAYER_FILTER_RULES > 255U)
+#error "PROTOCOL_LAYER_FILTER_RULES must be 1 to 255"
+#endif
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static pl_filter_rule_t s_rules[PROTOCOL_LAYER_FILTER_RULES];
+static uint8_t s_count;
+static pl_filter_stats_t s_stats;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+static bool Matches(const pl_filter_rule_t* rule, const uint8_t* srcMac, uint16_t lengthField, uint8_t mode)
+{
+    if (((rule->match & PL_FILTER_MATCH_SRC) != 0U) && (memcmp(rule->srcMac, srcMac, sizeof(rule->srcMac)) != 0))
+    {
+        return false;
+    }
+    if (((rule->match & PL_FILTER_MATCH_LENGTH) != 0U) &&
+        ((lengthField < rule->minLength) || (lengthField > rule->maxLength)))
+    {
+        return false;
+    }
+    if (((rule->match & PL_FILTER_MATCH_MODE) != 0U) && (mode != rule->mode))
+    {
+        return false;
+    }
+    return true;
+}
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Empty the rule table and the counters. */
+void ProtocolLayer_filterInit(void)
+{
+    s_count = 0;
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+/*! @brief Append a rule, checked after the ones already in the table.
+ *  @return false if the table is full or the action unknown. */
+bool ProtocolLayer_filterAdd(const pl_filter_rule_t* rule)
+{
+    if ((s_count == PROTOCOL_LAYER_FILTER_RULES) || (rule->action >= kPL_Filter_Num))
+    {
+        return false;
+    }
+    s_rules[s_count++] = *rule;
+    return true;
+}
+
+/*! @brief Remove every rule. */
+void ProtocolLayer_filterClear(void)
+{
+    s_count = 0;
+}
+
+/*! @brief Verdict of the first matching rule on the header fields of a frame.
+ *  @return kPL_Filter_Pass if no rule matches. */
+uint8_t ProtocolLayer_filterCheck(const uint8_t* srcMac, uint16_t lengthField, uint8_t mode)
+{
+    s_stats.screened++;
+    for (uint8_t i = 0; i < s_count; i++)
+    {
+        if (Matches(&s_rules[i], srcMac, lengthField, mode))
+        {
+            if (s_rules[i].action == kPL_Filter_Drop)
+            {
+                s_stats.dropped++;
+            }
+            else if (s_rules[i].action != kPL_Filter_Pass)
+            {
+                s_stats.steered++;
+            }
+            return s_rules[i].action;
+        }
+    }
+    return kPL_Filter_Pass;
+}
+
+/*! @brief Count a frame that passed the rules and failed the header or
+ *         sender checks. */
+void ProtocolLayer_filterOnReject(void)
+{
+    s_stats.rejected++;
+}
+
+/*! @brief Filter counters, for logging. */
+void ProtocolLayer_filterGetStats(pl_filter_stats_t* stats)
+{
+    *stats = s_stats;
+}
@@ -0,0 +1,64 @@
+/*
+This file declares the early receive filter: a small table of rules on
+the source MAC address, the length field and the mode byte of a frame,
+checked on the header bytes while the frame is still in its receive
+descriptor. A rule drops the frame or steers it to a receive class
+before any copy, integrity check or decryption is spent on it.
+*/
+
+#ifndef _PROTOCOL_LAYER_FILTER_H_
+#define _PROTOCOL_LAYER_FILTER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* Fields a rule compares, any combination; a rule without one matches all */
+#define PL_FILTER_MATCH_SRC    (0x01U)  // source MAC address equals srcMac
+#define PL_FILTER_MATCH_LENGTH (0x02U)  // length field within minLength..maxLength
+#define PL_FILTER_MATCH_MODE   (0x04U)  // mode byte equals mode
+
+/* Verdict on a frame; the steering ones follow the receive class order */
+typedef enum
+{
+    kPL_Filter_Pass = 0,            /* no rule matched: the usual header and sender checks */
+    kPL_Filter_Drop,                /* dropped in the descriptor */
+    kPL_Filter_Control,             /* steered to the control class */
+    kPL_Filter_Telemetry,           /* steered to the telemetry class */
+    kPL_Filter_Bulk,                /* steered to the bulk class */
+    kPL_Filter_Num
+} pl_filter_action_t;
+
+typedef struct
+{
+    uint8_t match;                  /* PL_FILTER_MATCH_* */
+    uint8_t action;                 /* pl_filter_action_t of a matching frame */
+    uint8_t srcMac[6];
+    uint16_t minLength;             /* length field range, inclusive */
+    uint16_t maxLength;
+    uint8_t mode;
+} pl_filter_rule_t;
+
+typedef struct
+{
+    uint32_t screened;              /* frames looked at */
+    uint32_t dropped;               /* dropped by a rule */
+    uint32_t rejected;              /* dropped by the header or sender checks */
+    uint32_t steered;               /* steered to a class by a rule */
+} pl_filter_stats_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+void ProtocolLayer_filterInit(void);
+bool ProtocolLayer_filterAdd(const pl_filter_rule_t* rule);
+void ProtocolLayer_filterClear(void);
+uint8_t ProtocolLayer_filterCheck(const uint8_t* srcMac, uint16_t lengthField, uint8_t mode);
+void ProtocolLayer_filterOnReject(void);
+void ProtocolLayer_filterGetStats(pl_filter_stats_t* stats);
+
+#endif // _PROTOCOL_LAYER_FILTER_H_
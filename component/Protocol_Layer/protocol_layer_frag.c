@@ -0,0 +1,275 @@
+/*
+This file contains the reassembly table. Every slot owns one message buffer
+of PROTOCOL_LAYER_MAX_MESSAGE bytes, so the memory used is fixed at build
+time. A fragment is stored as received, still encrypted, at its final
+offset (index times PROTOCOL_LAYER_FRAG_CHUNK) in any order, together with
+its IV and key epoch; a bitmap tracks which fragments have arrived. Only
+the last fragment is padded, so the chunks of a message line up without
+gaps. Messages are told apart by the sending peer and the message ID.
+
+The slot cannot be the caller's message buffer: fragments of one message
+arrive over several receive calls, and the buffer is handed back with
+other messages in between. What the slot saves is the decrypt pass: once
+the message is complete, it is decrypted in one pass from the slot straight
+into the caller's buffer, with no plaintext copy in the slot.
+*/
+#include <string.h>
+#include "protocol_layer_frag.h"
+#include "protocol_layer_backend.h"
+#include "protocol_layer_simd.h"
+#include "aes.h"        // libray from https://github.com/kokke/tiny-AES-c
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#if (PL_FRAG_MAX_COUNT > 32U)
+#error "PROTOCOL_LAYER_MAX_MESSAGE / PROTOCOL_LAYER_FRAG_CHUNK must not exceed 32 fragments"
+#endif
+#if ((PROTOCOL_LAYER_FRAG_CHUNK % AES_BLOCKLEN) != 0)
+#error "PROTOCOL_LAYER_FRAG_CHUNK must be a multiple of the AES block size"
+#endif
+
+typedef struct
+{
+    bool used;
+    uint8_t peer;                   /* index of the sending peer */
+    uint16_t msgId;
+    uint8_t count;
+    uint32_t received;              /* bit n set when fragment n is in place */
+    uint32_t epochs;                /* bit n set when fragment n uses key epoch 1 */
+    size_t lastLength;              /* ciphertext bytes of the last fragment */
+    uint32_t start;                 /* timer ticks of the first fragment */
+    uint8_t ivs[PL_FRAG_MAX_COUNT][AES_BLOCKLEN];
+    /* Ciphertext; spare block for the padding of the last fragment */
+    uint8_t buffer[PROTOCOL_LAYER_MAX_MESSAGE + AES_BLOCKLEN];
+} reasm_slot_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static reasm_slot_t s_slots[PROTOCOL_LAYER_REASM_SLOTS];
+static pl_reasm_stats_t s_stats;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+/*! @brief True once a message has waited PROTOCOL_LAYER_REASM_TIMEOUT_MS. */
+static bool Expired(const reasm_slot_t* slot, uint32_t now)
+{
+    uint32_t timeoutTicks = (ProtocolLayer_timerHz() / 1000U) * PROTOCOL_LAYER_REASM_TIMEOUT_MS;
+
+    return (now - slot->start) >= timeoutTicks;
+}
+
+/*! @brief Slot of a message in progress, or NULL. */
+static reasm_slot_t* FindSlot(uint8_t peer, uint16_t msgId)
+{
+    for (uint8_t i = 0; i < PROTOCOL_LAYER_REASM_SLOTS; i++)
+    {
+        if (s_slots[i].used && (s_slots[i].peer == peer) && (s_slots[i].msgId == msgId))
+        {
+            return &s_slots[i];
+        }
+    }
+    return NULL;
+}
+
+/*! @brief Free slot for a new message; an expired message is dropped to make
+ *         room, a message still in time never is. */
+static reasm_slot_t* AllocSlot(void)
+{
+    uint32_t now = ProtocolLayer_timerTicks();
+
+    for (uint8_t i = 0; i < PROTOCOL_LAYER_REASM_SLOTS; i++)
+    {
+        if (!s_slots[i].used)
+        {
+            return &s_slots[i];
+        }
+    }
+    for (uint8_t i = 0; i < PROTOCOL_LAYER_REASM_SLOTS; i++)
+    {
+        if (Expired(&s_slots[i], now))
+        {
+            s_stats.timeouts++;
+            return &s_slots[i];
+        }
+    }
+    return NULL;
+}
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Serialize a fragment extension. */
+void ProtocolLayer_fragWrite(uint8_t* ext, const pl_frag_t* frag)
+{
+    ext[0] = (uint8_t)(frag->msgId & 0xFFU);
+    ext[1] = (uint8_t)(frag->msgId >> 8);
+    ext[2] = frag->index;
+    ext[3] = frag->count;
+}
+
+/*! @brief Parse a fragment extension. */
+void ProtocolLayer_fragRead(const uint8_t* ext, pl_frag_t* frag)
+{
+    frag->msgId = (uint16_t)(ext[0] | (ext[1] << 8));
+    frag->index = ext[2];
+    frag->count = ext[3];
+}
+
+/*! @brief Empty the reassembly table. */
+void ProtocolLayer_reasmInit(void)
+{
+    for (uint8_t i = 0; i < PROTOCOL_LAYER_REASM_SLOTS; i++)
+    {
+        s_slots[i].used = false;
+    }
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+/*! @brief Drop the messages that did not complete in time, call it from the
+ *         idle loop. */
+void ProtocolLayer_reasmService(void)
+{
+    uint32_t now = ProtocolLayer_timerTicks();
+
+    for (uint8_t i = 0; i < PROTOCOL_LAYER_REASM_SLOTS; i++)
+    {
+        if (s_slots[i].used && Expired(&s_slots[i], now))
+        {
+            s_slots[i].used = false;
+            s_stats.timeouts++;
+        }
+    }
+}
+
+/*! @brief Store a fragment, still encrypted, in the reassembly table.
+ *  @param cipher ciphertext of the fragment, length bytes, a multiple of
+ *         AES_BLOCKLEN.
+ *  @param epoch key epoch the fragment was encrypted with.
+ *  @return false if the fragment is invalid, a duplicate, or there is no
+ *          room; it is then not stored. */
+bool ProtocolLayer_reasmAdd(uint8_t peer, const pl_frag_t* frag, const uint8_t* cipher, size_t length,
+                            const uint8_t* iv, uint8_t epoch)
+{
+    bool last = ((frag->index + 1U) == frag->count);
+    reasm_slot_t* slot;
+
+    // Every fragment but the last is exactly one chunk, the last one is padded
+    if ((frag->count < 2U) || (frag->count > PL_FRAG_MAX_COUNT) || (frag->index >= frag->count) ||
+        (!last && (length != PROTOCOL_LAYER_FRAG_CHUNK)) ||
+        (last && ((length == 0U) || ((length % AES_BLOCKLEN) != 0U) ||
+                  (length > (PROTOCOL_LAYER_FRAG_CHUNK + AES_BLOCKLEN)))) ||
+        ((((size_t)frag->index * PROTOCOL_LAYER_FRAG_CHUNK) + length) > sizeof(s_slots[0].buffer)))
+    {
+        s_stats.dropped++;
+        return false;
+    }
+
+    slot = FindSlot(peer, frag->msgId);
+    if (slot == NULL)
+    {
+        slot = AllocSlot();
+        if (slot == NULL)
+        {
+            s_stats.dropped++;
+            return false;
+        }
+        slot->used = true;
+        slot->peer = peer;
+        slot->msgId = frag->msgId;
+        slot->count = frag->count;
+        slot->received = 0;
+        slot->epochs = 0;
+        slot->lastLength = 0;
+        slot->start = ProtocolLayer_timerTicks();
+    }
+
+    if ((slot->count != frag->count) || ((slot->received & (1UL << frag->index)) != 0U))
+    {
+        s_stats.dropped++;
+        return false;
+    }
+
+    memcpy(&slot->buffer[(size_t)frag->index * PROTOCOL_LAYER_FRAG_CHUNK], cipher, length);
+    memcpy(slot->ivs[frag->index], iv, AES_BLOCKLEN);
+    slot->received |= (1UL << frag->index);
+    slot->epochs |= ((epoch != 0U) ? (1UL << frag->index) : 0U);
+    if (last)
+    {
+        slot->lastLength = length;
+    }
+    return true;
+}
+
+/*! @brief Decrypt a complete message into dst, which must hold
+ *         PROTOCOL_LAYER_MAX_MESSAGE bytes, and free its slot.
+ *
+ * Each fragment is decrypted with the key of its own epoch, so a rekey in
+ * the middle of a message is fine. The padded last block goes through a
+ * block on the stack, so nothing is written past the plaintext.
+ *  @return length of the message; 0 while fragments are still missing, or
+ *          if the padding is wrong or a key has expired since. */
+size_t ProtocolLayer_reasmDeliver(uint8_t peer, uint16_t msgId, pl_keyring_t* keys, uint8_t* dst)
+{
+    reasm_slot_t* slot = FindSlot(peer, msgId);
+    uint32_t all;
+    size_t total;
+    uint8_t block[AES_BLOCKLEN];
+    uint8_t padValue;
+
+    if (slot == NULL)
+    {
+        return 0;
+    }
+    all = (slot->count >= 32U) ? 0xFFFFFFFFUL : ((1UL << slot->count) - 1U);
+    if (slot->received != all)
+    {
+        return 0;
+    }
+
+    slot->used = false;
+    total = ((size_t)(slot->count - 1U) * PROTOCOL_LAYER_FRAG_CHUNK) + slot->lastLength;
+    for (uint8_t i = 0; i < slot->count; i++)
+    {
+        pl_session_t* session = ProtocolLayer_session(keys, ((slot->epochs & (1UL << i)) != 0U) ? 1U : 0U);
+        size_t offset = (size_t)i * PROTOCOL_LAYER_FRAG_CHUNK;
+        size_t length = ((i + 1U) == slot->count) ? slot->lastLength : PROTOCOL_LAYER_FRAG_CHUNK;
+
+        if (session == NULL)
+        {
+            s_stats.dropped++;
+            return 0;
+        }
+        if ((i + 1U) < slot->count)
+        {
+            ProtocolLayer_decryptCBCTo(session, &slot->buffer[offset], &dst[offset], length, slot->ivs[i]);
+            continue;
+        }
+        if (length > AES_BLOCKLEN)
+        {
+            ProtocolLayer_decryptCBCTo(session, &slot->buffer[offset], &dst[offset], length - AES_BLOCKLEN,
+                                       slot->ivs[i]);
+        }
+        ProtocolLayer_decryptCBCTo(session, &slot->buffer[total - AES_BLOCKLEN], block, AES_BLOCKLEN,
+                                   (length > AES_BLOCKLEN) ? &slot->buffer[total - (2U * AES_BLOCKLEN)]
+                                                           : slot->ivs[i]);
+    }
+
+    padValue = PL_CheckPadding(block);
+    if ((padValue == 0U) || ((total - padValue) > PROTOCOL_LAYER_MAX_MESSAGE))
+    {
+        s_stats.dropped++;
+        return 0;
+    }
+    memcpy(&dst[total - AES_BLOCKLEN], block, AES_BLOCKLEN - padValue);
+    s_stats.completed++;
+    return total - padValue;
+}
+
+/*! @brief Reassembly counters, for logging. */
+void ProtocolLayer_reasmGetStats(pl_reasm_stats_t* stats)
+{
+    *stats = s_stats;
+}
@@ -0,0 +1,51 @@
+/*
+This file declares the fragmentation layer. Messages longer than
+PROTOCOL_LAYER_FRAG_CHUNK are split over several frames, each carrying a
+fragment extension (message ID, fragment index, fragment count), and are
+put back together by a bounded reassembly table on receive.
+*/
+
+#ifndef _PROTOCOL_LAYER_FRAG_H_
+#define _PROTOCOL_LAYER_FRAG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+#include "protocol_layer_session.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* Fragment extension: message ID (2 bytes, little endian), index, count */
+#define PL_EXT_FRAG_SIZE       (4)
+#define PL_FRAG_MAX_COUNT      ((PROTOCOL_LAYER_MAX_MESSAGE + PROTOCOL_LAYER_FRAG_CHUNK - 1U) / PROTOCOL_LAYER_FRAG_CHUNK)
+
+typedef struct
+{
+    uint16_t msgId;
+    uint8_t index;
+    uint8_t count;
+} pl_frag_t;
+
+typedef struct
+{
+    uint32_t completed;     /* messages handed off */
+    uint32_t timeouts;      /* messages dropped after PROTOCOL_LAYER_REASM_TIMEOUT_MS */
+    uint32_t dropped;       /* fragments dropped: invalid, duplicate or table full */
+} pl_reasm_stats_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+void ProtocolLayer_fragWrite(uint8_t* ext, const pl_frag_t* frag);
+void ProtocolLayer_fragRead(const uint8_t* ext, pl_frag_t* frag);
+
+void ProtocolLayer_reasmInit(void);
+void ProtocolLayer_reasmService(void);
+bool ProtocolLayer_reasmAdd(uint8_t peer, const pl_frag_t* frag, const uint8_t* cipher, size_t length,
+                            const uint8_t* iv, uint8_t epoch);
+size_t ProtocolLayer_reasmDeliver(uint8_t peer, uint16_t msgId, pl_keyring_t* keys, uint8_t* dst);
+void ProtocolLayer_reasmGetStats(pl_reasm_stats_t* stats);
+
+#endif // _PROTOCOL_LAYER_FRAG_H_
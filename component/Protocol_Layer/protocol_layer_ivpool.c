@@ -0,0 +1,321 @@
+/*
+This file contains the per-frame IV pool. It is a single producer / single
+consumer ring: ProtocolLayer_ivPoolService() is the only writer of the head
+index and ProtocolLayer_ivPoolTake() the only writer of the tail index, so
+no lock is needed between the background refill and the send path.
+
+With PROTOCOL_LAYER_USE_ELS the batches come from the ELS DRBG
+(mcuxClEls_Rng_DrbgRequest_Async). The request is started by one service
+call and collected by a later one, so the service never waits either.
+Without ELS, and when the pool runs dry on send, IVs are made by encrypting
+a counter (NIST SP 800-38A, appendix C). The key of those IVs is derived
+from the data key and never encrypts frame data, and the counter block
+holds a nonce drawn at init (ELS DRBG, TRNG, or /dev/urandom on the host),
+so a counter that restarts at every boot does not repeat IVs.
+*/
+
+#include <string.h>
+#include "protocol_layer_ivpool.h"
+#include "protocol_layer_backend.h"
+#include "aes.h"        // libray from https://github.com/kokke/tiny-AES-c
+
+#if PROTOCOL_LAYER_USE_ELS
+#include "mcuxClEls.h"
+#endif
+
+#ifdef PROTOCOL_LAYER_HOST_BUILD
+#include <stdio.h>
+#elif !PROTOCOL_LAYER_USE_ELS
+#include "fsl_clock.h"
+#endif
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define IV_POOL_MASK           (PROTOCOL_LAYER_IV_POOL_DEPTH - 1U)
+#define IV_POOL_INIT_SPINS     (100000U)
+#define IV_NONCE_SIZE          (8U)
+#define IV_NONCE_SPINS         (1000000U)
+/* Block encrypted with the data key to derive the IV key */
+#define IV_KEY_LABEL           "PL-IV-KEY-V2\0\0\0\0"
+
+#if (PROTOCOL_LAYER_IV_POOL_DEPTH & IV_POOL_MASK) != 0
+#error "PROTOCOL_LAYER_IV_POOL_DEPTH must be a power of two"
+#endif
+
+#ifdef PROTOCOL_LAYER_HOST_BUILD
+#define IV_POOL_BARRIER()      __sync_synchronize()
+#else
+#include "fsl_device_registers.h"
+#define IV_POOL_BARRIER()      __DMB()
+#endif
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static uint8_t s_pool[PROTOCOL_LAYER_IV_POOL_DEPTH][PL_IV_SIZE];
+static volatile uint32_t s_head;   // written by the refill only
+static volatile uint32_t s_tail;   // written by the send path only
+
+static uint8_t s_batch[PROTOCOL_LAYER_IV_POOL_BATCH][PL_IV_SIZE];
+#if PROTOCOL_LAYER_USE_ELS
+static bool s_batchPending = false;
+#endif
+
+static struct AES_ctx s_ivCtx;
+static uint8_t s_nonce[IV_NONCE_SIZE];
+static bool s_nonceOk;
+static uint32_t s_refillCounter;    // producer side
+static uint32_t s_underrunCounter;  // consumer side
+
+static volatile uint32_t s_taken;
+static volatile uint32_t s_underruns;
+static uint32_t s_refilled;
+static uint32_t s_batches;
+static uint32_t s_windowStart;
+static uint32_t s_windowCount;
+static uint32_t s_refillPerSec;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+/*! @brief IV = AES_Kiv(counter || nonce || lane). The counter makes it
+ *         unique within a boot and the nonce across boots; the producer and
+ *         the consumer use separate lanes so they never share a counter. */
+static void CounterIv(uint8_t* iv, uint32_t* counter, uint32_t lane)
+{
+    uint32_t block[PL_IV_SIZE / sizeof(uint32_t)];
+
+    block[0] = (*counter)++;
+    memcpy(&block[1], s_nonce, IV_NONCE_SIZE);
+    block[3] = lane;
+    memcpy(iv, block, PL_IV_SIZE);
+    AES_ECB_encrypt(&s_ivCtx, iv);
+}
+
+/*! @brief Kiv = AES_K(label): the data key only ever encrypts this one
+ *         block for the pool, so IVs sent in clear tell nothing about it. */
+static void DeriveIvKey(const uint8_t* key)
+{
+    struct AES_ctx ctx;
+    uint8_t ivKey[AES_KEYLEN];
+
+    memcpy(ivKey, IV_KEY_LABEL, AES_KEYLEN);
+    AES_init_ctx(&ctx, key);
+    AES_ECB_encrypt(&ctx, ivKey);
+    AES_init_ctx(&s_ivCtx, ivKey);
+    memset(ivKey, 0, sizeof(ivKey));
+    memset(&ctx, 0, sizeof(ctx));
+}
+
+/*! @brief Draw the per-boot nonce; may block, init only.
+ *  @return false if no entropy source answered, the nonce is then the timer. */
+static bool DrawNonce(uint8_t* nonce)
+{
+#ifdef PROTOCOL_LAYER_HOST_BUILD
+    FILE* source = fopen("/dev/urandom", "rb");
+    bool ok = (source != NULL) && (fread(nonce, 1, IV_NONCE_SIZE, source) == IV_NONCE_SIZE);
+
+    if (source != NULL)
+    {
+        (void)fclose(source);
+    }
+#elif PROTOCOL_LAYER_USE_ELS
+    uint8_t drbg[AES_BLOCKLEN];
+    bool ok = false;
+
+    if (ProtocolLayer_elsAcquire())
+    {
+        MCUX_CSSL_FP_FUNCTION_CALL_BEGIN(result, token, mcuxClEls_Rng_DrbgRequest_Async(drbg, sizeof(drbg)));
+        ok = (MCUX_CSSL_FP_FUNCTION_CALLED(mcuxClEls_Rng_DrbgRequest_Async) == token) &&
+             (MCUXCLELS_STATUS_OK_WAIT == result);
+        MCUX_CSSL_FP_FUNCTION_CALL_END();
+        if (ok)
+        {
+            MCUX_CSSL_FP_FUNCTION_CALL_BEGIN(result, token, mcuxClEls_WaitForOperation(MCUXCLELS_ERROR_FLAGS_CLEAR));
+            ok = (MCUX_CSSL_FP_FUNCTION_CALLED(mcuxClEls_WaitForOperation) == token) && (MCUXCLELS_STATUS_OK == result);
+            MCUX_CSSL_FP_FUNCTION_CALL_END();
+        }
+        ProtocolLayer_elsRelease();
+    }
+    memcpy(nonce, drbg, IV_NONCE_SIZE);
+#else
+    // ELS is not built in, so the TRNG is free: leave program mode and
+    // fold one 256-bit entropy sample into the nonce
+    uint32_t words[IV_NONCE_SIZE / sizeof(uint32_t)] = {0};
+    bool ok = false;
+
+    CLOCK_EnableClock(kCLOCK_Trng);
+    TRNG->MCTL = (TRNG->MCTL & ~TRNG_MCTL_PRGM_MASK) | TRNG_MCTL_ERR_MASK;
+    for (uint32_t spin = 0; (spin < IV_NONCE_SPINS) && !ok; spin++)
+    {
+        uint32_t mctl = TRNG->MCTL;
+        if ((mctl & TRNG_MCTL_ERR_MASK) != 0U)
+        {
+            break;
+        }
+        if ((mctl & TRNG_MCTL_ENT_VAL_MASK) != 0U)
+        {
+            for (uint32_t i = 0; i < TRNG_ENTA_COUNT; i++)
+            {
+                words[i % 2U] ^= TRNG->ENT[i];
+            }
+            ok = true;
+        }
+    }
+    memcpy(nonce, words, IV_NONCE_SIZE);
+#endif
+    if (!ok)
+    {
+        uint32_t ticks = ProtocolLayer_timerTicks();
+        memcpy(nonce, &ticks, sizeof(ticks));
+    }
+    return ok;
+}
+
+/*! @brief Move a finished batch into the ring and update the refill rate. */
+static void CommitBatch(uint32_t count)
+{
+    uint32_t head = s_head;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        memcpy(s_pool[(head + i) & IV_POOL_MASK], s_batch[i], PL_IV_SIZE);
+    }
+    // The IVs must be visible before the consumer can see the new head
+    IV_POOL_BARRIER();
+    s_head = head + count;
+
+    s_refilled += count;
+    s_batches++;
+    s_windowCount += count;
+
+    uint32_t now = ProtocolLayer_timerTicks();
+    uint32_t elapsed = now - s_windowStart;
+    if (elapsed >= ProtocolLayer_timerHz())
+    {
+        s_refillPerSec = (uint32_t)(((uint64_t)s_windowCount * ProtocolLayer_timerHz()) / elapsed);
+        s_windowStart = now;
+        s_windowCount = 0;
+    }
+}
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Prepare the pool and fill it completely; may block, call at init. */
+void ProtocolLayer_ivPoolInit(void)
+{
+    DeriveIvKey(aes_key);
+    s_nonceOk = DrawNonce(s_nonce);
+    s_refillCounter = 0;
+    s_underrunCounter = 0;
+    s_head = 0;
+    s_tail = 0;
+    s_windowStart = ProtocolLayer_timerTicks();
+
+    for (uint32_t spin = 0; spin < IV_POOL_INIT_SPINS; spin++)
+    {
+        if ((s_head - s_tail) > (PROTOCOL_LAYER_IV_POOL_DEPTH - PROTOCOL_LAYER_IV_POOL_BATCH))
+        {
+            break;
+        }
+        ProtocolLayer_ivPoolService();
+    }
+}
+
+/*! @brief Background refill, call it from the idle loop. Never waits: a batch
+ *         is only requested when there is room for it, and an ELS request is
+ *         only collected once the engine has finished it. */
+void ProtocolLayer_ivPoolService(void)
+{
+#if PROTOCOL_LAYER_USE_ELS
+    if (s_batchPending)
+    {
+        mcuxClEls_HwState_t state;
+
+        MCUX_CSSL_FP_FUNCTION_CALL_BEGIN(result, token, mcuxClEls_GetHwState(&state));
+        (void)result;
+        (void)token;
+        MCUX_CSSL_FP_FUNCTION_CALL_END();
+        if (state.bits.busy)
+        {
+            return;
+        }
+
+        MCUX_CSSL_FP_FUNCTION_CALL_BEGIN(result, token, mcuxClEls_WaitForOperation(MCUXCLELS_ERROR_FLAGS_CLEAR));
+        s_batchPending = false;
+        ProtocolLayer_elsRelease();
+        if ((MCUX_CSSL_FP_FUNCTION_CALLED(mcuxClEls_WaitForOperation) == token) && (MCUXCLELS_STATUS_OK == result))
+        {
+            CommitBatch(PROTOCOL_LAYER_IV_POOL_BATCH);
+        }
+        MCUX_CSSL_FP_FUNCTION_CALL_END();
+        return;
+    }
+#endif
+
+    if ((PROTOCOL_LAYER_IV_POOL_DEPTH - (s_head - s_tail)) < PROTOCOL_LAYER_IV_POOL_BATCH)
+    {
+        return;
+    }
+
+#if PROTOCOL_LAYER_USE_ELS
+    if (ProtocolLayer_elsAcquire())
+    {
+        MCUX_CSSL_FP_FUNCTION_CALL_BEGIN(result, token,
+            mcuxClEls_Rng_DrbgRequest_Async(&s_batch[0][0], sizeof(s_batch)));
+        if ((MCUX_CSSL_FP_FUNCTION_CALLED(mcuxClEls_Rng_DrbgRequest_Async) == token) &&
+            (MCUXCLELS_STATUS_OK_WAIT == result))
+        {
+            s_batchPending = true;
+        }
+        else
+        {
+            ProtocolLayer_elsRelease();
+        }
+        MCUX_CSSL_FP_FUNCTION_CALL_END();
+    }
+#else
+    for (uint32_t i = 0; i < PROTOCOL_LAYER_IV_POOL_BATCH; i++)
+    {
+        CounterIv(s_batch[i], &s_refillCounter, 0U);
+    }
+    CommitBatch(PROTOCOL_LAYER_IV_POOL_BATCH);
+#endif
+}
+
+/*! @brief Take the IV for one frame. Never blocks: when the pool is empty a
+ *         counter IV is made on the spot and counted as an underrun.
+ *  @return true if the IV came from the pool. */
+bool ProtocolLayer_ivPoolTake(uint8_t* iv)
+{
+    uint32_t tail = s_tail;
+
+    if (tail == s_head)
+    {
+        CounterIv(iv, &s_underrunCounter, 1U);
+        s_underruns++;
+        return false;
+    }
+
+    // Read the slot before handing it back to the producer
+    memcpy(iv, s_pool[tail & IV_POOL_MASK], PL_IV_SIZE);
+    IV_POOL_BARRIER();
+    s_tail = tail + 1U;
+    s_taken++;
+    return true;
+}
+
+/*! @brief Pool depth, refill rate and counters, for logging. */
+void ProtocolLayer_ivPoolGetStats(pl_ivpool_stats_t* stats)
+{
+    stats->depth        = s_head - s_tail;
+    stats->capacity     = PROTOCOL_LAYER_IV_POOL_DEPTH;
+    stats->taken        = s_taken;
+    stats->refilled     = s_refilled;
+    stats->batches      = s_batches;
+    stats->underruns    = s_underruns;
+    stats->refillPerSec = s_refillPerSec;
+    stats->nonce        = s_nonceOk;
+}
@@ -0,0 +1,40 @@
+/*
+This file declares the per-frame IV pool. IVs are generated in batches in
+the background (ELS DRBG when available) and taken on send without ever
+waiting for the random number generator.
+*/
+
+#ifndef _PROTOCOL_LAYER_IVPOOL_H_
+#define _PROTOCOL_LAYER_IVPOOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define PL_IV_SIZE             (16)
+
+typedef struct
+{
+    uint32_t depth;         /* IVs ready to be taken */
+    uint32_t capacity;      /* PROTOCOL_LAYER_IV_POOL_DEPTH */
+    uint32_t taken;         /* IVs handed out from the pool */
+    uint32_t refilled;      /* IVs added by background refills */
+    uint32_t batches;       /* completed refill batches */
+    uint32_t underruns;     /* sends that found the pool empty */
+    uint32_t refillPerSec;  /* IVs per second added during the last window */
+    bool nonce;             /* per-boot nonce from the RNG; false: from the timer, IVs may repeat across boots */
+} pl_ivpool_stats_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+void ProtocolLayer_ivPoolInit(void);
+void ProtocolLayer_ivPoolService(void);
+bool ProtocolLayer_ivPoolTake(uint8_t* iv);
+void ProtocolLayer_ivPoolGetStats(pl_ivpool_stats_t* stats);
+
+#endif // _PROTOCOL_LAYER_IVPOOL_H_
@@ -0,0 +1,230 @@
+/*
+This file contains a small LZ4 block compressor and decompressor. The
+compressor is greedy with one hash table of 2^PROTOCOL_LAYER_LZ_HASH_BITS
+positions, the only working memory, allocated statically. The table is not
+cleared between calls: a stale entry is just a candidate, it is used only
+if it lies before the current position and its 4 bytes match.
+
+The decompressor checks every length and offset against the input and
+output bounds, so a malformed payload is rejected, never overruns.
+*/
+
+#include <string.h>
+#include "protocol_layer_lz.h"
+#include "protocol_layer_simd.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define LZ_MIN_MATCH           (4U)
+#define LZ_LAST_LITERALS       (5U)     /* LZ4: the last 5 bytes are literals */
+#define LZ_MF_LIMIT            (12U)    /* LZ4: no match starts in the last 12 bytes */
+#define LZ_RUN_MASK            (15U)
+#define LZ_HASH_SIZE           (1U << PROTOCOL_LAYER_LZ_HASH_BITS)
+
+#if (PROTOCOL_LAYER_FRAG_CHUNK > 0xFFFFU)
+#error "Compressed payloads are addressed with 16-bit positions"
+#endif
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static uint16_t s_hashTable[LZ_HASH_SIZE];
+static pl_lz_stats_t s_stats;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+/*! @brief Hash table slot of the 4 bytes at a position. */
+static uint32_t Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761U) >> (32U - PROTOCOL_LAYER_LZ_HASH_BITS);
+}
+
+/*! @brief Write the extra bytes of a length of 15 or more. */
+static size_t PutLength(uint8_t* out, size_t op, size_t value)
+{
+    value -= LZ_RUN_MASK;
+    while (value >= 255U)
+    {
+        out[op++] = 255U;
+        value -= 255U;
+    }
+    out[op++] = (uint8_t)value;
+    return op;
+}
+
+/*! @brief Read the extra bytes of a length, added to value. */
+static bool GetLength(const uint8_t* in, size_t length, size_t* ip, size_t* value)
+{
+    uint8_t byte;
+
+    do
+    {
+        if (*ip >= length)
+        {
+            return false;
+        }
+        byte = in[(*ip)++];
+        *value += byte;
+    } while (byte == 255U);
+    return true;
+}
+
+/*! @brief Append one sequence; matchLength 0 for the last one, literals only.
+ *  @return false if it does not fit in outLimit. */
+static bool EmitSequence(uint8_t* out, size_t* op, size_t outLimit, const uint8_t* literals, size_t literalLength,
+                         size_t offset, size_t matchLength)
+{
+    size_t o = *op;
+    size_t match = (matchLength != 0U) ? (matchLength - LZ_MIN_MATCH) : 0U;
+    size_t worst = 1U + (literalLength / 255U) + 1U + literalLength + ((matchLength != 0U) ? (3U + (match / 255U)) : 0U);
+
+    if ((o + worst) > outLimit)
+    {
+        return false;
+    }
+
+    uint8_t* token = &out[o++];
+    *token = (uint8_t)(((literalLength < LZ_RUN_MASK) ? literalLength : LZ_RUN_MASK) << 4);
+    if (literalLength >= LZ_RUN_MASK)
+    {
+        o = PutLength(out, o, literalLength);
+    }
+    memcpy(&out[o], literals, literalLength);
+    o += literalLength;
+
+    if (matchLength != 0U)
+    {
+        out[o++] = (uint8_t)(offset & 0xFFU);
+        out[o++] = (uint8_t)(offset >> 8);
+        *token |= (uint8_t)((match < LZ_RUN_MASK) ? match : LZ_RUN_MASK);
+        if (match >= LZ_RUN_MASK)
+        {
+            o = PutLength(out, o, match);
+        }
+    }
+    *op = o;
+    return true;
+}
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Compress a payload of up to 64 KB.
+ *  @return compressed length, 0 if it does not fit in outLimit bytes: the
+ *          payload is then sent uncompressed. */
+size_t ProtocolLayer_lzCompress(const uint8_t* in, size_t length, uint8_t* out, size_t outLimit)
+{
+    size_t ip = 0;
+    size_t anchor = 0;
+    size_t op = 0;
+
+    if (length > LZ_MF_LIMIT)
+    {
+        size_t matchLimit = length - LZ_LAST_LITERALS;
+        size_t ipLimit = length - LZ_MF_LIMIT;
+
+        while (ip < ipLimit)
+        {
+            uint32_t sequence = PL_Load32(&in[ip]);
+            uint32_t h = Hash(sequence);
+            size_t ref = s_hashTable[h];
+
+            s_hashTable[h] = (uint16_t)ip;
+            if ((ref >= ip) || (PL_Load32(&in[ref]) != sequence))
+            {
+                ip++;
+                continue;
+            }
+
+            size_t matchLength = LZ_MIN_MATCH;
+            while (((ip + matchLength) < matchLimit) && (in[ref + matchLength] == in[ip + matchLength]))
+            {
+                matchLength++;
+            }
+            if (!EmitSequence(out, &op, outLimit, &in[anchor], ip - anchor, ip - ref, matchLength))
+            {
+                s_stats.bypassed++;
+                return 0;
+            }
+            ip += matchLength;
+            anchor = ip;
+        }
+    }
+
+    if (!EmitSequence(out, &op, outLimit, &in[anchor], length - anchor, 0U, 0U))
+    {
+        s_stats.bypassed++;
+        return 0;
+    }
+    s_stats.compressed++;
+    s_stats.bytesIn += length;
+    s_stats.bytesOut += op;
+    return op;
+}
+
+/*! @brief Decompress a payload.
+ *  @return decompressed length, 0 if the payload is malformed or longer
+ *          than outLimit. */
+size_t ProtocolLayer_lzDecompress(const uint8_t* in, size_t length, uint8_t* out, size_t outLimit)
+{
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < length)
+    {
+        uint8_t token = in[ip++];
+        size_t literalLength = token >> 4;
+        size_t matchLength = token & LZ_RUN_MASK;
+        size_t offset;
+
+        if ((literalLength == LZ_RUN_MASK) && !GetLength(in, length, &ip, &literalLength))
+        {
+            return 0;
+        }
+        if ((literalLength > (length - ip)) || (literalLength > (outLimit - op)))
+        {
+            return 0;
+        }
+        memcpy(&out[op], &in[ip], literalLength);
+        ip += literalLength;
+        op += literalLength;
+
+        // The last sequence ends with its literals
+        if (ip == length)
+        {
+            return op;
+        }
+
+        if ((length - ip) < 2U)
+        {
+            return 0;
+        }
+        offset = (size_t)in[ip] | ((size_t)in[ip + 1U] << 8);
+        ip += 2U;
+        if ((matchLength == LZ_RUN_MASK) && !GetLength(in, length, &ip, &matchLength))
+        {
+            return 0;
+        }
+        matchLength += LZ_MIN_MATCH;
+        if ((offset == 0U) || (offset > op) || (matchLength > (outLimit - op)))
+        {
+            return 0;
+        }
+
+        // Byte by byte: the match may overlap the bytes it produces
+        for (size_t i = 0; i < matchLength; i++)
+        {
+            out[op] = out[op - offset];
+            op++;
+        }
+    }
+    return 0;
+}
+
+/*! @brief Compression counters, for logging. */
+void ProtocolLayer_lzGetStats(pl_lz_stats_t* stats)
+{
+    *stats = s_stats;
+}
@@ -0,0 +1,36 @@
+/*
+This file declares the compression stage. A frame payload is compressed
+before padding and encryption when that saves at least one AES block, and
+is sent with PL_FLAG_LZ; otherwise it goes out as it is. The format is the
+LZ4 block format: sequences of a token (literal count, match length - 4),
+the literals and a 2-byte little endian match offset, the last sequence
+having literals only.
+*/
+
+#ifndef _PROTOCOL_LAYER_LZ_H_
+#define _PROTOCOL_LAYER_LZ_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+typedef struct
+{
+    uint32_t compressed;    /* payloads sent compressed */
+    uint32_t bypassed;      /* payloads sent as they are, not worth it */
+    uint32_t bytesIn;       /* bytes before compression, compressed payloads only */
+    uint32_t bytesOut;      /* bytes after compression */
+} pl_lz_stats_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+size_t ProtocolLayer_lzCompress(const uint8_t* in, size_t length, uint8_t* out, size_t outLimit);
+size_t ProtocolLayer_lzDecompress(const uint8_t* in, size_t length, uint8_t* out, size_t outLimit);
+void ProtocolLayer_lzGetStats(pl_lz_stats_t* stats);
+
+#endif // _PROTOCOL_LAYER_LZ_H_
@@ -0,0 +1,131 @@
+/*
+This file contains the hybrid receive scheduler: the interrupt masking,
+the budget accounting and the check of the ring before the interrupt is
+unmasked. ProtocolLayer_napiOnIrq() masks the receive interrupt from the
+interrupt handler, and only ProtocolLayer_napiOnEmpty() unmasks it, so the
+interrupt never runs while a pass is in progress and the state needs no
+locking.
+*/
+
+#include <string.h>
+#include "protocol_layer_napi.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#if (PROTOCOL_LAYER_NAPI_BUDGET == 0U)
+#error "PROTOCOL_LAYER_NAPI_BUDGET must not be 0"
+#endif
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static const pl_napi_ops_t* s_ops;
+static bool s_scheduled;                        // polling until the ring is found empty
+static uint32_t s_budget;                       // frames left in the current pass
+static pl_napi_stats_t s_stats;
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Reset the scheduler on the given MAC; the receive interrupt
+ *         starts unmasked. */
+void ProtocolLayer_napiInit(const pl_napi_ops_t* ops)
+{
+    s_ops = ops;
+    s_scheduled = false;
+    s_budget = 0;
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+/*! @brief Receive interrupt: mask it and schedule polling. */
+void ProtocolLayer_napiOnIrq(void)
+{
+    s_ops->mask();
+    s_scheduled = true;
+    s_stats.interrupts++;
+    s_stats.passes++;
+    s_budget = PROTOCOL_LAYER_NAPI_BUDGET;
+}
+
+/*! @brief Call it before reading the ring.
+ *  @return true to read it: polling is scheduled and the pass has budget
+ *          left. false once per spent budget, for the caller to do its
+ *          idle work; the next call starts a new pass. */
+bool ProtocolLayer_napiPoll(void)
+{
+    if (!s_scheduled)
+    {
+        return false;
+    }
+    if (s_budget == 0U)
+    {
+        s_budget = PROTOCOL_LAYER_NAPI_BUDGET;
+        s_stats.passes++;
+        return false;
+    }
+    return true;
+}
+
+/*! @brief Count a frame read from the ring.
+ *  @return false when it used up the budget of the pass. */
+bool ProtocolLayer_napiOnFrame(void)
+{
+    s_stats.frames++;
+    if (s_budget != 0U)
+    {
+        s_budget--;
+    }
+    if (s_budget == 0U)
+    {
+        s_stats.exhausted++;
+        return false;
+    }
+    return true;
+}
+
+/*! @brief The ring was found empty: clear the interrupt flag, then look
+ *         again, and only end polling and unmask the interrupt if it is
+ *         still empty. A frame arriving after the second look sets the
+ *         flag and interrupts as soon as it is unmasked. */
+void ProtocolLayer_napiOnEmpty(void)
+{
+    s_ops->clearStatus();
+    if (s_ops->pending())
+    {
+        return;
+    }
+    s_scheduled = false;
+    s_budget = 0;
+    s_ops->unmask();
+}
+
+/*! @brief One pass over the ring, after ProtocolLayer_napiPoll() returned
+ *         true: frames are read until the budget is spent, max of them are
+ *         read or the ring is found empty.
+ *  @return frames read. */
+uint32_t ProtocolLayer_napiPass(uint32_t max)
+{
+    uint32_t frames = 0;
+
+    while (frames < max)
+    {
+        if (!s_ops->read())
+        {
+            ProtocolLayer_napiOnEmpty();
+            break;
+        }
+        frames++;
+        if (!ProtocolLayer_napiOnFrame())
+        {
+            break;
+        }
+    }
+    return frames;
+}
+
+/*! @brief Scheduler counters, for logging. */
+void ProtocolLayer_napiGetStats(pl_napi_stats_t* stats)
+{
+    *stats = s_stats;
+}
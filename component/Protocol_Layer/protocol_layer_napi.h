@@ -0,0 +1,52 @@
+/*
+This file declares the hybrid interrupt/poll receive scheduler. The first
+receive interrupt masks the receive interrupt and schedules polling: the
+receive path then reads the ring in passes of PROTOCOL_LAYER_NAPI_BUDGET
+frames, with the idle work between passes, and the interrupt is unmasked
+only once the ring is found empty. A frame after a quiet spell costs one
+interrupt; a burst costs one interrupt for the whole burst. The MAC is
+reached through pl_napi_ops_t only, so the scheduler also runs on the host
+against a simulated ring.
+*/
+
+#ifndef _PROTOCOL_LAYER_NAPI_H_
+#define _PROTOCOL_LAYER_NAPI_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* Receive ring and interrupt of the MAC */
+typedef struct
+{
+    bool (*pending)(void);          /* a frame, good or in error, is in the receive ring */
+    bool (*read)(void);             /* take the next frame, false if the ring is empty; for ProtocolLayer_napiPass() */
+    void (*mask)(void);             /* receive interrupt off */
+    void (*unmask)(void);           /* receive interrupt on, it fires at once if its flag is set */
+    void (*clearStatus)(void);      /* clear the flag of the receive interrupt */
+} pl_napi_ops_t;
+
+typedef struct
+{
+    uint32_t interrupts;    /* receive interrupts, each one starts polling */
+    uint32_t passes;        /* poll passes */
+    uint32_t frames;        /* frames read while polling */
+    uint32_t exhausted;     /* passes ended by the budget, the ring still busy */
+} pl_napi_stats_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+void ProtocolLayer_napiInit(const pl_napi_ops_t* ops);
+void ProtocolLayer_napiOnIrq(void);
+bool ProtocolLayer_napiPoll(void);
+bool ProtocolLayer_napiOnFrame(void);
+void ProtocolLayer_napiOnEmpty(void);
+uint32_t ProtocolLayer_napiPass(uint32_t max);
+void ProtocolLayer_napiGetStats(pl_napi_stats_t* stats);
+
+#endif // _PROTOCOL_LAYER_NAPI_H_
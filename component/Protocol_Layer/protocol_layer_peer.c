@@ -0,0 +1,221 @@
+/*
+This file contains the peer table: an open addressing hash table of packed
+8-byte keys (MAC address, state, context index) with linear probing, next
+to a fixed array of peer contexts. A lookup hashes the last four bytes of
+the MAC and normally reads one key entry; the contexts are only touched
+once the peer is found.
+
+Add and remove are meant for the application context and never block the
+receive path, which only reads the table: an entry is filled in first and
+then published through its state byte after a memory barrier, and a
+removed entry becomes a tombstone so the probe chains stay intact. The
+context of a removed peer is only reused by a later add.
+*/
+
+#include <string.h>
+#include "protocol_layer_peer.h"
+#include "protocol_layer_simd.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define TABLE_SIZE             (PROTOCOL_LAYER_PEER_TABLE_SIZE)
+#define TABLE_MASK             (TABLE_SIZE - 1U)
+
+#if ((TABLE_SIZE & TABLE_MASK) != 0U) || (TABLE_SIZE < (2U * PROTOCOL_LAYER_MAX_PEERS))
+#error "PROTOCOL_LAYER_PEER_TABLE_SIZE must be a power of two of at least twice PROTOCOL_LAYER_MAX_PEERS"
+#endif
+#if (PROTOCOL_LAYER_MAX_PEERS > 255U)
+#error "PROTOCOL_LAYER_MAX_PEERS must fit the 8-bit context index"
+#endif
+
+#ifdef PROTOCOL_LAYER_HOST_BUILD
+#define PUBLISH_BARRIER()      __sync_synchronize()
+#else
+#define PUBLISH_BARRIER()      __DMB()
+#endif
+
+typedef enum
+{
+    kPeerKey_Free = 0,              /* never used, ends a probe chain */
+    kPeerKey_Used,
+    kPeerKey_Deleted,               /* tombstone, skipped by lookups */
+} peer_key_state_t;
+
+/* One table entry, packed in 8 bytes */
+typedef struct
+{
+    uint8_t mac[PL_MAC_SIZE];
+    volatile uint8_t state;         /* peer_key_state_t */
+    uint8_t index;                  /* context in s_peers */
+} peer_key_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static peer_key_t s_table[TABLE_SIZE];
+static pl_peer_t s_peers[PROTOCOL_LAYER_MAX_PEERS];
+static const uint8_t s_defaultMac[PL_MAC_SIZE] = DEST_MAC_ADDRESS;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+/*! @brief Home slot of a MAC address; the vendor prefix is left out. */
+static uint32_t Hash(const uint8_t* mac)
+{
+    return ((PL_Load32(&mac[2]) * 2654435761U) >> 16) & TABLE_MASK;
+}
+
+/*! @brief Table entry of a peer in use, or NULL. */
+static peer_key_t* FindKey(const uint8_t* mac)
+{
+    uint32_t slot = Hash(mac);
+
+    for (uint32_t probe = 0; probe < TABLE_SIZE; probe++)
+    {
+        peer_key_t* key = &s_table[(slot + probe) & TABLE_MASK];
+        uint8_t state = key->state;
+
+        if (state == kPeerKey_Free)
+        {
+            return NULL;
+        }
+        if ((state == kPeerKey_Used) && (memcmp(key->mac, mac, PL_MAC_SIZE) == 0))
+        {
+            return key;
+        }
+    }
+    return NULL;
+}
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Empty the peer table. */
+void ProtocolLayer_peerInit(void)
+{
+    memset(s_table, 0, sizeof(s_table));
+    memset(s_peers, 0, sizeof(s_peers));
+}
+
+/*! @brief Add a peer with its own keys; the key schedules are expanded here,
+ *         in the caller's context, before the peer becomes visible.
+ *  @return the new peer, NULL if it already exists or the table is full. */
+pl_peer_t* ProtocolLayer_peerAdd(const uint8_t* mac, const uint8_t* key, const uint8_t* macKey)
+{
+    pl_peer_t* peer = NULL;
+    peer_key_t* entry = NULL;
+    uint32_t slot = Hash(mac);
+
+    if (FindKey(mac) != NULL)
+    {
+        return NULL;
+    }
+
+    for (uint8_t i = 0; i < PROTOCOL_LAYER_MAX_PEERS; i++)
+    {
+        if (!s_peers[i].used)
+        {
+            peer = &s_peers[i];
+            peer->index = i;
+            break;
+        }
+    }
+    for (uint32_t probe = 0; (peer != NULL) && (probe < TABLE_SIZE); probe++)
+    {
+        peer_key_t* candidate = &s_table[(slot + probe) & TABLE_MASK];
+
+        if (candidate->state != kPeerKey_Used)
+        {
+            entry = candidate;
+            break;
+        }
+    }
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(peer->mac, mac, PL_MAC_SIZE);
+    ProtocolLayer_sessionInit(&peer->keys, key, macKey);
+#if PROTOCOL_LAYER_RELIABLE
+    ProtocolLayer_relReset(&peer->rel);
+#endif
+#if PROTOCOL_LAYER_CREDIT
+    ProtocolLayer_creditInit(&peer->credit);
+#endif
+    memset(&peer->stats, 0, sizeof(peer->stats));
+    peer->used = true;
+
+    // Fill the entry, then publish it with a single write
+    memcpy(entry->mac, mac, PL_MAC_SIZE);
+    entry->index = peer->index;
+    PUBLISH_BARRIER();
+    entry->state = kPeerKey_Used;
+    return peer;
+}
+
+/*! @brief Remove a peer. A frame being received from it finishes with its
+ *         context, which stays intact until a later add reuses it.
+ *  @return false if the peer is not in the table. */
+bool ProtocolLayer_peerRemove(const uint8_t* mac)
+{
+    peer_key_t* key = FindKey(mac);
+
+    if (key == NULL)
+    {
+        return false;
+    }
+    key->state = kPeerKey_Deleted;
+    PUBLISH_BARRIER();
+    s_peers[key->index].used = false;
+    return true;
+}
+
+/*! @brief Peer of a MAC address, NULL if unknown. Safe from the receive path
+ *         while peers are added or removed. */
+pl_peer_t* ProtocolLayer_peerFind(const uint8_t* mac)
+{
+    peer_key_t* key = FindKey(mac);
+
+    return (key != NULL) ? &s_peers[key->index] : NULL;
+}
+
+/*! @brief Peer context by index, for walking all peers; NULL if unused. */
+pl_peer_t* ProtocolLayer_peerAt(uint8_t index)
+{
+    if ((index >= PROTOCOL_LAYER_MAX_PEERS) || !s_peers[index].used)
+    {
+        return NULL;
+    }
+    return &s_peers[index];
+}
+
+/*! @brief Start a key rotation with one peer, see ProtocolLayer_sessionRekey().
+ *  @return false if the peer is unknown or its previous rotation is not over. */
+bool ProtocolLayer_peerRekey(const uint8_t* mac, const uint8_t* key, const uint8_t* macKey)
+{
+    pl_peer_t* peer = ProtocolLayer_peerFind(mac);
+
+    return (peer != NULL) && ProtocolLayer_sessionRekey(&peer->keys, key, macKey);
+}
+
+/*! @brief Start a key rotation with the default peer (DEST_MAC_ADDRESS). */
+bool ProtocolLayer_rekey(const uint8_t* key, const uint8_t* macKey)
+{
+    return ProtocolLayer_peerRekey(s_defaultMac, key, macKey);
+}
+
+/*! @brief Frame counters of a peer, for logging.
+ *  @return false if the peer is unknown. */
+bool ProtocolLayer_peerGetStats(const uint8_t* mac, pl_peer_stats_t* stats)
+{
+    pl_peer_t* peer = ProtocolLayer_peerFind(mac);
+
+    if (peer == NULL)
+    {
+        return false;
+    }
+    *stats = peer->stats;
+    return true;
+}
@@ -0,0 +1,65 @@
+/*
+This file declares the peer table. Every peer the board talks to is found
+by its MAC address and owns its key ring, its reliable delivery and credit
+state and its statistics, so one board can hold sessions with several
+peers at once. DEST_MAC_ADDRESS is added at init as the default peer;
+multicast groups joined with ProtocolLayer_joinGroup() are entries too.
+*/
+
+#ifndef _PROTOCOL_LAYER_PEER_H_
+#define _PROTOCOL_LAYER_PEER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+#include "protocol_layer_session.h"
+#include "protocol_layer_reliable.h"
+#include "protocol_layer_credit.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define PL_MAC_SIZE            (6)
+/* Multicast group addresses have the I/G bit set. A group is a peer entry
+ * holding the group keys; its frames are not acknowledged or flow controlled. */
+#define PL_MAC_IS_GROUP(mac)   (((mac)[0] & 0x01U) != 0U)
+
+typedef struct
+{
+    uint32_t txFrames;      /* frames sent */
+    uint32_t txBytes;       /* payload bytes sent, before encryption */
+    uint32_t rxFrames;      /* frames accepted */
+    uint32_t rxBytes;       /* ciphertext bytes accepted */
+    uint32_t rejected;      /* frames dropped: integrity or key failure */
+} pl_peer_stats_t;
+
+/* Everything kept per peer */
+typedef struct pl_peer
+{
+    uint8_t mac[PL_MAC_SIZE];
+    uint8_t index;                  /* position in the context array */
+    volatile bool used;
+    pl_keyring_t keys;
+#if PROTOCOL_LAYER_RELIABLE
+    pl_rel_peer_t rel;
+#endif
+#if PROTOCOL_LAYER_CREDIT
+    pl_credit_t credit;
+#endif
+    pl_peer_stats_t stats;
+} pl_peer_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+void ProtocolLayer_peerInit(void);
+pl_peer_t* ProtocolLayer_peerAdd(const uint8_t* mac, const uint8_t* key, const uint8_t* macKey);
+bool ProtocolLayer_peerRemove(const uint8_t* mac);
+pl_peer_t* ProtocolLayer_peerFind(const uint8_t* mac);
+pl_peer_t* ProtocolLayer_peerAt(uint8_t index);
+bool ProtocolLayer_peerRekey(const uint8_t* mac, const uint8_t* key, const uint8_t* macKey);
+bool ProtocolLayer_rekey(const uint8_t* key, const uint8_t* macKey);
+bool ProtocolLayer_peerGetStats(const uint8_t* mac, pl_peer_stats_t* stats);
+
+#endif // _PROTOCOL_LAYER_PEER_H_
@@ -0,0 +1,407 @@
+/*
+This file contains the reliable delivery layer. Every frame sent with a
+sequence number keeps a copy of its plaintext in the send window until the
+peer acknowledges it, so up to PROTOCOL_LAYER_RELIABLE_WINDOW frames are in
+flight at once instead of one request/reply at a time.
+
+Every outgoing frame carries an ACK extension: the next sequence number
+expected (cumulative) and a bitmap of the frames received beyond it
+(selective), so a single loss only retransmits the missing frame. When
+there is no data to carry it, a pure ACK is sent after
+PROTOCOL_LAYER_RELIABLE_ACK_DELAY_US, or at once for an out of order frame.
+
+The retransmission timeout follows the RTT as in RFC 6298 (Jacobson/Karels
+with Karn's rule: retransmitted frames give no RTT sample) and doubles on
+every timeout. Received frames are delivered as they arrive; the sequence
+numbers only drop duplicates, they do not reorder. A received frame is
+checked with ProtocolLayer_relOnData() and only recorded, and so
+acknowledged, with ProtocolLayer_relAccept() once the layer above has taken
+it; a frame it had no room for is sent again.
+
+Either side may reboot while the other keeps its sequence state. After a
+reset the sender starts at a sequence number drawn from the free running
+timer and flags its first frame as a SYN, with nothing else in flight until
+the SYN is acknowledged. The receiver takes the sequence number of a SYN as
+its new starting point, and sends no ACK before it has one. A copy of the
+SYN it synced to is a plain duplicate.
+
+After a reset of its own the receiver does not know what came before the
+first frame it gets: an earlier one may be lost or still on its way. It
+starts PROTOCOL_LAYER_RELIABLE_WINDOW - 1 frames before it, so those frames
+are still taken and not acknowledged before they arrive. The sender never
+has more than a window in flight, so a frame beyond the bitmap proves that
+everything a bitmap behind it was acknowledged, and the receive window
+moves up to it.
+
+The module does not use the Ethernet driver, so it also builds for the host
+(PROTOCOL_LAYER_HOST_BUILD) against an in-memory link.
+*/
+
+#include <string.h>
+#include "protocol_layer_reliable.h"
+#include "protocol_layer_backend.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#if (PROTOCOL_LAYER_RELIABLE_WINDOW > 32U)
+#error "PROTOCOL_LAYER_RELIABLE_WINDOW must not exceed the 32-bit selective ACK bitmap"
+#endif
+#if ((PROTOCOL_LAYER_RELIABLE_WINDOW & (PROTOCOL_LAYER_RELIABLE_WINDOW - 1U)) != 0)
+#error "PROTOCOL_LAYER_RELIABLE_WINDOW must be a power of two"
+#endif
+
+#define SEQ_DIFF(a, b)         ((int16_t)(uint16_t)((a) - (b)))
+/* Range of the selective ACK bitmap */
+#define RCV_RANGE              (32)
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static pl_rel_send_fn_t s_send;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+/*! @brief Milliseconds to ProtocolLayer_timerTicks() ticks. */
+static uint32_t MsToTicks(uint32_t ms)
+{
+    return (ProtocolLayer_timerHz() / 1000U) * ms;
+}
+
+/*! @brief Ticks to microseconds, for the statistics. */
+static uint32_t TicksToUs(uint32_t ticks)
+{
+    return (uint32_t)(((uint64_t)ticks * 1000000U) / ProtocolLayer_timerHz());
+}
+
+/*! @brief Update SRTT/RTTVAR with a new sample and recompute the RTO. */
+static void RttSample(pl_rel_peer_t* rel, uint32_t rtt)
+{
+    if (rel->srtt == 0U)
+    {
+        rel->srtt = rtt;
+        rel->rttvar = rtt / 2U;
+    }
+    else
+    {
+        uint32_t err = (rtt > rel->srtt) ? (rtt - rel->srtt) : (rel->srtt - rtt);
+        rel->rttvar = rel->rttvar - (rel->rttvar / 4U) + (err / 4U);
+        rel->srtt = rel->srtt - (rel->srtt / 8U) + (rtt / 8U);
+    }
+
+    rel->rto = rel->srtt + (4U * rel->rttvar);
+    if (rel->rto < MsToTicks(PROTOCOL_LAYER_RELIABLE_RTO_MIN_MS))
+    {
+        rel->rto = MsToTicks(PROTOCOL_LAYER_RELIABLE_RTO_MIN_MS);
+    }
+    if (rel->rto > MsToTicks(PROTOCOL_LAYER_RELIABLE_RTO_MAX_MS))
+    {
+        rel->rto = MsToTicks(PROTOCOL_LAYER_RELIABLE_RTO_MAX_MS);
+    }
+}
+
+/*! @brief Acknowledge one frame of the send window; rtt gets its round trip
+ *         time unless it was retransmitted. */
+static void Ack(pl_rel_peer_t* rel, pl_rel_slot_t* slot, uint32_t now, uint32_t* rtt)
+{
+    if (slot->acked)
+    {
+        return;
+    }
+    slot->acked = true;
+    rel->stats.acked++;
+    if (!slot->retransmitted)
+    {
+        *rtt = now - slot->sentTick;
+    }
+}
+
+/*! @brief Whether a received frame sets a new starting point: any frame
+ *         before the first one, or a SYN other than a copy of the one
+ *         synced to. */
+static bool Resyncs(const pl_rel_peer_t* rel, uint16_t seq, bool syn)
+{
+    int16_t since = SEQ_DIFF(rel->rcvNext, rel->rcvSyn);
+
+    return !rel->rcvSynced || (syn && ((seq != rel->rcvSyn) || (since <= 0) || (since > RCV_RANGE)));
+}
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Set the function used for retransmissions and pure ACKs. */
+void ProtocolLayer_relInit(pl_rel_send_fn_t send)
+{
+    s_send = send;
+}
+
+/*! @brief Reset both directions of a peer. */
+void ProtocolLayer_relReset(pl_rel_peer_t* rel)
+{
+    memset(rel, 0, sizeof(*rel));
+    rel->rto = MsToTicks(PROTOCOL_LAYER_RELIABLE_RTO_INIT_MS);
+    rel->sndSyn = true;
+}
+
+/*! @brief Frames that can be queued before the window is full; only the
+ *         SYN until it is acknowledged. */
+uint32_t ProtocolLayer_relWindowSpace(const pl_rel_peer_t* rel)
+{
+    uint16_t inFlight = (uint16_t)(rel->sndNext - rel->sndUna);
+
+    if (rel->sndSyn)
+    {
+        return (inFlight == 0U) ? 1U : 0U;
+    }
+    return PROTOCOL_LAYER_RELIABLE_WINDOW - inFlight;
+}
+
+/*! @brief Keep a copy of a frame about to be sent until it is acknowledged.
+ *         Check ProtocolLayer_relWindowSpace() first.
+ *  @return the sequence number to send it with. */
+uint16_t ProtocolLayer_relQueue(pl_rel_peer_t* rel, const uint8_t* message, size_t length, const pl_frag_t* frag,
+                                uint16_t flags)
+{
+    uint16_t seq;
+    pl_rel_slot_t* slot;
+
+    if (rel->sndSyn && (rel->sndNext == rel->sndUna))
+    {
+        // Starting point of this boot: the timer runs at a different phase
+        // every time the first frame goes out
+        uint32_t ticks = ProtocolLayer_timerTicks();
+        rel->sndUna = (uint16_t)(ticks ^ (ticks >> 16));
+        rel->sndNext = rel->sndUna;
+    }
+    seq = rel->sndNext++;
+    slot = &rel->slots[seq % PROTOCOL_LAYER_RELIABLE_WINDOW];
+
+    slot->used = true;
+    slot->syn = rel->sndSyn;
+    slot->acked = false;
+    slot->retransmitted = false;
+    slot->seq = seq;
+    slot->flags = flags;
+    slot->hasFrag = (frag != NULL);
+    if (frag != NULL)
+    {
+        slot->frag = *frag;
+    }
+    slot->length = (length < sizeof(slot->message)) ? length : sizeof(slot->message);
+    memcpy(slot->message, message, slot->length);
+    slot->sentTick = ProtocolLayer_timerTicks();
+
+    rel->stats.sent++;
+    return seq;
+}
+
+/*! @brief Whether the frame with this sequence number is sent as a SYN. */
+bool ProtocolLayer_relIsSyn(const pl_rel_peer_t* rel, uint16_t seq)
+{
+    const pl_rel_slot_t* slot = &rel->slots[seq % PROTOCOL_LAYER_RELIABLE_WINDOW];
+
+    return slot->used && (slot->seq == seq) && slot->syn;
+}
+
+/*! @brief Whether the receive side has a starting point, so frames sent
+ *         to the peer can carry an ACK extension. */
+bool ProtocolLayer_relAckReady(const pl_rel_peer_t* rel)
+{
+    return rel->rcvSynced;
+}
+
+/*! @brief Serialize a sequence extension. */
+void ProtocolLayer_relWriteSeq(uint8_t* ext, uint16_t seq)
+{
+    ext[0] = (uint8_t)(seq & 0xFFU);
+    ext[1] = (uint8_t)(seq >> 8);
+}
+
+/*! @brief Serialize the ACK extension; the frame carrying it satisfies any
+ *         pending ACK. */
+void ProtocolLayer_relWriteAck(pl_rel_peer_t* rel, uint8_t* ext)
+{
+    ext[0] = (uint8_t)(rel->rcvNext & 0xFFU);
+    ext[1] = (uint8_t)(rel->rcvNext >> 8);
+    ext[2] = (uint8_t)(rel->rcvMask & 0xFFU);
+    ext[3] = (uint8_t)((rel->rcvMask >> 8) & 0xFFU);
+    ext[4] = (uint8_t)((rel->rcvMask >> 16) & 0xFFU);
+    ext[5] = (uint8_t)(rel->rcvMask >> 24);
+    rel->ackPending = false;
+    rel->ackNow = false;
+}
+
+/*! @brief Check a received sequence extension; syn is set for a SYN frame.
+ *         Nothing is recorded: call ProtocolLayer_relAccept() once the
+ *         frame has been taken.
+ *  @return false for a duplicate or a frame outside the window, which must
+ *          not be delivered; it is acknowledged again. */
+bool ProtocolLayer_relOnData(pl_rel_peer_t* rel, const uint8_t* ext, bool syn)
+{
+    uint16_t seq = (uint16_t)(ext[0] | (ext[1] << 8));
+    int16_t offset = SEQ_DIFF(seq, rel->rcvNext);
+
+    if (Resyncs(rel, seq, syn))
+    {
+        return true;
+    }
+    if ((offset >= RCV_RANGE) && (offset < (RCV_RANGE + (int16_t)PROTOCOL_LAYER_RELIABLE_WINDOW)))
+    {
+        // Beyond the bitmap by less than a window: moves it up on accept
+        return true;
+    }
+    if ((offset < 0) || (offset >= RCV_RANGE) || ((rel->rcvMask & (1UL << offset)) != 0U))
+    {
+        // Acknowledge duplicates at once: the earlier ACK may have been lost
+        if (!rel->ackPending)
+        {
+            rel->ackSince = ProtocolLayer_timerTicks();
+        }
+        rel->ackPending = true;
+        rel->ackNow = true;
+        rel->stats.duplicates++;
+        return false;
+    }
+    return true;
+}
+
+/*! @brief Record a frame passed by ProtocolLayer_relOnData() as received,
+ *         once the layer above has taken it; it is acknowledged from now on. */
+void ProtocolLayer_relAccept(pl_rel_peer_t* rel, const uint8_t* ext, bool syn)
+{
+    uint16_t seq = (uint16_t)(ext[0] | (ext[1] << 8));
+    int16_t offset;
+
+    if (Resyncs(rel, seq, syn))
+    {
+        // Not a SYN: the frames of the window before it may still come,
+        // and no value a copy of a SYN can match
+        rel->rcvNext = syn ? seq : (uint16_t)(seq - (PROTOCOL_LAYER_RELIABLE_WINDOW - 1U));
+        rel->rcvMask = 0;
+        rel->rcvSynced = true;
+        rel->rcvSyn = syn ? seq : (uint16_t)(seq + 0x8000U);
+    }
+    offset = SEQ_DIFF(seq, rel->rcvNext);
+    if ((offset >= RCV_RANGE) && (offset < (RCV_RANGE + (int16_t)PROTOCOL_LAYER_RELIABLE_WINDOW)))
+    {
+        // Everything more than a bitmap behind this frame was acknowledged
+        uint16_t shift = (uint16_t)(offset - (RCV_RANGE - 1));
+        rel->rcvMask = (shift < 32U) ? (rel->rcvMask >> shift) : 0U;
+        rel->rcvNext = (uint16_t)(rel->rcvNext + shift);
+        offset = RCV_RANGE - 1;
+    }
+    if ((offset < 0) || (offset >= RCV_RANGE))
+    {
+        return;
+    }
+
+    if (!rel->ackPending)
+    {
+        rel->ackSince = ProtocolLayer_timerTicks();
+    }
+    rel->ackPending = true;
+    rel->rcvMask |= (1UL << offset);
+    if (offset != 0)
+    {
+        // A gap: tell the sender at once which frames are missing
+        rel->ackNow = true;
+    }
+    while ((rel->rcvMask & 1U) != 0U)
+    {
+        rel->rcvMask >>= 1;
+        rel->rcvNext++;
+    }
+}
+
+/*! @brief Process a received ACK extension: release the frames it covers and
+ *         take an RTT sample from the newest one sent only once. */
+void ProtocolLayer_relOnAck(pl_rel_peer_t* rel, const uint8_t* ext)
+{
+    uint16_t cumulative = (uint16_t)(ext[0] | (ext[1] << 8));
+    uint32_t sack = (uint32_t)ext[2] | ((uint32_t)ext[3] << 8) | ((uint32_t)ext[4] << 16) | ((uint32_t)ext[5] << 24);
+    uint32_t now = ProtocolLayer_timerTicks();
+    uint32_t rtt = 0;
+    // A receiver that reset may hold its ACK point up to a bitmap behind,
+    // selective bits still acknowledge; while the SYN is out, nothing
+    // before it is valid
+    int16_t behind = rel->sndSyn ? 0 : RCV_RANGE;
+
+    // Ignore ACKs for frames never sent, and stale ones from before a reset
+    if ((SEQ_DIFF(cumulative, rel->sndNext) > 0) || (SEQ_DIFF(cumulative, rel->sndUna) < -behind))
+    {
+        return;
+    }
+
+    for (uint16_t seq = rel->sndUna; seq != rel->sndNext; seq++)
+    {
+        pl_rel_slot_t* slot = &rel->slots[seq % PROTOCOL_LAYER_RELIABLE_WINDOW];
+        int16_t offset = SEQ_DIFF(seq, cumulative);
+
+        if ((offset < 0) || ((offset < 32) && ((sack & (1UL << offset)) != 0U)))
+        {
+            Ack(rel, slot, now, &rtt);
+        }
+    }
+    if (rtt != 0U)
+    {
+        RttSample(rel, rtt);
+    }
+
+    while ((rel->sndUna != rel->sndNext) && rel->slots[rel->sndUna % PROTOCOL_LAYER_RELIABLE_WINDOW].acked)
+    {
+        rel->slots[rel->sndUna % PROTOCOL_LAYER_RELIABLE_WINDOW].used = false;
+        rel->sndUna++;
+        // The SYN is through, the whole window opens
+        rel->sndSyn = false;
+    }
+}
+
+/*! @brief Retransmit the frames of a peer whose timer expired and send a
+ *         pure ACK when one is due; call it for every peer from the idle loop. */
+void ProtocolLayer_relService(pl_rel_peer_t* rel, struct pl_peer* peer)
+{
+    uint32_t now = ProtocolLayer_timerTicks();
+    bool expired = false;
+
+    for (uint16_t seq = rel->sndUna; seq != rel->sndNext; seq++)
+    {
+        pl_rel_slot_t* slot = &rel->slots[seq % PROTOCOL_LAYER_RELIABLE_WINDOW];
+
+        if (slot->used && !slot->acked && ((now - slot->sentTick) >= rel->rto))
+        {
+            // Refused (e.g. no credit): the timer stays expired, retry later
+            if (!s_send(peer, slot->message, slot->length, slot->hasFrag ? &slot->frag : NULL, slot->flags,
+                        slot->seq))
+            {
+                break;
+            }
+            slot->retransmitted = true;
+            slot->sentTick = now;
+            rel->stats.retransmits++;
+            expired = true;
+        }
+    }
+    if (expired)
+    {
+        // Back off until an ACK gives a new RTT sample
+        rel->rto = ((rel->rto * 2U) < MsToTicks(PROTOCOL_LAYER_RELIABLE_RTO_MAX_MS)) ?
+                       (rel->rto * 2U) : MsToTicks(PROTOCOL_LAYER_RELIABLE_RTO_MAX_MS);
+    }
+
+    if (rel->ackPending &&
+        (rel->ackNow || ((now - rel->ackSince) >= ((ProtocolLayer_timerHz() / 1000000U) *
+                                                   PROTOCOL_LAYER_RELIABLE_ACK_DELAY_US))))
+    {
+        (void)s_send(peer, (const uint8_t*)"", 0, NULL, 0U, PL_REL_NO_SEQ);
+    }
+}
+
+/*! @brief Window and RTT counters of a peer, for logging. */
+void ProtocolLayer_relGetStats(const pl_rel_peer_t* rel, pl_reliable_stats_t* stats)
+{
+    *stats = rel->stats;
+    stats->inFlight = (uint16_t)(rel->sndNext - rel->sndUna);
+    stats->srttUs = TicksToUs(rel->srtt);
+    stats->rtoUs = TicksToUs(rel->rto);
+}
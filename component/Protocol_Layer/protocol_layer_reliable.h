@@ -0,0 +1,106 @@
+/*
+This file declares the reliable delivery layer: a sliding send window with
+sequence numbers, cumulative plus selective ACKs carried in the header of
+every frame, and retransmission timers that follow the measured RTT. The
+state is kept per peer in a pl_rel_peer_t. The first frame after a reset
+is a SYN, which tells the receiver where the sequence numbers start.
+*/
+
+#ifndef _PROTOCOL_LAYER_RELIABLE_H_
+#define _PROTOCOL_LAYER_RELIABLE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+#include "protocol_layer_frag.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* Sequence extension: sequence number of the frame, 2 bytes little endian */
+#define PL_EXT_SEQ_SIZE        (2)
+/* ACK extension: next expected sequence number (2 bytes) and a 32-bit
+ * bitmap, bit n set when sequence number ack + n has been received */
+#define PL_EXT_ACK_SIZE        (6)
+#define PL_REL_NO_SEQ          (0xFFFFFFFFU)
+
+struct pl_peer;
+
+/* Transmits a frame to a peer for the reliable layer: a retransmission (seq
+ * set) or a pure ACK (seq PL_REL_NO_SEQ, empty message). Returns false if
+ * the frame cannot go out now. */
+typedef bool (*pl_rel_send_fn_t)(struct pl_peer* peer, const uint8_t* message, size_t length, const pl_frag_t* frag,
+                                 uint16_t flags, uint32_t seq);
+
+typedef struct
+{
+    uint32_t sent;          /* frames sent with a sequence number */
+    uint32_t retransmits;   /* frames sent again after their timer expired */
+    uint32_t acked;         /* frames acknowledged, cumulatively or selectively */
+    uint32_t duplicates;    /* received frames dropped as already seen */
+    uint32_t inFlight;      /* frames sent and not acknowledged yet */
+    uint32_t srttUs;        /* smoothed round trip time */
+    uint32_t rtoUs;         /* current retransmission timeout */
+} pl_reliable_stats_t;
+
+typedef struct
+{
+    bool used;
+    bool acked;
+    bool retransmitted;             /* Karn: no RTT sample from this frame */
+    bool hasFrag;
+    bool syn;                       /* first frame after a reset */
+    uint16_t seq;
+    uint16_t flags;
+    pl_frag_t frag;
+    uint32_t sentTick;
+    size_t length;
+    uint8_t message[PROTOCOL_LAYER_FRAG_CHUNK];
+} pl_rel_slot_t;
+
+/* Sequence state of one peer */
+typedef struct
+{
+    /* Send side */
+    uint16_t sndUna;                /* oldest frame not acknowledged */
+    uint16_t sndNext;               /* sequence number of the next frame */
+    bool sndSyn;                    /* SYN not acknowledged yet, one frame in flight */
+    pl_rel_slot_t slots[PROTOCOL_LAYER_RELIABLE_WINDOW];
+    uint32_t srtt;                  /* ticks, 0 until the first sample */
+    uint32_t rttvar;
+    uint32_t rto;
+
+    /* Receive side */
+    uint16_t rcvNext;               /* next sequence number expected */
+    uint32_t rcvMask;               /* bit n: rcvNext + n received */
+    bool rcvSynced;                 /* rcvNext is known, ACKs can be sent */
+    uint16_t rcvSyn;                /* sequence number of the last SYN synced to */
+    bool ackPending;
+    bool ackNow;                    /* out of order frame, ACK without delay */
+    uint32_t ackSince;
+
+    pl_reliable_stats_t stats;
+} pl_rel_peer_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+void ProtocolLayer_relInit(pl_rel_send_fn_t send);
+void ProtocolLayer_relReset(pl_rel_peer_t* rel);
+void ProtocolLayer_relService(pl_rel_peer_t* rel, struct pl_peer* peer);
+uint32_t ProtocolLayer_relWindowSpace(const pl_rel_peer_t* rel);
+uint16_t ProtocolLayer_relQueue(pl_rel_peer_t* rel, const uint8_t* message, size_t length, const pl_frag_t* frag,
+                                uint16_t flags);
+
+bool ProtocolLayer_relIsSyn(const pl_rel_peer_t* rel, uint16_t seq);
+bool ProtocolLayer_relAckReady(const pl_rel_peer_t* rel);
+
+void ProtocolLayer_relWriteSeq(uint8_t* ext, uint16_t seq);
+void ProtocolLayer_relWriteAck(pl_rel_peer_t* rel, uint8_t* ext);
+bool ProtocolLayer_relOnData(pl_rel_peer_t* rel, const uint8_t* ext, bool syn);
+void ProtocolLayer_relAccept(pl_rel_peer_t* rel, const uint8_t* ext, bool syn);
+void ProtocolLayer_relOnAck(pl_rel_peer_t* rel, const uint8_t* ext);
+void ProtocolLayer_relGetStats(const pl_rel_peer_t* rel, pl_reliable_stats_t* stats);
+
+#endif // _PROTOCOL_LAYER_RELIABLE_H_
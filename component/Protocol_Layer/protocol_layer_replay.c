@@ -0,0 +1,78 @@
+/*
+This file contains the anti-replay window (RFC 4303 style). Counters are
+compared in serial arithmetic, so the window keeps working when the 32-bit
+counter wraps: a counter up to 2^31 ahead of the top moves the window, one
+behind it is looked up in the bitmap or is too old. A check is a
+subtraction, a shift and a mask, with no allocation.
+
+The check runs after the trailer has been verified, so forged counters
+never move the window.
+*/
+
+#include <string.h>
+#include "protocol_layer_replay.h"
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Empty the window, the next frame is accepted whatever its counter. */
+void ProtocolLayer_replayReset(pl_replay_t* replay)
+{
+    memset(replay, 0, sizeof(*replay));
+}
+
+/*! @brief Serialize the replay extension of a frame being sent. */
+void ProtocolLayer_replayWrite(uint8_t* ext, uint32_t counter)
+{
+    ext[0] = (uint8_t)(counter & 0xFFU);
+    ext[1] = (uint8_t)((counter >> 8) & 0xFFU);
+    ext[2] = (uint8_t)((counter >> 16) & 0xFFU);
+    ext[3] = (uint8_t)(counter >> 24);
+}
+
+/*! @brief Check the replay extension of an authenticated frame and record it.
+ *  @return false for a duplicate or a frame older than the window, which
+ *          must be dropped. */
+bool ProtocolLayer_replayCheck(pl_replay_t* replay, const uint8_t* ext)
+{
+    uint32_t counter = (uint32_t)ext[0] | ((uint32_t)ext[1] << 8) | ((uint32_t)ext[2] << 16) |
+                       ((uint32_t)ext[3] << 24);
+    int32_t ahead = (int32_t)(counter - replay->top);
+
+    if ((replay->bitmap == 0U) || (ahead > 0))
+    {
+        // New highest counter: slide the window
+        if ((replay->bitmap == 0U) || ((uint32_t)ahead >= PL_REPLAY_WINDOW))
+        {
+            replay->bitmap = 1U;
+        }
+        else
+        {
+            replay->bitmap = (replay->bitmap << ahead) | 1U;
+        }
+        replay->top = counter;
+        replay->stats.accepted++;
+        return true;
+    }
+
+    uint32_t behind = replay->top - counter;
+    if (behind >= PL_REPLAY_WINDOW)
+    {
+        replay->stats.tooOld++;
+        return false;
+    }
+    if ((replay->bitmap & ((uint64_t)1U << behind)) != 0U)
+    {
+        replay->stats.duplicates++;
+        return false;
+    }
+    replay->bitmap |= ((uint64_t)1U << behind);
+    replay->stats.accepted++;
+    return true;
+}
+
+/*! @brief Replay counters of a session, for logging. */
+void ProtocolLayer_replayGetStats(const pl_replay_t* replay, pl_replay_stats_t* stats)
+{
+    *stats = replay->stats;
+}
@@ -0,0 +1,46 @@
+/*
+This file declares the anti-replay window. Every frame carries a 32-bit
+counter of its session, covered by the CRC32 or CMAC trailer; the receiver
+keeps the highest counter seen and a 64-bit bitmap of the frames before it,
+so a copy of an authentic frame is rejected, even out of order.
+*/
+
+#ifndef _PROTOCOL_LAYER_REPLAY_H_
+#define _PROTOCOL_LAYER_REPLAY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* Replay extension: frame counter of the session, 4 bytes little endian */
+#define PL_EXT_REPLAY_SIZE     (4)
+#define PL_REPLAY_WINDOW       (64U)
+
+typedef struct
+{
+    uint32_t accepted;      /* frames with a new counter */
+    uint32_t duplicates;    /* counter inside the window, already seen */
+    uint32_t tooOld;        /* counter behind the window */
+} pl_replay_stats_t;
+
+/* Receive window of one session */
+typedef struct
+{
+    uint32_t top;                   /* highest counter accepted */
+    uint64_t bitmap;                /* bit n: top - n accepted, 0 before the first frame */
+    pl_replay_stats_t stats;
+} pl_replay_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+void ProtocolLayer_replayReset(pl_replay_t* replay);
+void ProtocolLayer_replayWrite(uint8_t* ext, uint32_t counter);
+bool ProtocolLayer_replayCheck(pl_replay_t* replay, const uint8_t* ext);
+void ProtocolLayer_replayGetStats(const pl_replay_t* replay, pl_replay_stats_t* stats);
+
+#endif // _PROTOCOL_LAYER_REPLAY_H_
@@ -0,0 +1,212 @@
+/*
+This file contains the descriptor rings of the MAC and their buffers. The
+descriptor tables are sized for PROTOCOL_LAYER_RING_MAX entries, which
+costs a few bytes per entry, and ProtocolLayer_ringConfigure() picks how
+many of them the MAC gets. SRAM holds frame buffers for
+PROTOCOL_LAYER_RING_SRAM_RX receive and PROTOCOL_LAYER_RING_SRAM_TX
+transmit descriptors; with PROTOCOL_LAYER_RING_PSRAM deeper rings take
+their buffers from the PSRAM instead, receive buffers first.
+
+The PSRAM is behind CACHE64, which the MAC does not snoop. The region of
+the ring buffers is made non-cacheable, the rest of the PSRAM keeps the
+policy BOARD_InitPsRam() set. A received frame is read once by
+ENET_ReadFrame() and a frame to send is written once, so a cache would
+not save any access, and the FlexSPI prefetch still serves the reads.
+
+The host build (PROTOCOL_LAYER_HOST_BUILD) only has the choice of the
+depths and the counters, without the tables, buffers and ENET calls.
+*/
+
+#include <string.h>
+#include "protocol_layer_ring.h"
+#ifndef PROTOCOL_LAYER_HOST_BUILD
+#include "protocol_layer.h"
+#include "board.h"
+#include "fsl_debug_console.h"
+#if PROTOCOL_LAYER_RING_PSRAM
+#include "fsl_cache.h"
+#endif
+#endif
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#if (PROTOCOL_LAYER_RING_MAX < 2U) || (PROTOCOL_LAYER_RING_MAX > 255U)
+#error "PROTOCOL_LAYER_RING_MAX must be 2 to 255"
+#endif
+#if (PROTOCOL_LAYER_RING_SRAM_RX < 2U) || (PROTOCOL_LAYER_RING_SRAM_RX > PROTOCOL_LAYER_RING_MAX) || \
+    (PROTOCOL_LAYER_RING_SRAM_TX < 1U) || (PROTOCOL_LAYER_RING_SRAM_TX > PROTOCOL_LAYER_RING_MAX)
+#error "PROTOCOL_LAYER_RING_SRAM_RX/TX must be 2/1 to PROTOCOL_LAYER_RING_MAX"
+#endif
+#if PROTOCOL_LAYER_CREDIT && (PROTOCOL_LAYER_CREDIT_WINDOW >= PROTOCOL_LAYER_RING_SRAM_RX)
+#error "PROTOCOL_LAYER_CREDIT_WINDOW must leave one receive descriptor free"
+#endif
+
+#ifndef PROTOCOL_LAYER_HOST_BUILD
+#define RX_BUFF_SIZE           SDK_SIZEALIGN(ENET_RXBUFF_SIZE, APP_ENET_BUFF_ALIGNMENT)
+#define TX_BUFF_SIZE           SDK_SIZEALIGN(ENET_TXBUFF_SIZE, APP_ENET_BUFF_ALIGNMENT)
+
+/* Start of the memory behind CACHE64_CTRL1, where its regions are counted from */
+#define PSRAM_CACHE_BASE       (0x28000000U)
+#endif
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+#ifndef PROTOCOL_LAYER_HOST_BUILD
+AT_NONCACHEABLE_SECTION_ALIGN(enet_rx_bd_struct_t g_rxBuffDescrip[PROTOCOL_LAYER_RING_MAX], ENET_BUFF_ALIGNMENT);
+AT_NONCACHEABLE_SECTION_ALIGN(enet_tx_bd_struct_t g_txBuffDescrip[PROTOCOL_LAYER_RING_MAX], ENET_BUFF_ALIGNMENT);
+SDK_ALIGN(uint8_t g_rxDataBuff[PROTOCOL_LAYER_RING_SRAM_RX][RX_BUFF_SIZE], APP_ENET_BUFF_ALIGNMENT);
+SDK_ALIGN(uint8_t g_txDataBuff[PROTOCOL_LAYER_RING_SRAM_TX][TX_BUFF_SIZE], APP_ENET_BUFF_ALIGNMENT);
+#endif
+
+static pl_ring_config_t s_config = {PROTOCOL_LAYER_RING_SRAM_RX, PROTOCOL_LAYER_RING_SRAM_TX, kPL_RingMemory_Sram};
+static pl_ring_stats_t s_stats;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+#if PROTOCOL_LAYER_RING_PSRAM && !defined(PROTOCOL_LAYER_HOST_BUILD)
+/*! @brief Bring up the PSRAM and place the frame buffers at
+ *         PROTOCOL_LAYER_RING_PSRAM_BASE, outside the cache.
+ *  @return false if the PSRAM does not answer. */
+static bool SetupPsram(enet_buffer_config_t* buffConfig)
+{
+    uint32_t rxBytes = (uint32_t)s_config.rxDepth * RX_BUFF_SIZE;
+    uint32_t txBytes = (uint32_t)s_config.txDepth * TX_BUFF_SIZE;
+
+    if (BOARD_InitPsRam() != kStatus_Success)
+    {
+        return false;
+    }
+
+#if BOARD_ENABLE_PSRAM_CACHE
+    // Region 0 ends after the ring buffers, region 1 keeps the default policy
+    cache64_config_t cacheConfig;
+    CACHE64_GetDefaultConfig(&cacheConfig);
+    cacheConfig.boundaryAddr[1] = cacheConfig.boundaryAddr[0];
+    cacheConfig.policy[1] = cacheConfig.policy[0];
+    cacheConfig.boundaryAddr[0] =
+        SDK_SIZEALIGN((PROTOCOL_LAYER_RING_PSRAM_BASE - PSRAM_CACHE_BASE) + rxBytes + txBytes,
+                      CACHE64_REGION_ALIGNMENT);
+    cacheConfig.policy[0] = kCACHE64_PolicyNonCacheable;
+    CACHE64_CleanInvalidateCache(CACHE64_CTRL1);
+    (void)CACHE64_Init(CACHE64_POLSEL1, &cacheConfig);
+#endif
+
+    buffConfig->rxBufferAlign = (uint8_t*)(uintptr_t)PROTOCOL_LAYER_RING_PSRAM_BASE;
+    buffConfig->txBufferAlign = (uint8_t*)(uintptr_t)(PROTOCOL_LAYER_RING_PSRAM_BASE + rxBytes);
+    return true;
+}
+#endif
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Choose the rings, before ProtocolLayer_init(). Without a call the
+ *         rings are PROTOCOL_LAYER_RING_SRAM_RX/TX deep, in SRAM.
+ *  @return false if the depths do not fit the memory chosen; the previous
+ *          choice is kept. */
+bool ProtocolLayer_ringConfigure(const pl_ring_config_t* config)
+{
+    uint8_t rxMax = PROTOCOL_LAYER_RING_SRAM_RX;
+    uint8_t txMax = PROTOCOL_LAYER_RING_SRAM_TX;
+
+    if (config->memory == kPL_RingMemory_Psram)
+    {
+#if PROTOCOL_LAYER_RING_PSRAM
+        rxMax = PROTOCOL_LAYER_RING_MAX;
+        txMax = PROTOCOL_LAYER_RING_MAX;
+#else
+        return false;
+#endif
+    }
+    else if (config->memory != kPL_RingMemory_Sram)
+    {
+        return false;
+    }
+
+    if ((config->rxDepth < 2U) || (config->rxDepth > rxMax) || (config->txDepth < 1U) ||
+        (config->txDepth > txMax))
+    {
+        return false;
+    }
+#if PROTOCOL_LAYER_CREDIT
+    // The peer may send a window of frames beyond the last one processed
+    if (config->rxDepth <= PROTOCOL_LAYER_CREDIT_WINDOW)
+    {
+        return false;
+    }
+#endif
+    s_config = *config;
+    return true;
+}
+
+#ifndef PROTOCOL_LAYER_HOST_BUILD
+/*! @brief Fill the buffer configuration of ENET_Init(). A PSRAM that does not
+ *         come up leaves the rings in SRAM at their SRAM depth. */
+void ProtocolLayer_ringSetup(enet_buffer_config_t* buffConfig)
+{
+    memset(&s_stats, 0, sizeof(s_stats));
+
+#if PROTOCOL_LAYER_RING_PSRAM
+    if ((s_config.memory == kPL_RingMemory_Psram) && !SetupPsram(buffConfig))
+    {
+        PRINTF("PSRAM init failed, rings in SRAM.\r\n");
+        s_config.rxDepth = PROTOCOL_LAYER_RING_SRAM_RX;
+        s_config.txDepth = PROTOCOL_LAYER_RING_SRAM_TX;
+        s_config.memory = kPL_RingMemory_Sram;
+    }
+#endif
+    if (s_config.memory == kPL_RingMemory_Sram)
+    {
+        buffConfig->rxBufferAlign = &g_rxDataBuff[0][0];
+        buffConfig->txBufferAlign = &g_txDataBuff[0][0];
+    }
+
+    buffConfig->rxBdNumber = s_config.rxDepth;
+    buffConfig->txBdNumber = s_config.txDepth;
+    buffConfig->rxBuffSizeAlign = RX_BUFF_SIZE;
+    buffConfig->txBuffSizeAlign = TX_BUFF_SIZE;
+    buffConfig->rxBdStartAddrAlign = &g_rxBuffDescrip[0];
+    buffConfig->txBdStartAddrAlign = &g_txBuffDescrip[0];
+    buffConfig->rxMaintainEnable = true;
+    buffConfig->txMaintainEnable = true;
+    buffConfig->txFrameInfo = NULL;
+    s_stats.config = s_config;
+}
+#endif
+
+/*! @brief Receive descriptors in use. */
+uint8_t ProtocolLayer_ringRxDepth(void)
+{
+    return s_config.rxDepth;
+}
+
+/*! @brief Count the frames found in the receive ring in one pass. */
+void ProtocolLayer_ringOnDrain(uint32_t frames)
+{
+    if (frames > s_stats.rxPeak)
+    {
+        s_stats.rxPeak = frames;
+    }
+}
+
+/*! @brief Count a frame that found every transmit descriptor taken. */
+void ProtocolLayer_ringOnTxFull(void)
+{
+    s_stats.txFull++;
+}
+
+#ifndef PROTOCOL_LAYER_HOST_BUILD
+/*! @brief Ring counters, for logging; the overflows are the MAC's count of
+ *         frames lost because no receive descriptor was free. */
+void ProtocolLayer_ringGetStats(ENET_Type* base, pl_ring_stats_t* stats)
+{
+    enet_transfer_stats_t mac;
+
+    ENET_GetStatistics(base, &mac);
+    *stats = s_stats;
+    stats->rxOverflow = mac.statsRxFifoOverflowErr;
+}
+#endif
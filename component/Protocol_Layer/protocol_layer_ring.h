@@ -0,0 +1,59 @@
+/*
+This file declares the placement of the ENET descriptor rings. The depth
+of the receive and transmit rings is chosen at init time, up to
+PROTOCOL_LAYER_RING_MAX, and their frame buffers are either in SRAM or,
+for rings deeper than the SRAM reserve, in the PSRAM set up by
+BOARD_InitPsRam(). The descriptors themselves always stay in
+non-cacheable SRAM. The choice of the depths builds on the host
+(PROTOCOL_LAYER_HOST_BUILD) as well, without the ENET parts.
+*/
+
+#ifndef _PROTOCOL_LAYER_RING_H_
+#define _PROTOCOL_LAYER_RING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+#ifndef PROTOCOL_LAYER_HOST_BUILD
+#include "fsl_enet.h"
+#endif
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+typedef enum
+{
+    kPL_RingMemory_Sram = 0,        /* static buffers, PROTOCOL_LAYER_RING_SRAM_RX/TX of them */
+    kPL_RingMemory_Psram,           /* PSRAM at PROTOCOL_LAYER_RING_PSRAM_BASE, not cached */
+    kPL_RingMemory_Num
+} pl_ring_memory_t;
+
+typedef struct
+{
+    uint8_t rxDepth;                /* receive descriptors, 2 to PROTOCOL_LAYER_RING_MAX */
+    uint8_t txDepth;                /* transmit descriptors, 1 to PROTOCOL_LAYER_RING_MAX */
+    uint8_t memory;                 /* pl_ring_memory_t of the frame buffers */
+} pl_ring_config_t;
+
+typedef struct
+{
+    pl_ring_config_t config;        /* rings in use */
+    uint32_t rxOverflow;            /* frames the MAC lost, every receive descriptor full */
+    uint32_t rxPeak;                /* most frames found in the receive ring at once */
+    uint32_t txFull;                /* times a frame found the transmit ring full */
+} pl_ring_stats_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+bool ProtocolLayer_ringConfigure(const pl_ring_config_t* config);
+uint8_t ProtocolLayer_ringRxDepth(void);
+void ProtocolLayer_ringOnDrain(uint32_t frames);
+void ProtocolLayer_ringOnTxFull(void);
+#ifndef PROTOCOL_LAYER_HOST_BUILD
+void ProtocolLayer_ringSetup(enet_buffer_config_t* buffConfig);
+void ProtocolLayer_ringGetStats(ENET_Type* base, pl_ring_stats_t* stats);
+#endif
+
+#endif // _PROTOCOL_LAYER_RING_H_
@@ -0,0 +1,182 @@
+/*
+This file contains the outstanding request table. A request takes a free
+slot; its correlation ID is the slot index in the low byte and a
+generation count in the high byte, so a reply finds its slot with one
+index and a late reply to an expired request, whose slot has been reused
+since, does not match. Deadlines are checked from ProtocolLayer_rpcPoll().
+
+The request is copied into the frame (or the reliable and credit queues)
+by ProtocolLayer_sendToFlags(), so the caller's buffer is free on return.
+Requests and replies go out with PL_FLAG_RPC in the header, and only a
+message received with it is taken for a reply.
+*/
+
+#include <string.h>
+#include "protocol_layer_rpc.h"
+#include "protocol_layer.h"
+#include "protocol_layer_backend.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#if ((PROTOCOL_LAYER_RPC_SLOTS == 0U) || (PROTOCOL_LAYER_RPC_SLOTS > 256U))
+#error "PROTOCOL_LAYER_RPC_SLOTS must be 1 to 256"
+#endif
+
+typedef struct
+{
+    bool used;
+    uint16_t id;
+    uint8_t mac[MAC_DATA_SIZE];
+    uint32_t start;
+    uint32_t timeoutTicks;
+    pl_rpc_done_fn_t done;
+    void* context;
+} rpc_slot_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static rpc_slot_t s_slots[PROTOCOL_LAYER_RPC_SLOTS];
+static uint8_t s_generation;
+static uint8_t s_request[PROTOCOL_LAYER_MAX_MESSAGE];
+static pl_rpc_stats_t s_stats;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+/*! @brief Release a slot and complete its request. */
+static void Complete(rpc_slot_t* slot, pl_rpc_status_t status, const uint8_t* reply, size_t length)
+{
+    // Free first: the callback may issue the next request
+    slot->used = false;
+    s_stats.outstanding--;
+    slot->done(slot->context, status, reply, length);
+}
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Empty the request table. */
+void ProtocolLayer_rpcInit(void)
+{
+    memset(s_slots, 0, sizeof(s_slots));
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+/*! @brief Send a request to a peer without waiting for the reply; done is
+ *         called from ProtocolLayer_rpcPoll() with the reply or on timeout.
+ *         timeoutMs must stay below half the timer wrap (a few seconds).
+ *  @return false if the request was not sent: table full, request too long,
+ *          or ProtocolLayer_sendToFlags() refused it (poll and retry). */
+bool ProtocolLayer_rpcCall(const uint8_t* mac, const uint8_t* request, size_t length, uint32_t timeoutMs,
+                           pl_rpc_done_fn_t done, void* context)
+{
+    rpc_slot_t* slot = NULL;
+    uint16_t index = 0;
+
+    if (length > PL_RPC_MAX_BODY)
+    {
+        return false;
+    }
+    for (; index < PROTOCOL_LAYER_RPC_SLOTS; index++)
+    {
+        if (!s_slots[index].used)
+        {
+            slot = &s_slots[index];
+            break;
+        }
+    }
+    if (slot == NULL)
+    {
+        return false;
+    }
+
+    uint16_t id = (uint16_t)(((uint16_t)s_generation << 8) | index);
+    s_request[0] = PL_RPC_REQUEST;
+    s_request[1] = (uint8_t)(id & 0xFFU);
+    s_request[2] = (uint8_t)(id >> 8);
+    memcpy(&s_request[PL_RPC_HEADER_SIZE], request, length);
+    if (!ProtocolLayer_sendToFlags(mac, s_request, PL_RPC_HEADER_SIZE + length, PL_FLAG_RPC))
+    {
+        return false;
+    }
+
+    s_generation++;
+    slot->used = true;
+    slot->id = id;
+    memcpy(slot->mac, mac, MAC_DATA_SIZE);
+    slot->start = ProtocolLayer_timerTicks();
+    slot->timeoutTicks = (ProtocolLayer_timerHz() / 1000U) * timeoutMs;
+    slot->done = done;
+    slot->context = context;
+    s_stats.calls++;
+    s_stats.outstanding++;
+    return true;
+}
+
+/*! @brief Receive like ProtocolLayer_receiveFrom(), completing the requests
+ *         whose replies arrive and those that expire.
+ *  @return length of a message that is not an RPC reply, for the caller;
+ *          0 if there is none. */
+uint16_t ProtocolLayer_rpcPoll(uint8_t* msgBuffer, uint8_t* mac)
+{
+    uint8_t source[MAC_DATA_SIZE];
+    uint16_t length = ProtocolLayer_receiveFrom(msgBuffer, source);
+
+    // Only a frame flagged as RPC is one, whatever its first byte
+    if (((ProtocolLayer_rxFlags() & PL_FLAG_RPC) != 0U) && (length >= PL_RPC_HEADER_SIZE) &&
+        (msgBuffer[0] == PL_RPC_RESPONSE))
+    {
+        uint16_t id = (uint16_t)(msgBuffer[1] | (msgBuffer[2] << 8));
+        rpc_slot_t* slot = &s_slots[(id & 0xFFU) % PROTOCOL_LAYER_RPC_SLOTS];   // the index, if id is valid
+
+        // The reply must come from the peer the request went to
+        if (slot->used && (slot->id == id) && (memcmp(slot->mac, source, MAC_DATA_SIZE) == 0))
+        {
+            s_stats.completed++;
+            Complete(slot, kPL_Rpc_Ok, &msgBuffer[PL_RPC_HEADER_SIZE], length - PL_RPC_HEADER_SIZE);
+        }
+        else
+        {
+            s_stats.stale++;
+        }
+        length = 0;
+    }
+    else if ((length != 0U) && (mac != NULL))
+    {
+        memcpy(mac, source, MAC_DATA_SIZE);
+    }
+
+    ProtocolLayer_rpcService();
+    return length;
+}
+
+/*! @brief Expire the requests past their deadline. */
+void ProtocolLayer_rpcService(void)
+{
+    uint32_t now = ProtocolLayer_timerTicks();
+
+    for (uint16_t i = 0; (i < PROTOCOL_LAYER_RPC_SLOTS) && (s_stats.outstanding != 0U); i++)
+    {
+        rpc_slot_t* slot = &s_slots[i];
+
+        if (slot->used && ((now - slot->start) >= slot->timeoutTicks))
+        {
+            s_stats.timeouts++;
+            Complete(slot, kPL_Rpc_Timeout, NULL, 0);
+        }
+    }
+}
+
+/*! @brief Requests waiting for a reply. */
+uint32_t ProtocolLayer_rpcOutstanding(void)
+{
+    return s_stats.outstanding;
+}
+
+/*! @brief RPC counters, for logging. */
+void ProtocolLayer_rpcGetStats(pl_rpc_stats_t* stats)
+{
+    *stats = s_stats;
+}
@@ -0,0 +1,57 @@
+/*
+This file declares the request/response layer on top of
+ProtocolLayer_sendTo() and ProtocolLayer_receiveFrom(). Every request
+carries a correlation ID that the responder echoes in its reply, so many
+requests can be in flight at once and their replies may come back in any
+order; each one completes its own callback, or times out.
+*/
+
+#ifndef _PROTOCOL_LAYER_RPC_H_
+#define _PROTOCOL_LAYER_RPC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* RPC message: type (1 byte), correlation ID (2 bytes little endian), body.
+ * Its frames carry PL_FLAG_RPC, so a plain message may start with any byte. */
+#define PL_RPC_REQUEST         (0x01U)
+#define PL_RPC_RESPONSE        (0x02U)
+#define PL_RPC_HEADER_SIZE     (3)
+#define PL_RPC_MAX_BODY        (PROTOCOL_LAYER_MAX_MESSAGE - PL_RPC_HEADER_SIZE)
+
+typedef enum
+{
+    kPL_Rpc_Ok = 0,                 /* reply received */
+    kPL_Rpc_Timeout,                /* no reply before the deadline */
+} pl_rpc_status_t;
+
+/* Completion of a request: reply and length are only valid for kPL_Rpc_Ok
+ * and during the call. */
+typedef void (*pl_rpc_done_fn_t)(void* context, pl_rpc_status_t status, const uint8_t* reply, size_t length);
+
+typedef struct
+{
+    uint32_t calls;         /* requests sent */
+    uint32_t completed;     /* replies matched to a request */
+    uint32_t timeouts;      /* requests that expired */
+    uint32_t stale;         /* replies to no outstanding request */
+    uint32_t outstanding;   /* requests waiting for a reply */
+} pl_rpc_stats_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+void ProtocolLayer_rpcInit(void);
+bool ProtocolLayer_rpcCall(const uint8_t* mac, const uint8_t* request, size_t length, uint32_t timeoutMs,
+                           pl_rpc_done_fn_t done, void* context);
+uint16_t ProtocolLayer_rpcPoll(uint8_t* msgBuffer, uint8_t* mac);
+void ProtocolLayer_rpcService(void);
+uint32_t ProtocolLayer_rpcOutstanding(void);
+void ProtocolLayer_rpcGetStats(pl_rpc_stats_t* stats);
+
+#endif // _PROTOCOL_LAYER_RPC_H_
@@ -0,0 +1,228 @@
+/*
+This file contains the receive class queues: one FIFO of fixed buffers per
+class, allocated statically with the depth and buffer size of the class.
+A frame is read from the MAC into a landing buffer, the next free bulk
+buffer when there is one, so a bulk frame is queued where it was read and
+only the shorter control and telemetry frames are copied.
+
+A tagged frame is classified by its priority code point and the tag is
+removed, so the rest of the receive path sees the usual layout. An
+untagged frame short enough for a control buffer (ACKs, credit updates,
+requests) is control, any other is bulk; a frame too long for the buffers
+of its class goes to the next class. A frame whose queue is full is
+dropped, a class never takes the buffers of another one.
+
+Buffers are word aligned and every frame is kept PL_RXQ_SHIFT bytes in,
+where the MAC puts it with PROTOCOL_LAYER_SHIFT16; a copied frame is
+placed at the same offset, so the protocol header stays word aligned.
+*/
+
+#include <string.h>
+#include "protocol_layer_rxq.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#if (PROTOCOL_LAYER_RXQ_CONTROL_DEPTH == 0U) || (PROTOCOL_LAYER_RXQ_CONTROL_DEPTH > 255U) || \
+    (PROTOCOL_LAYER_RXQ_TELEMETRY_DEPTH == 0U) || (PROTOCOL_LAYER_RXQ_TELEMETRY_DEPTH > 255U) || \
+    (PROTOCOL_LAYER_RXQ_BULK_DEPTH == 0U) || (PROTOCOL_LAYER_RXQ_BULK_DEPTH > 255U)
+#error "PROTOCOL_LAYER_RXQ_*_DEPTH must be 1 to 255"
+#endif
+#if (PROTOCOL_LAYER_RXQ_CONTROL_BUFFER > PROTOCOL_LAYER_RXQ_TELEMETRY_BUFFER) || \
+    (PROTOCOL_LAYER_RXQ_TELEMETRY_BUFFER > PROTOCOL_LAYER_RXQ_BULK_BUFFER)
+#error "PROTOCOL_LAYER_RXQ_*_BUFFER must grow from control to bulk"
+#endif
+
+/* Buffer of a class, in bytes; a multiple of 4 so every buffer is aligned */
+#define STRIDE(size)           (((PL_RXQ_SHIFT + (size) + PL_RXQ_SPARE) + 3U) & ~3U)
+
+/* FIFO of one class */
+typedef struct
+{
+    uint8_t* pool;                  /* depth buffers of stride bytes */
+    uint16_t* length;               /* frame length per buffer */
+    uint8_t* offset;                /* start of the frame in its buffer */
+    size_t stride;
+    size_t capacity;                /* longest frame */
+    uint8_t depth;
+    uint8_t head;
+    uint8_t count;
+} rx_queue_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static uint32_t s_controlPool[PROTOCOL_LAYER_RXQ_CONTROL_DEPTH][STRIDE(PROTOCOL_LAYER_RXQ_CONTROL_BUFFER) / 4U];
+static uint32_t s_telemetryPool[PROTOCOL_LAYER_RXQ_TELEMETRY_DEPTH][STRIDE(PROTOCOL_LAYER_RXQ_TELEMETRY_BUFFER) / 4U];
+static uint32_t s_bulkPool[PROTOCOL_LAYER_RXQ_BULK_DEPTH][STRIDE(PROTOCOL_LAYER_RXQ_BULK_BUFFER) / 4U];
+static uint16_t s_controlLength[PROTOCOL_LAYER_RXQ_CONTROL_DEPTH];
+static uint16_t s_telemetryLength[PROTOCOL_LAYER_RXQ_TELEMETRY_DEPTH];
+static uint16_t s_bulkLength[PROTOCOL_LAYER_RXQ_BULK_DEPTH];
+static uint8_t s_controlOffset[PROTOCOL_LAYER_RXQ_CONTROL_DEPTH];
+static uint8_t s_telemetryOffset[PROTOCOL_LAYER_RXQ_TELEMETRY_DEPTH];
+static uint8_t s_bulkOffset[PROTOCOL_LAYER_RXQ_BULK_DEPTH];
+
+/* Used when every bulk buffer is taken */
+static uint32_t s_scratch[STRIDE(PROTOCOL_LAYER_RXQ_BULK_BUFFER) / 4U];
+
+static rx_queue_t s_queues[kPL_RxClass_Num];
+static uint8_t* s_landing;
+static uint8_t s_current;                       // class of the frame returned by rxqNext
+static pl_rxq_stats_t s_stats;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+static void InitQueue(rx_queue_t* queue, uint8_t* pool, uint16_t* length, uint8_t* offset, size_t capacity,
+                      uint8_t depth)
+{
+    queue->pool = pool;
+    queue->length = length;
+    queue->offset = offset;
+    queue->stride = STRIDE(capacity);
+    queue->capacity = capacity;
+    queue->depth = depth;
+    queue->head = 0;
+    queue->count = 0;
+}
+
+/*! @brief Buffer of the next frame queued in a class. */
+static uint8_t Tail(const rx_queue_t* queue)
+{
+    return (uint8_t)((queue->head + queue->count) % queue->depth);
+}
+
+/*! @brief Class of a frame from its priority code point. */
+static uint8_t ClassOfPcp(uint8_t pcp)
+{
+    if (pcp >= PROTOCOL_LAYER_RXQ_PCP_CONTROL)
+    {
+        return kPL_RxClass_Control;
+    }
+    if (pcp >= PROTOCOL_LAYER_RXQ_PCP_TELEMETRY)
+    {
+        return kPL_RxClass_Telemetry;
+    }
+    return kPL_RxClass_Bulk;
+}
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Empty the class queues. */
+void ProtocolLayer_rxqInit(void)
+{
+    InitQueue(&s_queues[kPL_RxClass_Control], (uint8_t*)&s_controlPool[0][0], s_controlLength, s_controlOffset,
+              PROTOCOL_LAYER_RXQ_CONTROL_BUFFER, PROTOCOL_LAYER_RXQ_CONTROL_DEPTH);
+    InitQueue(&s_queues[kPL_RxClass_Telemetry], (uint8_t*)&s_telemetryPool[0][0], s_telemetryLength,
+              s_telemetryOffset, PROTOCOL_LAYER_RXQ_TELEMETRY_BUFFER, PROTOCOL_LAYER_RXQ_TELEMETRY_DEPTH);
+    InitQueue(&s_queues[kPL_RxClass_Bulk], (uint8_t*)&s_bulkPool[0][0], s_bulkLength, s_bulkOffset,
+              PROTOCOL_LAYER_RXQ_BULK_BUFFER, PROTOCOL_LAYER_RXQ_BULK_DEPTH);
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+/*! @brief Buffer to read the next frame into, PL_RXQ_SHIFT +
+ *         PL_RXQ_FRAME_MAX bytes, then queued with ProtocolLayer_rxqPush(). */
+uint8_t* ProtocolLayer_rxqLanding(void)
+{
+    rx_queue_t* bulk = &s_queues[kPL_RxClass_Bulk];
+
+    s_landing = (bulk->count < bulk->depth) ? &bulk->pool[Tail(bulk) * bulk->stride] : (uint8_t*)s_scratch;
+    return s_landing;
+}
+
+/*! @brief Classify the frame of length bytes in the landing buffer, as read
+ *         with its PL_RXQ_SHIFT leading bytes, and queue it. steer is the
+ *         class chosen by the receive filter, kPL_RxClass_Num if none.
+ *  @return false if the queue of its class is full and the frame was dropped. */
+bool ProtocolLayer_rxqPush(size_t length, uint8_t steer)
+{
+    uint8_t* frame = &s_landing[PL_RXQ_SHIFT];
+    uint8_t offset = PL_RXQ_SHIFT;
+    uint8_t cls;
+
+    length -= PL_RXQ_SHIFT;
+    if ((length > (2U * 6U + PL_VLAN_TAG_SIZE)) && (frame[12] == (PL_VLAN_TPID >> 8)) &&
+        (frame[13] == (PL_VLAN_TPID & 0xFFU)))
+    {
+        cls = ClassOfPcp((uint8_t)(frame[14] >> 5));
+        // Drop the tag: the addresses move up over it
+        memmove(&frame[PL_VLAN_TAG_SIZE], frame, 2U * 6U);
+        offset += PL_VLAN_TAG_SIZE;
+        length -= PL_VLAN_TAG_SIZE;
+    }
+    else
+    {
+        cls = (length <= PROTOCOL_LAYER_RXQ_CONTROL_BUFFER) ? kPL_RxClass_Control : kPL_RxClass_Bulk;
+    }
+    if (steer < kPL_RxClass_Num)
+    {
+        cls = steer;
+    }
+    while ((cls < kPL_RxClass_Bulk) && (length > s_queues[cls].capacity))
+    {
+        cls++;
+    }
+
+    rx_queue_t* queue = &s_queues[cls];
+    if (queue->count == queue->depth)
+    {
+        s_stats.dropped[cls]++;
+        return false;
+    }
+
+    uint8_t slot = Tail(queue);
+    uint8_t* buffer = &queue->pool[slot * queue->stride];
+    if (buffer != s_landing)
+    {
+        memcpy(&buffer[PL_RXQ_SHIFT], &s_landing[offset], length);
+        offset = PL_RXQ_SHIFT;
+    }
+    queue->length[slot] = (uint16_t)length;
+    queue->offset[slot] = offset;
+    queue->count++;
+
+    s_stats.queued[cls]++;
+    if (queue->count > s_stats.peak[cls])
+    {
+        s_stats.peak[cls] = queue->count;
+    }
+    return true;
+}
+
+/*! @brief Oldest frame of the most urgent class, with PL_RXQ_SPARE bytes of
+ *         room after it; it stays queued until ProtocolLayer_rxqRelease().
+ *  @return NULL if every queue is empty. */
+uint8_t* ProtocolLayer_rxqNext(uint32_t* length)
+{
+    for (uint8_t cls = 0; cls < kPL_RxClass_Num; cls++)
+    {
+        rx_queue_t* queue = &s_queues[cls];
+
+        if (queue->count != 0U)
+        {
+            s_current = cls;
+            *length = queue->length[queue->head];
+            return &queue->pool[(queue->head * queue->stride) + queue->offset[queue->head]];
+        }
+    }
+    return NULL;
+}
+
+/*! @brief Free the frame returned by ProtocolLayer_rxqNext(). */
+void ProtocolLayer_rxqRelease(void)
+{
+    rx_queue_t* queue = &s_queues[s_current];
+
+    if (queue->count != 0U)
+    {
+        queue->head = (uint8_t)((queue->head + 1U) % queue->depth);
+        queue->count--;
+    }
+}
+
+/*! @brief Queue counters, for logging. */
+void ProtocolLayer_rxqGetStats(pl_rxq_stats_t* stats)
+{
+    *stats = s_stats;
+}
@@ -0,0 +1,62 @@
+/*
+This file declares the receive class queues. The MAC of this part has a
+single receive ring, so frames are classified in software instead: every
+frame the ring holds is moved at once to the queue of its class (control,
+telemetry or bulk), each with its own depth and buffers, and the queues
+are served in priority order. A burst of bulk frames then delays a control
+message by one frame at most, and it never takes its buffers.
+*/
+
+#ifndef _PROTOCOL_LAYER_RXQ_H_
+#define _PROTOCOL_LAYER_RXQ_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* Spare block after every buffer for the in-place CMAC padding */
+#define PL_RXQ_SPARE           (16U)
+/* Longest frame accepted, the size of the bulk buffers */
+#define PL_RXQ_FRAME_MAX       (PROTOCOL_LAYER_RXQ_BULK_BUFFER)
+/* Bytes the MAC writes ahead of a frame with PROTOCOL_LAYER_SHIFT16 */
+#if PROTOCOL_LAYER_SHIFT16
+#define PL_RXQ_SHIFT           (2U)
+#else
+#define PL_RXQ_SHIFT           (0U)
+#endif
+
+/* 802.1Q tag, after the source address */
+#define PL_VLAN_TPID           (0x8100U)
+#define PL_VLAN_TAG_SIZE       (4U)
+
+/* Classes in priority order */
+typedef enum
+{
+    kPL_RxClass_Control = 0,        /* PCP >= PROTOCOL_LAYER_RXQ_PCP_CONTROL, short untagged frames */
+    kPL_RxClass_Telemetry,          /* PCP >= PROTOCOL_LAYER_RXQ_PCP_TELEMETRY */
+    kPL_RxClass_Bulk,               /* everything else */
+    kPL_RxClass_Num
+} pl_rx_class_t;
+
+typedef struct
+{
+    uint32_t queued[kPL_RxClass_Num];   /* frames queued per class */
+    uint32_t dropped[kPL_RxClass_Num];  /* frames dropped, queue of the class full */
+    uint32_t peak[kPL_RxClass_Num];     /* most frames waiting at once */
+} pl_rxq_stats_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+void ProtocolLayer_rxqInit(void);
+uint8_t* ProtocolLayer_rxqLanding(void);
+bool ProtocolLayer_rxqPush(size_t length, uint8_t steer);
+uint8_t* ProtocolLayer_rxqNext(uint32_t* length);
+void ProtocolLayer_rxqRelease(void);
+void ProtocolLayer_rxqGetStats(pl_rxq_stats_t* stats);
+
+#endif // _PROTOCOL_LAYER_RXQ_H_
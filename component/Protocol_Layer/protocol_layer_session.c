@@ -0,0 +1,167 @@
+/*
+This file contains the session key slots. ProtocolLayer_sessionRekey() only copies
+the new keys into the idle slot; the key schedules are expanded one step per
+ProtocolLayer_sessionService() call from the idle loop, so no send or
+receive ever waits for a key expansion. When the new slot is complete the
+transmit epoch is switched with a single write and the old slot keeps
+decrypting frames still in flight for PROTOCOL_LAYER_REKEY_GRACE_MS.
+*/
+
+#include <string.h>
+#include "protocol_layer_session.h"
+#include "protocol_layer_backend.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+typedef enum
+{
+    kExpand_Aes = 0,                /* AES-128 key schedule */
+    kExpand_Mac,                    /* CMAC key schedule */
+    kExpand_Subkeys,                /* CMAC subkeys K1/K2 */
+    kExpand_Done,
+} expand_step_t;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+/*! @brief Derive a CMAC subkey: left shift by one bit, xor Rb on carry. */
+static void CmacSubkey(const uint8_t* in, uint8_t* out)
+{
+    uint8_t carry = in[0] >> 7;
+
+    for (uint8_t i = 0; i < (AES_BLOCKLEN - 1); i++)
+    {
+        out[i] = (uint8_t)((in[i] << 1) | (in[i + 1] >> 7));
+    }
+    out[AES_BLOCKLEN - 1] = (uint8_t)((in[AES_BLOCKLEN - 1] << 1) ^ (carry ? 0x87U : 0x00U));
+}
+
+/*! @brief Run one step of the key expansion of a slot. */
+static void ExpandStep(pl_session_t* session)
+{
+    switch (session->step)
+    {
+        case kExpand_Aes:
+            AES_init_ctx(&session->aesCtx, session->aesKey);
+            break;
+        case kExpand_Mac:
+            AES_init_ctx(&session->macCtx, session->macKey);
+            break;
+        case kExpand_Subkeys:
+        {
+            // K1/K2 from the encryption of the zero block
+            uint8_t l[AES_BLOCKLEN] = {0};
+            AES_ECB_encrypt(&session->macCtx, l);
+            CmacSubkey(l, session->cmacK1);
+            CmacSubkey(session->cmacK1, session->cmacK2);
+            break;
+        }
+        default:
+            break;
+    }
+    session->step++;
+}
+
+/*! @brief Copy the keys into a slot and start its expansion. */
+static void Stage(pl_session_t* session, const uint8_t* key, const uint8_t* macKey)
+{
+    session->state = kPL_Session_Empty;
+    memcpy(session->aesKey, key, PL_KEY_SIZE);
+    memcpy(session->macKey, macKey, PL_KEY_SIZE);
+    // New keys, new counters: a replay window never spans two keys
+    session->txCounter = 0;
+    ProtocolLayer_replayReset(&session->replay);
+    session->step = kExpand_Aes;
+    session->state = kPL_Session_Expanding;
+}
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Expand keys into one slot and make it active; blocks. */
+void ProtocolLayer_sessionLoad(pl_session_t* session, const uint8_t* key, const uint8_t* macKey)
+{
+    Stage(session, key, macKey);
+    while (session->step < kExpand_Done)
+    {
+        ExpandStep(session);
+    }
+    session->state = kPL_Session_Active;
+}
+
+/*! @brief Load the keys of a peer into epoch 0; blocks, call it before the
+ *         key ring is used. */
+void ProtocolLayer_sessionInit(pl_keyring_t* ring, const uint8_t* key, const uint8_t* macKey)
+{
+    memset(ring, 0, sizeof(*ring));
+    ProtocolLayer_sessionLoad(&ring->sessions[0], key, macKey);
+    ring->txEpoch = 0;
+}
+
+/*! @brief Start a rotation to new keys. The keys are copied, expanded by
+ *         ProtocolLayer_sessionService() and then used for send.
+ *  @return false if the previous rotation has not finished its grace window. */
+bool ProtocolLayer_sessionRekey(pl_keyring_t* ring, const uint8_t* key, const uint8_t* macKey)
+{
+    pl_session_t* next = &ring->sessions[ring->txEpoch ^ 1U];
+
+    if ((next->state == kPL_Session_Expanding) || (next->state == kPL_Session_Grace))
+    {
+        return false;
+    }
+    Stage(next, key, macKey);
+    return true;
+}
+
+/*! @brief Background work of the key slots, call it from the idle loop: one
+ *         expansion step per call, the epoch switch, and the end of the grace
+ *         window of the old slot. */
+void ProtocolLayer_sessionService(pl_keyring_t* ring)
+{
+    uint8_t epoch = ring->txEpoch;
+    pl_session_t* current = &ring->sessions[epoch];
+    pl_session_t* next = &ring->sessions[epoch ^ 1U];
+
+    if (next->state == kPL_Session_Expanding)
+    {
+        ExpandStep(next);
+        if (next->step >= kExpand_Done)
+        {
+            // Complete before the epoch switch: one write moves every sender over
+            next->state = kPL_Session_Active;
+            ring->txEpoch = epoch ^ 1U;
+            current->graceStart = ProtocolLayer_timerTicks();
+            current->state = kPL_Session_Grace;
+        }
+    }
+    else if (next->state == kPL_Session_Grace)
+    {
+        uint32_t graceTicks = (ProtocolLayer_timerHz() / 1000U) * PROTOCOL_LAYER_REKEY_GRACE_MS;
+        if ((ProtocolLayer_timerTicks() - next->graceStart) >= graceTicks)
+        {
+            next->state = kPL_Session_Empty;
+        }
+    }
+}
+
+/*! @brief Epoch used to send to the peer, 0 or 1. */
+uint8_t ProtocolLayer_txEpoch(const pl_keyring_t* ring)
+{
+    return ring->txEpoch;
+}
+
+/*! @brief Key slot of an epoch.
+ *  @return NULL if frames of this epoch cannot be decrypted (no key or the
+ *          grace window is over). */
+pl_session_t* ProtocolLayer_session(pl_keyring_t* ring, uint8_t epoch)
+{
+    pl_session_t* session = &ring->sessions[epoch & 1U];
+    uint8_t state = session->state;
+
+    if ((state == kPL_Session_Empty) || (state == kPL_Session_Expanding))
+    {
+        return NULL;
+    }
+    return session;
+}
@@ -0,0 +1,66 @@
+/*
+This file declares the session key slots. Every peer has a key ring of two
+slots holding the expanded keys of the current and the next session; the
+epoch bit in the frame header says which slot a frame was protected with,
+so a rekey never pauses traffic.
+*/
+
+#ifndef _PROTOCOL_LAYER_SESSION_H_
+#define _PROTOCOL_LAYER_SESSION_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+#include "aes.h"        // libray from https://github.com/kokke/tiny-AES-c
+#include "protocol_layer_replay.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define PL_SESSION_NUM         (2)
+#define PL_KEY_SIZE            (16)
+
+typedef enum
+{
+    kPL_Session_Empty = 0,          /* no key, frames of this epoch are dropped */
+    kPL_Session_Expanding,          /* key staged, schedule built in the background */
+    kPL_Session_Active,             /* used for send and receive */
+    kPL_Session_Grace,              /* old epoch, receive only until the window ends */
+} pl_session_state_t;
+
+/* Expanded keys of one epoch. aesKey and macKey are kept for the ELS
+ * backends, which take the raw key. */
+typedef struct
+{
+    struct AES_ctx aesCtx;
+    struct AES_ctx macCtx;
+    uint8_t cmacK1[AES_BLOCKLEN];
+    uint8_t cmacK2[AES_BLOCKLEN];
+    uint8_t aesKey[PL_KEY_SIZE];
+    uint8_t macKey[PL_KEY_SIZE];
+    volatile uint8_t state;         /* pl_session_state_t */
+    uint8_t step;                   /* next expansion step */
+    uint32_t graceStart;            /* timer ticks when the slot was retired */
+    uint32_t txCounter;             /* replay counter of the next frame sent */
+    pl_replay_t replay;             /* replay window of the frames received */
+} pl_session_t;
+
+/* Both key slots of a peer */
+typedef struct
+{
+    pl_session_t sessions[PL_SESSION_NUM];
+    volatile uint8_t txEpoch;
+} pl_keyring_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+void ProtocolLayer_sessionLoad(pl_session_t* session, const uint8_t* key, const uint8_t* macKey);
+void ProtocolLayer_sessionInit(pl_keyring_t* ring, const uint8_t* key, const uint8_t* macKey);
+void ProtocolLayer_sessionService(pl_keyring_t* ring);
+bool ProtocolLayer_sessionRekey(pl_keyring_t* ring, const uint8_t* key, const uint8_t* macKey);
+uint8_t ProtocolLayer_txEpoch(const pl_keyring_t* ring);
+pl_session_t* ProtocolLayer_session(pl_keyring_t* ring, uint8_t epoch);
+
+#endif // _PROTOCOL_LAYER_SESSION_H_
@@ -0,0 +1,162 @@
+/*
+This file contains the word-wide kernels used on the hot paths of the
+protocol layer: 16-byte XOR, PKCS#7 padding validation, constant-time
+compare, word copy and unaligned 32-bit load. The project is built for
+cm33_nodsp (-mcpu=cortex-m33+nodsp), which has no SIMD32 instructions, so
+the kernels are plain C on 32-bit words: the padding check works on four
+byte lanes per word with borrow arithmetic instead of __USUB8/__SEL. The
+same code is built for the host (PROTOCOL_LAYER_HOST_BUILD). With
+PROTOCOL_LAYER_SHIFT16 the frame buffers are word aligned from the
+protocol header on, and the XOR and copy kernels take an aligned path when
+both pointers allow it.
+*/
+
+#ifndef _PROTOCOL_LAYER_SIMD_H_
+#define _PROTOCOL_LAYER_SIMD_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "protocol_layer_cfg.h"
+
+#ifndef PROTOCOL_LAYER_HOST_BUILD
+#include "cmsis_compiler.h"
+#endif
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define PL_BLOCK_SIZE          (16)
+#define PL_BYTES_X4(b)         ((uint32_t)(b) * 0x01010101U)
+#define PL_ALIGNED4(p)         ((((uintptr_t)(p)) & 3U) == 0U)
+
+/*******************************************************************************
+ * Functions
+ ******************************************************************************/
+/*! @brief Little endian 32-bit load from any address. */
+static inline uint32_t PL_Load32(const uint8_t* p)
+{
+#ifdef PROTOCOL_LAYER_HOST_BUILD
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+#else
+    // The M33 handles unaligned LDR, this only stops the compiler assuming alignment
+    return __UNALIGNED_UINT32_READ(p);
+#endif
+}
+
+/*! @brief Little endian 32-bit store to any address. */
+static inline void PL_Store32(uint8_t* p, uint32_t v)
+{
+#ifdef PROTOCOL_LAYER_HOST_BUILD
+    memcpy(p, &v, sizeof(v));
+#else
+    __UNALIGNED_UINT32_WRITE(p, v);
+#endif
+}
+
+/*! @brief dst ^= src over one 16-byte block, four words at a time. */
+static inline void PL_Xor16(uint8_t* dst, const uint8_t* src)
+{
+#if PROTOCOL_LAYER_SHIFT16
+    if (PL_ALIGNED4(dst) && PL_ALIGNED4(src))
+    {
+        // Known alignment lets the compiler pair the loads (LDRD/LDM)
+        uint32_t* d = (uint32_t*)(void*)dst;
+        const uint32_t* s = (const uint32_t*)(const void*)src;
+        d[0] ^= s[0];
+        d[1] ^= s[1];
+        d[2] ^= s[2];
+        d[3] ^= s[3];
+        return;
+    }
+#endif
+    PL_Store32(&dst[0],  PL_Load32(&dst[0])  ^ PL_Load32(&src[0]));
+    PL_Store32(&dst[4],  PL_Load32(&dst[4])  ^ PL_Load32(&src[4]));
+    PL_Store32(&dst[8],  PL_Load32(&dst[8])  ^ PL_Load32(&src[8]));
+    PL_Store32(&dst[12], PL_Load32(&dst[12]) ^ PL_Load32(&src[12]));
+}
+
+/*! @brief memcpy() for payloads; word by word when both buffers are
+ *         aligned, the library memcpy() of newlib-nano copies bytes. */
+static inline void PL_Copy(uint8_t* dst, const uint8_t* src, size_t length)
+{
+#if PROTOCOL_LAYER_SHIFT16
+    if (PL_ALIGNED4(dst) && PL_ALIGNED4(src))
+    {
+        uint32_t* d = (uint32_t*)(void*)dst;
+        const uint32_t* s = (const uint32_t*)(const void*)src;
+        size_t words = length / 4U;
+
+        for (size_t i = 0; i < words; i++)
+        {
+            d[i] = s[i];
+        }
+        dst = (uint8_t*)&d[words];
+        src = (const uint8_t*)&s[words];
+        length -= words * 4U;
+    }
+#endif
+    memcpy(dst, src, length);
+}
+
+/*! @brief Constant-time equality of two buffers; the time depends on the
+ *         length only, never on where the first difference is. */
+static inline bool PL_Equal(const uint8_t* a, const uint8_t* b, size_t length)
+{
+    uint32_t diff = 0;
+    size_t i = 0;
+
+    for (; (i + 4U) <= length; i += 4U)
+    {
+        diff |= PL_Load32(&a[i]) ^ PL_Load32(&b[i]);
+    }
+    for (; i < length; i++)
+    {
+        diff |= (uint32_t)(a[i] ^ b[i]);
+    }
+    return (diff == 0U);
+}
+
+/*! @brief Bytes of one word whose distance to the end of the block is below
+ *         the pad value: 0xFF for pad bytes, 0x00 for data bytes. distance
+ *         holds the four byte distances, pad the pad value in every lane. */
+static inline uint32_t PL_PadMask(uint32_t distance, uint32_t pad)
+{
+    uint32_t mask = 0;
+
+    for (uint8_t lane = 0; lane < 4U; lane++)
+    {
+        uint32_t d = (distance >> (lane * 8U)) & 0xFFU;
+        uint32_t p = (pad >> (lane * 8U)) & 0xFFU;
+        // d - p borrows into bits 8..15 exactly when d < p, without a branch
+        mask |= (((d - p) >> 8) & 0xFFU) << (lane * 8U);
+    }
+    return mask;
+}
+
+/*! @brief Validate the PKCS#7 padding of the last 16-byte block in constant
+ *         time.
+ *  @return the pad value (1..16), or 0 if the padding is not valid. */
+static inline uint8_t PL_CheckPadding(const uint8_t* lastBlock)
+{
+    /* Distance of every byte to the end of the block, packed per word */
+    static const uint32_t distance[4] = {0x0C0D0E0FU, 0x08090A0BU, 0x04050607U, 0x00010203U};
+    uint8_t padValue = lastBlock[PL_BLOCK_SIZE - 1];
+    uint32_t pad = PL_BYTES_X4(padValue);
+    uint32_t diff = 0;
+
+    for (uint8_t w = 0; w < 4U; w++)
+    {
+        diff |= (PL_Load32(&lastBlock[w * 4U]) ^ pad) & PL_PadMask(distance[w], pad);
+    }
+    if ((diff != 0U) || (padValue == 0U) || (padValue > PL_BLOCK_SIZE))
+    {
+        return 0;
+    }
+    return padValue;
+}
+
+#endif // _PROTOCOL_LAYER_SIMD_H_
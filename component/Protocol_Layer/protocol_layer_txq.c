@@ -0,0 +1,220 @@
+/*
+This file contains the transmit class queues: one FIFO of whole frames per
+class, allocated statically, and the shaper of the bulk class. Frames are
+copied in when they are built and handed to the MAC while it has a free
+descriptor, the most urgent class first.
+
+The shaper follows 802.1Qav: the bulk class earns credit at the idle
+slope while it has frames waiting and may send while its credit is not
+negative; a frame sent costs its length. Credit is capped at
+PROTOCOL_LAYER_TXQ_BULK_BURST bytes and a positive credit is lost when the
+queue runs empty, so the bulk rate stays at the idle slope over any
+interval and a control frame never waits for more than the frames already
+in the transmit ring.
+*/
+
+#include <string.h>
+#include "protocol_layer_txq.h"
+#include "protocol_layer_backend.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#if (PROTOCOL_LAYER_TXQ_CONTROL_DEPTH == 0U) || (PROTOCOL_LAYER_TXQ_CONTROL_DEPTH > 255U) || \
+    (PROTOCOL_LAYER_TXQ_TELEMETRY_DEPTH == 0U) || (PROTOCOL_LAYER_TXQ_TELEMETRY_DEPTH > 255U) || \
+    (PROTOCOL_LAYER_TXQ_BULK_DEPTH == 0U) || (PROTOCOL_LAYER_TXQ_BULK_DEPTH > 255U)
+#error "PROTOCOL_LAYER_TXQ_*_DEPTH must be 1 to 255"
+#endif
+
+/* FIFO of one class */
+typedef struct
+{
+    uint8_t* pool;                  /* depth buffers of PROTOCOL_LAYER_TXQ_BUFFER bytes */
+    uint16_t* length;               /* frame length per buffer */
+    uint8_t depth;
+    uint8_t head;
+    uint8_t count;
+} tx_queue_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static uint8_t s_controlPool[PROTOCOL_LAYER_TXQ_CONTROL_DEPTH][PROTOCOL_LAYER_TXQ_BUFFER];
+static uint8_t s_telemetryPool[PROTOCOL_LAYER_TXQ_TELEMETRY_DEPTH][PROTOCOL_LAYER_TXQ_BUFFER];
+static uint8_t s_bulkPool[PROTOCOL_LAYER_TXQ_BULK_DEPTH][PROTOCOL_LAYER_TXQ_BUFFER];
+static uint16_t s_controlLength[PROTOCOL_LAYER_TXQ_CONTROL_DEPTH];
+static uint16_t s_telemetryLength[PROTOCOL_LAYER_TXQ_TELEMETRY_DEPTH];
+static uint16_t s_bulkLength[PROTOCOL_LAYER_TXQ_BULK_DEPTH];
+
+static tx_queue_t s_queues[kPL_TxClass_Num];
+static uint8_t s_current;                       // class of the frame returned by txqNext
+
+/* Bulk shaper; credit is in bytes times timerHz, so earning it needs no division */
+static int64_t s_credit;
+static uint64_t s_bytesPerSecond;
+static uint32_t s_lastTick;
+static bool s_waiting;                          // the head bulk frame is held back
+
+static pl_txq_stats_t s_stats;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+static void InitQueue(tx_queue_t* queue, uint8_t* pool, uint16_t* length, uint8_t depth)
+{
+    queue->pool = pool;
+    queue->length = length;
+    queue->depth = depth;
+    queue->head = 0;
+    queue->count = 0;
+}
+
+/*! @brief Earn bulk credit for the time since the last update. */
+static void UpdateCredit(void)
+{
+    uint32_t now = ProtocolLayer_timerTicks();
+    int64_t burst = (int64_t)PROTOCOL_LAYER_TXQ_BULK_BURST * ProtocolLayer_timerHz();
+
+    s_credit += (int64_t)((uint64_t)(now - s_lastTick) * s_bytesPerSecond);
+    s_lastTick = now;
+
+    if (s_queues[kPL_TxClass_Bulk].count == 0U)
+    {
+        // Credit is not saved up while idle, only a debt is paid back
+        if (s_credit > 0)
+        {
+            s_credit = 0;
+        }
+    }
+    else if (s_credit > burst)
+    {
+        s_credit = burst;
+    }
+}
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Empty the class queues and reset the shaper. */
+void ProtocolLayer_txqInit(void)
+{
+    InitQueue(&s_queues[kPL_TxClass_Control], &s_controlPool[0][0], s_controlLength,
+              PROTOCOL_LAYER_TXQ_CONTROL_DEPTH);
+    InitQueue(&s_queues[kPL_TxClass_Telemetry], &s_telemetryPool[0][0], s_telemetryLength,
+              PROTOCOL_LAYER_TXQ_TELEMETRY_DEPTH);
+    InitQueue(&s_queues[kPL_TxClass_Bulk], &s_bulkPool[0][0], s_bulkLength, PROTOCOL_LAYER_TXQ_BULK_DEPTH);
+    s_credit = 0;
+    s_waiting = false;
+    s_lastTick = ProtocolLayer_timerTicks();
+    ProtocolLayer_txqSetBulkRate(PROTOCOL_LAYER_TXQ_BULK_KBPS);
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+/*! @brief Change the idle slope of the bulk class, in kbit/s. */
+void ProtocolLayer_txqSetBulkRate(uint32_t kbps)
+{
+    UpdateCredit();
+    s_bytesPerSecond = (uint64_t)kbps * 1000U / 8U;
+}
+
+/*! @brief Queue a frame of a class.
+ *  @return false if the queue of the class is full or the frame longer than
+ *          PROTOCOL_LAYER_TXQ_BUFFER. */
+bool ProtocolLayer_txqPush(uint8_t cls, const uint8_t* frame, size_t length)
+{
+    tx_queue_t* queue = &s_queues[(cls < kPL_TxClass_Num) ? cls : kPL_TxClass_Bulk];
+
+    if ((queue->count == queue->depth) || (length > PROTOCOL_LAYER_TXQ_BUFFER))
+    {
+        return false;
+    }
+    if ((queue == &s_queues[kPL_TxClass_Bulk]) && (queue->count == 0U))
+    {
+        // Credit is earned from the time the queue has a frame waiting
+        UpdateCredit();
+    }
+
+    uint8_t slot = (uint8_t)((queue->head + queue->count) % queue->depth);
+    memcpy(&queue->pool[slot * PROTOCOL_LAYER_TXQ_BUFFER], frame, length);
+    queue->length[slot] = (uint16_t)length;
+    queue->count++;
+
+    cls = (uint8_t)(queue - s_queues);
+    if (queue->count > s_stats.peak[cls])
+    {
+        s_stats.peak[cls] = queue->count;
+    }
+    return true;
+}
+
+/*! @brief Next frame to hand to the MAC: the oldest of the most urgent class,
+ *         unless that is bulk and out of credit. It stays queued until
+ *         ProtocolLayer_txqSent().
+ *  @return NULL if nothing may be sent now. */
+const uint8_t* ProtocolLayer_txqNext(uint32_t* length)
+{
+    for (uint8_t cls = 0; cls < kPL_TxClass_Num; cls++)
+    {
+        tx_queue_t* queue = &s_queues[cls];
+
+        if (queue->count == 0U)
+        {
+            continue;
+        }
+        if (cls == kPL_TxClass_Bulk)
+        {
+            UpdateCredit();
+            if (s_credit < 0)
+            {
+                if (!s_waiting)
+                {
+                    s_waiting = true;
+                    s_stats.shaped++;
+                }
+                return NULL;
+            }
+        }
+        s_current = cls;
+        *length = queue->length[queue->head];
+        return &queue->pool[queue->head * PROTOCOL_LAYER_TXQ_BUFFER];
+    }
+    return NULL;
+}
+
+/*! @brief The frame returned by ProtocolLayer_txqNext() is in the transmit
+ *         ring: free it and charge the shaper. */
+void ProtocolLayer_txqSent(void)
+{
+    tx_queue_t* queue = &s_queues[s_current];
+
+    if (queue->count == 0U)
+    {
+        return;
+    }
+    if (s_current == kPL_TxClass_Bulk)
+    {
+        s_credit -= (int64_t)queue->length[queue->head] * ProtocolLayer_timerHz();
+        s_waiting = false;
+    }
+    queue->head = (uint8_t)((queue->head + 1U) % queue->depth);
+    queue->count--;
+    s_stats.sent[s_current]++;
+}
+
+/*! @brief Frames waiting in all classes. */
+uint32_t ProtocolLayer_txqQueued(void)
+{
+    uint32_t queued = 0;
+
+    for (uint8_t cls = 0; cls < kPL_TxClass_Num; cls++)
+    {
+        queued += s_queues[cls].count;
+    }
+    return queued;
+}
+
+/*! @brief Queue counters, for logging. */
+void ProtocolLayer_txqGetStats(pl_txq_stats_t* stats)
+{
+    *stats = s_stats;
+}
@@ -0,0 +1,47 @@
+/*
+This file declares the transmit class queues. The MAC of this part has a
+single transmit ring and no AVB shapers, so frames wait in one software
+queue per traffic class and are handed to the ring in priority order:
+control and telemetry frames by strict priority, bulk frames through a
+credit-based shaper that caps their rate at the idle slope.
+*/
+
+#ifndef _PROTOCOL_LAYER_TXQ_H_
+#define _PROTOCOL_LAYER_TXQ_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* Traffic classes of ProtocolLayer_sendToClass(), in priority order */
+typedef enum
+{
+    kPL_TxClass_Control = 0,        /* strict priority; ACKs, credits and retransmissions too */
+    kPL_TxClass_Telemetry,          /* strict priority, after control */
+    kPL_TxClass_Bulk,               /* credit-based shaper, PROTOCOL_LAYER_TXQ_BULK_KBPS */
+    kPL_TxClass_Num
+} pl_tx_class_t;
+
+typedef struct
+{
+    uint32_t sent[kPL_TxClass_Num];     /* frames handed to the MAC per class */
+    uint32_t peak[kPL_TxClass_Num];     /* most frames waiting at once */
+    uint32_t shaped;                    /* times a bulk frame waited for credit */
+} pl_txq_stats_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+void ProtocolLayer_txqInit(void);
+void ProtocolLayer_txqSetBulkRate(uint32_t kbps);
+bool ProtocolLayer_txqPush(uint8_t cls, const uint8_t* frame, size_t length);
+const uint8_t* ProtocolLayer_txqNext(uint32_t* length);
+void ProtocolLayer_txqSent(void);
+uint32_t ProtocolLayer_txqQueued(void);
+void ProtocolLayer_txqGetStats(pl_txq_stats_t* stats);
+
+#endif // _PROTOCOL_LAYER_TXQ_H_
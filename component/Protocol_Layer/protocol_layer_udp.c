@@ -0,0 +1,256 @@
+/*
+This file contains the UDP/IPv4 encapsulation. Every route keeps the IPv4
+and UDP headers of its frames with both length fields at zero and the IPv4
+checksum of that template. Sending a frame copies the template and only
+adds the lengths: the checksum is updated for the total length alone
+(RFC 1624), so no header is summed per frame. The identification field is
+0 with Don't Fragment set (RFC 6864) and the UDP checksum is 0, which
+IPv4 allows; the payload has its own CRC32 or CMAC trailer.
+
+A received IPv4 frame is accepted if its header has no options and a good
+checksum, it is not a fragment, and it is UDP to the layer's port at the
+layer's address or at the multicast address of a group route. Its source
+address has to be the address of a route, whose peer is then the sender
+for the rest of the receive path.
+*/
+
+#include <string.h>
+#include "protocol_layer_udp.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define IP_VERSION_IHL         (0x45U)  // IPv4, 20-byte header
+#define IP_FLAGS_DF            (0x40U)  // Don't Fragment, high byte of the fragment field
+#define IP_PROTOCOL_UDP        (17U)
+#define IP_HEADER_SIZE         (20U)
+#define UDP_HEADER_SIZE        (8U)
+
+/* Field offsets in the IPv4 and UDP headers */
+#define IP_TOTAL_LENGTH        (2U)
+#define IP_FRAGMENT            (6U)
+#define IP_TTL                 (8U)
+#define IP_PROTOCOL            (9U)
+#define IP_CHECKSUM            (10U)
+#define IP_SRC                 (12U)
+#define IP_DST                 (16U)
+#define UDP_SRC_PORT           (IP_HEADER_SIZE + 0U)
+#define UDP_DST_PORT           (IP_HEADER_SIZE + 2U)
+#define UDP_LENGTH             (IP_HEADER_SIZE + 4U)
+
+#define IP_IS_MULTICAST(ip)    (((ip)[0] & 0xF0U) == 0xE0U)
+
+typedef struct
+{
+    uint8_t peer[6];                    // peer or group of the peer table
+    uint8_t nextHop[6];                 // static ARP entry
+    uint8_t ip[4];
+    uint8_t header[PL_UDP_HEADER_SIZE]; // IPv4 and UDP headers, lengths 0
+    uint16_t checksum;                  // IPv4 checksum of the template
+} pl_udp_route_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static pl_udp_route_t s_routes[PROTOCOL_LAYER_MAX_PEERS];
+static uint8_t s_count;
+static uint8_t s_ip[4];
+static uint16_t s_port;
+static pl_udp_stats_t s_stats;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+static uint16_t Read16(const uint8_t* data)
+{
+    return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+static void Write16(uint8_t* data, uint16_t value)
+{
+    data[0] = (uint8_t)(value >> 8);
+    data[1] = (uint8_t)(value & 0xFFU);
+}
+
+/*! @brief One's complement sum of length bytes, folded to 16 bits. */
+static uint16_t Sum16(const uint8_t* data, size_t length)
+{
+    uint32_t sum = 0;
+
+    for (size_t i = 0; (i + 1U) < length; i += 2U)
+    {
+        sum += Read16(&data[i]);
+    }
+    while ((sum >> 16) != 0U)
+    {
+        sum = (sum & 0xFFFFU) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+static pl_udp_route_t* FindPeer(const uint8_t* peer)
+{
+    for (uint8_t i = 0; i < s_count; i++)
+    {
+        if (memcmp(s_routes[i].peer, peer, sizeof(s_routes[i].peer)) == 0)
+        {
+            return &s_routes[i];
+        }
+    }
+    return NULL;
+}
+
+static pl_udp_route_t* FindIp(const uint8_t* ip)
+{
+    for (uint8_t i = 0; i < s_count; i++)
+    {
+        if (memcmp(s_routes[i].ip, ip, sizeof(s_routes[i].ip)) == 0)
+        {
+            return &s_routes[i];
+        }
+    }
+    return NULL;
+}
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief Set the address and port of the layer and empty the route table. */
+void ProtocolLayer_udpInit(const uint8_t* ip, uint16_t port)
+{
+    memcpy(s_ip, ip, sizeof(s_ip));
+    s_port = port;
+    s_count = 0;
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
+/*! @brief Send the frames of a peer or group to ip:port over UDP, through
+ *         nextHop: the peer's MAC address on the same segment, the router's
+ *         otherwise, or the multicast MAC address of a group. A peer that
+ *         already has a route gets the new one.
+ *  @return false if the table is full. */
+bool ProtocolLayer_udpAddRoute(const uint8_t* peer, const uint8_t* ip, uint16_t port, const uint8_t* nextHop)
+{
+    pl_udp_route_t* route = FindPeer(peer);
+
+    if (route == NULL)
+    {
+        if (s_count == PROTOCOL_LAYER_MAX_PEERS)
+        {
+            return false;
+        }
+        route = &s_routes[s_count++];
+    }
+
+    memcpy(route->peer, peer, sizeof(route->peer));
+    memcpy(route->nextHop, nextHop, sizeof(route->nextHop));
+    memcpy(route->ip, ip, sizeof(route->ip));
+
+    memset(route->header, 0, sizeof(route->header));
+    route->header[0] = IP_VERSION_IHL;
+    route->header[IP_FRAGMENT] = IP_FLAGS_DF;
+    route->header[IP_TTL] = PROTOCOL_LAYER_IP_TTL;
+    route->header[IP_PROTOCOL] = IP_PROTOCOL_UDP;
+    memcpy(&route->header[IP_SRC], s_ip, sizeof(s_ip));
+    memcpy(&route->header[IP_DST], ip, sizeof(route->ip));
+    Write16(&route->header[UDP_SRC_PORT], s_port);
+    Write16(&route->header[UDP_DST_PORT], port);
+    route->checksum = (uint16_t)~Sum16(route->header, IP_HEADER_SIZE);
+    return true;
+}
+
+/*! @brief Remove every route; all frames are sent in 802.3 again. */
+void ProtocolLayer_udpClear(void)
+{
+    s_count = 0;
+}
+
+/*! @brief Put the headers of the route of a frame in place. ethernet holds
+ *         the addresses of the frame, its destination (the peer) is replaced
+ *         by the next hop; ipUdp gets the IPv4 and UDP headers for a payload
+ *         of length bytes. The caller sets the EtherType.
+ *  @return false if the peer has no route; nothing is written. */
+bool ProtocolLayer_udpEncap(uint8_t* ethernet, uint8_t* ipUdp, size_t length)
+{
+    pl_udp_route_t* route = FindPeer(ethernet);
+    uint16_t total = (uint16_t)(PL_UDP_HEADER_SIZE + length);
+    uint32_t sum;
+
+    if (route == NULL)
+    {
+        return false;
+    }
+
+    memcpy(ethernet, route->nextHop, sizeof(route->nextHop));
+    memcpy(ipUdp, route->header, PL_UDP_HEADER_SIZE);
+    Write16(&ipUdp[IP_TOTAL_LENGTH], total);
+    Write16(&ipUdp[UDP_LENGTH], (uint16_t)(UDP_HEADER_SIZE + length));
+
+    // The template had a total length of 0: HC' = ~(~HC + m')
+    sum = (uint32_t)(uint16_t)~route->checksum + total;
+    sum = (sum & 0xFFFFU) + (sum >> 16);
+    Write16(&ipUdp[IP_CHECKSUM], (uint16_t)~sum);
+    s_stats.sent++;
+    return true;
+}
+
+/*! @brief Check the IPv4 and UDP headers of a received frame, length bytes
+ *         from the IPv4 header to the end of the frame, without counting it;
+ *         for a look at a frame before it is received. src gets the peer of
+ *         the route of the source address; dst the group of a multicast
+ *         destination, NULL for a frame to the layer's own address.
+ *  @return bytes of UDP payload, 0 if the frame is not for the layer. */
+size_t ProtocolLayer_udpCheck(const uint8_t* ipUdp, size_t length, const uint8_t** src, const uint8_t** dst)
+{
+    const pl_udp_route_t* sender;
+    const pl_udp_route_t* group = NULL;
+    uint16_t total;
+
+    if ((length < PL_UDP_HEADER_SIZE) || (ipUdp[0] != IP_VERSION_IHL) || (ipUdp[IP_PROTOCOL] != IP_PROTOCOL_UDP))
+    {
+        return 0;
+    }
+    total = Read16(&ipUdp[IP_TOTAL_LENGTH]);
+    if ((total < PL_UDP_HEADER_SIZE) || (total > length) || ((ipUdp[IP_FRAGMENT] & 0x3FU) != 0U) ||
+        (ipUdp[IP_FRAGMENT + 1U] != 0U) || (Sum16(ipUdp, IP_HEADER_SIZE) != 0xFFFFU) ||
+        (Read16(&ipUdp[UDP_DST_PORT]) != s_port) || (Read16(&ipUdp[UDP_LENGTH]) != (total - IP_HEADER_SIZE)))
+    {
+        return 0;
+    }
+
+    if (IP_IS_MULTICAST(&ipUdp[IP_DST]))
+    {
+        group = FindIp(&ipUdp[IP_DST]);
+    }
+    sender = FindIp(&ipUdp[IP_SRC]);
+    if ((sender == NULL) || ((group == NULL) && (memcmp(&ipUdp[IP_DST], s_ip, sizeof(s_ip)) != 0)))
+    {
+        return 0;
+    }
+
+    *src = sender->peer;
+    *dst = (group != NULL) ? group->peer : NULL;
+    return (size_t)(total - PL_UDP_HEADER_SIZE);
+}
+
+/*! @brief ProtocolLayer_udpCheck() of a frame being received, counted. */
+size_t ProtocolLayer_udpReceive(const uint8_t* ipUdp, size_t length, const uint8_t** src, const uint8_t** dst)
+{
+    size_t payload = ProtocolLayer_udpCheck(ipUdp, length, src, dst);
+
+    if (payload == 0U)
+    {
+        s_stats.rejected++;
+    }
+    else
+    {
+        s_stats.received++;
+    }
+    return payload;
+}
+
+/*! @brief UDP counters, for logging. */
+void ProtocolLayer_udpGetStats(pl_udp_stats_t* stats)
+{
+    *stats = s_stats;
+}
@@ -0,0 +1,43 @@
+/*
+This file declares the UDP/IPv4 encapsulation: a table of static routes
+that give a peer of the peer table an IPv4 address, a UDP port and the
+MAC address its frames are sent to (the peer itself, or the router
+towards it), in place of ARP. Frames to a peer with a route carry IPv4
+and UDP headers between the Ethernet header and the protocol header, so
+they can be routed and a host receives them on an ordinary UDP socket.
+*/
+
+#ifndef _PROTOCOL_LAYER_UDP_H_
+#define _PROTOCOL_LAYER_UDP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* IPv4 header without options, and UDP header */
+#define PL_UDP_HEADER_SIZE     (28U)
+#define PL_ETHERTYPE_IPV4      (0x0800U)
+
+typedef struct
+{
+    uint32_t sent;                  /* frames sent in UDP */
+    uint32_t received;              /* UDP frames handed to the receive path */
+    uint32_t rejected;              /* IPv4 frames dropped: header, checksum, address, port or no route */
+} pl_udp_stats_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+void ProtocolLayer_udpInit(const uint8_t* ip, uint16_t port);
+bool ProtocolLayer_udpAddRoute(const uint8_t* peer, const uint8_t* ip, uint16_t port, const uint8_t* nextHop);
+void ProtocolLayer_udpClear(void);
+bool ProtocolLayer_udpEncap(uint8_t* ethernet, uint8_t* ipUdp, size_t length);
+size_t ProtocolLayer_udpCheck(const uint8_t* ipUdp, size_t length, const uint8_t** src, const uint8_t** dst);
+size_t ProtocolLayer_udpReceive(const uint8_t* ipUdp, size_t length, const uint8_t** src, const uint8_t** dst);
+void ProtocolLayer_udpGetStats(pl_udp_stats_t* stats);
+
+#endif // _PROTOCOL_LAYER_UDP_H_
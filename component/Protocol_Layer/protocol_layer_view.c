@@ -0,0 +1,133 @@
+/*
+This file contains the lazy decryption of the receive view. The payload is
+AES-CBC, where a block decrypts with the ciphertext of the block before it
+as IV, so any range is decrypted from the blocks it covers without the
+ones ahead of it. The frame buffer keeps the ciphertext: the blocks are
+copied where they are decrypted, whole blocks straight to the destination
+and the partial ones at the ends of the range through a block on the
+stack, so a range costs at most three calls to the AES backend.
+
+The padding is only in the last block. The message length is worked out
+the first time a read reaches that block or the application asks for it,
+and is kept; reads that end before it do not need it.
+*/
+
+#include <string.h>
+#include "protocol_layer_view.h"
+#include "protocol_layer_backend.h"
+#include "protocol_layer_simd.h"
+#include "aes.h"        // libray from https://github.com/kokke/tiny-AES-c
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+/*! @brief Decrypt count blocks of the view, from block index, into dst. */
+static void DecryptBlocks(pl_view_t* view, size_t index, size_t count, uint8_t* dst)
+{
+    const uint8_t* iv = (index == 0U) ? view->iv : &view->data[(index - 1U) * AES_BLOCKLEN];
+
+    memcpy(dst, &view->data[index * AES_BLOCKLEN], count * AES_BLOCKLEN);
+    ProtocolLayer_decryptCBC(view->session, dst, count * AES_BLOCKLEN, iv);
+}
+
+/*******************************************************************************
+ * Global functions
+ ******************************************************************************/
+/*! @brief View size bytes of ciphertext. The IV is copied, the ciphertext has
+ *         to stay in place while the view is used. A payload that is not
+ *         whole blocks gives an empty view. */
+void ProtocolLayer_viewOpen(pl_view_t* view, pl_session_t* session, const uint8_t* cipher, size_t size,
+                            const uint8_t* iv)
+{
+    view->data = cipher;
+    view->session = session;
+    memcpy(view->iv, iv, sizeof(view->iv));
+    if ((size < AES_BLOCKLEN) || ((size % AES_BLOCKLEN) != 0U))
+    {
+        view->encrypted = false;
+        view->size = 0;
+        view->length = 0;
+    }
+    else
+    {
+        view->encrypted = true;
+        view->size = size;
+        view->length = PL_VIEW_LENGTH_UNKNOWN;
+    }
+}
+
+/*! @brief View a message that was decoded at once. */
+void ProtocolLayer_viewOpenPlain(pl_view_t* view, const uint8_t* plain, size_t length)
+{
+    view->data = plain;
+    view->session = NULL;
+    view->encrypted = false;
+    view->size = length;
+    view->length = length;
+}
+
+/*! @brief Message length, from the padding in the last block.
+ *  @return 0 if the padding is wrong. */
+size_t ProtocolLayer_viewLength(pl_view_t* view)
+{
+    if (view->length == PL_VIEW_LENGTH_UNKNOWN)
+    {
+        uint8_t block[AES_BLOCKLEN];
+        uint8_t padValue;
+
+        DecryptBlocks(view, (view->size / AES_BLOCKLEN) - 1U, 1U, block);
+        padValue = PL_CheckPadding(block);
+        view->length = (padValue != 0U) ? (view->size - padValue) : 0U;
+    }
+    return view->length;
+}
+
+/*! @brief Copy length bytes of the message from offset to dst, decrypting
+ *         only the blocks they are in.
+ *  @return bytes copied, fewer at the end of the message. */
+size_t ProtocolLayer_viewRead(pl_view_t* view, size_t offset, uint8_t* dst, size_t length)
+{
+    uint8_t block[AES_BLOCKLEN];
+    size_t end = offset + length;
+    size_t done = 0;
+
+    // Only a range that reaches the last block needs the padding
+    if (!view->encrypted || (end > (view->size - AES_BLOCKLEN)))
+    {
+        size_t total = ProtocolLayer_viewLength(view);
+        end = (end > total) ? total : end;
+    }
+    if (offset >= end)
+    {
+        return 0;
+    }
+    length = end - offset;
+
+    if (!view->encrypted)
+    {
+        memcpy(dst, &view->data[offset], length);
+        return length;
+    }
+
+    while (done < length)
+    {
+        size_t index = (offset + done) / AES_BLOCKLEN;
+        size_t skip = (offset + done) % AES_BLOCKLEN;
+        size_t whole = (length - done) / AES_BLOCKLEN;
+
+        if ((skip == 0U) && (whole != 0U))
+        {
+            DecryptBlocks(view, index, whole, &dst[done]);
+            done += whole * AES_BLOCKLEN;
+        }
+        else
+        {
+            size_t part = AES_BLOCKLEN - skip;
+            part = (part > (length - done)) ? (length - done) : part;
+            DecryptBlocks(view, index, 1U, block);
+            memcpy(&dst[done], &block[skip], part);
+            done += part;
+        }
+    }
+    return length;
+}
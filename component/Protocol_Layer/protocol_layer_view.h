@@ -0,0 +1,45 @@
+/*
+This file declares the receive view: a message handed to the application
+as a window on the received frame, after its integrity, replay and
+sequence checks, with the payload still encrypted. Bytes are decrypted
+when the application reads them, and only the AES blocks that cover the
+range read.
+*/
+
+#ifndef _PROTOCOL_LAYER_VIEW_H_
+#define _PROTOCOL_LAYER_VIEW_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol_layer_cfg.h"
+#include "protocol_layer_session.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+/* Length of a view whose last block has not been decrypted yet */
+#define PL_VIEW_LENGTH_UNKNOWN ((size_t)-1)
+
+typedef struct
+{
+    const uint8_t* data;            /* ciphertext in the receive buffer, or the plaintext of a decoded message */
+    size_t size;                    /* bytes at data */
+    size_t length;                  /* message length, PL_VIEW_LENGTH_UNKNOWN until known */
+    bool encrypted;                 /* data is still AES-CBC ciphertext */
+    pl_session_t* session;          /* keys of the frame */
+    uint8_t iv[16];                 /* IV of the first block */
+    uint8_t mac[6];                 /* sender */
+    uint32_t handle;                /* given back to ProtocolLayer_viewRelease(), 0 for no view */
+} pl_view_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+void ProtocolLayer_viewOpen(pl_view_t* view, pl_session_t* session, const uint8_t* cipher, size_t size,
+                            const uint8_t* iv);
+void ProtocolLayer_viewOpenPlain(pl_view_t* view, const uint8_t* plain, size_t length);
+size_t ProtocolLayer_viewLength(pl_view_t* view);
+size_t ProtocolLayer_viewRead(pl_view_t* view, size_t offset, uint8_t* dst, size_t length);
+
+#endif // _PROTOCOL_LAYER_VIEW_H_
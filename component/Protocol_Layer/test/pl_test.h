@@ -0,0 +1,63 @@
+/*
+This file contains the checks shared by the host tests of the protocol
+layer. A failed check prints its location and is counted; main() returns
+the count through PL_TEST_END(), so `make check` stops at the first test
+with a failure.
+*/
+
+#ifndef _PL_TEST_H_
+#define _PL_TEST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+static unsigned s_failures;
+
+#define PL_CHECK(cond)                                                              \
+    do                                                                              \
+    {                                                                               \
+        if (!(cond))                                                                \
+        {                                                                           \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);         \
+            s_failures++;                                                           \
+        }                                                                           \
+    } while (0)
+
+#define PL_TEST_END(name) (printf("%-20s %s\n", (name), (s_failures == 0U) ? "ok" : "FAILED"), (int)(s_failures != 0U))
+
+/*******************************************************************************
+ * Functions
+ ******************************************************************************/
+/*! @brief Bytes of a hex string, for test vectors. */
+static inline size_t PL_Hex(const char* hex, uint8_t* out)
+{
+    size_t n = 0;
+
+    for (; (hex[0] != '\0') && (hex[1] != '\0'); hex += 2)
+    {
+        unsigned value;
+        (void)sscanf(hex, "%2x", &value);
+        out[n++] = (uint8_t)value;
+    }
+    return n;
+}
+
+/*! @brief xorshift32 for reproducible loss and payload patterns. */
+static inline uint32_t PL_Random(uint32_t* state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+#endif // _PL_TEST_H_
@@ -0,0 +1,108 @@
+/*
+Host test of the aggregation buffers: messages packed by the transmit side
+come out of the receive side unchanged and in order, with 1 and 2 byte
+prefixes, an empty message and a malformed block told apart from the end;
+only short messages are packed, and the deadline fires on time.
+*/
+
+#include "pl_test.h"
+#include "protocol_layer_agg.h"
+#include "protocol_layer_backend.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define MESSAGES_MAX           (PROTOCOL_LAYER_AGG_FRAME_SIZE)
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static uint8_t s_messages[MESSAGES_MAX][PL_AGG_MAX_MESSAGE];
+static size_t s_lengths[MESSAGES_MAX];
+static uint8_t s_out[PL_AGG_MAX_MESSAGE];
+static uint32_t s_seed = 0x9E3779B9U;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+/*! @brief Append random messages until the frame is full, take the frame,
+ *         split it and compare.
+ *  @return messages packed. */
+static uint32_t RoundTrip(size_t maxLength)
+{
+    const uint8_t* frame;
+    size_t frameLength;
+    size_t length;
+    uint32_t count = 0;
+
+    for (;;)
+    {
+        s_lengths[count] = 1U + (PL_Random(&s_seed) % maxLength);
+        for (size_t i = 0; i < s_lengths[count]; i++)
+        {
+            s_messages[count][i] = (uint8_t)PL_Random(&s_seed);
+        }
+        if (!ProtocolLayer_aggAppend(s_messages[count], s_lengths[count]))
+        {
+            break;
+        }
+        count++;
+    }
+    PL_CHECK(count > 0U);
+    PL_CHECK(ProtocolLayer_aggQueued() > (PROTOCOL_LAYER_AGG_FRAME_SIZE - PL_AGG_PREFIX_MAX - maxLength));
+
+    frameLength = ProtocolLayer_aggTake(&frame);
+    PL_CHECK(ProtocolLayer_aggQueued() == 0U);
+    ProtocolLayer_aggLoad(frame, frameLength);
+    for (uint32_t n = 0; n < count; n++)
+    {
+        PL_CHECK(ProtocolLayer_aggPending());
+        PL_CHECK(ProtocolLayer_aggNext(s_out, &length));
+        PL_CHECK((length == s_lengths[n]) && (memcmp(s_out, s_messages[n], length) == 0));
+    }
+    PL_CHECK(!ProtocolLayer_aggPending());
+    PL_CHECK(!ProtocolLayer_aggNext(s_out, &length));
+    return count;
+}
+
+/*******************************************************************************
+ * Main
+ ******************************************************************************/
+int main(void)
+{
+    static const uint8_t block[] = {0x00, 0x02, 'h', 'i', 0x81, 0x00, 'x'};
+    const uint8_t* frame;
+    size_t length;
+
+    ProtocolLayer_initBackends();
+
+    // At least four messages of the longest aggregated size share a frame
+    PL_CHECK((4U * (PL_AGG_MAX_MESSAGE + PL_AGG_PREFIX_MAX)) <= PROTOCOL_LAYER_AGG_FRAME_SIZE);
+    PL_CHECK(RoundTrip(PL_AGG_PREFIX_SHORT_MAX) >= 4U);
+    PL_CHECK(RoundTrip(PL_AGG_MAX_MESSAGE) >= 4U);
+    PL_CHECK(!ProtocolLayer_aggAppend(s_messages[0], PL_AGG_MAX_MESSAGE + 1U));
+    PL_CHECK(ProtocolLayer_aggQueued() == 0U);
+
+    // An empty message is a message, the end and a truncated one are not
+    ProtocolLayer_aggLoad(block, sizeof(block));
+    PL_CHECK(ProtocolLayer_aggNext(s_out, &length) && (length == 0U));
+    PL_CHECK(ProtocolLayer_aggNext(s_out, &length) && (length == 2U) && (memcmp(s_out, "hi", 2) == 0));
+    PL_CHECK(ProtocolLayer_aggPending());
+    PL_CHECK(!ProtocolLayer_aggNext(s_out, &length));
+    PL_CHECK(!ProtocolLayer_aggPending());
+
+    // The deadline runs from the first message queued
+    PL_CHECK(!ProtocolLayer_aggDue());
+    PL_CHECK(ProtocolLayer_aggAppend(block, 1U));
+    PL_CHECK(!ProtocolLayer_aggDue());
+    uint32_t start = ProtocolLayer_timerTicks();
+    uint32_t deadline = (ProtocolLayer_timerHz() / 1000000U) * PROTOCOL_LAYER_AGG_DEADLINE_US;
+    while ((ProtocolLayer_timerTicks() - start) < deadline)
+    {
+    }
+    PL_CHECK(ProtocolLayer_aggDue());
+    PL_CHECK(ProtocolLayer_aggTake(&frame) == 2U);
+    PL_CHECK(!ProtocolLayer_aggDue());
+
+    return PL_TEST_END("test_agg");
+}
@@ -0,0 +1,141 @@
+/*
+Host test of the backends: the CRC32 and AES-CBC/CMAC results against
+known vectors through the dispatch table, and a calibration pass on the
+host clock.
+*/
+
+#include "pl_test.h"
+#include "protocol_layer_backend.h"
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static pl_session_t s_session;
+static uint8_t s_buffer[1488 + AES_BLOCKLEN];
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+/*! @brief CRC32 of "123456789" (IEEE 802.3 check value) and of every size
+ *         class against a bitwise reference. */
+static void TestCrc(void)
+{
+    static const uint16_t sizes[] = {0U, 1U, 48U, 64U, 65U, 256U, 257U, 1488U};
+
+    PL_CHECK(ProtocolLayer_crc32((const uint8_t*)"123456789", 9U) == 0xCBF43926U);
+    for (size_t s = 0; s < (sizeof(sizes) / sizeof(sizes[0])); s++)
+    {
+        uint32_t state = 0x1234U + s;
+        uint32_t crc = 0xFFFFFFFFU;
+
+        for (size_t i = 0; i < sizes[s]; i++)
+        {
+            s_buffer[i] = (uint8_t)PL_Random(&state);
+            crc ^= s_buffer[i];
+            for (uint8_t k = 0; k < 8U; k++)
+            {
+                crc = (crc & 1U) ? (0xEDB88320U ^ (crc >> 1)) : (crc >> 1);
+            }
+        }
+        PL_CHECK(ProtocolLayer_crc32(s_buffer, sizes[s]) == ~crc);
+    }
+}
+
+/*! @brief AES-128-CBC of NIST SP 800-38A F.2.1 and a round trip of every
+ *         sample size. */
+static void TestAes(void)
+{
+    uint8_t key[16];
+    uint8_t iv[16];
+    uint8_t expected[64];
+
+    PL_Hex("2b7e151628aed2a6abf7158809cf4f3c", key);
+    PL_Hex("000102030405060708090a0b0c0d0e0f", iv);
+    ProtocolLayer_sessionLoad(&s_session, key, key);
+
+    PL_Hex("6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+           "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710", s_buffer);
+    PL_Hex("7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b2"
+           "73bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7", expected);
+    ProtocolLayer_encryptCBC(&s_session, s_buffer, 64U, iv);
+    PL_CHECK(memcmp(s_buffer, expected, 64U) == 0);
+    ProtocolLayer_decryptCBC(&s_session, s_buffer, 64U, iv);
+    PL_Hex("6bc1bee22e409f96e93d7e117393172a", expected);
+    PL_CHECK(memcmp(s_buffer, expected, 16U) == 0);
+
+    for (size_t length = 16U; length <= 1488U; length += 16U)
+    {
+        uint8_t plain[1488];
+        uint32_t state = (uint32_t)length;
+
+        for (size_t i = 0; i < length; i++)
+        {
+            plain[i] = (uint8_t)PL_Random(&state);
+        }
+        memcpy(s_buffer, plain, length);
+        ProtocolLayer_encryptCBC(&s_session, s_buffer, length, iv);
+        PL_CHECK(memcmp(s_buffer, plain, length) != 0);
+        ProtocolLayer_decryptCBC(&s_session, s_buffer, length, iv);
+        PL_CHECK(memcmp(s_buffer, plain, length) == 0);
+    }
+}
+
+/*! @brief AES-CMAC of RFC 4493, section 4: empty, one block, 40 bytes. */
+static void TestCmac(void)
+{
+    static const char* const messages[] = {
+        "", "6bc1bee22e409f96e93d7e117393172a",
+        "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e5130c81c46a35ce411"};
+    static const char* const tags[] = {"bb1d6929e95937287fa37d129b756746", "070a16b46b4d4144f79bdd9dd04a287c",
+                                       "dfa66747de9ae63030ca32611497c827"};
+    uint8_t key[16];
+    uint8_t tag[16];
+    uint8_t mac[AES_BLOCKLEN];
+
+    PL_Hex("2b7e151628aed2a6abf7158809cf4f3c", key);
+    ProtocolLayer_sessionLoad(&s_session, key, key);
+    for (size_t m = 0; m < 3U; m++)
+    {
+        size_t length = PL_Hex(messages[m], s_buffer);
+
+        PL_Hex(tags[m], tag);
+        ProtocolLayer_cmacStart(&s_session, s_buffer, length);
+        PL_CHECK(ProtocolLayer_cmacFinish(mac));
+        PL_CHECK(memcmp(mac, tag, sizeof(tag)) == 0);
+    }
+}
+
+/*! @brief A calibration pass selects a backend of the table for every
+ *         class and leaves the results unchanged. */
+static void TestCalibrate(void)
+{
+    const pl_calibration_t* calib = ProtocolLayer_getCalibration();
+
+    PL_CHECK(!calib->valid);
+    ProtocolLayer_calibrate();
+    PL_CHECK(calib->valid);
+    PL_CHECK(calib->timerHz == ProtocolLayer_timerHz());
+    for (uint8_t sizeClass = 0; sizeClass < PL_SIZE_CLASS_NUM; sizeClass++)
+    {
+        PL_CHECK(calib->aesSelect[sizeClass] < kPL_AesBackend_Num);
+        PL_CHECK(calib->crcSelect[sizeClass] < kPL_CrcBackend_Num);
+        for (uint8_t b = 0; b < kPL_CrcBackend_Num; b++)
+        {
+            PL_CHECK((calib->crcTicks[b][sizeClass] != 0U) && (calib->crcTicks[b][sizeClass] != UINT32_MAX));
+        }
+    }
+    ProtocolLayer_printCalibration();
+}
+
+/*******************************************************************************
+ * Main
+ ******************************************************************************/
+int main(void)
+{
+    ProtocolLayer_initBackends();
+    TestCalibrate();
+    TestCrc();
+    TestAes();
+    TestCmac();
+    return PL_TEST_END("test_backend");
+}
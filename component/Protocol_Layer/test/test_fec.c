@@ -0,0 +1,259 @@
+/*
+Host simulation of the XOR parity groups: a stream of frames of random
+length goes through the send and receive sides of the FEC module over a
+link that loses frames at a given rate. A lost frame arrives either
+rebuilt from the parity frame of its group, or by retransmission after a
+fixed timeout, which may be lost again; the same stream without FEC only
+has the retransmission. The latency of every frame is printed as mean,
+p99 and p99.9 for both, and every rebuilt frame must match the lost one.
+
+    make build/test_fec && ./build/test_fec 10 50
+
+takes the loss rates in 1/1000 (1 % and 5 % by default). The group size
+is PROTOCOL_LAYER_FEC_GROUP, for instance
+
+    make -B build/test_fec test_fec_DEFS=-DPROTOCOL_LAYER_FEC_GROUP=8
+*/
+
+#include <stdlib.h>
+#include "pl_test.h"
+#include "protocol_layer_fec.h"
+#include "protocol_layer_backend.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define FRAMES                 (50000U)
+#define GAP_US                 (100U)   /* between two frames sent */
+#define DELAY_US               (150U)   /* one way */
+#define RTO_US                 (900U)   /* retransmission timeout, the fallback */
+#define MAC_SIZE               (12U)
+#define HEADER_SIZE            (4U)
+#define SEGMENT_MIN            (64U)
+#define SEGMENT_MAX            (1200U)
+
+/* A frame of the open group, MAC addresses and length field first */
+typedef struct
+{
+    bool lost;
+    uint32_t sentUs;
+    size_t length;          /* protected bytes */
+    uint8_t bytes[MAC_SIZE + PL_FEC_LENGTH_SIZE + SEGMENT_MAX];
+} frame_t;
+
+typedef struct
+{
+    uint32_t meanUs10;      /* mean, in 1/10 us */
+    uint32_t p99Us;
+    uint32_t p999Us;
+} result_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static frame_t s_group[PL_FEC_GROUP_MAX];
+static uint8_t s_parity[MAC_SIZE + PL_FEC_LENGTH_SIZE + HEADER_SIZE + PL_EXT_FEC_SIZE + PL_FEC_LENGTH_SIZE +
+                        SEGMENT_MAX];
+static uint8_t s_rebuilt[MAC_SIZE + PL_FEC_LENGTH_SIZE + SEGMENT_MAX];
+static uint32_t s_latency[FRAMES];
+static uint32_t s_lossSeed;
+static uint32_t s_retrySeed;
+static uint32_t s_paritySeed;
+static uint32_t s_dataSeed;
+static uint32_t s_mismatches;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+static bool Lost(uint32_t* seed, uint32_t perMille)
+{
+    return (PL_Random(seed) % 1000U) < perMille;
+}
+
+/*! @brief Latency of a lost frame that waits for its retransmissions. */
+static uint32_t Retransmitted(uint32_t perMille)
+{
+    uint32_t latency = RTO_US + DELAY_US;
+
+    while (Lost(&s_retrySeed, perMille))
+    {
+        latency += RTO_US;
+    }
+    return latency;
+}
+
+static int CompareU32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+static void Seed(void)
+{
+    s_lossSeed = 0x2545F491U;
+    s_retrySeed = 0x9E3779B9U;
+    s_paritySeed = 0x7F4A7C15U;
+    s_dataSeed = 0x1234567U;
+}
+
+static result_t Summarize(void)
+{
+    uint64_t sum = 0;
+
+    for (uint32_t i = 0; i < FRAMES; i++)
+    {
+        sum += s_latency[i];
+    }
+    qsort(s_latency, FRAMES, sizeof(s_latency[0]), CompareU32);
+    return (result_t){.meanUs10 = (uint32_t)((sum * 10U) / FRAMES),
+                      .p99Us = s_latency[(FRAMES * 99U) / 100U],
+                      .p999Us = s_latency[(FRAMES * 999U) / 1000U]};
+}
+
+/*! @brief The stream without FEC: a lost frame only comes back by retransmission. */
+static result_t RunPlain(uint32_t perMille)
+{
+    Seed();
+    for (uint32_t i = 0; i < FRAMES; i++)
+    {
+        s_latency[i] = Lost(&s_lossSeed, perMille) ? Retransmitted(perMille) : DELAY_US;
+    }
+    return Summarize();
+}
+
+/*! @brief Build the next data frame of the group and pass it to the send side. */
+static frame_t* SendData(uint32_t index, uint32_t nowUs)
+{
+    frame_t* frame = &s_group[index];
+    uint8_t* segment = &frame->bytes[MAC_SIZE + PL_FEC_LENGTH_SIZE];
+
+    frame->length = SEGMENT_MIN + (PL_Random(&s_dataSeed) % (SEGMENT_MAX - SEGMENT_MIN + 1U));
+    frame->sentUs = nowUs;
+    memset(frame->bytes, 0x5A, MAC_SIZE);
+    frame->bytes[MAC_SIZE] = (uint8_t)(frame->length >> 8);
+    frame->bytes[MAC_SIZE + 1U] = (uint8_t)(frame->length & 0xFFU);
+    segment[0] = 0;
+    segment[1] = (uint8_t)(HEADER_SIZE + PL_EXT_FEC_SIZE);
+    ProtocolLayer_fecWrite(&segment[HEADER_SIZE]);
+    for (size_t i = HEADER_SIZE + PL_EXT_FEC_SIZE; i < frame->length; i++)
+    {
+        segment[i] = (uint8_t)PL_Random(&s_dataSeed);
+    }
+    ProtocolLayer_fecAdd(segment, frame->length);
+    return frame;
+}
+
+/*! @brief The stream with FEC: a parity frame after each group, which takes
+ *         a slot on the link and can be lost as well.
+ *  @param overhead parity bytes per 1000 data bytes */
+static result_t RunFec(uint32_t perMille, uint32_t* overhead)
+{
+    uint8_t* segment = &s_parity[MAC_SIZE + PL_FEC_LENGTH_SIZE];
+    uint8_t* ext = &segment[HEADER_SIZE];
+    uint64_t dataBytes = 0;
+    uint64_t parityBytes = 0;
+    uint32_t nowUs = 0;
+    uint32_t frame = 0;
+
+    Seed();
+    ProtocolLayer_fecInit();
+    memset(s_parity, 0x5A, MAC_SIZE);
+    while (frame < FRAMES)
+    {
+        uint32_t count = 0;
+
+        for (; (count < PROTOCOL_LAYER_FEC_GROUP) && ((frame + count) < FRAMES); count++)
+        {
+            frame_t* data = SendData(count, nowUs);
+
+            dataBytes += data->length;
+            data->lost = Lost(&s_lossSeed, perMille);
+            if (!data->lost)
+            {
+                PL_CHECK(ProtocolLayer_fecOnData(0U, data->bytes, &data->bytes[MAC_SIZE + PL_FEC_LENGTH_SIZE +
+                                                                               HEADER_SIZE],
+                                                 &data->bytes[MAC_SIZE + PL_FEC_LENGTH_SIZE], data->length));
+            }
+            nowUs += GAP_US;
+        }
+
+        size_t length = ProtocolLayer_fecParity(ext, &segment[HEADER_SIZE + PL_EXT_FEC_SIZE]);
+        parityBytes += HEADER_SIZE + PL_EXT_FEC_SIZE + length;
+        uint32_t parityUs = nowUs;
+        nowUs += GAP_US;
+        if (!Lost(&s_paritySeed, perMille))
+        {
+            ProtocolLayer_fecOnParity(0U, s_parity, ext, &segment[HEADER_SIZE + PL_EXT_FEC_SIZE], length);
+        }
+
+        for (uint32_t i = 0; i < count; i++, frame++)
+        {
+            const frame_t* data = &s_group[i];
+
+            if (!data->lost)
+            {
+                s_latency[frame] = DELAY_US;
+            }
+            else if (ProtocolLayer_fecPending() != 0U)
+            {
+                // A group rebuilds at most one frame, this one
+                PL_CHECK(ProtocolLayer_fecPending() == (MAC_SIZE + PL_FEC_LENGTH_SIZE + data->length));
+                ProtocolLayer_fecRebuild(s_rebuilt);
+                s_mismatches += (memcmp(s_rebuilt, data->bytes, MAC_SIZE + PL_FEC_LENGTH_SIZE + data->length) != 0)
+                                    ? 1U
+                                    : 0U;
+                s_latency[frame] = (parityUs + DELAY_US) - data->sentUs;
+            }
+            else
+            {
+                s_latency[frame] = Retransmitted(perMille);
+            }
+        }
+        PL_CHECK(ProtocolLayer_fecPending() == 0U);
+    }
+    *overhead = (uint32_t)((parityBytes * 1000U) / dataBytes);
+    return Summarize();
+}
+
+/*******************************************************************************
+ * Main
+ ******************************************************************************/
+int main(int argc, char** argv)
+{
+    static const uint32_t defaults[] = {10U, 50U};
+    uint32_t runs = (argc > 1) ? (uint32_t)(argc - 1) : (uint32_t)(sizeof(defaults) / sizeof(defaults[0]));
+
+    ProtocolLayer_initBackends();
+    printf("group %u, %u us between frames, %u us delay, %u us timeout\n", (unsigned)PROTOCOL_LAYER_FEC_GROUP,
+           (unsigned)GAP_US, (unsigned)DELAY_US, (unsigned)RTO_US);
+    for (uint32_t r = 0; r < runs; r++)
+    {
+        uint32_t perMille = (argc > 1) ? (uint32_t)strtoul(argv[r + 1U], NULL, 10) : defaults[r];
+        pl_fec_stats_t stats;
+        uint32_t overhead;
+
+        PL_CHECK(perMille < 1000U);
+        result_t plain = RunPlain(perMille);
+        result_t fec = RunFec(perMille, &overhead);
+        ProtocolLayer_fecGetStats(&stats);
+
+        printf("loss %u.%u %%: mean %u.%u -> %u.%u us, p99 %u -> %u us, p99.9 %u -> %u us, "
+               "parity %u.%u %% of the bytes, %u rebuilt\n",
+               (unsigned)(perMille / 10U), (unsigned)(perMille % 10U), (unsigned)(plain.meanUs10 / 10U),
+               (unsigned)(plain.meanUs10 % 10U), (unsigned)(fec.meanUs10 / 10U), (unsigned)(fec.meanUs10 % 10U),
+               (unsigned)plain.p99Us, (unsigned)fec.p99Us, (unsigned)plain.p999Us, (unsigned)fec.p999Us,
+               (unsigned)(overhead / 10U), (unsigned)(overhead % 10U), (unsigned)stats.rebuilt);
+
+        // Loss at these rates leaves most groups with one frame at most
+        if ((perMille != 0U) && (perMille <= 100U))
+        {
+            PL_CHECK(stats.rebuilt > 0U);
+            PL_CHECK(fec.meanUs10 < plain.meanUs10);
+            PL_CHECK(fec.p999Us <= plain.p999Us);
+        }
+    }
+    PL_CHECK(s_mismatches == 0U);
+    return PL_TEST_END("test_fec");
+}
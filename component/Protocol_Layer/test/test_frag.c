@@ -0,0 +1,183 @@
+/*
+Host test of the reassembly table: fragments encrypted as the sender does
+it are added in any order and the message comes out whole, decrypted into
+a buffer of exactly PROTOCOL_LAYER_MAX_MESSAGE bytes; duplicates, bad
+padding, a full table and the timeout drop what they should.
+*/
+
+#include "pl_test.h"
+#include "protocol_layer_frag.h"
+#include "protocol_layer_backend.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define PEER                   (3U)
+#define GUARD                  (32U)
+
+/* One message cut into encrypted fragments, as the sender builds them */
+typedef struct
+{
+    pl_frag_t frag[PL_FRAG_MAX_COUNT];
+    uint8_t cipher[PL_FRAG_MAX_COUNT][PROTOCOL_LAYER_FRAG_CHUNK + AES_BLOCKLEN];
+    size_t length[PL_FRAG_MAX_COUNT];
+    uint8_t iv[PL_FRAG_MAX_COUNT][AES_BLOCKLEN];
+    uint8_t epoch[PL_FRAG_MAX_COUNT];
+} message_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static pl_keyring_t s_keys;
+static message_t s_message;
+static uint8_t s_plain[PROTOCOL_LAYER_MAX_MESSAGE];
+static uint8_t s_out[PROTOCOL_LAYER_MAX_MESSAGE + GUARD];
+static uint32_t s_seed = 0x2545F491U;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+/*! @brief Fill s_plain with length random bytes and cut it into s_message;
+ *         fragments with a bit set in epochMask use key epoch 1. */
+static uint8_t Cut(size_t length, uint16_t msgId, uint32_t epochMask)
+{
+    uint8_t count = (uint8_t)((length + PROTOCOL_LAYER_FRAG_CHUNK - 1U) / PROTOCOL_LAYER_FRAG_CHUNK);
+
+    for (size_t i = 0; i < length; i++)
+    {
+        s_plain[i] = (uint8_t)PL_Random(&s_seed);
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+        size_t offset = (size_t)i * PROTOCOL_LAYER_FRAG_CHUNK;
+        size_t chunk = ((i + 1U) == count) ? (length - offset) : PROTOCOL_LAYER_FRAG_CHUNK;
+        size_t padded = chunk;
+
+        memcpy(s_message.cipher[i], &s_plain[offset], chunk);
+        if ((i + 1U) == count)
+        {
+            uint8_t pad = (uint8_t)(AES_BLOCKLEN - (chunk % AES_BLOCKLEN));
+            memset(&s_message.cipher[i][chunk], pad, pad);
+            padded += pad;
+        }
+        for (uint8_t b = 0; b < AES_BLOCKLEN; b++)
+        {
+            s_message.iv[i][b] = (uint8_t)PL_Random(&s_seed);
+        }
+        s_message.epoch[i] = (uint8_t)((epochMask >> i) & 1U);
+        ProtocolLayer_encryptCBC(&s_keys.sessions[s_message.epoch[i]], s_message.cipher[i], padded,
+                                 s_message.iv[i]);
+        s_message.length[i] = padded;
+        s_message.frag[i].msgId = msgId;
+        s_message.frag[i].index = i;
+        s_message.frag[i].count = count;
+    }
+    return count;
+}
+
+/*! @brief Add fragment i of s_message. */
+static bool Add(uint8_t i)
+{
+    return ProtocolLayer_reasmAdd(PEER, &s_message.frag[i], s_message.cipher[i], s_message.length[i],
+                                  s_message.iv[i], s_message.epoch[i]);
+}
+
+static size_t Deliver(uint16_t msgId)
+{
+    return ProtocolLayer_reasmDeliver(PEER, msgId, &s_keys, s_out);
+}
+
+/*! @brief Add every fragment of s_message last to first, delivering after each. */
+static size_t AddReversed(uint8_t count, uint16_t msgId)
+{
+    size_t length = 0;
+
+    for (uint8_t i = count; i > 0U; i--)
+    {
+        PL_CHECK(length == 0U);
+        PL_CHECK(Add((uint8_t)(i - 1U)));
+        length = Deliver(msgId);
+    }
+    return length;
+}
+
+/*******************************************************************************
+ * Main
+ ******************************************************************************/
+int main(void)
+{
+    static const uint8_t key1[PL_KEY_SIZE] = "next-session-key";
+    static const uint8_t mac1[PL_KEY_SIZE] = "next-session-mac";
+    pl_reasm_stats_t stats;
+    uint8_t count;
+
+    ProtocolLayer_initBackends();
+    ProtocolLayer_sessionInit(&s_keys, aes_key, aes_key);
+    ProtocolLayer_sessionLoad(&s_keys.sessions[1], key1, mac1);
+    ProtocolLayer_reasmInit();
+
+    // Largest message, out of order, decrypted into a buffer of its size
+    memset(s_out, 0xA5, sizeof(s_out));
+    count = Cut(PROTOCOL_LAYER_MAX_MESSAGE, 1U, 0U);
+    PL_CHECK(count == PL_FRAG_MAX_COUNT);
+    PL_CHECK(AddReversed(count, 1U) == PROTOCOL_LAYER_MAX_MESSAGE);
+    PL_CHECK(memcmp(s_out, s_plain, PROTOCOL_LAYER_MAX_MESSAGE) == 0);
+    for (uint32_t i = 0; i < GUARD; i++)
+    {
+        PL_CHECK(s_out[PROTOCOL_LAYER_MAX_MESSAGE + i] == 0xA5U);
+    }
+
+    // Lengths around the block and chunk edges, with a rekey mid-message
+    static const size_t lengths[] = {PROTOCOL_LAYER_FRAG_CHUNK + 1U, PROTOCOL_LAYER_FRAG_CHUNK + AES_BLOCKLEN,
+                                     (2U * PROTOCOL_LAYER_FRAG_CHUNK) - 1U, (2U * PROTOCOL_LAYER_FRAG_CHUNK) + 17U};
+    for (uint32_t n = 0; n < (sizeof(lengths) / sizeof(lengths[0])); n++)
+    {
+        count = Cut(lengths[n], (uint16_t)(10U + n), 0x2U);
+        PL_CHECK(AddReversed(count, (uint16_t)(10U + n)) == lengths[n]);
+        PL_CHECK(memcmp(s_out, s_plain, lengths[n]) == 0);
+    }
+
+    // A duplicate is refused and does not complete the message twice
+    count = Cut(2000U, 20U, 0U);
+    PL_CHECK(Add(0));
+    PL_CHECK(!Add(0));
+    PL_CHECK(Add(2));
+    PL_CHECK(Deliver(20U) == 0U);
+    PL_CHECK(Add(1));
+    PL_CHECK(Deliver(20U) == 2000U);
+    PL_CHECK(Deliver(20U) == 0U);
+    s_message.frag[0].index = count;
+    PL_CHECK(!Add(0));
+
+    // Wrong padding, or a fragment count that changes, drops the message
+    count = Cut(2000U, 21U, 0U);
+    s_message.cipher[count - 1U][s_message.length[count - 1U] - 1U] ^= 0x40U;
+    PL_CHECK(AddReversed(count, 21U) == 0U);
+    count = Cut(2000U, 22U, 0U);
+    PL_CHECK(Add(0));
+    s_message.frag[1].count = 2U;
+    PL_CHECK(!Add(1));
+    ProtocolLayer_reasmService();
+
+    // Table full: a third message waits for a slot until one times out
+    (void)Cut(2000U, 23U, 0U);
+    PL_CHECK(Add(0));
+    (void)Cut(2000U, 24U, 0U);
+    PL_CHECK(!Add(0));
+    uint32_t start = ProtocolLayer_timerTicks();
+    uint32_t timeout = (ProtocolLayer_timerHz() / 1000U) * (PROTOCOL_LAYER_REASM_TIMEOUT_MS + 1U);
+    while ((ProtocolLayer_timerTicks() - start) < timeout)
+    {
+    }
+    PL_CHECK(Add(0));
+    ProtocolLayer_reasmService();
+    PL_CHECK(Add(1));
+    PL_CHECK(Deliver(24U) == 0U);
+
+    ProtocolLayer_reasmGetStats(&stats);
+    PL_CHECK(stats.completed == (1U + (sizeof(lengths) / sizeof(lengths[0])) + 1U));
+    PL_CHECK(stats.timeouts == 2U);
+    printf("%u messages, %u timeouts, %u fragments dropped\n", (unsigned)stats.completed,
+           (unsigned)stats.timeouts, (unsigned)stats.dropped);
+    return PL_TEST_END("test_frag");
+}
@@ -0,0 +1,238 @@
+/*
+Host driver of the hybrid interrupt/poll receive scheduler: a synthetic
+receive ring fills at a given rate behind the pl_napi_ops_t of the
+scheduler, and the receive loop of the protocol layer is run against it:
+ProtocolLayer_napiPass() when ProtocolLayer_napiPoll() allows it, the idle
+work otherwise. Every frame read and every idle turn take one tick. Whatever the load and the ring depth, a pass
+never reads more than PROTOCOL_LAYER_NAPI_BUDGET frames and the idle work
+gets a turn after every pass; a lone frame costs one interrupt, a burst or
+a sustained overload one interrupt in all, and once the traffic stops the
+ring is empty with the interrupt unmasked, so no frame is stranded.
+*/
+
+#include "pl_test.h"
+#include "protocol_layer_napi.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define QUIET_TICKS            (1000U)  /* after a phase, to let the ring empty */
+
+/* Arrivals of a phase: rate frames per 1000 ticks, or burst frames at once
+ * every period ticks */
+typedef struct
+{
+    const char* name;
+    uint32_t ticks;
+    uint32_t rate;
+    uint32_t burst;
+    uint32_t period;
+} phase_t;
+
+/* The MAC side: ring occupancy, interrupt mask and status flag */
+typedef struct
+{
+    uint32_t depth;
+    uint32_t used;
+    bool masked;
+    bool status;            /* a frame arrived since the flag was cleared */
+    uint32_t arrived;
+    uint32_t overflow;      /* frames lost to a full ring */
+} ring_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static ring_t s_ring;
+static uint32_t s_tick;
+static uint32_t s_accumulated;          /* arrival rate carried over, in 1/1000 frame */
+static const phase_t* s_phase;
+static uint32_t s_read;
+static uint32_t s_idleTurns;
+static uint32_t s_sinceIdle;            /* frames read since the last idle turn */
+static uint32_t s_maxPass;
+static uint32_t s_maxSinceIdle;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+static void Arrive(uint32_t frames)
+{
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        s_ring.arrived++;
+        if (s_ring.used == s_ring.depth)
+        {
+            s_ring.overflow++;
+            continue;
+        }
+        s_ring.used++;
+        s_ring.status = true;
+    }
+}
+
+/*! @brief One tick of the link: frames of the phase arrive, and the receive
+ *         interrupt fires if it is unmasked, as EnetCallback() handles it. */
+static void Tick(void)
+{
+    s_tick++;
+    if (s_phase != NULL)
+    {
+        if (s_phase->period != 0U)
+        {
+            Arrive(((s_tick % s_phase->period) == 0U) ? s_phase->burst : 0U);
+        }
+        else
+        {
+            s_accumulated += s_phase->rate;
+            Arrive(s_accumulated / 1000U);
+            s_accumulated %= 1000U;
+        }
+    }
+    if (s_ring.status && !s_ring.masked)
+    {
+        ProtocolLayer_napiOnIrq();
+    }
+}
+
+static bool RingPending(void)
+{
+    return s_ring.used != 0U;
+}
+
+/*! @brief Read a frame, which takes a tick. */
+static bool RingRead(void)
+{
+    if (s_ring.used == 0U)
+    {
+        return false;
+    }
+    s_ring.used--;
+    s_read++;
+    s_sinceIdle++;
+    s_maxSinceIdle = (s_sinceIdle > s_maxSinceIdle) ? s_sinceIdle : s_maxSinceIdle;
+    Tick();
+    return true;
+}
+
+static void RingMask(void)
+{
+    s_ring.masked = true;
+}
+
+static void RingUnmask(void)
+{
+    s_ring.masked = false;
+}
+
+static void RingClearStatus(void)
+{
+    s_ring.status = false;
+}
+
+/*! @brief One call of the receive loop: a pass over the ring, or the idle
+ *         work (the queued messages, the transmit queue, the timers). */
+static void Service(void)
+{
+    if (ProtocolLayer_napiPoll())
+    {
+        uint32_t frames = ProtocolLayer_napiPass(s_ring.depth);
+
+        s_maxPass = (frames > s_maxPass) ? frames : s_maxPass;
+        return;
+    }
+    s_idleTurns++;
+    s_sinceIdle = 0;
+    Tick();
+}
+
+/*! @brief Run a phase, then quiet ticks until the ring is empty.
+ *  @return interrupts taken in the phase. */
+static uint32_t Run(const phase_t* phase)
+{
+    pl_napi_stats_t before;
+    pl_napi_stats_t after;
+    uint32_t end = s_tick + phase->ticks;
+
+    ProtocolLayer_napiGetStats(&before);
+    s_phase = phase;
+    s_accumulated = 0;
+    while (s_tick < end)
+    {
+        Service();
+    }
+    s_phase = NULL;
+    end = s_tick + QUIET_TICKS;
+    while (s_tick < end)
+    {
+        Service();
+    }
+    ProtocolLayer_napiGetStats(&after);
+
+    // No frame stranded, polling over and the interrupt back on
+    PL_CHECK(s_ring.used == 0U);
+    PL_CHECK(!s_ring.masked && !ProtocolLayer_napiPoll());
+    PL_CHECK(s_read == (s_ring.arrived - s_ring.overflow));
+    PL_CHECK((after.frames - before.frames) == s_read);
+
+    // The budget bounds every pass, and the idle work runs between passes
+    PL_CHECK(s_maxPass <= PROTOCOL_LAYER_NAPI_BUDGET);
+    PL_CHECK(s_maxSinceIdle <= PROTOCOL_LAYER_NAPI_BUDGET);
+
+    printf("ring %2u, %-9s: %6u frames, %5u lost, %5u interrupts, %6u passes, %5u exhausted, %6u idle turns\n",
+           (unsigned)s_ring.depth, phase->name, (unsigned)s_ring.arrived, (unsigned)s_ring.overflow,
+           (unsigned)(after.interrupts - before.interrupts), (unsigned)(after.passes - before.passes),
+           (unsigned)(after.exhausted - before.exhausted), (unsigned)s_idleTurns);
+    return after.interrupts - before.interrupts;
+}
+
+static void Reset(uint32_t depth)
+{
+    memset(&s_ring, 0, sizeof(s_ring));
+    s_ring.depth = depth;
+    s_read = 0;
+    s_idleTurns = 0;
+    s_sinceIdle = 0;
+    s_maxPass = 0;
+    s_maxSinceIdle = 0;
+}
+
+/*******************************************************************************
+ * Main
+ ******************************************************************************/
+int main(void)
+{
+    static const uint32_t depths[] = {PROTOCOL_LAYER_RING_SRAM_RX, PROTOCOL_LAYER_RING_MAX};
+    static const pl_napi_ops_t ops = {RingPending, RingRead, RingMask, RingUnmask, RingClearStatus};
+
+    ProtocolLayer_napiInit(&ops);
+    for (uint32_t d = 0; d < (sizeof(depths) / sizeof(depths[0])); d++)
+    {
+        uint32_t depth = depths[d];
+        const phase_t trickle = {"trickle", 20000U, 10U, 0U, 0U};
+        const phase_t bursts = {"bursts", 20000U, 0U, depth, 500U};
+        const phase_t overload = {"overload", 20000U, 1500U, 0U, 0U};
+        uint32_t interrupts;
+
+        // A lone frame after a quiet spell: one interrupt, one pass
+        Reset(depth);
+        interrupts = Run(&trickle);
+        PL_CHECK((interrupts == s_ring.arrived) && (s_ring.overflow == 0U));
+
+        // A burst that fits the ring: one interrupt for all of it
+        Reset(depth);
+        interrupts = Run(&bursts);
+        PL_CHECK((interrupts == (bursts.ticks / bursts.period)) && (s_ring.overflow == 0U));
+
+        // More frames than one per tick: the ring never empties, so polling
+        // goes on from a single interrupt, and every budget still ends in
+        // an idle turn; the frames beyond that are the MAC's to drop
+        Reset(depth);
+        interrupts = Run(&overload);
+        PL_CHECK(interrupts == 1U);
+        PL_CHECK(s_ring.overflow > 0U);
+        PL_CHECK(s_idleTurns >= (s_read / PROTOCOL_LAYER_NAPI_BUDGET));
+    }
+
+    return PL_TEST_END("test_napi");
+}
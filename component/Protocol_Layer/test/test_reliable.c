@@ -0,0 +1,293 @@
+/*
+Host test of the reliable delivery layer: two pl_rel_peer_t endpoints send
+numbered messages to each other over an in-memory link that drops and
+reorders frames, and a receiver that now and then has no room for a frame.
+Every message must be delivered exactly once, the cumulative ACK point must
+only pass messages already delivered, and the retransmissions must match
+the losses. Then each side reboots in turn and the link must carry on.
+The layer runs on a virtual clock of one microsecond per step, so the
+timeouts do not depend on how fast the host runs the test.
+*/
+
+#include "pl_test.h"
+#include "protocol_layer_reliable.h"
+#include "protocol_layer_backend.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define MESSAGES_MAX           (6000U)
+#define WIRE_MAX               (256U)
+#define STEPS_MAX              (20000000UL)
+
+/* Link conditions, in 1/1000 */
+typedef struct
+{
+    uint32_t loss;          /* frames dropped */
+    uint32_t reorder;       /* frames that overtake the one in front */
+    uint32_t refuse;        /* sequenced frames the receiver has no room for */
+} link_t;
+
+/* One frame on the wire: the extensions and the number of the message */
+typedef struct
+{
+    uint8_t to;
+    bool hasSeq;
+    bool syn;
+    bool hasAck;
+    uint8_t seq[PL_EXT_SEQ_SIZE];
+    uint8_t ack[PL_EXT_ACK_SIZE];
+    uint32_t message;
+} frame_t;
+
+/* Only the reliable layer state of a peer is needed here */
+struct pl_peer
+{
+    uint8_t index;
+    pl_rel_peer_t rel;
+    uint32_t queued;                        /* messages handed to the layer */
+    uint32_t target;                        /* messages to send in this phase */
+    uint16_t seqOf[MESSAGES_MAX];           /* sequence number each one went with */
+    uint32_t inOrder;                       /* messages the peer's ACK point has passed */
+    uint8_t delivered[MESSAGES_MAX];        /* copies delivered of each message of the peer */
+    uint32_t droppedData;
+    uint32_t refused;
+};
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static struct pl_peer s_ends[2];
+static frame_t s_wire[WIRE_MAX];
+static uint32_t s_wireCount;
+static link_t s_link;
+static uint32_t s_seed = 0x1234567U;
+static uint32_t s_synSent;
+static uint32_t s_now;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+/*! @brief The virtual clock, in place of the one of the backend. */
+uint32_t ProtocolLayer_timerTicks(void)
+{
+    return s_now;
+}
+
+uint32_t ProtocolLayer_timerHz(void)
+{
+    return 1000000U;
+}
+
+static bool Chance(uint32_t perMille)
+{
+    return (PL_Random(&s_seed) % 1000U) < perMille;
+}
+
+/*! @brief Send function of the reliable layer: a frame from peer to the
+ *         other end, with the extensions SendFrame() would add. */
+static bool LinkSend(struct pl_peer* peer, const uint8_t* message, size_t length, const pl_frag_t* frag,
+                     uint16_t flags, uint32_t seq)
+{
+    frame_t frame = {.to = (uint8_t)(1U - peer->index)};
+
+    (void)frag;
+    (void)flags;
+    if (seq != PL_REL_NO_SEQ)
+    {
+        frame.hasSeq = true;
+        frame.syn = ProtocolLayer_relIsSyn(&peer->rel, (uint16_t)seq);
+        ProtocolLayer_relWriteSeq(frame.seq, (uint16_t)seq);
+        memcpy(&frame.message, message, sizeof(frame.message));
+        s_synSent += frame.syn ? 1U : 0U;
+    }
+    PL_CHECK((seq == PL_REL_NO_SEQ) == (length == 0U));
+    if (ProtocolLayer_relAckReady(&peer->rel))
+    {
+        frame.hasAck = true;
+        ProtocolLayer_relWriteAck(&peer->rel, frame.ack);
+    }
+    if (Chance(s_link.loss) || (s_wireCount == WIRE_MAX))
+    {
+        peer->droppedData += frame.hasSeq ? 1U : 0U;
+        return true;
+    }
+    s_wire[s_wireCount++] = frame;
+    return true;
+}
+
+/*! @brief Hand the next message of a peer to the layer if the window has room. */
+static void SendNext(struct pl_peer* peer)
+{
+    uint32_t number = peer->queued;
+
+    if ((peer->queued == peer->target) || (ProtocolLayer_relWindowSpace(&peer->rel) == 0U))
+    {
+        return;
+    }
+    peer->seqOf[number] = ProtocolLayer_relQueue(&peer->rel, (const uint8_t*)&number, sizeof(number), NULL, 0U);
+    peer->queued++;
+    (void)LinkSend(peer, (const uint8_t*)&number, sizeof(number), NULL, 0U, peer->seqOf[number]);
+}
+
+/*! @brief Take a frame as ReceiveFrame() does: ACK first, then the sequence
+ *         check, and the sequence is only recorded once the frame is taken. */
+static void Receive(const frame_t* frame)
+{
+    struct pl_peer* peer = &s_ends[frame->to];
+    struct pl_peer* sender = &s_ends[1U - frame->to];
+
+    if (frame->hasAck)
+    {
+        ProtocolLayer_relOnAck(&peer->rel, frame->ack);
+    }
+    if (frame->hasSeq && ProtocolLayer_relOnData(&peer->rel, frame->seq, frame->syn))
+    {
+        if (Chance(s_link.refuse))
+        {
+            sender->refused++;
+            return;
+        }
+        PL_CHECK(frame->message < sender->queued);
+        sender->delivered[frame->message]++;
+        PL_CHECK(sender->delivered[frame->message] == 1U);
+        ProtocolLayer_relAccept(&peer->rel, frame->seq, frame->syn);
+
+        // The ACK point passes a message only once it is delivered
+        while ((sender->inOrder < sender->queued) &&
+               ((int16_t)(uint16_t)(peer->rel.rcvNext - sender->seqOf[sender->inOrder]) > 0))
+        {
+            PL_CHECK(sender->delivered[sender->inOrder] == 1U);
+            sender->inOrder++;
+        }
+    }
+}
+
+/*! @brief Take one frame off the wire, now and then not the first one. */
+static void Deliver(void)
+{
+    uint32_t pick = 0;
+    frame_t frame;
+
+    if (s_wireCount == 0U)
+    {
+        return;
+    }
+    while (((pick + 1U) < s_wireCount) && Chance(s_link.reorder))
+    {
+        pick++;
+    }
+    frame = s_wire[pick];
+    memmove(&s_wire[pick], &s_wire[pick + 1U], (s_wireCount - pick - 1U) * sizeof(frame_t));
+    s_wireCount--;
+    Receive(&frame);
+}
+
+/*! @brief Run until each peer has sent count more messages, all of them
+ *         acknowledged, and the wire is empty.
+ *  @return false if the link deadlocked. */
+static bool Run(uint32_t count)
+{
+    pl_reliable_stats_t stats[2];
+
+    for (uint32_t i = 0; i < 2U; i++)
+    {
+        s_ends[i].target = s_ends[i].queued + count;
+    }
+    for (uint32_t step = 0; step < STEPS_MAX; step++, s_now++)
+    {
+        for (uint32_t i = 0; i < 2U; i++)
+        {
+            SendNext(&s_ends[i]);
+            ProtocolLayer_relService(&s_ends[i].rel, &s_ends[i]);
+        }
+        Deliver();
+
+        ProtocolLayer_relGetStats(&s_ends[0].rel, &stats[0]);
+        ProtocolLayer_relGetStats(&s_ends[1].rel, &stats[1]);
+        if ((s_wireCount == 0U) && (stats[0].inFlight == 0U) && (stats[1].inFlight == 0U) &&
+            (s_ends[0].queued == s_ends[0].target) && (s_ends[1].queued == s_ends[1].target) &&
+            !s_ends[0].rel.ackPending && !s_ends[1].rel.ackPending)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*! @brief Every message sent so far delivered exactly once. */
+static void CheckDelivered(void)
+{
+    for (uint32_t i = 0; i < 2U; i++)
+    {
+        uint32_t missing = 0;
+
+        for (uint32_t n = 0; n < s_ends[i].queued; n++)
+        {
+            missing += (s_ends[i].delivered[n] != 1U) ? 1U : 0U;
+        }
+        PL_CHECK(missing == 0U);
+    }
+}
+
+/*******************************************************************************
+ * Main
+ ******************************************************************************/
+int main(void)
+{
+    pl_reliable_stats_t stats[2];
+
+    ProtocolLayer_relInit(LinkSend);
+    for (uint8_t i = 0; i < 2U; i++)
+    {
+        s_ends[i].index = i;
+        ProtocolLayer_relReset(&s_ends[i].rel);
+    }
+
+    // A reset peer sends nothing but its SYN until it is acknowledged
+    PL_CHECK(ProtocolLayer_relWindowSpace(&s_ends[0].rel) == 1U);
+    PL_CHECK(!ProtocolLayer_relAckReady(&s_ends[0].rel));
+
+    // Clean link: no retransmission, no duplicate
+    PL_CHECK(Run(500U));
+    PL_CHECK(s_synSent == 2U);
+    PL_CHECK(ProtocolLayer_relWindowSpace(&s_ends[0].rel) == PROTOCOL_LAYER_RELIABLE_WINDOW);
+    ProtocolLayer_relGetStats(&s_ends[0].rel, &stats[0]);
+    ProtocolLayer_relGetStats(&s_ends[1].rel, &stats[1]);
+    PL_CHECK((stats[0].retransmits == 0U) && (stats[1].retransmits == 0U));
+    PL_CHECK((stats[0].duplicates == 0U) && (stats[1].duplicates == 0U));
+    CheckDelivered();
+
+    // 10 % loss, reordering and 5 % of the frames refused
+    s_link = (link_t){.loss = 100U, .reorder = 300U, .refuse = 50U};
+    PL_CHECK(Run(2000U));
+    CheckDelivered();
+    ProtocolLayer_relGetStats(&s_ends[0].rel, &stats[0]);
+    ProtocolLayer_relGetStats(&s_ends[1].rel, &stats[1]);
+    for (uint32_t i = 0; i < 2U; i++)
+    {
+        uint32_t lost = s_ends[i].droppedData + s_ends[i].refused;
+
+        // Every lost frame is sent again, and little else is
+        printf("peer %u: %u frames lost or refused, %u retransmits, %u duplicates\n", (unsigned)i,
+               (unsigned)lost, (unsigned)stats[i].retransmits, (unsigned)stats[1U - i].duplicates);
+        PL_CHECK(stats[i].retransmits >= lost);
+        PL_CHECK(stats[i].retransmits <= (3U * lost));
+        PL_CHECK(s_ends[i].inOrder == s_ends[i].queued);
+    }
+
+    // Sender reboot: the SYN moves the receiver to the new sequence numbers
+    ProtocolLayer_relReset(&s_ends[0].rel);
+    s_synSent = 0;
+    PL_CHECK(Run(500U));
+    PL_CHECK(s_synSent >= 1U);
+    CheckDelivered();
+
+    // Receiver reboot: it takes the first frame it gets as its starting point
+    ProtocolLayer_relReset(&s_ends[1].rel);
+    s_ends[0].inOrder = s_ends[0].queued;
+    PL_CHECK(Run(500U));
+    CheckDelivered();
+
+    return PL_TEST_END("test_reliable");
+}
@@ -0,0 +1,247 @@
+/*
+Host test of the anti-replay window and of its place in front of FEC: the
+window takes counters in and out of order once, and refuses copies and
+counters behind it, across the 32-bit wrap. Frames of a parity group then
+go through the replay check before their group, as ReceiveFrame() does
+it, so replayed data and parity frames leave the groups alone, the lost
+frame is still rebuilt, and its late original is refused.
+*/
+
+#include "pl_test.h"
+#include "protocol_layer_replay.h"
+#include "protocol_layer_fec.h"
+#include "protocol_layer_backend.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define PEER                   (1U)
+#define MAC_SIZE               (12U)
+#define HEADER_SIZE            (4U)
+#define PAYLOAD_MAX            (96U)
+#define GROUPS                 (4U)
+#define FRAMES_MAX             (GROUPS * (PROTOCOL_LAYER_FEC_GROUP + 1U))
+#define EXT_SIZE               (HEADER_SIZE + PL_EXT_REPLAY_SIZE + PL_EXT_FEC_SIZE)
+
+/* One frame as it is sent: MAC addresses, length field and the protected
+ * bytes, header with the replay and FEC extensions first. A parity frame
+ * carries a whole data frame and its length behind its own header. */
+typedef struct
+{
+    size_t length;          /* protected bytes */
+    uint8_t bytes[MAC_SIZE + PL_FEC_LENGTH_SIZE + EXT_SIZE + PL_FEC_LENGTH_SIZE + EXT_SIZE + PAYLOAD_MAX];
+} frame_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+static frame_t s_frames[FRAMES_MAX];
+static uint32_t s_frameCount;
+static uint32_t s_counter;
+static pl_replay_t s_window;
+static uint32_t s_delivered;
+static uint32_t s_seed = 0x7F4A7C15U;
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+static bool Check(pl_replay_t* replay, uint32_t counter)
+{
+    uint8_t ext[PL_EXT_REPLAY_SIZE];
+
+    ProtocolLayer_replayWrite(ext, counter);
+    return ProtocolLayer_replayCheck(replay, ext);
+}
+
+static uint8_t* Segment(frame_t* frame)
+{
+    return &frame->bytes[MAC_SIZE + PL_FEC_LENGTH_SIZE];
+}
+
+/*! @brief Next frame, with its MAC addresses, header and replay extension. */
+static frame_t* NewFrame(void)
+{
+    frame_t* frame = &s_frames[s_frameCount++];
+    uint8_t* segment = Segment(frame);
+
+    memset(frame->bytes, 0x5A, MAC_SIZE);
+    segment[0] = 0;
+    segment[1] = (uint8_t)EXT_SIZE;
+    ProtocolLayer_replayWrite(&segment[HEADER_SIZE], s_counter++);
+    return frame;
+}
+
+static void SetLength(frame_t* frame, size_t length)
+{
+    frame->length = length;
+    frame->bytes[MAC_SIZE] = (uint8_t)(length >> 8);
+    frame->bytes[MAC_SIZE + 1U] = (uint8_t)(length & 0xFFU);
+}
+
+/*! @brief Send a data frame of random bytes through the send side of FEC. */
+static frame_t* SendData(void)
+{
+    size_t payload = 1U + (PL_Random(&s_seed) % PAYLOAD_MAX);
+    frame_t* frame = NewFrame();
+    uint8_t* segment = Segment(frame);
+
+    SetLength(frame, EXT_SIZE + payload);
+    ProtocolLayer_fecWrite(&segment[HEADER_SIZE + PL_EXT_REPLAY_SIZE]);
+    for (size_t i = 0; i < payload; i++)
+    {
+        segment[EXT_SIZE + i] = (uint8_t)PL_Random(&s_seed);
+    }
+    ProtocolLayer_fecAdd(segment, frame->length);
+    return frame;
+}
+
+/*! @brief Close the group with its parity frame, as SendParity() does. */
+static frame_t* SendParity(void)
+{
+    frame_t* frame = NewFrame();
+    uint8_t* segment = Segment(frame);
+    size_t length = ProtocolLayer_fecParity(&segment[HEADER_SIZE + PL_EXT_REPLAY_SIZE], &segment[EXT_SIZE]);
+
+    SetLength(frame, EXT_SIZE + length);
+    return frame;
+}
+
+/*! @brief Take an authenticated frame as ReceiveFrame() does: the replay
+ *         check, then FEC, then delivery; a rebuilt frame skips FEC.
+ *  @return true if the frame is delivered. */
+static bool Receive(const uint8_t* bytes, bool rebuilt)
+{
+    const uint8_t* segment = &bytes[MAC_SIZE + PL_FEC_LENGTH_SIZE];
+    size_t length = ((size_t)bytes[MAC_SIZE] << 8) | bytes[MAC_SIZE + 1U];
+    const uint8_t* ext = &segment[HEADER_SIZE + PL_EXT_REPLAY_SIZE];
+    bool deliver = true;
+
+    if (!ProtocolLayer_replayCheck(&s_window, &segment[HEADER_SIZE]))
+    {
+        return false;
+    }
+    if (!rebuilt && ProtocolLayer_fecIsParity(ext))
+    {
+        ProtocolLayer_fecOnParity(PEER, bytes, ext, &segment[segment[1]], length - segment[1]);
+        deliver = false;
+    }
+    else if (!rebuilt)
+    {
+        deliver = ProtocolLayer_fecOnData(PEER, bytes, ext, segment, length);
+    }
+    s_delivered += deliver ? 1U : 0U;
+    return deliver;
+}
+
+static bool ReceiveFrame(const frame_t* frame)
+{
+    return Receive(frame->bytes, false);
+}
+
+/*! @brief Rebuild the frame FEC has ready, if any, and receive it. */
+static bool ReceiveRebuilt(uint8_t* out)
+{
+    if (ProtocolLayer_fecPending() == 0U)
+    {
+        return false;
+    }
+    ProtocolLayer_fecRebuild(out);
+    return Receive(out, true);
+}
+
+/*******************************************************************************
+ * Main
+ ******************************************************************************/
+int main(void)
+{
+    static frame_t rebuilt;
+    frame_t* group[GROUPS][PROTOCOL_LAYER_FEC_GROUP + 1U];
+    pl_replay_stats_t stats;
+    pl_fec_stats_t fecStats;
+    pl_replay_t window;
+
+    ProtocolLayer_initBackends();
+
+    // Out of order inside the window once, copies and stale counters never
+    ProtocolLayer_replayReset(&window);
+    PL_CHECK(Check(&window, 1000U));
+    PL_CHECK(!Check(&window, 1000U));
+    PL_CHECK(Check(&window, 1003U));
+    PL_CHECK(Check(&window, 1001U));
+    PL_CHECK(!Check(&window, 1001U));
+    PL_CHECK(Check(&window, 1003U - (PL_REPLAY_WINDOW - 1U)));
+    PL_CHECK(!Check(&window, 1003U - PL_REPLAY_WINDOW));
+    PL_CHECK(Check(&window, 1002U));
+    PL_CHECK(Check(&window, 1003U + (2U * PL_REPLAY_WINDOW)));
+    PL_CHECK(!Check(&window, 1003U));
+    ProtocolLayer_replayGetStats(&window, &stats);
+    PL_CHECK((stats.accepted == 6U) && (stats.duplicates == 2U) && (stats.tooOld == 2U));
+
+    // The counter wraps without opening the window to old frames
+    ProtocolLayer_replayReset(&window);
+    PL_CHECK(Check(&window, 0xFFFFFFFEU));
+    PL_CHECK(Check(&window, 1U));
+    PL_CHECK(Check(&window, 0xFFFFFFFFU));
+    PL_CHECK(Check(&window, 0U));
+    PL_CHECK(!Check(&window, 0xFFFFFFFEU));
+    PL_CHECK(!Check(&window, 0xFFFFFFFFU - PL_REPLAY_WINDOW));
+
+    // Parity groups: every frame of the first ones arrives, the last data
+    // frame of the last group is lost
+    ProtocolLayer_fecInit();
+    ProtocolLayer_replayReset(&s_window);
+    for (uint32_t g = 0; g < GROUPS; g++)
+    {
+        for (uint32_t i = 0; i < PROTOCOL_LAYER_FEC_GROUP; i++)
+        {
+            group[g][i] = SendData();
+        }
+        group[g][PROTOCOL_LAYER_FEC_GROUP] = SendParity();
+    }
+    for (uint32_t g = 0; g < (GROUPS - 1U); g++)
+    {
+        for (uint32_t i = 0; i <= PROTOCOL_LAYER_FEC_GROUP; i++)
+        {
+            PL_CHECK(ReceiveFrame(group[g][i]) == (i < PROTOCOL_LAYER_FEC_GROUP));
+        }
+    }
+    for (uint32_t i = 0; i < (PROTOCOL_LAYER_FEC_GROUP - 1U); i++)
+    {
+        PL_CHECK(ReceiveFrame(group[GROUPS - 1U][i]));
+    }
+
+    // Replays of every earlier frame, data and parity, are refused before
+    // they reach FEC: no group is evicted, none is reopened
+    for (uint32_t g = 0; g < GROUPS; g++)
+    {
+        for (uint32_t i = 0; i < (PROTOCOL_LAYER_FEC_GROUP - 1U); i++)
+        {
+            PL_CHECK(!ReceiveFrame(group[g][i]));
+        }
+        if (g < (GROUPS - 1U))
+        {
+            PL_CHECK(!ReceiveFrame(group[g][PROTOCOL_LAYER_FEC_GROUP - 1U]));
+            PL_CHECK(!ReceiveFrame(group[g][PROTOCOL_LAYER_FEC_GROUP]));
+        }
+    }
+    PL_CHECK(ProtocolLayer_fecPending() == 0U);
+
+    // The parity frame rebuilds the lost one, which passes its own replay
+    // check; the original arriving late is then a copy
+    const frame_t* lost = group[GROUPS - 1U][PROTOCOL_LAYER_FEC_GROUP - 1U];
+    PL_CHECK(!ReceiveFrame(group[GROUPS - 1U][PROTOCOL_LAYER_FEC_GROUP]));
+    PL_CHECK(ProtocolLayer_fecPending() == (MAC_SIZE + PL_FEC_LENGTH_SIZE + lost->length));
+    PL_CHECK(ReceiveRebuilt(rebuilt.bytes));
+    PL_CHECK(memcmp(rebuilt.bytes, lost->bytes, MAC_SIZE + PL_FEC_LENGTH_SIZE + lost->length) == 0);
+    PL_CHECK(!ReceiveFrame(lost));
+    PL_CHECK(!ReceiveFrame(group[GROUPS - 1U][PROTOCOL_LAYER_FEC_GROUP]));
+    PL_CHECK(!ReceiveRebuilt(rebuilt.bytes));
+
+    PL_CHECK(s_delivered == (GROUPS * PROTOCOL_LAYER_FEC_GROUP));
+    ProtocolLayer_fecGetStats(&fecStats);
+    PL_CHECK((fecStats.parityReceived == GROUPS) && (fecStats.rebuilt == 1U) && (fecStats.unrecoverable == 0U));
+    ProtocolLayer_replayGetStats(&s_window, &stats);
+    printf("%u frames accepted, %u replays refused, %u rebuilt\n", (unsigned)stats.accepted,
+           (unsigned)(stats.duplicates + stats.tooOld), (unsigned)fecStats.rebuilt);
+    return PL_TEST_END("test_replay");
+}
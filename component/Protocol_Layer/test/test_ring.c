@@ -0,0 +1,79 @@
+/*
+Host test of the choice of the descriptor rings: the SRAM depths until a
+call, the bounds of the receive and transmit depths in SRAM and in the
+PSRAM, the PSRAM refused without PROTOCOL_LAYER_RING_PSRAM, a receive
+ring no deeper than the credit window refused with PROTOCOL_LAYER_CREDIT,
+and the previous choice kept whenever a configuration is refused. It is
+built with the default options, with PROTOCOL_LAYER_RING_PSRAM and with
+PROTOCOL_LAYER_CREDIT.
+*/
+
+#include "pl_test.h"
+#include "protocol_layer_ring.h"
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+static bool Configure(uint32_t rxDepth, uint32_t txDepth, uint8_t memory)
+{
+    pl_ring_config_t config = {(uint8_t)rxDepth, (uint8_t)txDepth, memory};
+
+    return ProtocolLayer_ringConfigure(&config);
+}
+
+/*! @brief A refused configuration leaves the receive depth as it was. */
+static void CheckRefused(uint32_t rxDepth, uint32_t txDepth, uint8_t memory)
+{
+    uint8_t before = ProtocolLayer_ringRxDepth();
+
+    PL_CHECK(!Configure(rxDepth, txDepth, memory));
+    PL_CHECK(ProtocolLayer_ringRxDepth() == before);
+}
+
+/*******************************************************************************
+ * Main
+ ******************************************************************************/
+int main(void)
+{
+    uint32_t rxMin = PROTOCOL_LAYER_CREDIT ? (PROTOCOL_LAYER_CREDIT_WINDOW + 1U) : 2U;
+
+    // Without a call the rings are the SRAM ones
+    PL_CHECK(ProtocolLayer_ringRxDepth() == PROTOCOL_LAYER_RING_SRAM_RX);
+
+    // SRAM: from the shallowest rings to the SRAM reserve, nothing beyond
+    PL_CHECK(Configure(rxMin, 1U, kPL_RingMemory_Sram));
+    PL_CHECK(ProtocolLayer_ringRxDepth() == rxMin);
+    CheckRefused(rxMin - 1U, 1U, kPL_RingMemory_Sram);
+    CheckRefused(PROTOCOL_LAYER_RING_SRAM_RX, 0U, kPL_RingMemory_Sram);
+    CheckRefused(PROTOCOL_LAYER_RING_SRAM_RX + 1U, 1U, kPL_RingMemory_Sram);
+    CheckRefused(PROTOCOL_LAYER_RING_SRAM_RX, PROTOCOL_LAYER_RING_SRAM_TX + 1U, kPL_RingMemory_Sram);
+    PL_CHECK(Configure(PROTOCOL_LAYER_RING_SRAM_RX, PROTOCOL_LAYER_RING_SRAM_TX, kPL_RingMemory_Sram));
+    PL_CHECK(ProtocolLayer_ringRxDepth() == PROTOCOL_LAYER_RING_SRAM_RX);
+
+    // The credit window needs a free receive descriptor beyond it
+#if PROTOCOL_LAYER_CREDIT
+    CheckRefused(PROTOCOL_LAYER_CREDIT_WINDOW, 1U, kPL_RingMemory_Sram);
+#endif
+
+    // PSRAM: up to PROTOCOL_LAYER_RING_MAX, only with the option
+#if PROTOCOL_LAYER_RING_PSRAM
+    PL_CHECK(Configure(PROTOCOL_LAYER_RING_MAX, PROTOCOL_LAYER_RING_MAX, kPL_RingMemory_Psram));
+    PL_CHECK(ProtocolLayer_ringRxDepth() == PROTOCOL_LAYER_RING_MAX);
+    CheckRefused(PROTOCOL_LAYER_RING_MAX + 1U, 1U, kPL_RingMemory_Psram);
+    CheckRefused(rxMin, PROTOCOL_LAYER_RING_MAX + 1U, kPL_RingMemory_Psram);
+    CheckRefused(rxMin - 1U, 1U, kPL_RingMemory_Psram);
+#else
+    CheckRefused(rxMin, 1U, kPL_RingMemory_Psram);
+#endif
+
+    // Neither SRAM nor PSRAM
+    CheckRefused(rxMin, 1U, kPL_RingMemory_Num);
+
+#if PROTOCOL_LAYER_RING_PSRAM
+    return PL_TEST_END("test_ring_psram");
+#elif PROTOCOL_LAYER_CREDIT
+    return PL_TEST_END("test_ring_credit");
+#else
+    return PL_TEST_END("test_ring");
+#endif
+}
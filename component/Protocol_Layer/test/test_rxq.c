@@ -0,0 +1,101 @@
+/*
+Host test of the receive class queues while a view holds a frame: the
+frame at the head of its queue stays untouched while the ring keeps
+draining into the queues, a class whose queue fills up drops its own
+frames only, and once the view is released the frames queued meanwhile
+come out by class, in order and intact.
+*/
+
+#include "pl_test.h"
+#include "protocol_layer_rxq.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define BULK_LENGTH            (1000U)
+#define CONTROL_LENGTH         (64U)
+#define EXTRA_BULK             (3U)
+#define CONTROL_FRAMES         (2U)
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+/*! @brief Read a frame into the landing buffer as DrainRing() does, every
+ *         byte after the addresses set to number, and queue it. */
+static bool Push(uint8_t number, size_t length)
+{
+    uint8_t* frame = &ProtocolLayer_rxqLanding()[PL_RXQ_SHIFT];
+
+    memset(frame, 0x5A, 12U);
+    memset(&frame[12], number, length - 12U);
+    return ProtocolLayer_rxqPush(PL_RXQ_SHIFT + length, kPL_RxClass_Num);
+}
+
+static bool Intact(const uint8_t* frame, uint8_t number, uint32_t length)
+{
+    for (uint32_t i = 12U; i < length; i++)
+    {
+        if (frame[i] != number)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*******************************************************************************
+ * Main
+ ******************************************************************************/
+int main(void)
+{
+    pl_rxq_stats_t stats;
+    uint32_t length;
+    uint8_t* held;
+    uint8_t* frame;
+    uint8_t number = 1;
+
+    ProtocolLayer_rxqInit();
+
+    // A bulk frame is taken and held by a view
+    PL_CHECK(Push(number, BULK_LENGTH));
+    held = ProtocolLayer_rxqNext(&length);
+    PL_CHECK((held != NULL) && (length == BULK_LENGTH));
+
+    // The ring drains meanwhile: bulk fills its queue, control still gets in
+    for (uint32_t i = 0; i < (PROTOCOL_LAYER_RXQ_BULK_DEPTH - 1U); i++)
+    {
+        PL_CHECK(Push((uint8_t)(++number), BULK_LENGTH));
+    }
+    for (uint32_t i = 0; i < EXTRA_BULK; i++)
+    {
+        PL_CHECK(!Push(0xEEU, BULK_LENGTH));
+    }
+    for (uint32_t i = 0; i < CONTROL_FRAMES; i++)
+    {
+        PL_CHECK(Push((uint8_t)(0x80U + i), CONTROL_LENGTH));
+    }
+    PL_CHECK(Intact(held, 1U, BULK_LENGTH));
+
+    ProtocolLayer_rxqGetStats(&stats);
+    PL_CHECK(stats.dropped[kPL_RxClass_Bulk] == EXTRA_BULK);
+    PL_CHECK(stats.dropped[kPL_RxClass_Control] == 0U);
+    PL_CHECK(stats.peak[kPL_RxClass_Bulk] == PROTOCOL_LAYER_RXQ_BULK_DEPTH);
+
+    // Released: control first, then the bulk frames in arrival order
+    ProtocolLayer_rxqRelease();
+    for (uint32_t i = 0; i < CONTROL_FRAMES; i++)
+    {
+        frame = ProtocolLayer_rxqNext(&length);
+        PL_CHECK((frame != NULL) && (length == CONTROL_LENGTH) && Intact(frame, (uint8_t)(0x80U + i), length));
+        ProtocolLayer_rxqRelease();
+    }
+    for (uint8_t n = 2; n <= number; n++)
+    {
+        frame = ProtocolLayer_rxqNext(&length);
+        PL_CHECK((frame != NULL) && (length == BULK_LENGTH) && Intact(frame, n, length));
+        ProtocolLayer_rxqRelease();
+    }
+    PL_CHECK(ProtocolLayer_rxqNext(&length) == NULL);
+
+    return PL_TEST_END("test_rxq");
+}
@@ -0,0 +1,172 @@
+/*
+Host test of the word-wide kernels against byte-wise references: XOR,
+copy and compare at every alignment and length, and the padding check on
+every pad value with every byte of the padding corrupted.
+*/
+
+#include "pl_test.h"
+#include "protocol_layer_simd.h"
+
+/*******************************************************************************
+ * Definitions
+ ******************************************************************************/
+#define ROUNDS                 (20000U)
+
+/*******************************************************************************
+ * Private functions
+ ******************************************************************************/
+static uint8_t RefCheckPadding(const uint8_t* block)
+{
+    uint8_t pad = block[PL_BLOCK_SIZE - 1];
+
+    if ((pad == 0U) || (pad > PL_BLOCK_SIZE))
+    {
+        return 0;
+    }
+    for (uint8_t i = 0; i < pad; i++)
+    {
+        if (block[PL_BLOCK_SIZE - 1 - i] != pad)
+        {
+            return 0;
+        }
+    }
+    return pad;
+}
+
+static bool RefEqual(const uint8_t* a, const uint8_t* b, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        if (a[i] != b[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void Fill(uint8_t* buf, size_t length, uint32_t* state)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        buf[i] = (uint8_t)PL_Random(state);
+    }
+}
+
+/*! @brief PL_Xor16 and PL_Copy at every pair of alignments. */
+static void TestXorCopy(void)
+{
+    uint32_t words[3][72];
+    uint32_t state = 1U;
+
+    for (uint8_t da = 0; da < 4U; da++)
+    {
+        for (uint8_t sa = 0; sa < 4U; sa++)
+        {
+            uint8_t* dst = (uint8_t*)words[0] + da;
+            uint8_t* ref = (uint8_t*)words[1] + da;
+            uint8_t* src = (uint8_t*)words[2] + sa;
+
+            Fill(dst, 260U, &state);
+            Fill(src, 260U, &state);
+            memcpy(ref, dst, 260U);
+            PL_Xor16(dst, src);
+            for (uint8_t i = 0; i < PL_BLOCK_SIZE; i++)
+            {
+                ref[i] ^= src[i];
+            }
+            PL_CHECK(memcmp(dst, ref, 260U) == 0);
+
+            for (size_t length = 0; length <= 256U; length++)
+            {
+                Fill(dst, 260U, &state);
+                memcpy(ref, dst, 260U);
+                PL_Copy(dst, src, length);
+                memcpy(ref, src, length);
+                PL_CHECK(memcmp(dst, ref, 260U) == 0);
+            }
+        }
+    }
+}
+
+/*! @brief PL_Equal on equal buffers and on a single differing bit at every
+ *         position, length and alignment. */
+static void TestEqual(void)
+{
+    uint8_t a[68];
+    uint8_t b[68];
+    uint32_t state = 2U;
+
+    for (uint8_t align = 0; align < 4U; align++)
+    {
+        for (size_t length = 0; length <= 64U; length++)
+        {
+            Fill(&a[align], length, &state);
+            memcpy(&b[align], &a[align], length);
+            PL_CHECK(PL_Equal(&a[align], &b[align], length));
+            for (size_t i = 0; i < length; i++)
+            {
+                uint8_t bit = (uint8_t)(1U << (PL_Random(&state) & 7U));
+                b[align + i] ^= bit;
+                PL_CHECK(PL_Equal(&a[align], &b[align], length) == RefEqual(&a[align], &b[align], length));
+                PL_CHECK(!PL_Equal(&a[align], &b[align], length));
+                b[align + i] ^= bit;
+            }
+        }
+    }
+}
+
+/*! @brief PL_CheckPadding on every valid padding, every corrupted one, every
+ *         last byte value, and random blocks. */
+static void TestPadding(void)
+{
+    uint8_t block[PL_BLOCK_SIZE];
+    uint32_t state = 3U;
+
+    for (uint8_t pad = 1; pad <= PL_BLOCK_SIZE; pad++)
+    {
+        Fill(block, sizeof(block), &state);
+        memset(&block[PL_BLOCK_SIZE - pad], pad, pad);
+        PL_CHECK(PL_CheckPadding(block) == pad);
+        PL_CHECK(RefCheckPadding(block) == pad);
+        for (uint8_t i = 1; i < pad; i++)
+        {
+            for (uint16_t value = 0; value < 256U; value++)
+            {
+                block[PL_BLOCK_SIZE - 1 - i] = (uint8_t)value;
+                PL_CHECK(PL_CheckPadding(block) == RefCheckPadding(block));
+            }
+            block[PL_BLOCK_SIZE - 1 - i] = pad;
+        }
+    }
+    for (uint16_t last = 0; last < 256U; last++)
+    {
+        memset(block, (int)last, sizeof(block));
+        PL_CHECK(PL_CheckPadding(block) == RefCheckPadding(block));
+    }
+    for (uint32_t round = 0; round < ROUNDS; round++)
+    {
+        Fill(block, sizeof(block), &state);
+        // Bias towards the interesting cases: a small pad value in front
+        // of a partly matching tail
+        block[PL_BLOCK_SIZE - 1] = (uint8_t)((block[PL_BLOCK_SIZE - 1] & 0x0FU) + 1U);
+        memset(&block[PL_BLOCK_SIZE - 1 - (round % block[PL_BLOCK_SIZE - 1])], block[PL_BLOCK_SIZE - 1],
+               round % block[PL_BLOCK_SIZE - 1]);
+        PL_CHECK(PL_CheckPadding(block) == RefCheckPadding(block));
+    }
+}
+
+/*******************************************************************************
+ * Main
+ ******************************************************************************/
+int main(void)
+{
+    TestXorCopy();
+    TestEqual();
+    TestPadding();
+#if PROTOCOL_LAYER_SHIFT16
+    return PL_TEST_END("test_simd_shift16");
+#else
+    return PL_TEST_END("test_simd");
+#endif
+}
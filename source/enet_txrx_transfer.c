@@ -8,6 +8,7 @@
 #include "fsl_debug_console.h"
 #include "fsl_silicon_id.h"
 #include "protocol_layer.h"
+#include "protocol_layer_rpc.h"
 #include "board.h"
 #include "app.h"
 #include "fsl_common.h"
@@ -15,6 +16,11 @@
 /*******************************************************************************
  * Definitions
  ******************************************************************************/
+#if PROTOCOL_LAYER_UDP
+/* Address and port of the PC, where the Python peer listens in UDP mode */
+#define APP_PC_IP_ADDRESS {192U, 168U, 0U, 101U}
+#define APP_PC_UDP_PORT (47800U)
+#endif
 
 /*******************************************************************************
  * Prototypes
@@ -35,18 +41,36 @@ int main(void)
 {
     BOARD_InitHardware();
     ProtocolLayer_init();
+#if PROTOCOL_LAYER_UDP
+    // The PC is on the same segment, so it is its own next hop
+    static const uint8_t pc[MAC_DATA_SIZE] = DEST_MAC_ADDRESS;
+    static const uint8_t pcIp[4] = APP_PC_IP_ADDRESS;
+    (void)ProtocolLayer_udpAddRoute(pc, pcIp, APP_PC_UDP_PORT, pc);
+#endif
 
    // ENET_BuildBroadCastFrame();
 
     test_ProtocolLayer_send();
 
-    uint8_t msgBuffer[ENET_DATA_LENGTH];
+    static uint8_t msgBuffer[PROTOCOL_LAYER_MAX_MESSAGE];
     while (1)
     {
         ProtocolLayer_receive(msgBuffer);
     }
 }
 
+#if PROTOCOL_LAYER_RPC
+/*! @brief Completion of a test request, context is the request text. */
+static void test_RpcDone(void* context, pl_rpc_status_t status, const uint8_t* reply, size_t length)
+{
+    if (status == kPL_Rpc_Ok) {
+        PRINTF("Reply to \"%s\": %.*s\r\n", (const char*)context, (int)length, (const char*)reply);
+    } else {
+        PRINTF("No reply to \"%s\"\r\n", (const char*)context);
+    }
+}
+#endif
+
 /*! @brief Function to test ProtocolLayer_send. */
 void test_ProtocolLayer_send(void)
 {
@@ -71,7 +95,30 @@ void test_ProtocolLayer_send(void)
 
     size_t num_messages = sizeof(messages) / sizeof(messages[0]);
 
-    uint8_t msgBuffer[ENET_DATA_LENGTH];
+    static uint8_t msgBuffer[PROTOCOL_LAYER_MAX_MESSAGE];
+#if PROTOCOL_LAYER_RPC
+    // Every message is a request in flight, the replies complete in any order
+    static const uint8_t peer[MAC_DATA_SIZE] = DEST_MAC_ADDRESS;
+    for (size_t i = 0; i < num_messages; i++) {
+        PRINTF("Sending test request: %s\r\n", messages[i]);
+        while (!ProtocolLayer_rpcCall(peer, (const uint8_t*)messages[i], strlen(messages[i]),
+                                      PROTOCOL_LAYER_RPC_TIMEOUT_MS, test_RpcDone, (void*)messages[i])) {
+            ProtocolLayer_rpcPoll(msgBuffer, NULL);
+        }
+    }
+    while (ProtocolLayer_rpcOutstanding() != 0U) {
+        ProtocolLayer_rpcPoll(msgBuffer, NULL);
+    }
+#elif PROTOCOL_LAYER_RELIABLE
+    // The send window keeps several messages in flight: send back to back and
+    // only service the receive side while the window is full
+    for (size_t i = 0; i < num_messages; i++) {
+        PRINTF("Sending test message: %s\r\n", messages[i]);
+        while (!ProtocolLayer_send((const uint8_t*)messages[i], strlen(messages[i]))) {
+            ProtocolLayer_receive(msgBuffer);
+        }
+    }
+#else
     for (size_t i = 0; i < num_messages; i++) {
         PRINTF("Sending test message: %s\r\n", messages[i]);
         ProtocolLayer_send((const uint8_t*)messages[i], strlen(messages[i]));
@@ -79,4 +126,5 @@ void test_ProtocolLayer_send(void)
         ProtocolLayer_receive(msgBuffer);
         SDK_DelayAtLeastUs(2000000, SDK_DEVICE_MAXIMUM_CPU_CLOCK_FREQUENCY);
     }
+#endif
 }
@@ -1,7 +1,10 @@
 from scapy.all import *
 from Crypto.Cipher import AES
+from Crypto.Hash import CMAC
 from Crypto.Util.Padding import pad, unpad
 import zlib
+import os
+import socket
 import sys, signal
 
 
@@ -9,6 +12,54 @@ pc_eth_mac = "00:2b:67:36:70:0f"
 frdm_eth_mac = "54:27:8d:24:2a:f2"
 aes_key = b"My16byteKey00000"
 aes_iv = b"My16byteIV000000"
+aes_mac_key = b"My16byteMacKey00"
+# (AES key, MAC key) per epoch bit. Before the board rotates with
+# ProtocolLayer_rekey(), put its new keys in the other slot.
+session_keys = [(aes_key, aes_mac_key), (aes_key, aes_mac_key)]
+# UDP/IPv4 mode (PROTOCOL_LAYER_UDP): the board sends to pc_ip:udp_port once
+# the test application has added its route, and the replies go back to
+# board_ip:udp_port from an ordinary UDP socket instead of raw frames. There
+# is no ARP on the board: the PC needs a static entry for it, e.g.
+# ip neigh add 192.168.0.102 lladdr 54:27:8d:24:2a:f2 dev <if>
+udp_mode = False
+pc_ip = "192.168.0.101"
+board_ip = "192.168.0.102"
+udp_port = 47800
+udp_socket = None
+# (AES key, MAC key) of the multicast groups the board sends to with
+# ProtocolLayer_joinGroup()/ProtocolLayer_sendTo(). Group messages are
+# decrypted with the group keys and not answered.
+group_keys = {}
+
+# Protocol header: mode, header length, flags (little endian)
+PL_HEADER_SIZE = 4
+PL_MODE_CRC32 = 0x00
+PL_MODE_CMAC = 0x01
+# Header extensions follow the base header in flag bit order
+PL_FLAG_IV = 0x0001
+PL_FLAG_EPOCH = 0x0002
+PL_FLAG_FRAG = 0x0004
+PL_EXT_FRAG_SIZE = 4
+PL_FLAG_AGG = 0x0008
+PL_EXT_IV_SIZE = 16
+PL_FLAG_SEQ = 0x0010
+PL_EXT_SEQ_SIZE = 2
+PL_FLAG_ACK = 0x0020
+PL_EXT_ACK_SIZE = 6
+PL_FLAG_CREDIT = 0x0040
+PL_EXT_CREDIT_SIZE = 4
+PL_CREDIT_PROBE = 0x8000
+PL_CREDIT_MASK = 0x7FFF
+PL_FLAG_LZ = 0x0080
+PL_FLAG_REPLAY = 0x0100
+PL_EXT_REPLAY_SIZE = 4
+PL_FLAG_FEC = 0x0200
+PL_EXT_FEC_SIZE = 4
+PL_FLAG_SYN = 0x0400
+PL_FLAG_RPC = 0x0800
+# Extension sizes indexed by flag bit
+PL_EXT_SIZES = [PL_EXT_IV_SIZE, 0, PL_EXT_FRAG_SIZE, 0, PL_EXT_SEQ_SIZE, PL_EXT_ACK_SIZE, PL_EXT_CREDIT_SIZE, 0,
+                PL_EXT_REPLAY_SIZE, PL_EXT_FEC_SIZE, 0, 0]
 
 messages_and_replies = { "No todo lo que es oro reluce...": "...Ni todos los que vagan están perdidos.",
                          "Aún en la oscuridad...":"...brilla una luz.",
@@ -38,90 +89,381 @@ def pba(byte_array):
     formatted_bytes = ", ".join(f"{byte:02X}" for byte in byte_array)
     print(formatted_bytes)
 
-def encrypt(data, key):
-    cipher = AES.new(key, AES.MODE_CBC, aes_iv)
+def encrypt(data, key, iv=aes_iv):
+    cipher = AES.new(key, AES.MODE_CBC, iv)
     ciphertext = cipher.encrypt(pad(data, AES.block_size))
     return ciphertext
 
-def decrypt(data, key):
-    iv = aes_iv
+def decrypt(data, key, iv=aes_iv, padded=True):
     cipher = AES.new(key, AES.MODE_CBC, iv)
-    plaintext = unpad(cipher.decrypt(data), AES.block_size)
+    plaintext = cipher.decrypt(data)
+    if padded:
+        plaintext = unpad(plaintext, AES.block_size)
     return plaintext
 
+# Decompresses an LZ4 block: token (literal count, match length - 4),
+# literals, 2-byte match offset; the last sequence has literals only
+def lzDecompress(data):
+    out = bytearray()
+    offset = 0
+
+    def readLength(length):
+        nonlocal offset
+        if length == 15:
+            while True:
+                byte = data[offset]
+                offset += 1
+                length += byte
+                if byte != 255:
+                    break
+        return length
+
+    while offset < len(data):
+        token = data[offset]
+        offset += 1
+        literals = readLength(token >> 4)
+        out += data[offset:offset + literals]
+        offset += literals
+        if offset >= len(data):
+            break
+        distance = int.from_bytes(data[offset:offset + 2], byteorder='little')
+        offset += 2
+        match = readLength(token & 0x0F) + 4
+        for _ in range(match):
+            out.append(out[-distance])
+    return bytes(out)
+
+# Splits an aggregated frame: each message has a 1-byte length (< 128) or
+# a 2-byte length with the top bit of the first byte set
+def splitAggregate(data):
+    messages = []
+    offset = 0
+    while offset < len(data):
+        length = data[offset]
+        offset += 1
+        if length & 0x80:
+            length = ((length & 0x7F) << 8) | data[offset]
+            offset += 1
+        messages.append(data[offset:offset + length])
+        offset += length
+    return messages
+
+# Offset of the extension of the given flag, after those of the lower flags
+def extOffset(flags, flag):
+    offset = PL_HEADER_SIZE
+    bit = 0
+    while (1 << bit) < flag:
+        if flags & (1 << bit):
+            offset += PL_EXT_SIZES[bit]
+        bit += 1
+    return offset
+
+# Reliable delivery: the board numbers its frames and retransmits them until
+# they are acknowledged. This script only acknowledges, its replies carry an
+# ACK extension but no sequence number. A SYN, which the board sends first
+# after a reboot, sets where the numbers start; a copy of the SYN synced to
+# is a duplicate. Any other first frame starts REL_WINDOW - 1 before it,
+# since earlier frames of the window may still come, and a frame beyond
+# the bitmap moves it up. REL_WINDOW is PROTOCOL_LAYER_RELIABLE_WINDOW of
+# the board.
+REL_WINDOW = 8
+rcv_next = 0
+rcv_mask = 0
+rcv_synced = False
+rcv_syn = 0
+
+# Records a received sequence number, returns False for a duplicate
+def recordSeq(seq, syn):
+    global rcv_next, rcv_mask, rcv_synced, rcv_syn
+    since = (rcv_next - rcv_syn) & 0xFFFF
+    if not rcv_synced or (syn and (seq != rcv_syn or since == 0 or since > 32)):
+        rcv_next = seq if syn else (seq - (REL_WINDOW - 1)) & 0xFFFF
+        rcv_mask, rcv_synced = 0, True
+        rcv_syn = seq if syn else (seq + 0x8000) & 0xFFFF
+    offset = (seq - rcv_next) & 0xFFFF
+    if 32 <= offset < 32 + REL_WINDOW:
+        shift = offset - 31
+        rcv_mask >>= shift
+        rcv_next = (rcv_next + shift) & 0xFFFF
+        offset = 31
+    if offset >= 32 or rcv_mask & (1 << offset):
+        return False
+    rcv_mask |= 1 << offset
+    while rcv_mask & 1:
+        rcv_mask >>= 1
+        rcv_next = (rcv_next + 1) & 0xFFFF
+    return True
+
+# Next expected sequence number and the bitmap of frames received after it
+def ackExtension():
+    return rcv_next.to_bytes(2, byteorder='little') + rcv_mask.to_bytes(4, byteorder='little')
+
+# Credit-based flow control: the board grants frames up to a limit, the
+# replies beyond it wait in pending_replies. PROTOCOL_LAYER_CREDIT_WINDOW of
+# the board is the first grant; the PC grants CREDIT_WINDOW frames.
+CREDIT_WINDOW = 32
+credit_tx_count = 0
+credit_tx_limit = 3
+credit_rx_count = 0
+pending_replies = []
+
+# Difference of two 15-bit frame counts
+def countDiff(a, b):
+    diff = (a - b) & PL_CREDIT_MASK
+    return diff - (PL_CREDIT_MASK + 1) if diff & 0x4000 else diff
+
+# Processes the credit extension of a frame, returns True if the board asks for a grant
+def creditOnFrame(ext):
+    global credit_rx_count, credit_tx_limit
+    count = int.from_bytes(ext[0:2], byteorder='little')
+    limit = int.from_bytes(ext[2:4], byteorder='little') & PL_CREDIT_MASK
+    if countDiff(count & PL_CREDIT_MASK, credit_rx_count) > 0:
+        credit_rx_count = count & PL_CREDIT_MASK
+    if countDiff(limit, credit_tx_limit) > 0:
+        credit_tx_limit = limit
+    return bool(count & PL_CREDIT_PROBE)
+
+# Frame count (a frame with a message uses one credit) and the grant
+def creditExtension(charge):
+    global credit_tx_count
+    if charge:
+        credit_tx_count = (credit_tx_count + 1) & PL_CREDIT_MASK
+    limit = (credit_rx_count + CREDIT_WINDOW) & PL_CREDIT_MASK
+    return credit_tx_count.to_bytes(2, byteorder='little') + limit.to_bytes(2, byteorder='little')
+
+# Anti-replay: once the board sends frame counters, every reply carries the
+# next counter of its epoch. The board restarts its counters on a rekey.
+replay = False
+replay_tx_counter = [0, 0]
+
+def replayExtension(epoch_flag):
+    slot = 1 if epoch_flag else 0
+    counter = replay_tx_counter[slot]
+    replay_tx_counter[slot] = (counter + 1) & 0xFFFFFFFF
+    return counter.to_bytes(4, byteorder='little')
+
+# RPC: a request is type, correlation ID (2 bytes little endian) and body,
+# in a frame flagged PL_FLAG_RPC; the reply, flagged too, echoes the ID so
+# the board can match replies in any order
+PL_RPC_REQUEST = 0x01
+PL_RPC_RESPONSE = 0x02
+PL_RPC_HEADER_SIZE = 3
+
+# Fragments of messages in progress: message ID -> {index: plaintext}
+pending_fragments = {}
+
 # Computes the CRC32 on the given data
 def computeCRC32(data):
     return zlib.crc32(data)
 
-# look for the interface that has the MAC address we want to use
-for iface_name, iface_info in conf.ifaces.items():
-    # print(f"Interface: {iface_name}, Index: {iface_info.index}, MAC: {iface_info.mac}, IPv4: {iface_info.ip}, Status: {iface_info.flags}")
-    if iface_info.mac == pc_eth_mac:
-        # print(f"  - This is the interface we want to use!")
-        conf.iface = iface_name
+# Computes the 4-byte trailer (CRC32 or truncated AES-CMAC) for the given mode
+def computeTrailer(data, mode, mac_key=aes_mac_key):
+    if mode == PL_MODE_CMAC:
+        return CMAC.new(mac_key, msg=data, ciphermod=AES).digest()[:4]
+    return zlib.crc32(data).to_bytes(4, byteorder='little')
+
+def buildHeader(mode, flags=0, extensions=b""):
+    return bytes([mode, PL_HEADER_SIZE + len(extensions)]) + flags.to_bytes(2, byteorder='little') + extensions
+
+# Encrypts and sends a reply in the given mode and epoch, an empty reply is a pure ACK.
+# A reply to a tagged frame gets the same 802.1Q tag (priority, VLAN ID), a
+# reply to an RPC request the RPC flag.
+def sendReply(reply_bytes, mode, epoch_flag, key, mac_key, reliable, credit=False, vlan=None, rpc=False):
+    reply_iv = os.urandom(PL_EXT_IV_SIZE)
+    encrypted_data = encrypt(reply_bytes, key, reply_iv)
+    # print("Encrypted reply:")
+    # pba(encrypted_data)
+
+    flags = PL_FLAG_IV | epoch_flag
+    if rpc:
+        flags |= PL_FLAG_RPC
+    extensions = reply_iv
+    if reliable:
+        flags |= PL_FLAG_ACK
+        extensions += ackExtension()
+    if credit:
+        flags |= PL_FLAG_CREDIT
+        extensions += creditExtension(len(reply_bytes) > 0)
+    if replay:
+        flags |= PL_FLAG_REPLAY
+        extensions += replayExtension(epoch_flag)
+    # The trailer covers header and encrypted data
+    covered = buildHeader(mode, flags, extensions) + encrypted_data
+    reply_trailer = computeTrailer(covered, mode, mac_key)
+    # print(f"reply trailer: {reply_trailer.hex()}")
+
+    send_payload = covered + reply_trailer
+    if udp_mode:
+        udp_socket.sendto(send_payload, (board_ip, udp_port))
+        return
+    # Construct an Ethernet packet with Ethertype (Data lenght) 100, behind
+    # the tag if there is one
+    if vlan is not None:
+        ether = Ether(dst=frdm_eth_mac, src=pc_eth_mac)/Dot1Q(prio=vlan[0], vlan=vlan[1], type=len(send_payload))
+    else:
+        ether = Ether(dst=frdm_eth_mac, src=pc_eth_mac, type=len(send_payload))
+    # Combine the Ethernet header and data
+    packet = ether/Raw(load=send_payload)
+    # Send the packet
+    sendp(packet)
+
+# Receives the next frame of the board: the payload from the protocol
+# header on, its length without padding, the destination MAC address (None
+# over UDP) and the 802.1Q priority and VLAN ID, None if untagged. Returns
+# None for a frame that is not for this script.
+def receiveFrame():
+    if udp_mode:
+        # The datagram is the payload, without the length field. Group
+        # messages go to a multicast address this socket does not join.
+        payload, (src_ip, _) = udp_socket.recvfrom(2048)
+        print("")
+        print(">>> >>> Received datagram:")
+        if src_ip != board_ip:
+            print(f"Datagram from {src_ip}")
+            return None
+        return payload, len(payload), None, None
+
+    # Receive packets with the source MAC address of the FRDM board
+    rx_packet = sniff(lfilter=lambda x: x.src == frdm_eth_mac, count=1)
+    print("")
+    print(">>> >>> Received packet:")
+    # rx_packet.show()
+    if Dot1Q in rx_packet[0]:
+        # 802.1Q tag (PROTOCOL_LAYER_VLAN): the length field follows it
+        tag = rx_packet[0][Dot1Q]
+        print(f"802.1Q priority {tag.prio}, VLAN {tag.vlan}")
+        return bytes(tag.payload), tag.type, rx_packet[0].dst, (tag.prio, tag.vlan)
+    if Dot3 in rx_packet[0]:
+        return bytes(rx_packet[0][Dot3].payload), rx_packet[0][Dot3].len, rx_packet[0].dst, None
+    if Ether in rx_packet[0] and rx_packet[0][Ether].type <= 1500:
+        return bytes(rx_packet[0][Ether].payload), rx_packet[0][Ether].type, rx_packet[0].dst, None
+    print("Invalid packet")
+    return None
+
+if udp_mode:
+    udp_socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    udp_socket.bind((pc_ip, udp_port))
+else:
+    # look for the interface that has the MAC address we want to use
+    for iface_name, iface_info in conf.ifaces.items():
+        # print(f"Interface: {iface_name}, Index: {iface_info.index}, MAC: {iface_info.mac}, IPv4: {iface_info.ip}, Status: {iface_info.flags}")
+        if iface_info.mac == pc_eth_mac:
+            # print(f"  - This is the interface we want to use!")
+            conf.iface = iface_name
 print("Listening...")
 try:
     while True:
-        # Receive packets with the source MAC address of the FRDM board
-        rx_packet = sniff(lfilter=lambda x: x.src == frdm_eth_mac, count=1)
-        print("")
-        print(">>> >>> Received packet:")
-        # rx_packet.show()
-        if Dot3 in rx_packet[0]:
-            payload_len = rx_packet[0][Dot3].len
-            payload = bytes(rx_packet[0][Dot3].payload)
-        elif Ether in rx_packet[0]:
-            payload_len = rx_packet[0][Ether].type
-            payload = bytes(rx_packet[0][Ether].payload)
-        else:
-            print("Invalid packet")
+        frame = receiveFrame()
+        if frame is None:
             continue
+        payload, payload_len, dst, vlan = frame
 
         #print(f"payload length: {payload_len}")
         #print(f"payload: {payload}")
 
-        # Extract the CRC integer value from the payload
-        packet_crc = int.from_bytes(payload[payload_len-4:payload_len], byteorder='little')
-        print(f"CRC32: {packet_crc:08x}")
+        # Protocol header in front of the encrypted data
+        mode = payload[0]
+        hdr_len = payload[1]
+        flags = int.from_bytes(payload[2:4], byteorder='little')
+        iv = aes_iv
+        if flags & PL_FLAG_IV:
+            ext = extOffset(flags, PL_FLAG_IV)
+            iv = payload[ext:ext + PL_EXT_IV_SIZE]
+        epoch_flag = flags & PL_FLAG_EPOCH
+        group = dst in group_keys
+        if group:
+            key, mac_key = group_keys[dst]
+        else:
+            key, mac_key = session_keys[1 if epoch_flag else 0]
+
+        # Extract the trailer (CRC32 or CMAC tag) from the payload
+        packet_trailer = payload[payload_len-4:payload_len]
+        print(f"{'CMAC' if mode == PL_MODE_CMAC else 'CRC32'}: {packet_trailer.hex()}")
 
-        # Compute the CRC32 of the payload
-        calc_crc = zlib.crc32(payload[:payload_len - 4])
-        print(f"Calc CRC32: {calc_crc:08x}")
+        # Compute the trailer of the header and encrypted data
+        calc_trailer = computeTrailer(payload[:payload_len - 4], mode, mac_key)
+        print(f"Calc: {calc_trailer.hex()}")
 
-        if packet_crc != calc_crc:
-            print("CRC32 is incorrect!")
+        if packet_trailer != calc_trailer:
+            print("Integrity check failed!")
             continue
 
-        # Decrypt the data
-        decrypted_data = decrypt(payload[:payload_len - 4], aes_key)
-        decrypted_data = str(decrypted_data, 'utf-8')
-        print(f"Decrypted data: {decrypted_data}")
-
-        if decrypted_data in messages_and_replies:
-            reply = messages_and_replies[decrypted_data]
-        else:  
-            reply = "No comprendo"
-        print(f"Reply: {reply}")
-        reply_bytes = bytes(reply, 'utf-8')
-        # print("Reply bytes:")
-        # pba(reply_bytes)
-
-        encrypted_data = encrypt(reply_bytes, aes_key)
-        # print("Encrypted reply:")
-        # pba(encrypted_data)
-
-        # Compute the CRC32 of the reply payload
-        calc_crc = zlib.crc32(encrypted_data)
-        # print(f"reply Calc CRC32: {calc_crc:08x}")
-
-        send_payload = encrypted_data + calc_crc.to_bytes(4, byteorder='little')
-        # Construct an Ethernet packet with Ethertype (Data lenght) 100
-        ether = Ether(dst=frdm_eth_mac, src=pc_eth_mac, type=len(send_payload))
-        # Combine the Ethernet header and data
-        packet = ether/Raw(load=send_payload)
-        # Send the packet
-        sendp(packet)
+        # FEC parity frames (count byte set) only help a receiver that lost a
+        # frame of the group; this script does not rebuild frames
+        if flags & PL_FLAG_FEC and payload[extOffset(flags, PL_FLAG_FEC) + 3]:
+            print("Parity frame")
+            continue
+
+        reliable = bool(flags & PL_FLAG_SEQ)
+        replay = bool(flags & PL_FLAG_REPLAY)
+        # Credits granted by the board, replies waiting for them go out first
+        credit = bool(flags & PL_FLAG_CREDIT)
+        if credit:
+            probe = creditOnFrame(payload[extOffset(flags, PL_FLAG_CREDIT):])
+            while pending_replies and countDiff(credit_tx_limit, credit_tx_count) > 0:
+                sendReply(*pending_replies.pop(0))
+            if probe:
+                sendReply(b"", mode, epoch_flag, key, mac_key, reliable, credit, vlan)
+
+        # A sequenced frame is acknowledged, a duplicate only gets the ACK
+        if reliable:
+            ext = extOffset(flags, PL_FLAG_SEQ)
+            if not recordSeq(int.from_bytes(payload[ext:ext + PL_EXT_SEQ_SIZE], byteorder='little'),
+                             bool(flags & PL_FLAG_SYN)):
+                print("Duplicate frame")
+                sendReply(b"", mode, epoch_flag, key, mac_key, reliable, credit, vlan)
+                continue
+
+        # Decrypt the data, only the last fragment of a message is padded
+        if flags & PL_FLAG_FRAG:
+            ext = extOffset(flags, PL_FLAG_FRAG)
+            msg_id = int.from_bytes(payload[ext:ext + 2], byteorder='little')
+            frag_index = payload[ext + 2]
+            frag_count = payload[ext + 3]
+            fragments = pending_fragments.setdefault(msg_id, {})
+            fragments[frag_index] = decrypt(payload[hdr_len:payload_len - 4], key, iv,
+                                            padded=(frag_index == frag_count - 1))
+            print(f"Fragment {frag_index + 1}/{frag_count} of message {msg_id}")
+            if len(fragments) < frag_count:
+                continue
+            decrypted_data = b"".join(fragments[i] for i in range(frag_count))
+            del pending_fragments[msg_id]
+        else:
+            decrypted_data = decrypt(payload[hdr_len:payload_len - 4], key, iv)
+            if flags & PL_FLAG_LZ:
+                decrypted_data = lzDecompress(decrypted_data)
+        # An aggregated frame carries several length-prefixed messages
+        messages = splitAggregate(decrypted_data) if flags & PL_FLAG_AGG else [decrypted_data]
+        for decrypted_data in messages:
+            # A pure ACK from the board carries no message
+            if not decrypted_data:
+                continue
+            rpc_header = b""
+            rpc = (bool(flags & PL_FLAG_RPC) and decrypted_data[0] == PL_RPC_REQUEST
+                   and len(decrypted_data) >= PL_RPC_HEADER_SIZE)
+            if rpc:
+                rpc_header = bytes([PL_RPC_RESPONSE]) + decrypted_data[1:PL_RPC_HEADER_SIZE]
+                print(f"Request {int.from_bytes(decrypted_data[1:3], byteorder='little'):#06x}")
+                decrypted_data = decrypted_data[PL_RPC_HEADER_SIZE:]
+            decrypted_data = str(decrypted_data, 'utf-8')
+            print(f"Decrypted data: {decrypted_data}")
+            if group:
+                print(f"Group message to {dst}")
+                continue
 
+            if decrypted_data in messages_and_replies:
+                reply = messages_and_replies[decrypted_data]
+            else:  
+                reply = "No comprendo"
+            print(f"Reply: {reply}")
+            reply_bytes = rpc_header + bytes(reply, 'utf-8')
+            # print("Reply bytes:")
+            # pba(reply_bytes)
+            if credit and (pending_replies or countDiff(credit_tx_limit, credit_tx_count) <= 0):
+                print("Waiting for credits")
+                pending_replies.append((reply_bytes, mode, epoch_flag, key, mac_key, reliable, credit, vlan, rpc))
+            else:
+                sendReply(reply_bytes, mode, epoch_flag, key, mac_key, reliable, credit, vlan, rpc)
 
 except KeyboardInterrupt:
     print("Exiting...")
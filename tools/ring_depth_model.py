@@ -0,0 +1,49 @@
+# Queue model behind the receive ring depths of PROTOCOL_LAYER_RING_*: a
+# burst of back-to-back full-size frames arrives at 100 Mbit/s while the CPU
+# is away, and from its return the receive path frees one descriptor every
+# SERVICE_NS. A frame that completes with every descriptor taken is lost,
+# as the MAC counts it in its overflows. Prints the frames lost for each
+# depth and the shallowest ring that loses nothing.
+#
+#   python3 tools/ring_depth_model.py [away_us ...]   (2000 5000 by default)
+#
+# The service time outruns the wire, so frames are only lost until the CPU
+# frees its first descriptor: the 4 SRAM descriptors of the default ring ride
+# out a stall of about 0.4 ms, and a ring of 64 (PROTOCOL_LAYER_RING_MAX)
+# holds a whole burst of 64 frames, however long the stall.
+import sys
+
+BURST = 64
+WIRE_BYTES = 1518 + 8 + 12      # frame, preamble and gap
+FRAME_NS = WIRE_BYTES * 8 * 10
+SERVICE_NS = 60000              # to read one frame and free its descriptor
+DEPTHS = [4, 16, 32, 64]
+MIN_DEPTH = 2                   # the shallowest ring ProtocolLayer_ringConfigure() takes
+
+# Frames of the burst lost by a ring of depth descriptors when the CPU comes
+# back away_ns after the first frame
+def lost(depth, away_ns):
+    freed_at = []               # when the descriptor of each stored frame is freed
+    server_ns = away_ns
+    freed = 0
+    count = 0
+    for k in range(BURST):
+        arrival_ns = k * FRAME_NS
+        while freed < len(freed_at) and freed_at[freed] <= arrival_ns:
+            freed += 1
+        if len(freed_at) - freed == depth:
+            count += 1
+            continue
+        server_ns = max(server_ns, arrival_ns) + SERVICE_NS
+        freed_at.append(server_ns)
+    return count
+
+away_times = [int(arg) for arg in sys.argv[1:]] or [2000, 5000]
+print(f"{BURST} frames of {FRAME_NS} ns, {SERVICE_NS} ns to serve one")
+print("CPU away" + "".join(f"  depth {depth:2}" for depth in DEPTHS) + "  lossless")
+for away_us in away_times:
+    away_ns = away_us * 1000
+    lossless = MIN_DEPTH
+    while lost(lossless, away_ns):
+        lossless += 1
+    print(f"{away_us:5} us" + "".join(f"  {lost(depth, away_ns):2} lost " for depth in DEPTHS) + f"  {lossless:3}")